@@ -0,0 +1,244 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Benchmarks of selector parsing and matching, over the dummy DOM and
+//! selector implementation of the tests.
+//!
+//! Inputs are generated deterministically, so `cargo bench --features bench`
+//! results can be compared between commits.
+
+extern crate test;
+
+use crate::bloom::BloomFilter;
+use crate::context::{MatchingContext, MatchingForInvalidation, MatchingMode};
+use crate::context::{NeedsSelectorFlags, QuirksMode, SelectorCaches};
+use crate::matching::{matches_selector, matches_selector_list};
+use crate::parser::tests::{parse, DummySelectorImpl};
+use crate::parser::{AncestorHashes, SelectorList};
+use crate::tree::tests::DummyDom;
+use crate::tree::Element;
+use std::fmt::Write;
+
+const CLASS_COUNT: u64 = 32;
+const TAGS: [&str; 5] = ["div", "span", "section", "li", "a"];
+
+/// A deterministic xorshift generator, so that the inputs are the same
+/// between runs.
+struct Rng(u64);
+
+impl Rng {
+    fn below(&mut self, n: u64) -> u64 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        self.0 % n
+    }
+
+    fn class(&mut self) -> String {
+        format!(".c{}", self.below(CLASS_COUNT))
+    }
+
+    fn tag(&mut self) -> &'static str {
+        TAGS[self.below(TAGS.len() as u64) as usize]
+    }
+}
+
+/// A comma-separated list of `count` selectors, of the kinds found in real
+/// stylesheets.
+fn selector_corpus(count: usize) -> String {
+    let mut rng = Rng(0x5e1ec7);
+    let mut css = String::new();
+    for i in 0..count {
+        if i != 0 {
+            css.push_str(", ");
+        }
+        match rng.below(10) {
+            0 => write!(css, "#e{}", rng.below(256)),
+            1 => write!(css, "{}{}", rng.tag(), rng.class()),
+            2 => write!(css, "{} {}", rng.class(), rng.class()),
+            3 => write!(css, "{} > {} {}", rng.tag(), rng.class(), rng.tag()),
+            4 => write!(css, "{}:nth-child({}n+1)", rng.tag(), 2 + rng.below(3)),
+            5 => write!(css, ":is({}, {}) > {}", rng.class(), rng.class(), rng.tag()),
+            6 => write!(css, "{}:not({}):hover", rng.class(), rng.class()),
+            7 => write!(css, "[data-kind=\"k{}\"] ~ {}", rng.below(4), rng.class()),
+            8 => write!(css, "{}:has(> {})", rng.tag(), rng.class()),
+            _ => write!(css, "{}{}{}", rng.tag(), rng.class(), rng.class()),
+        }
+        .unwrap();
+    }
+    css
+}
+
+/// The selectors matched against the leaf of a deep tree. Most of them are
+/// rejected by the bloom filter, as in real stylesheets.
+fn descendant_selectors() -> SelectorList<DummySelectorImpl> {
+    let mut rng = Rng(0xdee9);
+    let css = (0..200)
+        .map(|_| format!("{} {} {}", rng.class(), rng.class(), rng.tag()))
+        .collect::<Vec<_>>()
+        .join(", ");
+    parse(&css).unwrap()
+}
+
+/// Builds a chain of `depth` elements, each with a class, and returns the
+/// indices from the root to the leaf.
+fn build_chain(dom: &DummyDom, depth: usize) -> Vec<usize> {
+    let mut rng = Rng(0xc4a1);
+    let mut chain: Vec<usize> = Vec::with_capacity(depth);
+    for _ in 0..depth {
+        let element = dom.create_element(rng.tag());
+        dom.add_class(element, &rng.class()[1..]);
+        if let Some(&parent) = chain.last() {
+            dom.append_child(parent, element);
+        }
+        chain.push(element);
+    }
+    chain
+}
+
+fn context<'a>(
+    bloom_filter: Option<&'a BloomFilter>,
+    caches: &'a mut SelectorCaches,
+) -> MatchingContext<'a, DummySelectorImpl> {
+    MatchingContext::new(
+        MatchingMode::Normal,
+        bloom_filter,
+        caches,
+        QuirksMode::NoQuirks,
+        NeedsSelectorFlags::No,
+        MatchingForInvalidation::No,
+    )
+}
+
+#[bench]
+fn parse_1000_selectors(b: &mut test::Bencher) {
+    let css = selector_corpus(1000);
+    b.bytes = css.len() as u64;
+    b.iter(|| test::black_box(parse(&css).unwrap()));
+}
+
+#[bench]
+fn ancestor_hashes_1000_selectors(b: &mut test::Bencher) {
+    let list = parse(&selector_corpus(1000)).unwrap();
+    b.iter(|| {
+        for selector in list.slice() {
+            test::black_box(AncestorHashes::new(selector, QuirksMode::NoQuirks));
+        }
+    });
+}
+
+/// Matches the descendant selectors against the leaf of a 64-deep tree,
+/// walking up the ancestors for every selector.
+#[bench]
+fn match_deep_tree_without_bloom(b: &mut test::Bencher) {
+    let dom = DummyDom::new();
+    let chain = build_chain(&dom, 64);
+    let leaf = dom.element(*chain.last().unwrap());
+    let list = descendant_selectors();
+    b.iter(|| {
+        let mut caches = SelectorCaches::default();
+        let mut context = context(None, &mut caches);
+        for selector in list.slice() {
+            test::black_box(matches_selector(selector, 0, None, &leaf, &mut context));
+        }
+    });
+}
+
+/// Same as above, with the ancestor hashes checked against a bloom filter
+/// of the ancestors first, as the style traversal does.
+#[bench]
+fn match_deep_tree_with_bloom(b: &mut test::Bencher) {
+    let dom = DummyDom::new();
+    let chain = build_chain(&dom, 64);
+    let leaf = dom.element(*chain.last().unwrap());
+    let mut filter = BloomFilter::new();
+    for &ancestor in &chain[..chain.len() - 1] {
+        dom.element(ancestor).add_element_unique_hashes(&mut filter);
+    }
+    let list = descendant_selectors();
+    let hashes = list
+        .slice()
+        .iter()
+        .map(|s| AncestorHashes::new(s, QuirksMode::NoQuirks))
+        .collect::<Vec<_>>();
+    b.iter(|| {
+        let mut caches = SelectorCaches::default();
+        let mut context = context(Some(&filter), &mut caches);
+        for (selector, hashes) in list.slice().iter().zip(&hashes) {
+            test::black_box(matches_selector(
+                selector,
+                0,
+                Some(hashes),
+                &leaf,
+                &mut context,
+            ));
+        }
+    });
+}
+
+/// Restyles every item of a 1000-item list with an `:nth-child(of S)`
+/// selector, which can't use the sibling index cache.
+#[bench]
+fn match_nth_child_of_1000_items(b: &mut test::Bencher) {
+    let dom = DummyDom::new();
+    let list_element = dom.create_element("ul");
+    let items = (0..1000)
+        .map(|i| {
+            let item = dom.create_element("li");
+            if i % 3 == 0 {
+                dom.add_class(item, "important");
+            }
+            dom.append_child(list_element, item);
+            item
+        })
+        .collect::<Vec<_>>();
+    let list = parse("li:nth-child(2n+1 of .important)").unwrap();
+    b.iter(|| {
+        let mut caches = SelectorCaches::default();
+        let mut context = context(None, &mut caches);
+        for &item in &items {
+            test::black_box(matches_selector_list(
+                &list,
+                &dom.element(item),
+                &mut context,
+            ));
+        }
+    });
+}
+
+/// Matches relative selectors against each of 100 sections of 20 items,
+/// one of which has a matching descendant.
+#[bench]
+fn match_has_100_sections(b: &mut test::Bencher) {
+    let dom = DummyDom::new();
+    let root = dom.create_element("body");
+    let sections = (0..100)
+        .map(|i| {
+            let section = dom.create_element("section");
+            dom.append_child(root, section);
+            for j in 0..20 {
+                let item = dom.create_element("div");
+                dom.append_child(section, item);
+                let span = dom.create_element("span");
+                dom.append_child(item, span);
+                if i == 50 && j == 10 {
+                    dom.add_class(span, "target");
+                }
+            }
+            section
+        })
+        .collect::<Vec<_>>();
+    let list = parse("section:has(.target), section:has(> div + div > .target)").unwrap();
+    b.iter(|| {
+        let mut caches = SelectorCaches::default();
+        let mut context = context(None, &mut caches);
+        for &section in &sections {
+            test::black_box(matches_selector_list(
+                &list,
+                &dom.element(section),
+                &mut context,
+            ));
+        }
+    });
+}
@@ -271,6 +271,91 @@ impl Clone for BloomStorageBool {
     }
 }
 
+const SUMMARY_KEY_SIZE: usize = 9;
+const SUMMARY_BITS: usize = 1 << SUMMARY_KEY_SIZE;
+const SUMMARY_KEY_MASK: u32 = (1 << SUMMARY_KEY_SIZE) - 1;
+
+/// A small non-counting Bloom filter that summarizes the hashes (local names,
+/// namespaces, ids, classes and attribute names) of every descendant of an
+/// element.
+///
+/// Unlike `BloomFilter`, this is meant to be stored per element and kept up to
+/// date by the DOM as it mutates, so it's deliberately tiny (64 bytes). It
+/// uses the same hash segments as the counting filter, truncated to
+/// `SUMMARY_KEY_SIZE` bits each, so the hashes from `add_element_unique_hashes`
+/// and `collect_selector_hashes` can be used directly.
+///
+/// Bits can't be cleared, so a summary is only ever a superset of the real
+/// subtree contents: it may not reject, but never rejects wrongly.
+#[derive(Clone, Copy, Default, Eq, PartialEq)]
+pub struct SubtreeSummary {
+    bits: [u64; SUMMARY_BITS / 64],
+}
+
+impl SubtreeSummary {
+    /// Creates a new, empty summary.
+    #[inline]
+    pub fn new() -> Self {
+        Default::default()
+    }
+
+    #[inline]
+    fn set_bit(&mut self, index: u32) {
+        self.bits[(index / 64) as usize] |= 1u64 << (index % 64);
+    }
+
+    #[inline]
+    fn has_bit(&self, index: u32) -> bool {
+        (self.bits[(index / 64) as usize] & (1u64 << (index % 64))) != 0
+    }
+
+    /// Inserts an item with a particular hash into the summary.
+    #[inline]
+    pub fn insert_hash(&mut self, hash: u32) {
+        self.set_bit(hash1(hash) & SUMMARY_KEY_MASK);
+        self.set_bit(hash2(hash) & SUMMARY_KEY_MASK);
+    }
+
+    /// Check whether the subtree might contain an item with the given hash.
+    #[inline]
+    pub fn might_contain_hash(&self, hash: u32) -> bool {
+        self.has_bit(hash1(hash) & SUMMARY_KEY_MASK) && self.has_bit(hash2(hash) & SUMMARY_KEY_MASK)
+    }
+
+    /// Adds every hash in `other` to this summary.
+    #[inline]
+    pub fn union_with(&mut self, other: &Self) {
+        for (bits, other_bits) in self.bits.iter_mut().zip(other.bits.iter()) {
+            *bits |= *other_bits;
+        }
+    }
+
+    /// Whether every hash in `other` is already present in this summary.
+    ///
+    /// Used to stop propagating an insertion up the ancestor chain as soon as
+    /// it doesn't change anything.
+    #[inline]
+    pub fn contains_all(&self, other: &Self) -> bool {
+        self.bits
+            .iter()
+            .zip(other.bits.iter())
+            .all(|(bits, other_bits)| (*bits & *other_bits) == *other_bits)
+    }
+
+    /// Whether this summary contains no hashes at all.
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.bits.iter().all(|x| *x == 0)
+    }
+}
+
+impl Debug for SubtreeSummary {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        let bits_set: u32 = self.bits.iter().map(|x| x.count_ones()).sum();
+        write!(f, "SubtreeSummary({}/{})", bits_set, SUMMARY_BITS)
+    }
+}
+
 #[inline]
 fn hash1(hash: u32) -> u32 {
     hash & KEY_MASK
@@ -338,6 +423,24 @@ fn create_and_insert_some_stuff() {
     }
 }
 
+#[test]
+fn subtree_summary_union_and_lookup() {
+    let mut child = SubtreeSummary::new();
+    assert!(child.is_empty());
+    for i in 0_u32..16 {
+        child.insert_hash(i.wrapping_mul(0x9e3779b9) & BLOOM_HASH_MASK);
+    }
+    for i in 0_u32..16 {
+        assert!(child.might_contain_hash(i.wrapping_mul(0x9e3779b9) & BLOOM_HASH_MASK));
+    }
+
+    let mut parent = SubtreeSummary::new();
+    assert!(!parent.contains_all(&child));
+    parent.union_with(&child);
+    assert!(parent.contains_all(&child));
+    assert_eq!(parent, child);
+}
+
 #[cfg(feature = "bench")]
 #[cfg(test)]
 mod bench {
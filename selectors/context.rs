@@ -204,6 +204,12 @@ where
     /// Caches to speed up expensive selector matches.
     pub selector_caches: &'a mut SelectorCaches,
 
+    /// The number of compound selectors that have been matched against an
+    /// element since this was set to `Some(0)`, which is a rough measure of
+    /// how much work a selector match took. `None` (the default) means that
+    /// they aren't counted.
+    pub compound_selector_steps: Option<u32>,
+
     classes_and_ids_case_sensitivity: CaseSensitivity,
     _impl: ::std::marker::PhantomData<Impl>,
 }
@@ -263,10 +269,20 @@ where
             extra_data: Default::default(),
             current_relative_selector_anchor: None,
             selector_caches,
+            compound_selector_steps: None,
             _impl: ::std::marker::PhantomData,
         }
     }
 
+    /// Counts a compound selector matched against an element, if we're
+    /// counting them.
+    #[inline(always)]
+    pub(crate) fn note_compound_selector_step(&mut self) {
+        if let Some(ref mut steps) = self.compound_selector_steps {
+            *steps += 1;
+        }
+    }
+
     // Grab a reference to the appropriate cache.
     #[inline]
     pub fn nth_index_cache(
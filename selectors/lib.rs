@@ -6,6 +6,9 @@
 #![cfg_attr(feature = "bench", feature(test))]
 
 pub mod attr;
+#[cfg(feature = "bench")]
+#[cfg(test)]
+mod bench;
 pub mod bloom;
 mod builder;
 pub mod context;
@@ -18,6 +21,6 @@ pub mod sink;
 mod tree;
 pub mod visitor;
 
-pub use crate::nth_index_cache::NthIndexCache;
+pub use crate::nth_index_cache::{NthIndexCache, SiblingIndexCache};
 pub use crate::parser::{Parser, SelectorImpl, SelectorList};
 pub use crate::tree::{Element, OpaqueElement};
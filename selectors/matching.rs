@@ -343,6 +343,7 @@ where
     if cfg!(debug_assertions) && from_offset != 0 {
         selector.combinator_at_parse_order(from_offset - 1); // This asserts.
     }
+    context.note_compound_selector_step();
 
     let mut local_context = LocalMatchingContext {
         shared: context,
@@ -1183,6 +1184,7 @@ fn matches_compound_selector<E>(
 where
     E: Element,
 {
+    context.note_compound_selector_step();
     if context.featureless()
         && compound_matches_featureless_host(
             &mut selector_iter.clone(),
@@ -1468,6 +1470,26 @@ where
         .into();
     }
 
+    // The DOM may keep structural indices across restyles.
+    if !has_selectors {
+        if let Some(index) = element.cached_nth_index(is_of_type, is_from_end) {
+            debug_assert_eq!(
+                index,
+                nth_child_index(
+                    element,
+                    context,
+                    selectors,
+                    is_of_type,
+                    is_from_end,
+                    /* check_cache = */ false,
+                    rightmost,
+                ),
+                "invalid DOM nth-index cache"
+            );
+            return an_plus_b.matches_index(index).into();
+        }
+    }
+
     // Lookup or compute the index.
     let index = if let Some(i) = context
         .nth_index_cache(is_of_type, is_from_end, selectors)
@@ -4,8 +4,8 @@
 
 use std::hash::Hash;
 
-use crate::{parser::Selector, tree::OpaqueElement, SelectorImpl};
-use rustc_hash::FxHashMap;
+use crate::{parser::Selector, tree::Element, tree::OpaqueElement, SelectorImpl};
+use rustc_hash::{FxHashMap, FxHashSet};
 
 /// A cache to speed up matching of nth-index-like selectors.
 ///
@@ -100,3 +100,361 @@ impl NthIndexCacheInner {
         self.0.is_empty()
     }
 }
+
+/// The structural indices of an element among its element siblings.
+#[derive(Clone, Copy, Debug)]
+struct SiblingIndices {
+    /// The generation in which the indices of this group of siblings were
+    /// computed.
+    generation: u64,
+    nth: i32,
+    nth_last: i32,
+    nth_of_type: i32,
+    nth_last_of_type: i32,
+}
+
+/// A cache of the structural indices used by `:nth-child()`,
+/// `:nth-last-child()`, `:nth-of-type()` and `:nth-last-of-type()` (without a
+/// selector list), meant to live as long as the document.
+///
+/// Unlike `NthIndexCache`, which is reset for every traversal, this is kept up
+/// to date by the DOM across restyles: the DOM calls `note_inserted` and
+/// `note_removed` as children are added and removed, `flush` before styling,
+/// and answers `Element::cached_nth_index` from `lookup`.
+///
+/// Each group of siblings gets a generation when its indices are computed.
+/// Mutations only invalidate the generation of the affected group, in O(1),
+/// and the group is recomputed lazily on the next `flush`, so a batch of
+/// mutations to the same list costs a single pass over it. Lookups of valid
+/// entries are O(1).
+///
+/// The `:nth-child(An+B of S)` variants aren't cached here, since whether a
+/// sibling matches `S` depends on state other than the tree structure.
+pub struct SiblingIndexCache<E: Element> {
+    indices: FxHashMap<OpaqueElement, SiblingIndices>,
+    valid_generations: FxHashSet<u64>,
+    /// Never wraps around, so that a stale entry can't match a later
+    /// generation.
+    next_generation: u64,
+    /// Elements whose siblings need their indices recomputed.
+    dirty: Vec<E>,
+}
+
+impl<E: Element> Default for SiblingIndexCache<E> {
+    fn default() -> Self {
+        Self {
+            indices: Default::default(),
+            valid_generations: Default::default(),
+            next_generation: 0,
+            dirty: Vec::new(),
+        }
+    }
+}
+
+impl<E: Element> SiblingIndexCache<E> {
+    /// Creates a new, empty cache.
+    pub fn new() -> Self {
+        Default::default()
+    }
+
+    fn valid_entry(&self, element: OpaqueElement) -> Option<&SiblingIndices> {
+        self.indices
+            .get(&element)
+            .filter(|entry| self.valid_generations.contains(&entry.generation))
+    }
+
+    /// Returns the cached index of the element, if it's up to date.
+    #[inline]
+    pub fn lookup(
+        &self,
+        element: OpaqueElement,
+        is_of_type: bool,
+        is_from_end: bool,
+    ) -> Option<i32> {
+        let entry = self.valid_entry(element)?;
+        Some(match (is_of_type, is_from_end) {
+            (false, false) => entry.nth,
+            (false, true) => entry.nth_last,
+            (true, false) => entry.nth_of_type,
+            (true, true) => entry.nth_last_of_type,
+        })
+    }
+
+    fn invalidate_siblings_of(&mut self, element: Option<E>) {
+        if let Some(entry) = element.and_then(|e| self.indices.get(&e.opaque())) {
+            self.valid_generations.remove(&entry.generation);
+        }
+    }
+
+    /// Notes that `element` was just inserted into the tree.
+    pub fn note_inserted(&mut self, element: E) {
+        self.invalidate_siblings_of(element.prev_sibling_element());
+        self.invalidate_siblings_of(element.next_sibling_element());
+        self.dirty.push(element);
+    }
+
+    /// Notes that `element` is about to be removed from the tree, along with
+    /// its subtree. This must be called while `element` is still attached.
+    pub fn note_removed(&mut self, element: &E) {
+        if let Some(entry) = self.indices.get(&element.opaque()) {
+            self.valid_generations.remove(&entry.generation);
+        }
+        if let Some(sibling) = element
+            .prev_sibling_element()
+            .or_else(|| element.next_sibling_element())
+        {
+            self.dirty.push(sibling);
+        }
+
+        // Forget about the removed subtree, since its elements may be freed
+        // and their identities reused.
+        let mut removed = FxHashSet::default();
+        let mut stack = vec![element.clone()];
+        while let Some(e) = stack.pop() {
+            let opaque = e.opaque();
+            self.indices.remove(&opaque);
+            removed.insert(opaque);
+            let mut child = e.first_element_child();
+            while let Some(c) = child {
+                child = c.next_sibling_element();
+                stack.push(c);
+            }
+        }
+        self.dirty.retain(|e| !removed.contains(&e.opaque()));
+    }
+
+    /// Recomputes the indices of all the sibling groups invalidated since the
+    /// last flush. This must be called before styling, while the DOM is
+    /// immutable.
+    pub fn flush(&mut self) {
+        let dirty = std::mem::take(&mut self.dirty);
+        for element in dirty {
+            if self.valid_entry(element.opaque()).is_some() {
+                // Already recomputed along with an earlier sibling.
+                continue;
+            }
+            self.rebuild_siblings_of(element);
+        }
+    }
+
+    fn rebuild_siblings_of(&mut self, element: E) {
+        let mut first = element;
+        while let Some(prev) = first.prev_sibling_element() {
+            first = prev;
+        }
+
+        let generation = self.next_generation;
+        self.next_generation += 1;
+        self.valid_generations.insert(generation);
+
+        // One representative element and count per element type among these
+        // siblings. There are usually very few distinct types, so a linear
+        // search through `is_same_type` is fine.
+        let mut types: Vec<(E, i32)> = Vec::new();
+        let mut siblings: Vec<(OpaqueElement, usize)> = Vec::new();
+        let mut current = Some(first);
+        while let Some(e) = current {
+            let type_index = match types.iter().position(|(t, _)| t.is_same_type(&e)) {
+                Some(i) => i,
+                None => {
+                    types.push((e.clone(), 0));
+                    types.len() - 1
+                },
+            };
+            types[type_index].1 += 1;
+            let opaque = e.opaque();
+            siblings.push((opaque, type_index));
+            self.indices.insert(
+                opaque,
+                SiblingIndices {
+                    generation,
+                    nth: siblings.len() as i32,
+                    nth_last: 0,
+                    nth_of_type: types[type_index].1,
+                    nth_last_of_type: 0,
+                },
+            );
+            current = e.next_sibling_element();
+        }
+
+        let count = siblings.len() as i32;
+        for (opaque, type_index) in siblings {
+            let entry = self.indices.get_mut(&opaque).unwrap();
+            entry.nth_last = count - entry.nth + 1;
+            entry.nth_last_of_type = types[type_index].1 - entry.nth_of_type + 1;
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::SiblingIndexCache;
+    use crate::tree::tests::{DummyDom, DummyElement};
+    use crate::tree::Element;
+
+    fn check_indices<'a>(
+        dom: &'a DummyDom,
+        cache: &SiblingIndexCache<DummyElement<'a>>,
+        parent: usize,
+    ) {
+        let mut children = vec![];
+        let mut child = dom.element(parent).first_element_child();
+        while let Some(c) = child {
+            child = c.next_sibling_element();
+            children.push(c);
+        }
+        for (i, c) in children.iter().enumerate() {
+            let same_type: Vec<_> = children.iter().filter(|o| o.is_same_type(c)).collect();
+            let of_type = same_type.iter().position(|o| o.index == c.index).unwrap();
+            let opaque = c.opaque();
+            assert_eq!(cache.lookup(opaque, false, false), Some(i as i32 + 1));
+            assert_eq!(
+                cache.lookup(opaque, false, true),
+                Some((children.len() - i) as i32)
+            );
+            assert_eq!(cache.lookup(opaque, true, false), Some(of_type as i32 + 1));
+            assert_eq!(
+                cache.lookup(opaque, true, true),
+                Some((same_type.len() - of_type) as i32)
+            );
+        }
+    }
+
+    #[test]
+    fn sibling_index_cache_tracks_mutations() {
+        let dom = DummyDom::new();
+        let list = dom.create_element("ul");
+        let mut cache = SiblingIndexCache::new();
+        let mut items = vec![];
+        for i in 0..10 {
+            let item = dom.create_element(if i % 3 == 0 { "p" } else { "li" });
+            dom.append_child(list, item);
+            cache.note_inserted(dom.element(item));
+            items.push(item);
+        }
+        cache.flush();
+        check_indices(&dom, &cache, list);
+
+        // Inserting invalidates the siblings until the next flush.
+        let inserted = dom.create_element("li");
+        dom.insert_before(items[4], inserted);
+        cache.note_inserted(dom.element(inserted));
+        assert_eq!(
+            cache.lookup(dom.element(items[0]).opaque(), false, false),
+            None
+        );
+        cache.flush();
+        check_indices(&dom, &cache, list);
+
+        cache.note_removed(&dom.element(items[0]));
+        dom.remove(items[0]);
+        assert_eq!(
+            cache.lookup(dom.element(items[0]).opaque(), false, false),
+            None
+        );
+        cache.flush();
+        check_indices(&dom, &cache, list);
+    }
+}
+
+#[cfg(feature = "bench")]
+#[cfg(test)]
+mod bench {
+    extern crate test;
+    use super::SiblingIndexCache;
+    use crate::context::{MatchingContext, MatchingForInvalidation, MatchingMode};
+    use crate::context::{NeedsSelectorFlags, QuirksMode, SelectorCaches};
+    use crate::matching::matches_selector;
+    use crate::parser::tests::parse;
+    use crate::tree::tests::DummyDom;
+
+    const LIST_LENGTH: usize = 10_000;
+
+    fn build_list(dom: &DummyDom) -> (usize, Vec<usize>) {
+        let list = dom.create_element("ul");
+        let items = (0..LIST_LENGTH)
+            .map(|_| {
+                let item = dom.create_element("li");
+                dom.append_child(list, item);
+                item
+            })
+            .collect();
+        (list, items)
+    }
+
+    /// Simulates a restyle of every item of a long list: the per-traversal
+    /// cache starts empty every time.
+    #[bench]
+    fn restyle_10k_nth_child_per_traversal_cache(b: &mut test::Bencher) {
+        let dom = DummyDom::new();
+        let (_, items) = build_list(&dom);
+        let list = parse("li:nth-last-child(2n+1)").unwrap();
+        let selector = &list.slice()[0];
+        b.iter(|| {
+            let mut caches = SelectorCaches::default();
+            let mut context = MatchingContext::new(
+                MatchingMode::Normal,
+                None,
+                &mut caches,
+                QuirksMode::NoQuirks,
+                NeedsSelectorFlags::No,
+                MatchingForInvalidation::No,
+            );
+            for item in &items {
+                test::black_box(matches_selector(
+                    selector,
+                    0,
+                    None,
+                    &dom.element(*item),
+                    &mut context,
+                ));
+            }
+        });
+    }
+
+    /// Same as above, with indices kept in a document-lifetime cache.
+    #[bench]
+    fn restyle_10k_nth_child_sibling_index_cache(b: &mut test::Bencher) {
+        let dom = DummyDom::new();
+        let (_, items) = build_list(&dom);
+        let mut cache = SiblingIndexCache::new();
+        cache.note_inserted(dom.element(items[0]));
+        cache.flush();
+        let list = parse("li:nth-last-child(2n+1)").unwrap();
+        let selector = &list.slice()[0];
+        b.iter(|| {
+            let mut caches = SelectorCaches::default();
+            let mut context = MatchingContext::new(
+                MatchingMode::Normal,
+                None,
+                &mut caches,
+                QuirksMode::NoQuirks,
+                NeedsSelectorFlags::No,
+                MatchingForInvalidation::No,
+            );
+            for item in &items {
+                let element = dom.element_with_cache(*item, &cache);
+                test::black_box(matches_selector(selector, 0, None, &element, &mut context));
+            }
+        });
+    }
+
+    /// Cost of re-indexing a 10k-item list after inserting in the middle.
+    #[bench]
+    fn insert_and_flush_10k(b: &mut test::Bencher) {
+        let dom = DummyDom::new();
+        let (_, items) = build_list(&dom);
+        let mut cache = SiblingIndexCache::new();
+        cache.note_inserted(dom.element(items[0]));
+        cache.flush();
+        b.iter(|| {
+            let item = dom.create_element("li");
+            dom.insert_before(items[LIST_LENGTH / 2], item);
+            cache.note_inserted(dom.element(item));
+            cache.flush();
+            cache.note_removed(&dom.element(item));
+            dom.remove(item);
+            cache.flush();
+        });
+    }
+}
@@ -324,6 +324,12 @@ pub trait Parser<'i> {
         true
     }
 
+    /// Creates the identifier of an id, class or part selector. Parsers can
+    /// override this to intern repeated identifiers.
+    fn identifier(&self, name: &str) -> <Self::Impl as SelectorImpl>::Identifier {
+        name.into()
+    }
+
     /// This function can return an "Err" pseudo-element in order to support CSS2.1
     /// pseudo-elements.
     fn parse_non_ts_pseudo_class(
@@ -3585,7 +3591,7 @@ where
             if state.intersects(SelectorParsingState::AFTER_PSEUDO) {
                 return Err(input.new_custom_error(SelectorParseErrorKind::InvalidState));
             }
-            let id = Component::ID(id.as_ref().into());
+            let id = Component::ID(parser.identifier(&id));
             SimpleSelectorParseResult::SimpleSelector(id)
         },
         Token::Delim(delim) if delim == '.' || (delim == '&' && parser.parse_parent_selector()) => {
@@ -3603,7 +3609,7 @@ where
                         return Err(location.new_custom_error(e));
                     },
                 };
-                Component::Class(class.as_ref().into())
+                Component::Class(parser.identifier(class))
             })
         },
         Token::SquareBracketBlock => {
@@ -3649,9 +3655,9 @@ where
                         }
                         let names = input.parse_nested_block(|input| {
                             let mut result = Vec::with_capacity(1);
-                            result.push(input.expect_ident()?.as_ref().into());
+                            result.push(parser.identifier(input.expect_ident()?));
                             while !input.is_exhausted() {
-                                result.push(input.expect_ident()?.as_ref().into());
+                                result.push(parser.identifier(input.expect_ident()?));
                             }
                             Ok(result.into_boxed_slice())
                         })?;
@@ -3892,7 +3898,7 @@ pub mod tests {
     }
 
     #[derive(Clone, Debug, Default, Eq, Hash, PartialEq)]
-    pub struct DummyAttrValue(String);
+    pub struct DummyAttrValue(pub String);
 
     impl ToCss for DummyAttrValue {
         fn to_css<W>(&self, dest: &mut W) -> fmt::Result
@@ -3914,7 +3920,7 @@ pub mod tests {
     }
 
     #[derive(Clone, Debug, Default, Eq, Hash, PartialEq)]
-    pub struct DummyAtom(String);
+    pub struct DummyAtom(pub String);
 
     impl ToCss for DummyAtom {
         fn to_css<W>(&self, dest: &mut W) -> fmt::Result
@@ -3939,7 +3945,13 @@ pub mod tests {
 
     impl PrecomputedHash for DummyAtom {
         fn precomputed_hash(&self) -> u32 {
-            self.0.as_ptr() as u32
+            // Hash the contents rather than the pointer, so that equal atoms
+            // from selectors and from test elements can share bloom filters.
+            use std::hash::{Hash, Hasher};
+            let mut hasher = rustc_hash::FxHasher::default();
+            self.0.hash(&mut hasher);
+            let hash = hasher.finish();
+            (hash >> 32) as u32 ^ (hash as u32)
         }
     }
 
@@ -4056,7 +4068,7 @@ pub mod tests {
         }
     }
 
-    fn parse<'i>(
+    pub(crate) fn parse<'i>(
         input: &'i str,
     ) -> Result<SelectorList<DummySelectorImpl>, SelectorParseError<'i>> {
         parse_relative(input, ParseRelative::No)
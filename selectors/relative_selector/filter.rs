@@ -55,7 +55,7 @@ pub struct RelativeSelectorFilterMap {
 fn fast_reject<Impl: SelectorImpl>(
     selector: &RelativeSelector<Impl>,
     quirks_mode: QuirksMode,
-    filter: &BloomFilter,
+    might_contain_hash: impl Fn(u32) -> bool,
 ) -> bool {
     let mut hashes = [0u32; 4];
     let mut len = 0;
@@ -75,7 +75,7 @@ fn fast_reject<Impl: SelectorImpl>(
         |s| s.iter(),
     );
     for i in 0..len {
-        if !filter.might_contain_hash(hashes[i]) {
+        if !might_contain_hash(hashes[i]) {
             // Definitely rejected.
             return true;
         }
@@ -143,17 +143,32 @@ impl RelativeSelectorFilterMap {
         } else {
             TraversalKind::Children
         };
-        if is_sibling {
-            // Contain the entirety of the parent's children/subtree in the filter, and use that.
-            // This is less likely to reject, especially for sibling subtree matches; however, it's less
-            // expensive memory-wise, compared to storing filters for each sibling.
-            element.parent_element().map_or(false, |parent| {
-                self.get_filter(&parent, kind)
-                    .map_or(false, |filter| fast_reject(selector, quirks_mode, filter))
-            })
+        // Contain the entirety of the parent's children/subtree in the filter for sibling
+        // matches, and use that. This is less likely to reject, especially for sibling subtree
+        // matches; however, it's less expensive memory-wise, compared to storing filters for
+        // each sibling.
+        let anchor = if is_sibling {
+            match element.parent_element() {
+                Some(parent) => parent,
+                None => return false,
+            }
         } else {
-            self.get_filter(element, kind)
-                .map_or(false, |filter| fast_reject(selector, quirks_mode, filter))
+            element.clone()
+        };
+        // If the DOM keeps a summary of the subtree, try that first: it's up to date, and
+        // doesn't need a traversal of the subtree to build. The summary covers all descendants,
+        // so it's a valid (if less precise) filter for the children traversal too.
+        if let Some(summary) = anchor.subtree_summary() {
+            if fast_reject(selector, quirks_mode, |hash| {
+                summary.might_contain_hash(hash)
+            }) {
+                return true;
+            }
         }
+        self.get_filter(&anchor, kind).map_or(false, |filter| {
+            fast_reject(selector, quirks_mode, |hash| {
+                filter.might_contain_hash(hash)
+            })
+        })
     }
 }
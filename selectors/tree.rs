@@ -6,7 +6,7 @@
 //! between layout and style.
 
 use crate::attr::{AttrSelectorOperation, CaseSensitivity, NamespaceConstraint};
-use crate::bloom::BloomFilter;
+use crate::bloom::{BloomFilter, SubtreeSummary};
 use crate::matching::{ElementSelectorFlags, MatchingContext};
 use crate::parser::SelectorImpl;
 use std::fmt::Debug;
@@ -181,4 +181,344 @@ pub trait Element: Sized + Clone + Debug {
     /// Add hashes unique to this element to the given filter, returning true
     /// if any got added.
     fn add_element_unique_hashes(&self, filter: &mut BloomFilter) -> bool;
+
+    /// Returns a summary of the hashes of all the descendants of this element,
+    /// if the DOM keeps one up to date.
+    ///
+    /// The summary must be a superset of what `add_element_unique_hashes`
+    /// would add for every descendant, since it's used to reject relative
+    /// selectors without walking the subtree. `None` means the subtree is
+    /// unknown, and is never used to reject.
+    fn subtree_summary(&self) -> Option<SubtreeSummary> {
+        None
+    }
+
+    /// Returns the 1-based index of this element among its element siblings,
+    /// as used by `:nth-child()` and friends without a selector list, if the
+    /// DOM keeps those up to date across restyles (e.g. with a
+    /// `SiblingIndexCache`).
+    fn cached_nth_index(&self, _is_of_type: bool, _is_from_end: bool) -> Option<i32> {
+        None
+    }
+}
+
+/// A minimal in-memory DOM implementing `Element`, for tests and benchmarks.
+#[cfg(test)]
+pub mod tests {
+    use super::*;
+    use crate::attr::CaseSensitivity;
+    use crate::bloom::BLOOM_HASH_MASK;
+    use crate::nth_index_cache::SiblingIndexCache;
+    use crate::parser::tests::{DummyAtom, DummyAttrValue, DummySelectorImpl};
+    use crate::parser::tests::{PseudoClass, PseudoElement};
+    use precomputed_hash::PrecomputedHash;
+    use std::cell::RefCell;
+    use std::fmt;
+
+    #[derive(Default)]
+    struct DummyNode {
+        local_name: DummyAtom,
+        namespace: DummyAtom,
+        id: Option<DummyAtom>,
+        classes: Vec<DummyAtom>,
+        attrs: Vec<(DummyAtom, String)>,
+        parent: Option<usize>,
+        first_child: Option<usize>,
+        last_child: Option<usize>,
+        prev_sibling: Option<usize>,
+        next_sibling: Option<usize>,
+    }
+
+    /// An arena of elements. Nodes are never freed, so indices are stable and
+    /// double as element identities.
+    #[derive(Default)]
+    pub struct DummyDom {
+        nodes: RefCell<Vec<DummyNode>>,
+    }
+
+    impl DummyDom {
+        pub fn new() -> Self {
+            Default::default()
+        }
+
+        /// Creates a new detached element, and returns its index.
+        pub fn create_element(&self, local_name: &str) -> usize {
+            let mut nodes = self.nodes.borrow_mut();
+            nodes.push(DummyNode {
+                local_name: local_name.into(),
+                ..Default::default()
+            });
+            nodes.len() - 1
+        }
+
+        pub fn set_id(&self, element: usize, id: &str) {
+            self.nodes.borrow_mut()[element].id = Some(id.into());
+        }
+
+        pub fn add_class(&self, element: usize, class: &str) {
+            self.nodes.borrow_mut()[element].classes.push(class.into());
+        }
+
+        pub fn set_attr(&self, element: usize, name: &str, value: &str) {
+            self.nodes.borrow_mut()[element]
+                .attrs
+                .push((name.into(), value.into()));
+        }
+
+        pub fn append_child(&self, parent: usize, child: usize) {
+            let mut nodes = self.nodes.borrow_mut();
+            debug_assert!(nodes[child].parent.is_none());
+            let last = nodes[parent].last_child;
+            nodes[child].parent = Some(parent);
+            nodes[child].prev_sibling = last;
+            match last {
+                Some(last) => nodes[last].next_sibling = Some(child),
+                None => nodes[parent].first_child = Some(child),
+            }
+            nodes[parent].last_child = Some(child);
+        }
+
+        pub fn insert_before(&self, reference: usize, child: usize) {
+            let mut nodes = self.nodes.borrow_mut();
+            debug_assert!(nodes[child].parent.is_none());
+            let parent = nodes[reference]
+                .parent
+                .expect("Reference should be in the tree");
+            let prev = nodes[reference].prev_sibling;
+            nodes[child].parent = Some(parent);
+            nodes[child].prev_sibling = prev;
+            nodes[child].next_sibling = Some(reference);
+            nodes[reference].prev_sibling = Some(child);
+            match prev {
+                Some(prev) => nodes[prev].next_sibling = Some(child),
+                None => nodes[parent].first_child = Some(child),
+            }
+        }
+
+        pub fn remove(&self, child: usize) {
+            let mut nodes = self.nodes.borrow_mut();
+            let Some(parent) = nodes[child].parent.take() else {
+                return;
+            };
+            let prev = nodes[child].prev_sibling.take();
+            let next = nodes[child].next_sibling.take();
+            match prev {
+                Some(prev) => nodes[prev].next_sibling = next,
+                None => nodes[parent].first_child = next,
+            }
+            match next {
+                Some(next) => nodes[next].prev_sibling = prev,
+                None => nodes[parent].last_child = prev,
+            }
+        }
+
+        pub fn element(&self, index: usize) -> DummyElement {
+            DummyElement {
+                dom: self,
+                index,
+                nth_index_cache: None,
+            }
+        }
+
+        /// Returns an element that will look up structural nth indices in the
+        /// given cache.
+        pub fn element_with_cache<'a>(
+            &'a self,
+            index: usize,
+            cache: &'a SiblingIndexCache<DummyElement<'a>>,
+        ) -> DummyElement<'a> {
+            DummyElement {
+                dom: self,
+                index,
+                nth_index_cache: Some(cache),
+            }
+        }
+    }
+
+    #[derive(Clone)]
+    pub struct DummyElement<'a> {
+        dom: &'a DummyDom,
+        pub index: usize,
+        nth_index_cache: Option<&'a SiblingIndexCache<DummyElement<'a>>>,
+    }
+
+    impl<'a> fmt::Debug for DummyElement<'a> {
+        fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+            let nodes = self.dom.nodes.borrow();
+            write!(f, "<{} #{}>", nodes[self.index].local_name.0, self.index)
+        }
+    }
+
+    impl<'a> DummyElement<'a> {
+        fn with_node<R>(&self, f: impl FnOnce(&DummyNode) -> R) -> R {
+            f(&self.dom.nodes.borrow()[self.index])
+        }
+
+        fn relative(&self, f: impl FnOnce(&DummyNode) -> Option<usize>) -> Option<Self> {
+            self.with_node(f).map(|index| DummyElement {
+                dom: self.dom,
+                index,
+                nth_index_cache: self.nth_index_cache,
+            })
+        }
+    }
+
+    impl<'a> Element for DummyElement<'a> {
+        type Impl = DummySelectorImpl;
+
+        fn opaque(&self) -> OpaqueElement {
+            // Indices are stable identities, and opaque elements are never
+            // dereferenced.
+            OpaqueElement::from_non_null_ptr(NonNull::new((self.index + 1) as *mut ()).unwrap())
+        }
+
+        fn parent_element(&self) -> Option<Self> {
+            self.relative(|n| n.parent)
+        }
+
+        fn parent_node_is_shadow_root(&self) -> bool {
+            false
+        }
+
+        fn containing_shadow_host(&self) -> Option<Self> {
+            None
+        }
+
+        fn is_pseudo_element(&self) -> bool {
+            false
+        }
+
+        fn prev_sibling_element(&self) -> Option<Self> {
+            self.relative(|n| n.prev_sibling)
+        }
+
+        fn next_sibling_element(&self) -> Option<Self> {
+            self.relative(|n| n.next_sibling)
+        }
+
+        fn first_element_child(&self) -> Option<Self> {
+            self.relative(|n| n.first_child)
+        }
+
+        fn is_html_element_in_html_document(&self) -> bool {
+            true
+        }
+
+        fn has_local_name(&self, local_name: &DummyAtom) -> bool {
+            self.with_node(|n| n.local_name == *local_name)
+        }
+
+        fn has_namespace(&self, ns: &DummyAtom) -> bool {
+            self.with_node(|n| n.namespace == *ns)
+        }
+
+        fn is_same_type(&self, other: &Self) -> bool {
+            let nodes = self.dom.nodes.borrow();
+            let (a, b) = (&nodes[self.index], &nodes[other.index]);
+            a.local_name == b.local_name && a.namespace == b.namespace
+        }
+
+        fn attr_matches(
+            &self,
+            _ns: &NamespaceConstraint<&DummyAtom>,
+            local_name: &DummyAtom,
+            operation: &AttrSelectorOperation<&DummyAttrValue>,
+        ) -> bool {
+            self.with_node(|n| {
+                n.attrs.iter().any(|(name, value)| {
+                    if name != local_name {
+                        return false;
+                    }
+                    match *operation {
+                        AttrSelectorOperation::Exists => true,
+                        AttrSelectorOperation::WithValue {
+                            operator,
+                            case_sensitivity,
+                            value: expected,
+                        } => operator.eval_str(value, &expected.0, case_sensitivity),
+                    }
+                })
+            })
+        }
+
+        fn match_non_ts_pseudo_class(
+            &self,
+            _pc: &PseudoClass,
+            _context: &mut MatchingContext<DummySelectorImpl>,
+        ) -> bool {
+            false
+        }
+
+        fn match_pseudo_element(
+            &self,
+            _pe: &PseudoElement,
+            _context: &mut MatchingContext<DummySelectorImpl>,
+        ) -> bool {
+            false
+        }
+
+        fn apply_selector_flags(&self, _flags: ElementSelectorFlags) {}
+
+        fn is_link(&self) -> bool {
+            false
+        }
+
+        fn is_html_slot_element(&self) -> bool {
+            false
+        }
+
+        fn has_id(&self, id: &DummyAtom, case_sensitivity: CaseSensitivity) -> bool {
+            self.with_node(|n| {
+                n.id.as_ref().map_or(false, |own| {
+                    case_sensitivity.eq(own.0.as_bytes(), id.0.as_bytes())
+                })
+            })
+        }
+
+        fn has_class(&self, name: &DummyAtom, case_sensitivity: CaseSensitivity) -> bool {
+            self.with_node(|n| {
+                n.classes
+                    .iter()
+                    .any(|class| case_sensitivity.eq(class.0.as_bytes(), name.0.as_bytes()))
+            })
+        }
+
+        fn has_custom_state(&self, _name: &DummyAtom) -> bool {
+            false
+        }
+
+        fn imported_part(&self, _name: &DummyAtom) -> Option<DummyAtom> {
+            None
+        }
+
+        fn is_part(&self, _name: &DummyAtom) -> bool {
+            false
+        }
+
+        fn is_empty(&self) -> bool {
+            self.with_node(|n| n.first_child.is_none())
+        }
+
+        fn is_root(&self) -> bool {
+            self.with_node(|n| n.parent.is_none())
+        }
+
+        fn add_element_unique_hashes(&self, filter: &mut BloomFilter) -> bool {
+            self.with_node(|n| {
+                filter.insert_hash(n.local_name.precomputed_hash() & BLOOM_HASH_MASK);
+                if let Some(ref id) = n.id {
+                    filter.insert_hash(id.precomputed_hash() & BLOOM_HASH_MASK);
+                }
+                for class in &n.classes {
+                    filter.insert_hash(class.precomputed_hash() & BLOOM_HASH_MASK);
+                }
+            });
+            true
+        }
+
+        fn cached_nth_index(&self, is_of_type: bool, is_from_end: bool) -> Option<i32> {
+            self.nth_index_cache?
+                .lookup(self.opaque(), is_of_type, is_from_end)
+        }
+    }
 }
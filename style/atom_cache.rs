@@ -0,0 +1,192 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! A front cache for the atoms created while parsing a stylesheet.
+//!
+//! Stylesheets repeat the same classes, ids, custom property names and
+//! keyframes names many times, and each occurrence used to go through the
+//! global dynamic atom set, which takes a lock. While a `ParseScope` is alive,
+//! `atomize` looks identifiers up in a small direct-mapped thread-local table
+//! first, so that repeated identifiers only cost a hash and a refcount
+//! increment.
+//!
+//! The cache is emptied when the outermost scope of a thread ends, so it
+//! doesn't keep the atoms of a stylesheet alive after it's been parsed. Outside
+//! of a scope, `atomize` is just `Atom::from`.
+//!
+//! Gecko's atom table has its own cache of recently used atoms, so this is
+//! only used with Servo's atoms.
+
+use crate::Atom;
+#[cfg(feature = "servo")]
+use std::cell::{Cell, RefCell};
+#[cfg(feature = "servo")]
+use std::sync::atomic::{AtomicBool, Ordering};
+
+/// The number of entries of the cache of each thread.
+#[cfg(feature = "servo")]
+const CACHE_SIZE: usize = 512;
+
+/// Identifiers up to this length are stored inline in their atom, so they
+/// don't go through the atom set and aren't worth caching.
+#[cfg(feature = "servo")]
+const MAX_INLINE_LEN: usize = 7;
+
+#[cfg(feature = "servo")]
+static ENABLED: AtomicBool = AtomicBool::new(true);
+
+#[cfg(feature = "servo")]
+thread_local! {
+    static CACHE: RefCell<Box<[Option<Atom>]>> = RefCell::new(Box::default());
+    static SCOPE_DEPTH: Cell<usize> = Cell::new(0);
+    static STATS: Cell<AtomCacheStats> = Cell::new(AtomCacheStats::default());
+}
+
+/// The number of lookups in the cache of a thread, and how many of them found
+/// their atom.
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub struct AtomCacheStats {
+    /// The number of identifiers looked up in the cache.
+    pub lookups: usize,
+    /// The number of identifiers whose atom was in the cache.
+    pub hits: usize,
+}
+
+/// Enables or disables the cache for the scopes created from now on. It's
+/// enabled by default.
+pub fn set_enabled(enabled: bool) {
+    #[cfg(feature = "servo")]
+    ENABLED.store(enabled, Ordering::Relaxed);
+    #[cfg(not(feature = "servo"))]
+    let _ = enabled;
+}
+
+/// Returns the statistics of the current thread since the last call, and
+/// resets them.
+pub fn take_stats() -> AtomCacheStats {
+    #[cfg(feature = "servo")]
+    return STATS.with(|stats| stats.take());
+    #[cfg(not(feature = "servo"))]
+    AtomCacheStats::default()
+}
+
+/// Enables the cache of the current thread while alive. Scopes can be nested,
+/// and the cache is emptied when the outermost one is dropped.
+pub struct ParseScope {
+    #[cfg(feature = "servo")]
+    active: bool,
+}
+
+impl ParseScope {
+    /// Enables the cache of the current thread, unless it's been disabled with
+    /// `set_enabled`.
+    pub fn new() -> Self {
+        #[cfg(feature = "servo")]
+        {
+            let active = ENABLED.load(Ordering::Relaxed);
+            if active {
+                SCOPE_DEPTH.with(|depth| depth.set(depth.get() + 1));
+            }
+            return Self { active };
+        }
+        #[cfg(not(feature = "servo"))]
+        Self {}
+    }
+}
+
+#[cfg(feature = "servo")]
+impl Drop for ParseScope {
+    fn drop(&mut self) {
+        if !self.active {
+            return;
+        }
+        let depth = SCOPE_DEPTH.with(|depth| {
+            depth.set(depth.get() - 1);
+            depth.get()
+        });
+        if depth == 0 {
+            CACHE.with(|cache| {
+                for entry in cache.borrow_mut().iter_mut() {
+                    *entry = None;
+                }
+            });
+        }
+    }
+}
+
+/// Returns the atom for `string`, from the cache of the current thread if
+/// there's a `ParseScope` alive.
+#[inline]
+pub fn atomize(string: &str) -> Atom {
+    #[cfg(feature = "servo")]
+    {
+        if string.len() > MAX_INLINE_LEN && SCOPE_DEPTH.with(Cell::get) != 0 {
+            return atomize_cached(string);
+        }
+    }
+    Atom::from(string)
+}
+
+#[cfg(feature = "servo")]
+fn atomize_cached(string: &str) -> Atom {
+    use std::hash::Hasher;
+
+    let mut hasher = rustc_hash::FxHasher::default();
+    hasher.write(string.as_bytes());
+    let index = hasher.finish() as usize % CACHE_SIZE;
+
+    let (atom, hit) = CACHE.with(|cache| {
+        let mut cache = cache.borrow_mut();
+        if cache.is_empty() {
+            *cache = vec![None; CACHE_SIZE].into_boxed_slice();
+        }
+        let entry = &mut cache[index];
+        match *entry {
+            Some(ref atom) if &**atom == string => (atom.clone(), true),
+            _ => {
+                let atom = Atom::from(string);
+                *entry = Some(atom.clone());
+                (atom, false)
+            },
+        }
+    });
+
+    STATS.with(|stats| {
+        let mut s = stats.get();
+        s.lookups += 1;
+        s.hits += hit as usize;
+        stats.set(s);
+    });
+    atom
+}
+
+#[cfg(all(test, feature = "servo"))]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn caches_within_scope() {
+        take_stats();
+        let outside = atomize("outside-of-a-scope");
+        assert_eq!(take_stats(), AtomCacheStats::default());
+        {
+            let _scope = ParseScope::new();
+            assert_eq!(atomize("outside-of-a-scope"), outside);
+            assert_eq!(atomize("outside-of-a-scope"), outside);
+            assert_eq!(atomize("short"), Atom::from("short"));
+            {
+                let _nested = ParseScope::new();
+                assert_eq!(atomize("outside-of-a-scope"), outside);
+            }
+            assert_eq!(
+                take_stats(),
+                AtomCacheStats {
+                    lookups: 3,
+                    hits: 2
+                }
+            );
+        }
+        assert!(CACHE.with(|cache| cache.borrow().iter().all(Option::is_none)));
+    }
+}
@@ -12,7 +12,13 @@ use crate::values::CSSFloat;
 
 const NEWTON_METHOD_ITERATIONS: u8 = 8;
 
+/// The number of samples of the curve parameter of a `PrecomputedBezier`, at evenly spaced values
+/// of the x coordinate.
+const SAMPLE_COUNT: usize = 17;
+const SAMPLE_STEP: f64 = 1.0 / (SAMPLE_COUNT - 1) as f64;
+
 /// A unit cubic Bézier curve, used for timing functions in CSS transitions and animations.
+#[derive(Clone, Debug, PartialEq)]
 pub struct Bezier {
     ax: f64,
     bx: f64,
@@ -80,6 +86,32 @@ impl Bezier {
         Bezier::new(x1, y1, x2, y2).solve(progress, epsilon)
     }
 
+    /// Calculate the output of a unit cubic Bézier curve for each of the given
+    /// progress values, in place.
+    ///
+    /// This is equivalent to calling `calculate_bezier_output` for each value,
+    /// but the curve coefficients are only computed once for all of them.
+    pub fn calculate_bezier_outputs(
+        progress: &mut [f64],
+        epsilon: f64,
+        x1: f32,
+        y1: f32,
+        x2: f32,
+        y2: f32,
+    ) {
+        if x1 == y1 && x2 == y2 {
+            return;
+        }
+        let bezier = Bezier::new(x1, y1, x2, y2);
+        for progress in progress.iter_mut() {
+            *progress = if *progress > 0.0 && *progress < 1.0 {
+                bezier.solve(*progress, epsilon)
+            } else {
+                Self::calculate_bezier_output(*progress, epsilon, x1, y1, x2, y2)
+            };
+        }
+    }
+
     #[inline]
     fn new(x1: CSSFloat, y1: CSSFloat, x2: CSSFloat, y2: CSSFloat) -> Bezier {
         let cx = 3. * x1 as f64;
@@ -116,8 +148,15 @@ impl Bezier {
 
     #[inline]
     fn solve_curve_x(&self, x: f64, epsilon: f64) -> f64 {
+        self.solve_curve_x_from(x, epsilon, x, 0.0, 1.0)
+    }
+
+    /// Solve the x coordinate of the curve for `x`, starting from `guess`, and, if Newton's
+    /// method doesn't converge, bisecting the `lo..hi` range of the parameter.
+    #[inline]
+    fn solve_curve_x_from(&self, x: f64, epsilon: f64, guess: f64, lo: f64, hi: f64) -> f64 {
         // Fast path: Use Newton's method.
-        let mut t = x;
+        let mut t = guess;
         for _ in 0..NEWTON_METHOD_ITERATIONS {
             let x2 = self.sample_curve_x(t);
             if x2.approx_eq(x, epsilon) {
@@ -131,7 +170,7 @@ impl Bezier {
         }
 
         // Slow path: Use bisection.
-        let (mut lo, mut hi, mut t) = (0.0, 1.0, x);
+        let (mut lo, mut hi, mut t) = (lo, hi, guess);
 
         if t < lo {
             return lo;
@@ -164,6 +203,75 @@ impl Bezier {
     }
 }
 
+/// A unit cubic Bézier curve with a table of the parameter of the curve at evenly spaced values of
+/// its x coordinate, for curves that are evaluated many times, like the timing functions of
+/// running animations.
+///
+/// Looking up the table gives the solver a close initial guess, so that Newton's method usually
+/// converges in a single iteration, even for steep curves, and limits the bisection fallback to a
+/// sixteenth of the curve. Outputs meet the same `epsilon` bound as
+/// `Bezier::calculate_bezier_output`, since the solver has the same stop condition.
+#[derive(Clone, Debug, PartialEq)]
+pub struct PrecomputedBezier {
+    curve: Bezier,
+    x1: f32,
+    y1: f32,
+    x2: f32,
+    y2: f32,
+    params: [f64; SAMPLE_COUNT],
+}
+
+impl PrecomputedBezier {
+    /// The precision of the parameters in the table.
+    const TABLE_EPSILON: f64 = 1e-9;
+
+    /// Create a curve from the two middle control points, see `Bezier::calculate_bezier_output`.
+    pub fn new(x1: f32, y1: f32, x2: f32, y2: f32) -> Self {
+        let curve = Bezier::new(x1, y1, x2, y2);
+        let mut params = [0.0; SAMPLE_COUNT];
+        for (i, param) in params.iter_mut().enumerate() {
+            *param = curve.solve_curve_x(i as f64 * SAMPLE_STEP, Self::TABLE_EPSILON);
+        }
+        Self {
+            curve,
+            x1,
+            y1,
+            x2,
+            y2,
+            params,
+        }
+    }
+
+    /// Calculate the output of the curve, as `Bezier::calculate_bezier_output` would.
+    #[inline]
+    pub fn calculate_output(&self, progress: f64, epsilon: f64) -> f64 {
+        let is_linear = self.x1 == self.y1 && self.x2 == self.y2;
+        if is_linear || !(progress > 0.0 && progress < 1.0) {
+            return Bezier::calculate_bezier_output(
+                progress, epsilon, self.x1, self.y1, self.x2, self.y2,
+            );
+        }
+
+        // The x coordinate is monotonic in the parameter, since the control points are in the
+        // unit square, so the parameter is between the ones of the surrounding samples.
+        let position = progress * (SAMPLE_COUNT - 1) as f64;
+        let index = (position as usize).min(SAMPLE_COUNT - 2);
+        let (lo, hi) = (self.params[index], self.params[index + 1]);
+        let guess = lo + (hi - lo) * (position - index as f64);
+        let t = self
+            .curve
+            .solve_curve_x_from(progress, epsilon, guess, lo, hi);
+        self.curve.sample_curve_y(t)
+    }
+
+    /// Calculate the output of the curve for each of the given progress values, in place.
+    pub fn calculate_outputs(&self, progress: &mut [f64], epsilon: f64) {
+        for progress in progress.iter_mut() {
+            *progress = self.calculate_output(*progress, epsilon);
+        }
+    }
+}
+
 trait ApproxEq {
     fn approx_eq(self, value: Self, epsilon: Self) -> bool;
 }
@@ -174,3 +282,88 @@ impl ApproxEq for f64 {
         (self - value).abs() < epsilon
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const EPSILON: f64 = 1e-9;
+
+    /// Control points of the keyword timing functions, and of curves that overshoot, with y
+    /// coordinates outside of [0, 1].
+    const CURVES: &[(f32, f32, f32, f32)] = &[
+        (0.25, 0.1, 0.25, 1.0),
+        (0.42, 0.0, 1.0, 1.0),
+        (0.0, 0.0, 0.58, 1.0),
+        (0.42, 0.0, 0.58, 1.0),
+        (0.9, 0.0, 0.1, 1.0),
+        (0.5, -1.5, 0.5, 2.5),
+        (0.3, 2.0, 0.7, -1.0),
+        (0.1, -0.6, 0.2, 0.0),
+        (0.68, -0.55, 0.265, 1.55),
+    ];
+
+    #[test]
+    fn table_matches_solver() {
+        for &(x1, y1, x2, y2) in CURVES {
+            let precomputed = PrecomputedBezier::new(x1, y1, x2, y2);
+            let curve = &precomputed.curve;
+            assert_eq!(precomputed.params[0], 0.0);
+            assert_eq!(precomputed.params[SAMPLE_COUNT - 1], 1.0);
+            for (i, param) in precomputed.params.iter().enumerate() {
+                let x = i as f64 * SAMPLE_STEP;
+                assert!(curve.sample_curve_x(*param).approx_eq(x, EPSILON));
+                let expected = curve.solve(x, EPSILON);
+                let actual = curve.sample_curve_y(*param);
+                assert!(
+                    actual.approx_eq(expected, 1e-6),
+                    "{:?} at {}: {} != {}",
+                    (x1, y1, x2, y2),
+                    x,
+                    actual,
+                    expected
+                );
+            }
+            assert!(precomputed.params.windows(2).all(|w| w[0] <= w[1]));
+        }
+    }
+
+    #[test]
+    fn outputs_match_solver() {
+        // Values between, on and next to the samples, and outside of the curve.
+        let mut progress = vec![-1.0, -0.25, -f64::EPSILON, 1.0 + f64::EPSILON, 1.25, 3.0];
+        for i in 0..=(4 * (SAMPLE_COUNT - 1)) {
+            let x = i as f64 * SAMPLE_STEP / 4.0;
+            progress.extend([x, x - 1e-12, x + 1e-12]);
+        }
+        for &(x1, y1, x2, y2) in CURVES {
+            let precomputed = PrecomputedBezier::new(x1, y1, x2, y2);
+            for &p in progress.iter() {
+                let expected = Bezier::calculate_bezier_output(p, EPSILON, x1, y1, x2, y2);
+                let actual = precomputed.calculate_output(p, EPSILON);
+                assert!(
+                    actual.approx_eq(expected, 1e-6),
+                    "{:?} at {}: {} != {}",
+                    (x1, y1, x2, y2),
+                    p,
+                    actual,
+                    expected
+                );
+            }
+
+            let mut outputs = progress.clone();
+            precomputed.calculate_outputs(&mut outputs, EPSILON);
+            for (output, &p) in outputs.iter().zip(progress.iter()) {
+                assert_eq!(*output, precomputed.calculate_output(p, EPSILON));
+            }
+        }
+    }
+
+    #[test]
+    fn linear_curves_are_not_solved() {
+        let precomputed = PrecomputedBezier::new(0.3, 0.3, 0.6, 0.6);
+        for p in [-0.5, 0.0, 0.123, 0.5, 1.0, 1.5] {
+            assert_eq!(precomputed.calculate_output(p, EPSILON), p);
+        }
+    }
+}
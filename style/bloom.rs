@@ -10,7 +10,7 @@
 use crate::dom::{SendElement, TElement};
 use crate::LocalName;
 use atomic_refcell::{AtomicRefCell, AtomicRefMut};
-use selectors::bloom::BloomFilter;
+use selectors::bloom::{BloomFilter, SubtreeSummary, BLOOM_HASH_MASK};
 use smallvec::SmallVec;
 
 thread_local! {
@@ -133,6 +133,17 @@ where
     });
 }
 
+/// Returns what `element` contributes to the subtree summary of its parent,
+/// that is, its own relevant hashes plus its own subtree summary.
+///
+/// Returns `None` if `element` has no subtree summary, since its subtree is
+/// then unknown, and its parent can't have a summary either.
+pub fn subtree_summary_contribution<E: TElement>(element: E) -> Option<SubtreeSummary> {
+    let mut summary = element.subtree_summary()?;
+    each_relevant_element_hash(element, |hash| summary.insert_hash(hash & BLOOM_HASH_MASK));
+    Some(summary)
+}
+
 impl<E: TElement> Drop for StyleBloom<E> {
     fn drop(&mut self) {
         // Leave the reusable bloom filter in a zeroed state.
@@ -64,6 +64,14 @@ fn generate_properties(engine: &str) {
         // TODO(mrobinson): Is this happening because of how we run this script? It
         // would be better to ensure are just placed in the output directory.
         .env("PYTHONDONTWRITEBYTECODE", "1")
+        .env(
+            "STYLO_SPARSE_STYLE_STRUCTS",
+            if cfg!(feature = "sparse_style_structs") {
+                "1"
+            } else {
+                "0"
+            },
+        )
         .arg(&script)
         .arg(engine)
         .arg("style-crate")
@@ -0,0 +1,445 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Opt-in profiling of the cascade hot paths.
+//!
+//! When enabled, this attributes the time spent applying non-prioritary
+//! longhands to each longhand, and selector-matching attempts and successes to
+//! each selector and the stylesheet it came from.
+//!
+//! Samples are gathered into thread-local buffers without any synchronization,
+//! and merged into a global profile at the end of each unit of traversal work
+//! (see `flush_thread_local`). The driver then takes the merged profile and
+//! reports it alongside the rest of the traversal statistics.
+//!
+//! All of this is a no-op (a single relaxed atomic load per call site) unless
+//! a `ProfilingScope` is alive, which the driver keeps for the duration of the
+//! traversals that have `StyleSystemOptions::profile_cascade` set.
+
+use crate::properties::{property_counts, LonghandId};
+use crate::rule_tree::CascadeLevel;
+use crate::selector_parser::SelectorImpl;
+use crate::stylesheets::Origin;
+use crate::stylist::{CascadeData, Rule, RuleSheet};
+use cssparser::ToCss;
+use parking_lot::Mutex;
+use rustc_hash::FxHashMap;
+use selectors::parser::Selector;
+use std::cell::RefCell;
+use std::fmt::{self, Write};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::time::Duration;
+
+/// The number of `ProfilingScope`s alive.
+static ACTIVE_SCOPES: AtomicUsize = AtomicUsize::new(0);
+
+lazy_static! {
+    static ref GLOBAL_PROFILE: Mutex<CascadeProfile> = Mutex::new(CascadeProfile::default());
+}
+
+thread_local! {
+    static LOCAL_PROFILE: RefCell<CascadeProfile> = RefCell::new(CascadeProfile::default());
+}
+
+/// The maximum number of selectors reported in the `[PERF]` statistics block.
+const MAX_REPORTED_SELECTORS: usize = 20;
+
+/// Enables the cascade profiler while alive.
+///
+/// Scopes can overlap (e.g., for concurrent traversals of different
+/// documents), in which case the profiler stays enabled until all of them are
+/// dropped.
+pub struct ProfilingScope(());
+
+impl ProfilingScope {
+    /// Enables the cascade profiler until the returned scope is dropped.
+    pub fn new() -> Self {
+        ACTIVE_SCOPES.fetch_add(1, Ordering::Relaxed);
+        ProfilingScope(())
+    }
+}
+
+impl Drop for ProfilingScope {
+    fn drop(&mut self) {
+        ACTIVE_SCOPES.fetch_sub(1, Ordering::Relaxed);
+    }
+}
+
+/// Returns whether the cascade profiler is enabled.
+#[inline(always)]
+pub fn is_enabled() -> bool {
+    ACTIVE_SCOPES.load(Ordering::Relaxed) != 0
+}
+
+/// Records that applying `longhand` took `time`.
+pub fn record_longhand(longhand: LonghandId, time: Duration) {
+    LOCAL_PROFILE.with(|profile| profile.borrow_mut().add_longhand(longhand, time));
+}
+
+/// Records an attempt to match `rule`, from the given cascade data and level,
+/// and whether it matched.
+pub fn record_match_attempt(
+    rule: &Rule,
+    cascade_level: CascadeLevel,
+    cascade_data: &CascadeData,
+    matched: bool,
+) {
+    LOCAL_PROFILE.with(|profile| {
+        profile
+            .borrow_mut()
+            .add_match_attempt(rule, cascade_level, cascade_data, matched)
+    });
+}
+
+/// Merges this thread's samples into the global profile.
+pub fn flush_thread_local() {
+    if !is_enabled() {
+        return;
+    }
+    let local = LOCAL_PROFILE.with(|profile| std::mem::take(&mut *profile.borrow_mut()));
+    if local.is_empty() {
+        return;
+    }
+    GLOBAL_PROFILE.lock().merge(local);
+}
+
+/// Takes the global profile, leaving an empty one in its place.
+///
+/// Samples that haven't been flushed by their thread yet are not included.
+/// This needs to be called at the end of every profiled traversal, even if the
+/// profile isn't reported, so that the global profile doesn't keep growing.
+pub fn take() -> CascadeProfile {
+    flush_thread_local();
+    std::mem::take(&mut *GLOBAL_PROFILE.lock())
+}
+
+/// The accumulated cost of applying a given longhand.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct LonghandCost {
+    /// The number of declarations of this longhand that were applied.
+    pub count: u32,
+    /// The total time spent applying them.
+    pub time: Duration,
+}
+
+/// The number of times a selector, or the selectors of a stylesheet, were
+/// tried against an element, and how many of those matched.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct MatchCost {
+    /// The number of match attempts.
+    pub attempts: u32,
+    /// The number of successful matches.
+    pub matches: u32,
+}
+
+impl MatchCost {
+    fn add(&mut self, matched: bool) {
+        self.attempts += 1;
+        self.matches += matched as u32;
+    }
+
+    fn merge(&mut self, other: &Self) {
+        self.attempts += other.attempts;
+        self.matches += other.matches;
+    }
+}
+
+/// The matching cost of a single selector.
+#[derive(Clone, Debug)]
+pub struct SelectorCost {
+    /// The selector itself.
+    pub selector: Selector<SelectorImpl>,
+    /// The origin of the rule the selector belongs to.
+    pub origin: Origin,
+    /// The stylesheet the selector came from, if known.
+    pub sheet: Option<RuleSheet>,
+    /// The attempts and matches of this selector.
+    pub cost: MatchCost,
+}
+
+/// The matching cost of all the selectors of a stylesheet.
+///
+/// The selectors of a stylesheet shared by many shadow trees are counted
+/// together.
+#[derive(Clone, Debug)]
+pub struct StylesheetCost {
+    /// The origin of the stylesheet.
+    pub origin: Origin,
+    /// The stylesheet. Its index is the one it was first seen at.
+    pub sheet: RuleSheet,
+    /// The attempts and matches of the selectors in this stylesheet.
+    pub cost: MatchCost,
+}
+
+/// A cascade profile, either for a single thread or merged across threads.
+#[derive(Debug, Default)]
+pub struct CascadeProfile {
+    /// Indexed by `LonghandId`, lazily allocated.
+    longhands: Vec<LonghandCost>,
+    /// Keyed by the selector's heap pointer.
+    selectors: FxHashMap<usize, SelectorCost>,
+    /// Keyed by the address of the stylesheet contents, see `RuleSheet`.
+    stylesheets: FxHashMap<usize, StylesheetCost>,
+}
+
+impl CascadeProfile {
+    /// Returns whether no sample has been recorded in this profile.
+    pub fn is_empty(&self) -> bool {
+        self.longhands.is_empty() && self.selectors.is_empty()
+    }
+
+    fn add_longhand(&mut self, longhand: LonghandId, time: Duration) {
+        if self.longhands.is_empty() {
+            self.longhands = vec![LonghandCost::default(); property_counts::LONGHANDS];
+        }
+        let cost = &mut self.longhands[longhand as usize];
+        cost.count += 1;
+        cost.time += time;
+    }
+
+    fn add_match_attempt(
+        &mut self,
+        rule: &Rule,
+        cascade_level: CascadeLevel,
+        cascade_data: &CascadeData,
+        matched: bool,
+    ) {
+        let origin = cascade_level.origin();
+        let key = rule.selector.thin_arc_heap_ptr() as usize;
+        let selector_cost = self.selectors.entry(key).or_insert_with(|| SelectorCost {
+            selector: rule.selector.clone(),
+            origin,
+            sheet: cascade_data.sheet_for_source_order(rule.source_order),
+            cost: MatchCost::default(),
+        });
+        selector_cost.cost.add(matched);
+        if let Some(sheet) = selector_cost.sheet {
+            self.stylesheets
+                .entry(sheet.contents)
+                .or_insert_with(|| StylesheetCost {
+                    origin,
+                    sheet,
+                    cost: MatchCost::default(),
+                })
+                .cost
+                .add(matched);
+        }
+    }
+
+    /// Merges another profile into this one.
+    pub fn merge(&mut self, other: Self) {
+        if self.longhands.is_empty() {
+            self.longhands = other.longhands;
+        } else {
+            for (cost, other) in self.longhands.iter_mut().zip(other.longhands.iter()) {
+                cost.count += other.count;
+                cost.time += other.time;
+            }
+        }
+        for (key, other) in other.selectors {
+            match self.selectors.get_mut(&key) {
+                Some(cost) => cost.cost.merge(&other.cost),
+                None => {
+                    self.selectors.insert(key, other);
+                },
+            }
+        }
+        for (key, other) in other.stylesheets {
+            match self.stylesheets.get_mut(&key) {
+                Some(cost) => cost.cost.merge(&other.cost),
+                None => {
+                    self.stylesheets.insert(key, other);
+                },
+            }
+        }
+    }
+
+    /// Returns the longhands that were applied at least once, with their cost,
+    /// sorted by decreasing total time.
+    pub fn longhands(&self) -> Vec<(LonghandId, LonghandCost)> {
+        let mut result: Vec<_> = self
+            .longhands
+            .iter()
+            .enumerate()
+            .filter(|(_, cost)| cost.count != 0)
+            .map(|(index, cost)| {
+                // Safety: `longhands` has exactly `property_counts::LONGHANDS`
+                // entries, and LonghandId is a `u16` enum.
+                let id: LonghandId = unsafe { std::mem::transmute(index as u16) };
+                (id, *cost)
+            })
+            .collect();
+        result.sort_by(|a, b| b.1.time.cmp(&a.1.time));
+        result
+    }
+
+    /// Returns the profiled selectors, sorted by decreasing number of match
+    /// attempts.
+    pub fn selectors(&self) -> Vec<&SelectorCost> {
+        let mut result: Vec<_> = self.selectors.values().collect();
+        result.sort_by(|a, b| b.cost.attempts.cmp(&a.cost.attempts));
+        result
+    }
+
+    /// Returns the profiled stylesheets, sorted by decreasing number of match
+    /// attempts.
+    pub fn stylesheets(&self) -> Vec<&StylesheetCost> {
+        let mut result: Vec<_> = self.stylesheets.values().collect();
+        result.sort_by(|a, b| b.cost.attempts.cmp(&a.cost.attempts));
+        result
+    }
+
+    /// Writes the profile as `[PERF]` lines, to be included in the traversal
+    /// statistics block.
+    pub fn write_perf_lines(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        for (id, cost) in self.longhands() {
+            writeln!(f, "[PERF],longhand_count,{},{}", id.name(), cost.count)?;
+            writeln!(
+                f,
+                "[PERF],longhand_time_ms,{},{}",
+                id.name(),
+                cost.time.as_secs_f64() * 1000.
+            )?;
+        }
+        for sheet in self.stylesheets() {
+            writeln!(
+                f,
+                "[PERF],stylesheet_match_attempts,{:?}:{}:{:#x},{}",
+                sheet.origin, sheet.sheet.index, sheet.sheet.contents, sheet.cost.attempts
+            )?;
+            writeln!(
+                f,
+                "[PERF],stylesheet_matches,{:?}:{}:{:#x},{}",
+                sheet.origin, sheet.sheet.index, sheet.sheet.contents, sheet.cost.matches
+            )?;
+        }
+        for selector in self.selectors().into_iter().take(MAX_REPORTED_SELECTORS) {
+            let css = selector.selector.to_css_string();
+            writeln!(
+                f,
+                "[PERF],selector_match_attempts,{},{}",
+                css, selector.cost.attempts
+            )?;
+            writeln!(
+                f,
+                "[PERF],selector_matches,{},{}",
+                css, selector.cost.matches
+            )?;
+        }
+        Ok(())
+    }
+
+    /// Serializes the whole profile as JSON.
+    pub fn to_json(&self) -> String {
+        let mut json = String::new();
+        self.write_json(&mut json).unwrap();
+        json
+    }
+
+    fn write_json<W: Write>(&self, dest: &mut W) -> fmt::Result {
+        dest.write_str("{\"longhands\":[")?;
+        for (i, (id, cost)) in self.longhands().into_iter().enumerate() {
+            if i != 0 {
+                dest.write_char(',')?;
+            }
+            write!(
+                dest,
+                "{{\"name\":\"{}\",\"count\":{},\"time_ms\":{}}}",
+                id.name(),
+                cost.count,
+                cost.time.as_secs_f64() * 1000.
+            )?;
+        }
+        dest.write_str("],\"stylesheets\":[")?;
+        for (i, sheet) in self.stylesheets().into_iter().enumerate() {
+            if i != 0 {
+                dest.write_char(',')?;
+            }
+            write!(
+                dest,
+                "{{\"origin\":\"{:?}\",\"index\":{},\"contents\":{},\"attempts\":{},\"matches\":{}}}",
+                sheet.origin,
+                sheet.sheet.index,
+                sheet.sheet.contents,
+                sheet.cost.attempts,
+                sheet.cost.matches
+            )?;
+        }
+        dest.write_str("],\"selectors\":[")?;
+        for (i, selector) in self.selectors().into_iter().enumerate() {
+            if i != 0 {
+                dest.write_char(',')?;
+            }
+            dest.write_str("{\"selector\":")?;
+            write_json_string(&selector.selector.to_css_string(), dest)?;
+            write!(dest, ",\"origin\":\"{:?}\",\"sheet\":", selector.origin)?;
+            match selector.sheet {
+                Some(sheet) => write!(dest, "{},\"contents\":{}", sheet.index, sheet.contents)?,
+                None => dest.write_str("null,\"contents\":null")?,
+            }
+            write!(
+                dest,
+                ",\"attempts\":{},\"matches\":{}}}",
+                selector.cost.attempts, selector.cost.matches
+            )?;
+        }
+        dest.write_str("]}")
+    }
+}
+
+fn write_json_string<W: Write>(value: &str, dest: &mut W) -> fmt::Result {
+    dest.write_char('"')?;
+    for c in value.chars() {
+        match c {
+            '"' => dest.write_str("\\\"")?,
+            '\\' => dest.write_str("\\\\")?,
+            c if (c as u32) < 0x20 => write!(dest, "\\u{:04x}", c as u32)?,
+            c => dest.write_char(c)?,
+        }
+    }
+    dest.write_char('"')
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn merge_longhand_costs() {
+        let mut a = CascadeProfile::default();
+        a.add_longhand(LonghandId::Display, Duration::from_micros(3));
+        let mut b = CascadeProfile::default();
+        b.add_longhand(LonghandId::Display, Duration::from_micros(2));
+        b.add_longhand(LonghandId::Opacity, Duration::from_micros(7));
+        a.merge(b);
+
+        let longhands = a.longhands();
+        assert_eq!(longhands.len(), 2);
+        assert_eq!(longhands[0].0, LonghandId::Opacity);
+        assert_eq!(longhands[1].0, LonghandId::Display);
+        assert_eq!(longhands[1].1.count, 2);
+        assert_eq!(longhands[1].1.time, Duration::from_micros(5));
+    }
+
+    #[test]
+    fn scopes_enable_the_profiler() {
+        let outer = ProfilingScope::new();
+        assert!(is_enabled());
+        let inner = ProfilingScope::new();
+        drop(outer);
+        assert!(is_enabled());
+        record_longhand(LonghandId::Display, Duration::from_micros(1));
+        let profile = take();
+        assert_eq!(profile.longhands()[0].1.count, 1);
+        assert!(take().is_empty());
+        drop(inner);
+    }
+
+    #[test]
+    fn json_escaping() {
+        let mut out = String::new();
+        write_json_string("a\"b\\c\n", &mut out).unwrap();
+        assert_eq!(out, "\"a\\\"b\\\\c\\u000a\"");
+    }
+}
@@ -6,7 +6,9 @@
 
 #[cfg(feature = "servo")]
 use crate::animation::DocumentAnimationSet;
+use crate::applicable_declarations::ApplicableDeclarationList;
 use crate::bloom::StyleBloom;
+use crate::cascade_profiler::CascadeProfile;
 use crate::computed_value_flags::ComputedValueFlags;
 use crate::data::{EagerPseudoStyles, ElementData};
 use crate::dom::{SendElement, TElement};
@@ -56,6 +58,11 @@ pub struct StyleSystemOptions {
     /// The minimum number of elements that must be traversed to trigger a dump
     /// of style statistics.
     pub style_statistics_threshold: usize,
+    /// Whether we should profile the cascade, attributing work to longhands,
+    /// selectors and stylesheets, and include it in the dumped statistics.
+    ///
+    /// See the `cascade_profiler` module.
+    pub profile_cascade: bool,
 }
 
 #[cfg(feature = "gecko")]
@@ -92,6 +99,12 @@ pub static DEFAULT_DISABLE_STYLE_SHARING_CACHE: std::sync::atomic::AtomicBool =
 pub static DEFAULT_DUMP_STYLE_STATISTICS: std::sync::atomic::AtomicBool =
     std::sync::atomic::AtomicBool::new(false);
 
+/// A global variable holding the state of
+/// `StyleSystemOptions::default().profile_cascade`.
+#[cfg(feature = "servo")]
+pub static DEFAULT_PROFILE_CASCADE: std::sync::atomic::AtomicBool =
+    std::sync::atomic::AtomicBool::new(false);
+
 impl Default for StyleSystemOptions {
     #[cfg(feature = "servo")]
     fn default() -> Self {
@@ -102,6 +115,7 @@ impl Default for StyleSystemOptions {
                 .load(Ordering::Relaxed),
             dump_style_statistics: DEFAULT_DUMP_STYLE_STATISTICS.load(Ordering::Relaxed),
             style_statistics_threshold: DEFAULT_STATISTICS_THRESHOLD,
+            profile_cascade: DEFAULT_PROFILE_CASCADE.load(Ordering::Relaxed),
         }
     }
 
@@ -112,6 +126,7 @@ impl Default for StyleSystemOptions {
             dump_style_statistics: get_env_bool("DUMP_STYLE_STATISTICS"),
             style_statistics_threshold: get_env_usize("STYLE_STATISTICS_THRESHOLD")
                 .unwrap_or(DEFAULT_STATISTICS_THRESHOLD),
+            profile_cascade: get_env_bool("PROFILE_STYLE_CASCADE"),
         }
     }
 }
@@ -312,6 +327,9 @@ pub struct TraversalStatistics {
     pub is_parallel: bool,
     /// Whether this is a "large" traversal.
     pub is_large: bool,
+    /// The cascade profile gathered during the traversal, if the cascade
+    /// profiler was enabled.
+    pub cascade_profile: Option<CascadeProfile>,
 }
 
 /// Format the statistics in a way that the performance test harness understands.
@@ -363,6 +381,9 @@ impl fmt::Display for TraversalStatistics {
             "[PERF],traversal_time_ms,{}",
             self.traversal_time.as_secs_f64() * 1000.
         )?;
+        if let Some(ref profile) = self.cascade_profile {
+            profile.write_perf_lines(f)?;
+        }
         writeln!(f, "[PERF] perf block end")
     }
 }
@@ -397,6 +418,7 @@ impl TraversalStatistics {
             traversal_time: Instant::now() - start,
             is_parallel: parallel,
             is_large,
+            cascade_profile: None,
         }
     }
 }
@@ -613,6 +635,12 @@ pub struct ThreadLocalStyleContext<E: TElement> {
     pub stack_limit_checker: StackLimitChecker,
     /// Collection of caches (And cache-likes) for speeding up expensive selector matches.
     pub selector_caches: SelectorCaches,
+    /// Scratch storage for the declarations matched by an element.
+    ///
+    /// It's drained into the rule tree after matching each element, but kept
+    /// around so that its heap storage, once spilled, is reused by the next
+    /// elements instead of being reallocated every time.
+    pub applicable_declarations: ApplicableDeclarationList,
 }
 
 impl<E: TElement> ThreadLocalStyleContext<E> {
@@ -628,6 +656,7 @@ impl<E: TElement> ThreadLocalStyleContext<E> {
                 (STYLE_THREAD_STACK_SIZE_KB - STACK_SAFETY_MARGIN_KB) * 1024,
             ),
             selector_caches: SelectorCaches::default(),
+            applicable_declarations: ApplicableDeclarationList::new(),
         }
     }
 }
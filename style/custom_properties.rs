@@ -7,6 +7,7 @@
 //! [custom]: https://drafts.csswg.org/css-variables/
 
 use crate::applicable_declarations::CascadePriority;
+use crate::atom_cache;
 use crate::custom_properties_map::CustomPropertiesMap;
 use crate::media_queries::Device;
 use crate::properties::{
@@ -295,6 +296,12 @@ impl ComputedCustomProperties {
         self.inherited.is_empty() && self.non_inherited.is_empty()
     }
 
+    /// Returns whether both the inherited and non-inherited maps share storage with `other`.
+    #[inline]
+    pub fn ptr_eq(&self, other: &Self) -> bool {
+        self.inherited.ptr_eq(&other.inherited) && self.non_inherited.ptr_eq(&other.non_inherited)
+    }
+
     /// Return the name and value of the property at specified index, if any.
     pub fn property_at(&self, index: usize) -> Option<(&Name, &Option<ComputedRegisteredValue>)> {
         // Just expose the custom property items from custom_properties.inherited, followed
@@ -791,7 +798,7 @@ fn parse_declaration_value_block<'i, 't>(
                         // TODO(emilio): For env() this should be <custom-ident> per spec, but no other browser does
                         // that, see https://github.com/w3c/csswg-drafts/issues/3262.
                         let name = input.expect_ident()?;
-                        let name = Atom::from(if is_var {
+                        let name = atom_cache::atomize(if is_var {
                             match parse_name(name.as_ref()) {
                                 Ok(name) => name,
                                 Err(()) => {
@@ -927,6 +934,9 @@ pub struct CustomPropertiesBuilder<'a, 'b: 'a> {
     seen: PrecomputedHashSet<&'a Name>,
     may_have_cycles: bool,
     has_color_scheme: bool,
+    /// Whether the result only depends on the declarations we've cascaded and the inherited
+    /// custom properties, and thus can be reused via the rule cache.
+    cacheable: bool,
     custom_properties: ComputedCustomProperties,
     reverted: PrecomputedHashMap<&'a Name, (CascadePriority, bool)>,
     stylist: &'a Stylist,
@@ -973,6 +983,7 @@ impl<'a, 'b: 'a> CustomPropertiesBuilder<'a, 'b> {
             reverted: Default::default(),
             may_have_cycles: false,
             has_color_scheme: false,
+            cacheable: true,
             custom_properties,
             stylist,
             computed_context,
@@ -1022,12 +1033,20 @@ impl<'a, 'b: 'a> CustomPropertiesBuilder<'a, 'b> {
             return;
         }
 
+        let registration = self.stylist.get_custom_property_registration(&name);
+        if !registration.syntax.is_universal()
+            || matches!(value, CustomDeclarationValue::Parsed(..))
+        {
+            // Computing registered values depends on the rest of the computed context, so we can't
+            // reuse the result for other elements.
+            self.cacheable = false;
+        }
+
         if !self.value_may_affect_style(name, value) {
             return;
         }
 
         let map = &mut self.custom_properties;
-        let registration = self.stylist.get_custom_property_registration(&name);
         match value {
             CustomDeclarationValue::Unparsed(unparsed_value) => {
                 // At this point of the cascade we're not guaranteed to have seen the color-scheme
@@ -1147,6 +1166,10 @@ impl<'a, 'b: 'a> CustomPropertiesBuilder<'a, 'b> {
             _ => return,
         };
 
+        // Whether the non-custom properties end up invalid depends on the whole dependency
+        // graph, which we don't cache.
+        self.cacheable = false;
+
         let variables: Vec<Atom> = refs
             .refs
             .iter()
@@ -1358,6 +1381,19 @@ impl<'a, 'b: 'a> CustomPropertiesBuilder<'a, 'b> {
             },
         };
 
+        if self.cacheable
+            && deferred_custom_properties
+                .as_ref()
+                .map_or(true, |d| d.is_empty())
+        {
+            let inherited = self.computed_context.inherited_custom_properties().clone();
+            let is_root_element = self.computed_context.is_root_element();
+            self.computed_context
+                .rule_cache_conditions
+                .borrow_mut()
+                .set_custom_properties_cacheable(inherited, is_root_element);
+        }
+
         deferred_custom_properties
     }
 
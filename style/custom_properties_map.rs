@@ -155,6 +155,12 @@ impl CustomPropertiesMap {
         self.0.is_empty()
     }
 
+    /// Returns whether both maps share the same storage, which implies they're equal.
+    #[inline]
+    pub fn ptr_eq(&self, other: &Self) -> bool {
+        Arc::ptr_eq(&self.0, &other.0)
+    }
+
     /// Returns the amount of different properties in the map.
     pub fn len(&self) -> usize {
         self.0.len()
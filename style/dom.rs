@@ -8,6 +8,7 @@
 #![deny(missing_docs)]
 
 use crate::applicable_declarations::ApplicableDeclarationBlock;
+use crate::bloom::subtree_summary_contribution;
 use crate::context::SharedStyleContext;
 #[cfg(feature = "gecko")]
 use crate::context::UpdateAnimationsTasks;
@@ -23,6 +24,7 @@ use crate::values::AtomIdent;
 use crate::{LocalName, WeakAtom};
 use atomic_refcell::{AtomicRef, AtomicRefMut};
 use dom::ElementState;
+use selectors::bloom::SubtreeSummary;
 use selectors::matching::{ElementSelectorFlags, QuirksMode, VisitedHandlingMode};
 use selectors::sink::Push;
 use selectors::{Element as SelectorsElement, OpaqueElement};
@@ -130,6 +132,36 @@ pub trait TDocument: Sized + Copy + Clone {
         Err(())
     }
 
+    /// Get a list of elements with a given class in this document, sorted by
+    /// tree position. Class names are compared case-sensitively.
+    ///
+    /// Can return an error to signal that this list is not available, or also
+    /// return an empty slice.
+    fn elements_with_class<'a>(
+        &self,
+        _class: &AtomIdent,
+    ) -> Result<&'a [<Self::ConcreteNode as TNode>::ConcreteElement], ()>
+    where
+        Self: 'a,
+    {
+        Err(())
+    }
+
+    /// Get a list of elements with a given attribute in no namespace in this
+    /// document, sorted by tree position.
+    ///
+    /// Can return an error to signal that this list is not available, or also
+    /// return an empty slice.
+    fn elements_with_attr<'a>(
+        &self,
+        _name: &LocalName,
+    ) -> Result<&'a [<Self::ConcreteNode as TNode>::ConcreteElement], ()>
+    where
+        Self: 'a,
+    {
+        Err(())
+    }
+
     /// This document's shared lock.
     fn shared_lock(&self) -> &SharedRwLock;
 }
@@ -377,6 +409,36 @@ pub trait TShadowRoot: Sized + Copy + Clone + Debug + PartialEq {
         Err(())
     }
 
+    /// Get a list of elements with a given class in this shadow root, sorted
+    /// by tree position. Class names are compared case-sensitively.
+    ///
+    /// Can return an error to signal that this list is not available, or also
+    /// return an empty slice.
+    fn elements_with_class<'a>(
+        &self,
+        _class: &AtomIdent,
+    ) -> Result<&'a [<Self::ConcreteNode as TNode>::ConcreteElement], ()>
+    where
+        Self: 'a,
+    {
+        Err(())
+    }
+
+    /// Get a list of elements with a given attribute in no namespace in this
+    /// shadow root, sorted by tree position.
+    ///
+    /// Can return an error to signal that this list is not available, or also
+    /// return an empty slice.
+    fn elements_with_attr<'a>(
+        &self,
+        _name: &LocalName,
+    ) -> Result<&'a [<Self::ConcreteNode as TNode>::ConcreteElement], ()>
+    where
+        Self: 'a,
+    {
+        Err(())
+    }
+
     /// Get the implicit scope for a stylesheet in given index.
     fn implicit_scope_for_sheet(&self, _sheet_index: usize) -> Option<ImplicitScopeRoot> {
         None
@@ -915,6 +977,100 @@ pub trait TElement:
     fn compute_layout_damage(_old: &ComputedValues, _new: &ComputedValues) -> RestyleDamage {
         Default::default()
     }
+
+    /// Stores the subtree summary of this element, as later returned by
+    /// `SelectorsElement::subtree_summary`, or forgets it if `None`.
+    ///
+    /// DOMs that keep subtree summaries need to implement both, and call
+    /// `update_subtree_summaries_after_insertion` and
+    /// `update_subtree_summaries_after_removal` as the tree mutates.
+    ///
+    /// Summaries are maintained bottom-up, and all or nothing: an element can
+    /// only have a summary if all its element children have one, since an
+    /// element without a summary is an unknown subtree. The hooks below keep
+    /// that up, forgetting the summaries of all the ancestors of an element
+    /// without one.
+    ///
+    /// # Safety
+    ///
+    /// This must not be called during a traversal, or while anything else
+    /// may be matching selectors against the tree. Callers other than the
+    /// hooks below must keep the summary a superset of the hashes of all the
+    /// descendants, and must not give an element a summary if any of its
+    /// element children has none, or `:has()` may wrongly reject the element.
+    unsafe fn set_subtree_summary(&self, _summary: Option<SubtreeSummary>) {}
+
+    /// Forgets the subtree summaries of this element and all its ancestors,
+    /// for example because a descendant without a summary was inserted.
+    fn invalidate_subtree_summaries(&self) {
+        let mut current = Some(*self);
+        while let Some(element) = current {
+            if element.subtree_summary().is_some() {
+                unsafe { element.set_subtree_summary(None) };
+            }
+            current = element.parent_element();
+        }
+    }
+
+    /// Updates the subtree summaries of the ancestors of this element after it
+    /// has been inserted in the tree, or after it gained an id, class or
+    /// attribute.
+    ///
+    /// Summaries of ancestors always contain the summaries of their
+    /// descendants, so we can stop as soon as an ancestor already has all the
+    /// new hashes. If this element or an ancestor has no summary, the
+    /// summaries of all the ancestors above it are forgotten.
+    fn update_subtree_summaries_after_insertion(&self) {
+        let Some(parent) = self.parent_element() else {
+            return;
+        };
+        let Some(contribution) = subtree_summary_contribution(*self) else {
+            return parent.invalidate_subtree_summaries();
+        };
+        let mut current = Some(parent);
+        while let Some(ancestor) = current {
+            let Some(mut summary) = ancestor.subtree_summary() else {
+                return ancestor.invalidate_subtree_summaries();
+            };
+            if summary.contains_all(&contribution) {
+                break;
+            }
+            summary.union_with(&contribution);
+            unsafe { ancestor.set_subtree_summary(Some(summary)) };
+            current = ancestor.parent_element();
+        }
+    }
+
+    /// Recomputes the subtree summaries of this element and its ancestors
+    /// after a child was removed from it, or after a child lost an id, class
+    /// or attribute.
+    ///
+    /// Summaries can't forget hashes, so this rebuilds them from the children
+    /// of each ancestor, stopping as soon as a summary doesn't change. If an
+    /// element on the way has no summary, or has a child without one, the
+    /// summaries of it and all its ancestors are forgotten.
+    fn update_subtree_summaries_after_removal(&self) {
+        let mut current = Some(*self);
+        while let Some(element) = current {
+            let Some(old_summary) = element.subtree_summary() else {
+                return element.invalidate_subtree_summaries();
+            };
+            let mut summary = SubtreeSummary::new();
+            let mut child = element.first_element_child();
+            while let Some(c) = child {
+                let Some(contribution) = subtree_summary_contribution(c) else {
+                    return element.invalidate_subtree_summaries();
+                };
+                summary.union_with(&contribution);
+                child = c.next_sibling_element();
+            }
+            if summary == old_summary {
+                break;
+            }
+            unsafe { element.set_subtree_summary(Some(summary)) };
+            current = element.parent_element();
+        }
+    }
 }
 
 /// TNode and TElement aren't Send because we want to be careful and explicit
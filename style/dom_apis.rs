@@ -5,6 +5,7 @@
 //! Generic implementations of some DOM APIs so they can be shared between Servo
 //! and Gecko.
 
+use crate::bloom::each_relevant_element_hash;
 use crate::context::QuirksMode;
 use crate::dom::{TDocument, TElement, TNode, TShadowRoot};
 use crate::invalidation::element::invalidation_map::Dependency;
@@ -16,13 +17,16 @@ use crate::selector_parser::SelectorImpl;
 use crate::values::AtomIdent;
 use selectors::attr::CaseSensitivity;
 use selectors::attr::{AttrSelectorOperation, NamespaceConstraint};
+use selectors::bloom::BloomFilter;
 use selectors::matching::{
     self, MatchingContext, MatchingForInvalidation, MatchingMode, NeedsSelectorFlags,
     SelectorCaches,
 };
-use selectors::parser::{Combinator, Component, LocalName};
+use selectors::parser::{AncestorHashes, Combinator, Component, LocalName};
 use selectors::{Element, OpaqueElement, SelectorList};
+use servo_arc::Arc;
 use smallvec::SmallVec;
+use uluru::LRUCache;
 
 /// <https://dom.spec.whatwg.org/#dom-element-matches>
 pub fn element_matches<E>(
@@ -81,6 +85,46 @@ where
     return None;
 }
 
+/// Same as `element_closest`, but with a precompiled plan, which allows
+/// rejecting the whole ancestor chain upfront if the DOM indices prove that no
+/// element can match, and skipping full matching for ancestors without the
+/// key of any selector.
+pub fn element_closest_with_plan<E>(element: E, plan: &QueryPlan) -> Option<E>
+where
+    E: TElement,
+{
+    let quirks_mode = element.as_node().owner_doc().quirks_mode();
+    if plan.rejected_by_indices(
+        element.as_node(),
+        quirks_mode.classes_and_ids_case_sensitivity(),
+    ) {
+        return None;
+    }
+
+    let mut selector_caches = SelectorCaches::default();
+
+    let mut context = MatchingContext::new(
+        MatchingMode::Normal,
+        None,
+        &mut selector_caches,
+        quirks_mode,
+        NeedsSelectorFlags::No,
+        MatchingForInvalidation::No,
+    );
+    context.scope_element = Some(element.opaque());
+    context.current_host = element.containing_shadow_host().map(|e| e.opaque());
+
+    let mut current = Some(element);
+    while let Some(element) = current.take() {
+        if plan.matches(element, None, &mut context) {
+            return Some(element);
+        }
+        current = element.parent_element();
+    }
+
+    None
+}
+
 /// A selector query abstraction, in order to be generic over QuerySelector and
 /// QuerySelectorAll.
 pub trait SelectorQuery<E: TElement> {
@@ -299,6 +343,54 @@ where
     false
 }
 
+/// An index of elements that the DOM may keep for a document or shadow root.
+#[derive(Clone, Copy)]
+enum ElementIndex<'a> {
+    Id(&'a AtomIdent),
+    Class(&'a AtomIdent),
+    Attr(&'a crate::LocalName),
+}
+
+/// Fast path for iterating over every element in a given index of the
+/// document or shadow root that `root` is connected to.
+fn fast_connected_elements_in_index<'a, N>(
+    root: N,
+    index: ElementIndex,
+    class_and_id_case_sensitivity: CaseSensitivity,
+) -> Result<&'a [N::ConcreteElement], ()>
+where
+    N: TNode + 'a,
+{
+    // The id and class indices are case-sensitive.
+    if !matches!(index, ElementIndex::Attr(..))
+        && class_and_id_case_sensitivity != CaseSensitivity::CaseSensitive
+    {
+        return Err(());
+    }
+
+    if root.is_in_document() {
+        let doc = root.owner_doc();
+        return match index {
+            ElementIndex::Id(id) => doc.elements_with_id(id),
+            ElementIndex::Class(class) => doc.elements_with_class(class),
+            ElementIndex::Attr(name) => doc.elements_with_attr(name),
+        };
+    }
+
+    let shadow = match root.as_shadow_root() {
+        Some(shadow) => shadow,
+        None => match root.as_element().and_then(|e| e.containing_shadow()) {
+            Some(shadow) => shadow,
+            None => return Err(()),
+        },
+    };
+    match index {
+        ElementIndex::Id(id) => shadow.elements_with_id(id),
+        ElementIndex::Class(class) => shadow.elements_with_class(class),
+        ElementIndex::Attr(name) => shadow.elements_with_attr(name),
+    }
+}
+
 /// Fast path for iterating over every element with a given id in the document
 /// or shadow root that `root` is connected to.
 fn fast_connected_elements_with_id<'a, N>(
@@ -309,23 +401,90 @@ fn fast_connected_elements_with_id<'a, N>(
 where
     N: TNode + 'a,
 {
-    if case_sensitivity != CaseSensitivity::CaseSensitive {
-        return Err(());
-    }
+    fast_connected_elements_in_index(root, ElementIndex::Id(id), case_sensitivity)
+}
 
-    if root.is_in_document() {
-        return root.owner_doc().elements_with_id(id);
-    }
+/// The maximum number of indexed elements we're willing to go through when
+/// querying the subtree of an element, since checking whether each of them is
+/// a descendant of the root requires walking up the tree.
+const MAX_INDEXED_ELEMENTS_FOR_SUBTREE_QUERY: usize = 64;
+
+/// Whether going through `elements` is cheaper than walking the subtree of
+/// `root`.
+fn should_use_index<N>(root: N, elements: &[N::ConcreteElement]) -> bool
+where
+    N: TNode,
+{
+    root.as_document().is_some()
+        || root.as_shadow_root().is_some()
+        || elements.len() <= MAX_INDEXED_ELEMENTS_FOR_SUBTREE_QUERY
+}
 
-    if let Some(shadow) = root.as_shadow_root() {
-        return shadow.elements_with_id(id);
+/// <https://dom.spec.whatwg.org/#concept-getelementsbyclassname>
+///
+/// Collects the descendants of `root` that have all the given classes. When
+/// the DOM keeps a class index, only the elements with the rarest of the
+/// classes are looked at.
+pub fn elements_by_class_name<E, Q>(
+    root: E::ConcreteNode,
+    classes: &[AtomIdent],
+    results: &mut Q::Output,
+) where
+    E: TElement,
+    Q: SelectorQuery<E>,
+{
+    let case_sensitivity = root
+        .owner_doc()
+        .quirks_mode()
+        .classes_and_ids_case_sensitivity();
+    collect_elements_with_classes::<E, Q>(root, classes, results, case_sensitivity)
+}
+
+/// Collects the descendants of `root` that have all the given classes.
+fn collect_elements_with_classes<E, Q>(
+    root: E::ConcreteNode,
+    classes: &[AtomIdent],
+    results: &mut Q::Output,
+    case_sensitivity: CaseSensitivity,
+) where
+    E: TElement,
+    Q: SelectorQuery<E>,
+{
+    if classes.is_empty() {
+        return;
     }
+    let has_all_classes = |element: E| {
+        classes
+            .iter()
+            .all(|class| element.has_class(class, case_sensitivity))
+    };
 
-    if let Some(shadow) = root.as_element().and_then(|e| e.containing_shadow()) {
-        return shadow.elements_with_id(id);
+    let mut rarest: Option<&[E]> = None;
+    for class in classes {
+        let Ok(elements) =
+            fast_connected_elements_in_index(root, ElementIndex::Class(class), case_sensitivity)
+        else {
+            rarest = None;
+            break;
+        };
+        if rarest.map_or(true, |r| elements.len() < r.len()) {
+            rarest = Some(elements);
+        }
     }
 
-    Err(())
+    let elements = match rarest {
+        Some(elements) if should_use_index(root, elements) => elements,
+        _ => return collect_all_elements::<E, Q, _>(root, results, has_all_classes),
+    };
+    for element in elements {
+        if !connected_element_is_descendant_of(*element, root) || !has_all_classes(*element) {
+            continue;
+        }
+        Q::append_element(results, *element);
+        if Q::should_stop_after_first_match() {
+            return;
+        }
+    }
 }
 
 /// Collects elements with a given id under `root`, that pass `filter`.
@@ -451,9 +610,12 @@ where
         Component::ExplicitUniversalType => {
             collect_all_elements::<E, Q, _>(root, results, |_| true)
         },
-        Component::Class(ref class) => collect_all_elements::<E, Q, _>(root, results, |element| {
-            element.has_class(class, class_and_id_case_sensitivity)
-        }),
+        Component::Class(ref class) => collect_elements_with_classes::<E, Q>(
+            root,
+            std::slice::from_ref(class),
+            results,
+            class_and_id_case_sensitivity,
+        ),
         Component::LocalName(ref local_name) => {
             collect_all_elements::<E, Q, _>(root, results, |element| {
                 local_name_matches(element, local_name)
@@ -511,18 +673,12 @@ where
     Ok(())
 }
 
-enum SimpleFilter<'a> {
-    Class(&'a AtomIdent),
-    Attr(&'a crate::LocalName),
-    LocalName(&'a LocalName<SelectorImpl>),
-}
-
 /// Fast paths for a given selector query.
 ///
 /// When there's only one component, we go directly to
 /// `query_selector_single_query`, otherwise, we try to optimize by looking just
-/// at the subtrees rooted at ids in the selector, and otherwise we try to look
-/// up by class name or local name in the rightmost compound.
+/// at the subtrees rooted at ids in the selector. Other keys in the rightmost
+/// compound are handled by the `QueryPlan`.
 ///
 /// FIXME(emilio, nbp): This may very well be a good candidate for code to be
 /// replaced by HolyJit :)
@@ -561,105 +717,67 @@ where
     let mut iter = selector.iter();
     let mut combinator: Option<Combinator> = None;
 
-    // We want to optimize some cases where there's no id involved whatsoever,
-    // like `.foo .bar`, but we don't want to make `#foo .bar` slower because of
-    // that.
-    let mut simple_filter = None;
-
     'selector_loop: loop {
         debug_assert!(combinator.map_or(true, |c| !c.is_sibling()));
 
         'component_loop: for component in &mut iter {
-            match *component {
-                Component::Class(ref class) => {
-                    if combinator.is_none() {
-                        simple_filter = Some(SimpleFilter::Class(class));
+            if let Some(id) = get_id(component) {
+                if combinator.is_none() {
+                    // In the rightmost compound, just find descendants of root that match
+                    // the selector list with that id.
+                    collect_elements_with_id::<E, Q, _>(
+                        root,
+                        id,
+                        results,
+                        class_and_id_case_sensitivity,
+                        |e| matching::matches_selector_list(selector_list, &e, matching_context),
+                    );
+                    return Ok(());
+                }
+
+                let elements =
+                    fast_connected_elements_with_id(root, id, class_and_id_case_sensitivity)?;
+                if elements.is_empty() {
+                    return Ok(());
+                }
+
+                // Results need to be in document order. Let's not bother
+                // reordering or deduplicating nodes, which we would need to
+                // do if one element with the given id were a descendant of
+                // another element with that given id.
+                if !Q::should_stop_after_first_match() && elements.len() > 1 {
+                    continue;
+                }
+
+                for element in elements {
+                    // If the element is not a descendant of the root, then
+                    // it may have descendants that match our selector that
+                    // _are_ descendants of the root, and other descendants
+                    // that match our selector that are _not_.
+                    //
+                    // So we can't just walk over the element's descendants
+                    // and match the selector against all of them, nor can
+                    // we skip looking at this element's descendants.
+                    //
+                    // Give up on trying to optimize based on this id and
+                    // keep walking our selector.
+                    if !connected_element_is_descendant_of(*element, root) {
+                        continue 'component_loop;
                     }
-                },
-                Component::LocalName(ref local_name) => {
-                    if combinator.is_none() {
-                        // Prefer to look at class rather than local-name if
-                        // both are present.
-                        if let Some(SimpleFilter::Class(..)) = simple_filter {
-                            continue;
-                        }
-                        simple_filter = Some(SimpleFilter::LocalName(local_name));
-                    }
-                },
-                ref other => {
-                    if let Some(id) = get_id(other) {
-                        if combinator.is_none() {
-                            // In the rightmost compound, just find descendants of root that match
-                            // the selector list with that id.
-                            collect_elements_with_id::<E, Q, _>(
-                                root,
-                                id,
-                                results,
-                                class_and_id_case_sensitivity,
-                                |e| {
-                                    matching::matches_selector_list(
-                                        selector_list,
-                                        &e,
-                                        matching_context,
-                                    )
-                                },
-                            );
-                            return Ok(());
-                        }
-
-                        let elements = fast_connected_elements_with_id(
-                            root,
-                            id,
-                            class_and_id_case_sensitivity,
-                        )?;
-                        if elements.is_empty() {
-                            return Ok(());
-                        }
-
-                        // Results need to be in document order. Let's not bother
-                        // reordering or deduplicating nodes, which we would need to
-                        // do if one element with the given id were a descendant of
-                        // another element with that given id.
-                        if !Q::should_stop_after_first_match() && elements.len() > 1 {
-                            continue;
-                        }
-
-                        for element in elements {
-                            // If the element is not a descendant of the root, then
-                            // it may have descendants that match our selector that
-                            // _are_ descendants of the root, and other descendants
-                            // that match our selector that are _not_.
-                            //
-                            // So we can't just walk over the element's descendants
-                            // and match the selector against all of them, nor can
-                            // we skip looking at this element's descendants.
-                            //
-                            // Give up on trying to optimize based on this id and
-                            // keep walking our selector.
-                            if !connected_element_is_descendant_of(*element, root) {
-                                continue 'component_loop;
-                            }
-
-                            query_selector_slow::<E, Q>(
-                                element.as_node(),
-                                selector_list,
-                                results,
-                                matching_context,
-                            );
-
-                            if Q::should_stop_after_first_match() && !Q::is_empty(&results) {
-                                break;
-                            }
-                        }
-
-                        return Ok(());
-                    }
-                    if combinator.is_none() && simple_filter.is_none() {
-                        if let Some(attr_name) = get_attr_name(other) {
-                            simple_filter = Some(SimpleFilter::Attr(attr_name));
-                        }
+
+                    query_selector_slow::<E, Q>(
+                        element.as_node(),
+                        selector_list,
+                        results,
+                        matching_context,
+                    );
+
+                    if Q::should_stop_after_first_match() && !Q::is_empty(&results) {
+                        break;
                     }
-                },
+                }
+
+                return Ok(());
             }
         }
 
@@ -683,35 +801,8 @@ where
         }
     }
 
-    // We got here without finding any ID or such that we could handle. Try to
-    // use one of the simple filters.
-    let simple_filter = match simple_filter {
-        Some(f) => f,
-        None => return Err(()),
-    };
-
-    match simple_filter {
-        SimpleFilter::Class(ref class) => {
-            collect_all_elements::<E, Q, _>(root, results, |element| {
-                element.has_class(class, class_and_id_case_sensitivity)
-                    && matching::matches_selector_list(selector_list, &element, matching_context)
-            });
-        },
-        SimpleFilter::LocalName(ref local_name) => {
-            collect_all_elements::<E, Q, _>(root, results, |element| {
-                local_name_matches(element, local_name)
-                    && matching::matches_selector_list(selector_list, &element, matching_context)
-            });
-        },
-        SimpleFilter::Attr(ref local_name) => {
-            collect_all_elements::<E, Q, _>(root, results, |element| {
-                has_attr(element, local_name)
-                    && matching::matches_selector_list(selector_list, &element, matching_context)
-            });
-        },
-    }
-
-    Ok(())
+    // We got here without finding any ID we could handle.
+    Err(())
 }
 
 // Slow path for a given selector query.
@@ -738,6 +829,372 @@ pub enum MayUseInvalidation {
     No,
 }
 
+/// The most selective simple selector in the rightmost compound of a
+/// selector, which is checked before running the full selector matching.
+#[derive(Clone)]
+enum QueryKey {
+    Id(AtomIdent),
+    Class(AtomIdent),
+    /// An attribute in no namespace, which the DOM may keep an index of.
+    Attr(crate::LocalName),
+    /// An attribute that may be in a namespace, which isn't in the indices.
+    AttrInAnyNamespace(crate::LocalName),
+    LocalName(LocalName<SelectorImpl>),
+}
+
+impl QueryKey {
+    fn from_component(component: &Component<SelectorImpl>) -> Option<Self> {
+        if let Some(id) = get_id(component) {
+            return Some(QueryKey::Id(id.clone()));
+        }
+        match *component {
+            Component::Class(ref class) => Some(QueryKey::Class(class.clone())),
+            Component::LocalName(ref local_name) => Some(QueryKey::LocalName(local_name.clone())),
+            Component::AttributeOther(..) => {
+                get_attr_name(component).map(|name| QueryKey::AttrInAnyNamespace(name.clone()))
+            },
+            ref other => get_attr_name(other).map(|name| QueryKey::Attr(name.clone())),
+        }
+    }
+
+    /// How selective this key usually is. Lower is better.
+    fn rank(&self) -> u8 {
+        match *self {
+            QueryKey::Id(..) => 0,
+            QueryKey::Class(..) => 1,
+            QueryKey::Attr(..) | QueryKey::AttrInAnyNamespace(..) => 2,
+            QueryKey::LocalName(..) => 3,
+        }
+    }
+
+    fn index(&self) -> Option<ElementIndex> {
+        Some(match *self {
+            QueryKey::Id(ref id) => ElementIndex::Id(id),
+            QueryKey::Class(ref class) => ElementIndex::Class(class),
+            QueryKey::Attr(ref name) => ElementIndex::Attr(name),
+            QueryKey::AttrInAnyNamespace(..) | QueryKey::LocalName(..) => return None,
+        })
+    }
+
+    #[inline]
+    fn matches<E>(&self, element: E, class_and_id_case_sensitivity: CaseSensitivity) -> bool
+    where
+        E: TElement,
+    {
+        match *self {
+            QueryKey::Id(ref id) => element.has_id(id, class_and_id_case_sensitivity),
+            QueryKey::Class(ref class) => element.has_class(class, class_and_id_case_sensitivity),
+            QueryKey::Attr(ref name) | QueryKey::AttrInAnyNamespace(ref name) => {
+                has_attr(element, name)
+            },
+            QueryKey::LocalName(ref local_name) => local_name_matches(element, local_name),
+        }
+    }
+}
+
+struct SelectorPlan {
+    /// The key that an element needs to match for this selector to match, if
+    /// any.
+    key: Option<QueryKey>,
+    /// The hashes of the ancestors this selector requires, to reject elements
+    /// with the bloom filter.
+    hashes: AncestorHashes,
+}
+
+impl SelectorPlan {
+    fn new(selector: &selectors::parser::Selector<SelectorImpl>, quirks_mode: QuirksMode) -> Self {
+        let mut key: Option<QueryKey> = None;
+        // Only the rightmost compound is relevant for the key, the ancestor
+        // compounds are taken care of by the bloom filter.
+        for component in selector.iter() {
+            let Some(candidate) = QueryKey::from_component(component) else {
+                continue;
+            };
+            if key.as_ref().map_or(true, |k| candidate.rank() < k.rank()) {
+                key = Some(candidate);
+            }
+        }
+        Self {
+            key,
+            hashes: AncestorHashes::new(selector, quirks_mode),
+        }
+    }
+
+    fn has_ancestor_hashes(&self) -> bool {
+        self.hashes.packed_hashes[0] != 0
+    }
+}
+
+/// A selector list compiled for querySelector and querySelectorAll.
+///
+/// For each selector, the plan picks the most selective key of the rightmost
+/// compound (id, then class, then attribute, then local name), and the
+/// ancestor hashes that the descendant walk checks against a bloom filter of
+/// the ancestors of each element. Elements only go through full selector
+/// matching if they pass both.
+pub struct QueryPlan {
+    selector_list: SelectorList<SelectorImpl>,
+    selectors: SmallVec<[SelectorPlan; 1]>,
+    quirks_mode: QuirksMode,
+}
+
+impl QueryPlan {
+    /// Compiles a plan for the given selector list.
+    pub fn new(selector_list: SelectorList<SelectorImpl>, quirks_mode: QuirksMode) -> Self {
+        let selectors = selector_list
+            .slice()
+            .iter()
+            .map(|selector| SelectorPlan::new(selector, quirks_mode))
+            .collect();
+        Self {
+            selector_list,
+            selectors,
+            quirks_mode,
+        }
+    }
+
+    /// Returns the selector list this plan was compiled from.
+    pub fn selector_list(&self) -> &SelectorList<SelectorImpl> {
+        &self.selector_list
+    }
+
+    fn has_ancestor_hashes(&self) -> bool {
+        self.selectors.iter().any(|s| s.has_ancestor_hashes())
+    }
+
+    /// Whether every selector has a key, so that most elements are rejected
+    /// without full selector matching. Otherwise, the invalidation machinery
+    /// may do better for selectors with combinators.
+    fn is_useful(&self) -> bool {
+        self.selectors.iter().all(|s| s.key.is_some())
+    }
+
+    #[inline]
+    fn matches<E>(
+        &self,
+        element: E,
+        ancestor_filter: Option<&BloomFilter>,
+        matching_context: &mut MatchingContext<E::Impl>,
+    ) -> bool
+    where
+        E: TElement,
+    {
+        let class_and_id_case_sensitivity = matching_context.classes_and_ids_case_sensitivity();
+        self.selectors
+            .iter()
+            .zip(self.selector_list.slice().iter())
+            .any(|(plan, selector)| {
+                if let Some(ref key) = plan.key {
+                    if !key.matches(element, class_and_id_case_sensitivity) {
+                        return false;
+                    }
+                }
+                if let Some(filter) = ancestor_filter {
+                    if !matching::selector_may_match(&plan.hashes, filter) {
+                        return false;
+                    }
+                }
+                matching::matches_selector(selector, 0, None, &element, matching_context)
+            })
+    }
+}
+
+impl QueryPlan {
+    /// Whether the DOM indices prove that no connected element in the tree of
+    /// `node` can match this plan.
+    fn rejected_by_indices<N>(
+        &self,
+        node: N,
+        class_and_id_case_sensitivity: CaseSensitivity,
+    ) -> bool
+    where
+        N: TNode,
+    {
+        self.selectors.iter().all(|plan| {
+            plan.key
+                .as_ref()
+                .and_then(|key| key.index())
+                .and_then(|index| {
+                    fast_connected_elements_in_index(node, index, class_and_id_case_sensitivity)
+                        .ok()
+                })
+                .map_or(false, |elements| elements.is_empty())
+        })
+    }
+}
+
+/// Collects the descendants of `root` that match `plan` from the DOM index of
+/// the key of its only selector, if the DOM keeps one.
+fn collect_with_plan_from_index<E, Q>(
+    root: E::ConcreteNode,
+    plan: &QueryPlan,
+    results: &mut Q::Output,
+    matching_context: &mut MatchingContext<E::Impl>,
+) -> Result<(), ()>
+where
+    E: TElement,
+    Q: SelectorQuery<E>,
+{
+    // We'd need to merge the results of multiple indices in tree order
+    // otherwise.
+    if plan.selectors.len() != 1 {
+        return Err(());
+    }
+    let index = plan.selectors[0]
+        .key
+        .as_ref()
+        .and_then(|key| key.index())
+        .ok_or(())?;
+    let elements = fast_connected_elements_in_index(
+        root,
+        index,
+        matching_context.classes_and_ids_case_sensitivity(),
+    )?;
+    if !should_use_index(root, elements) {
+        return Err(());
+    }
+    for element in elements {
+        if !connected_element_is_descendant_of(*element, root) {
+            continue;
+        }
+        if !plan.matches(*element, None, matching_context) {
+            continue;
+        }
+        Q::append_element(results, *element);
+        if Q::should_stop_after_first_match() {
+            break;
+        }
+    }
+    Ok(())
+}
+
+/// Walks the descendants of `root` in tree order, collecting the ones that
+/// match `plan`.
+///
+/// If the plan has ancestor hashes, this keeps a bloom filter of the ancestors
+/// of the current element up to date as we go down and up the tree.
+fn collect_with_plan<E, Q>(
+    root: E::ConcreteNode,
+    plan: &QueryPlan,
+    results: &mut Q::Output,
+    matching_context: &mut MatchingContext<E::Impl>,
+) where
+    E: TElement,
+    Q: SelectorQuery<E>,
+{
+    // Only use the filter in the light tree of the document, where the
+    // ancestors that selectors can match are exactly the parent elements.
+    let mut ancestor_filter =
+        if plan.has_ancestor_hashes() && matching_context.current_host.is_none() {
+            let mut filter = Box::new(BloomFilter::new());
+            // Selectors can match ancestors of the root too.
+            let mut ancestor = root.as_element();
+            while let Some(element) = ancestor {
+                each_relevant_element_hash(element, |hash| filter.insert_hash(hash));
+                ancestor = element.parent_element();
+            }
+            Some(filter)
+        } else {
+            None
+        };
+
+    // The nodes we descended into, along with the number of hashes they added
+    // to the filter.
+    let mut parents: SmallVec<[(E::ConcreteNode, usize); 16]> = SmallVec::new();
+    let mut pushed_hashes: SmallVec<[u32; 64]> = SmallVec::new();
+
+    let mut current = root.first_child();
+    while let Some(node) = current {
+        if let Some(element) = node.as_element() {
+            if plan.matches(element, ancestor_filter.as_deref(), matching_context) {
+                Q::append_element(results, element);
+                if Q::should_stop_after_first_match() {
+                    return;
+                }
+            }
+
+            if let Some(first_child) = node.first_child() {
+                let mut count = 0;
+                if let Some(ref mut filter) = ancestor_filter {
+                    each_relevant_element_hash(element, |hash| {
+                        filter.insert_hash(hash);
+                        pushed_hashes.push(hash);
+                        count += 1;
+                    });
+                }
+                parents.push((node, count));
+                current = Some(first_child);
+                continue;
+            }
+        }
+
+        // Move to the next sibling, going up the tree as needed.
+        let mut node = node;
+        current = loop {
+            if let Some(next) = node.next_sibling() {
+                break Some(next);
+            }
+            let Some((parent, count)) = parents.pop() else {
+                break None;
+            };
+            if let Some(ref mut filter) = ancestor_filter {
+                for hash in pushed_hashes.drain(pushed_hashes.len() - count..) {
+                    filter.remove_hash(hash);
+                }
+            }
+            node = parent;
+        };
+    }
+}
+
+/// The number of compiled query plans we keep per cache.
+const QUERY_PLAN_CACHE_SIZE: usize = 32;
+
+struct QueryPlanCacheEntry {
+    text: Box<str>,
+    plan: Arc<QueryPlan>,
+}
+
+/// A cache of compiled query plans keyed by selector text, meant to be kept
+/// per document so that repeated querySelector calls skip both parsing and
+/// compilation.
+#[derive(Default)]
+pub struct QueryPlanCache {
+    entries: LRUCache<QueryPlanCacheEntry, QUERY_PLAN_CACHE_SIZE>,
+}
+
+impl QueryPlanCache {
+    /// Returns the plan for `text`, parsing and compiling it with `parse` if
+    /// it's not in the cache.
+    pub fn get_or_compile<F, Error>(
+        &mut self,
+        text: &str,
+        quirks_mode: QuirksMode,
+        parse: F,
+    ) -> Result<Arc<QueryPlan>, Error>
+    where
+        F: FnOnce(&str) -> Result<SelectorList<SelectorImpl>, Error>,
+    {
+        if let Some(entry) = self
+            .entries
+            .find(|entry| &*entry.text == text && entry.plan.quirks_mode == quirks_mode)
+        {
+            return Ok(entry.plan.clone());
+        }
+        let plan = Arc::new(QueryPlan::new(parse(text)?, quirks_mode));
+        self.entries.insert(QueryPlanCacheEntry {
+            text: text.into(),
+            plan: plan.clone(),
+        });
+        Ok(plan)
+    }
+
+    /// Drops all the cached plans.
+    pub fn clear(&mut self) {
+        self.entries.clear();
+    }
+}
+
 /// <https://dom.spec.whatwg.org/#dom-parentnode-queryselector>
 pub fn query_selector<E, Q>(
     root: E::ConcreteNode,
@@ -747,11 +1204,45 @@ pub fn query_selector<E, Q>(
 ) where
     E: TElement,
     Q: SelectorQuery<E>,
+{
+    query_selector_internal::<E, Q>(root, selector_list, None, results, may_use_invalidation)
+}
+
+/// Same as `query_selector`, but with a precompiled plan, usually from a
+/// `QueryPlanCache`.
+pub fn query_selector_with_plan<E, Q>(
+    root: E::ConcreteNode,
+    plan: &QueryPlan,
+    results: &mut Q::Output,
+    may_use_invalidation: MayUseInvalidation,
+) where
+    E: TElement,
+    Q: SelectorQuery<E>,
+{
+    query_selector_internal::<E, Q>(
+        root,
+        &plan.selector_list,
+        Some(plan),
+        results,
+        may_use_invalidation,
+    )
+}
+
+fn query_selector_internal<E, Q>(
+    root: E::ConcreteNode,
+    selector_list: &SelectorList<E::Impl>,
+    plan: Option<&QueryPlan>,
+    results: &mut Q::Output,
+    may_use_invalidation: MayUseInvalidation,
+) where
+    E: TElement,
+    Q: SelectorQuery<E>,
 {
     use crate::invalidation::element::invalidator::TreeStyleInvalidator;
 
     let mut selector_caches = SelectorCaches::default();
     let quirks_mode = root.owner_doc().quirks_mode();
+    debug_assert!(plan.map_or(true, |p| p.quirks_mode == quirks_mode));
 
     let mut matching_context = MatchingContext::new(
         MatchingMode::Normal,
@@ -775,8 +1266,18 @@ pub fn query_selector<E, Q>(
         return;
     }
 
-    // Slow path: Use the invalidation machinery if we're a root, and tree
-    // traversal otherwise.
+    let compiled_plan;
+    let plan = match plan {
+        Some(plan) => plan,
+        None => {
+            compiled_plan = QueryPlan::new(selector_list.clone(), quirks_mode);
+            &compiled_plan
+        },
+    };
+
+    // Slow path: Walk the tree with the plan if it has a key for every
+    // selector. Otherwise, use the invalidation machinery if we're a root, and
+    // tree traversal otherwise.
     //
     // See the comment in collect_invalidations to see why only if we're a root.
     //
@@ -790,8 +1291,12 @@ pub fn query_selector<E, Q>(
     let invalidation_may_be_useful = may_use_invalidation == MayUseInvalidation::Yes
         && selector_list.slice().iter().any(|s| s.len() > 2);
 
-    if root_element.is_some() || !invalidation_may_be_useful {
-        query_selector_slow::<E, Q>(root, selector_list, results, &mut matching_context);
+    if collect_with_plan_from_index::<E, Q>(root, plan, results, &mut matching_context).is_ok() {
+        return;
+    }
+
+    if root_element.is_some() || !invalidation_may_be_useful || plan.is_useful() {
+        collect_with_plan::<E, Q>(root, plan, results, &mut matching_context);
     } else {
         let dependencies = selector_list
             .slice()
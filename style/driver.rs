@@ -7,6 +7,7 @@
 
 #![deny(missing_docs)]
 
+use crate::cascade_profiler;
 use crate::context::{PerThreadTraversalStatistics, StyleContext};
 use crate::context::{ThreadLocalStyleContext, TraversalStatistics};
 use crate::dom::{SendNode, TElement, TNode};
@@ -99,9 +100,15 @@ where
     let root = token
         .traversal_root()
         .expect("Should've ensured we needed to traverse");
+    let _span = style_span!("traverse_dom", parallel = pool.is_some());
 
     let report_stats = should_report_statistics();
     let dump_stats = traversal.shared_context().options.dump_style_statistics;
+    let profiling = traversal
+        .shared_context()
+        .options
+        .profile_cascade
+        .then(cascade_profiler::ProfilingScope::new);
     let start_time = if dump_stats {
         Some(Instant::now())
     } else {
@@ -147,6 +154,14 @@ where
         );
     });
 
+    // Take the samples of this traversal even if they aren't reported, so
+    // that they don't accumulate in the global profile, and stop profiling.
+    let cascade_profile = profiling.map(|scope| {
+        let profile = cascade_profiler::take();
+        drop(scope);
+        profile
+    });
+
     // Collect statistics from thread-locals if requested.
     if dump_stats || report_stats {
         let mut aggregate = PerThreadTraversalStatistics::default();
@@ -162,8 +177,9 @@ where
         // dump statistics to stdout if requested
         if dump_stats {
             let parallel = pool.is_some();
-            let stats =
+            let mut stats =
                 TraversalStatistics::new(aggregate, traversal, parallel, start_time.unwrap());
+            stats.cascade_profile = cascade_profile;
             if stats.is_large {
                 println!("{}", stats);
             }
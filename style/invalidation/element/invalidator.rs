@@ -471,6 +471,7 @@ where
     /// Perform the invalidation pass.
     pub fn invalidate(mut self) -> InvalidationResult {
         debug!("StyleTreeInvalidator::invalidate({:?})", self.element);
+        let _span = style_span!("TreeStyleInvalidator::invalidate");
 
         let mut self_invalidations = InvalidationVector::new();
         let mut descendant_invalidations = DescendantInvalidationLists::default();
@@ -186,6 +186,10 @@ impl StylesheetInvalidationSet {
             document_element,
             snapshots.is_some()
         );
+        let _span = style_span!(
+            "StylesheetInvalidationSet::flush",
+            fully_invalid = self.fully_invalid,
+        );
         let have_invalidations = match document_element {
             Some(e) => self.process_invalidations(e, snapshots),
             None => false,
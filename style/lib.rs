@@ -80,9 +80,11 @@ extern crate to_shmem_derive;
 mod macros;
 
 pub mod applicable_declarations;
+pub mod atom_cache;
 pub mod author_styles;
 pub mod bezier;
 pub mod bloom;
+pub mod cascade_profiler;
 pub mod color;
 #[path = "properties/computed_value_flags.rs"]
 pub mod computed_value_flags;
@@ -117,6 +119,7 @@ pub mod rule_collector;
 pub mod rule_tree;
 pub mod scoped_tls;
 pub mod selector_map;
+pub mod selector_match_stats;
 pub mod selector_parser;
 pub mod shared_lock;
 pub mod sharing;
@@ -128,6 +131,7 @@ pub mod stylesheet_set;
 pub mod stylesheets;
 pub mod stylist;
 pub mod thread_state;
+pub mod trace_spans;
 pub mod traversal;
 pub mod traversal_flags;
 pub mod use_counters;
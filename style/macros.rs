@@ -62,6 +62,41 @@ macro_rules! local_name {
     };
 }
 
+/// Enters a trace-level `tracing` span with the given name and fields, and
+/// returns a guard which exits it when dropped. Fields declared as
+/// `tracing::field::Empty` can be filled in later with `style_span_record!`.
+///
+/// Without the `tracing` feature this evaluates none of its arguments and
+/// returns a zero-sized guard.
+macro_rules! style_span {
+    ($name:expr $(, $field:ident = $value:expr)* $(,)?) => {{
+        #[cfg(feature = "tracing")]
+        let span = ::tracing::trace_span!(target: "style", $name $(, $field = $value)*).entered();
+        #[cfg(not(feature = "tracing"))]
+        let span = $crate::trace_spans::EnteredSpan;
+        span
+    }};
+}
+
+/// Records the value of a field of a span entered with `style_span!`.
+///
+/// Like `style_span!`, without the `tracing` feature this evaluates none of
+/// its arguments other than the span.
+macro_rules! style_span_record {
+    ($span:expr, $field:literal, $value:expr) => {{
+        #[cfg(feature = "tracing")]
+        {
+            $span.record($field, $value);
+        }
+        // The value is only mentioned in a closure that is never called, so
+        // that the variables it uses don't end up unused.
+        #[cfg(not(feature = "tracing"))]
+        {
+            let _ = (&$span, || $value);
+        }
+    }};
+}
+
 /// Asserts the size of a type at compile time.
 macro_rules! size_of_test {
     ($t: ty, $expected_size: expr) => {
@@ -716,12 +716,7 @@ trait PrivateMatchMethods: TElement {
 
         let key = AnimationSetKey::new(self.as_node().opaque(), pseudo_element);
         let shared_context = context.shared;
-        let mut animation_set = shared_context
-            .animations
-            .sets
-            .write()
-            .remove(&key)
-            .unwrap_or_default();
+        let mut animation_set = shared_context.animations.take(&key).unwrap_or_default();
 
         // Starting animations is expensive, because we have to recalculate the style
         // for all the keyframes. We only want to do this if we think that there's a
@@ -764,11 +759,7 @@ trait PrivateMatchMethods: TElement {
         let changed_animations = animation_set.dirty;
         if !animation_set.is_empty() {
             animation_set.dirty = false;
-            shared_context
-                .animations
-                .sets
-                .write()
-                .insert(key, animation_set);
+            shared_context.animations.insert(key, animation_set);
         }
 
         changed_animations
@@ -22,6 +22,7 @@
 
 #![deny(missing_docs)]
 
+use crate::cascade_profiler;
 use crate::context::{StyleContext, ThreadLocalStyleContext};
 use crate::dom::{OpaqueNode, SendNode, TElement};
 use crate::scoped_tls::ScopedTLS;
@@ -152,6 +153,13 @@ pub fn style_trees<'a, 'scope, E, D>(
         static_prefs::pref!("layout.css.stylo-local-work-queue.in-worker")
     } as usize;
 
+    let span = style_span!(
+        "style_trees",
+        thread = tls.current_thread_index(),
+        elements = tracing::field::Empty,
+    );
+    let elements_traversed_before = context.thread_local.statistics.elements_traversed;
+
     let mut nodes_remaining_at_current_depth = discovered.len();
     while let Some(node) = discovered.pop_front() {
         let mut children_to_process = 0isize;
@@ -192,4 +200,14 @@ pub fn style_trees<'a, 'scope, E, D>(
             nodes_remaining_at_current_depth = discovered.len();
         }
     }
+
+    style_span_record!(
+        span,
+        "elements",
+        context.thread_local.statistics.elements_traversed - elements_traversed_before
+    );
+
+    // Publish the samples of this unit of work, if we're profiling, since
+    // worker-thread-local state is unreachable from the driver.
+    cascade_profiler::flush_thread_local();
 }
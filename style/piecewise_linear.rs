@@ -7,7 +7,6 @@ use crate::values::computed::Percentage;
 use core::slice::Iter;
 /// draft as in https://github.com/w3c/csswg-drafts/pull/6533.
 use euclid::approxeq::ApproxEq;
-use itertools::Itertools;
 use std::fmt::{self, Write};
 use style_traits::{CssWriter, ToCss};
 
@@ -126,15 +125,14 @@ impl PiecewiseLinearFunction {
         }
 
         // Now we know the input sits within the domain explicitly defined by our function.
-        for (point_b, point_a) in self.entries.iter().rev().tuple_windows() {
-            // Need to let point A be the _last_ point where its x is less than the input x,
-            // hence the reverse traversal.
-            if x < point_a.x {
-                continue;
-            }
-            return Self::interpolate(x, *point_a, *point_b, point_a);
-        }
-        unreachable!("Input is supposed to be within the entries' min & max!");
+        // Need to let point A be the _last_ point where its x is less than the input x. The
+        // entries are sorted by x, so binary search for it, as functions with many stops are
+        // evaluated on every animation tick.
+        let index = self.entries.partition_point(|entry| entry.x <= x);
+        debug_assert!(index > 0 && index < self.entries.len());
+        let point_a = self.entries[index - 1];
+        let point_b = self.entries[index];
+        Self::interpolate(x, point_a, point_b, &point_a)
     }
 
     #[allow(missing_docs)]
@@ -279,3 +277,111 @@ impl PiecewiseLinearFunctionBuilder {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Builds a function from `(y, x)` stops.
+    fn function(stops: &[(ValueType, ValueType)]) -> PiecewiseLinearFunction {
+        let mut builder = PiecewiseLinearFunctionBuilder::with_capacity(stops.len());
+        for &(y, x) in stops {
+            builder.push(y, Some(x));
+        }
+        builder.build()
+    }
+
+    fn check(function: &PiecewiseLinearFunction, cases: &[(ValueType, ValueType)]) {
+        for &(x, expected) in cases {
+            let actual = function.at(x);
+            assert!(
+                actual.approx_eq(&expected),
+                "at({}): {} != {}",
+                x,
+                actual,
+                expected
+            );
+        }
+    }
+
+    /// The point A of the spec found by scanning the stops backwards, as `at` did before it
+    /// searched them.
+    fn at_by_scan(function: &PiecewiseLinearFunction, x: ValueType) -> ValueType {
+        let entries = &function.entries;
+        for i in (0..entries.len() - 1).rev() {
+            if x >= entries[i].x {
+                let (a, b) = (entries[i], entries[i + 1]);
+                return PiecewiseLinearFunction::interpolate(x, a, b, &a);
+            }
+        }
+        unreachable!()
+    }
+
+    #[test]
+    fn boundaries() {
+        let triangle = function(&[(0.0, 0.0), (1.0, 0.5), (0.0, 1.0)]);
+        check(
+            &triangle,
+            &[(0.0, 0.0), (0.25, 0.5), (0.5, 1.0), (0.75, 0.5), (1.0, 0.0)],
+        );
+    }
+
+    #[test]
+    fn duplicate_inputs() {
+        // A jump in the middle takes the value of the last stop at the input.
+        let jump = function(&[(0.0, 0.0), (0.5, 0.5), (1.0, 0.5), (1.0, 1.0)]);
+        check(
+            &jump,
+            &[(0.25, 0.25), (0.499, 0.499), (0.5, 1.0), (0.75, 1.0)],
+        );
+
+        // Three stops at the same input.
+        let steps = function(&[(0.0, 0.0), (0.2, 0.5), (0.4, 0.5), (0.6, 0.5), (1.0, 1.0)]);
+        check(&steps, &[(0.25, 0.1), (0.5, 0.6), (0.75, 0.8)]);
+
+        // Duplicate stops at the ends extend flat.
+        let flat = function(&[(0.0, 0.0), (0.5, 0.0), (0.5, 1.0), (1.0, 1.0)]);
+        check(
+            &flat,
+            &[(-0.5, 0.5), (0.0, 0.5), (0.5, 0.5), (1.0, 1.0), (1.5, 1.0)],
+        );
+    }
+
+    #[test]
+    fn out_of_range_progress() {
+        let triangle = function(&[(0.0, 0.0), (1.0, 0.5), (0.0, 1.0)]);
+        // The first and last segments extend to infinity.
+        check(&triangle, &[(-0.5, -1.0), (1.5, -1.0)]);
+        check(
+            &triangle,
+            &[
+                (ValueType::INFINITY, 1.0),
+                (ValueType::NEG_INFINITY, 0.0),
+                (ValueType::NAN, 0.0),
+            ],
+        );
+
+        // Stops that don't cover [0, 1] are extended too.
+        let partial = function(&[(0.0, 0.25), (1.0, 0.75)]);
+        check(&partial, &[(0.0, -0.5), (0.5, 0.5), (1.0, 1.5)]);
+    }
+
+    #[test]
+    fn search_matches_scan() {
+        let mut stops = Vec::new();
+        for i in 0..32 {
+            let x = (i / 3) as ValueType / 10.0;
+            let y = ((i * 7) % 11) as ValueType / 10.0;
+            stops.push((y, x));
+        }
+        let many = function(&stops);
+        let last = many.entries.last().unwrap().x;
+        for i in 0..=200 {
+            let x = i as ValueType / 200.0 * last;
+            if x < many.entries[0].x || x >= last {
+                continue;
+            }
+            assert_eq!(many.at(x), at_by_scan(&many, x), "at({})", x);
+        }
+    }
+}
@@ -39,7 +39,10 @@ def main():
     ]:
         abort(usage)
 
-    properties = data.PropertiesData(engine=engine)
+    sparse_style_structs = os.environ.get("STYLO_SPARSE_STYLE_STRUCTS") == "1"
+    properties = data.PropertiesData(
+        engine=engine, sparse_style_structs=sparse_style_structs
+    )
     properties_template = os.path.join(BASE, "properties.mako.rs")
     properties_file = render(
         properties_template,
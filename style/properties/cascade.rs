@@ -5,6 +5,7 @@
 //! The main cascading algorithm of the style system.
 
 use crate::applicable_declarations::CascadePriority;
+use crate::cascade_profiler;
 use crate::color::AbsoluteColor;
 use crate::computed_value_flags::ComputedValueFlags;
 use crate::custom_properties::{
@@ -20,7 +21,7 @@ use crate::properties::{
     PropertyFlags, ShorthandsWithPropertyReferencesCache, StyleBuilder, CASCADE_PROPERTY,
 };
 use crate::rule_cache::{RuleCache, RuleCacheConditions};
-use crate::rule_tree::{CascadeLevel, StrongRuleNode};
+use crate::rule_tree::{CascadeLevel, StrongRuleNode, StyleSource};
 use crate::selector_parser::PseudoElement;
 use crate::shared_lock::StylesheetGuards;
 use crate::style_adjuster::StyleAdjuster;
@@ -34,6 +35,9 @@ use rustc_hash::FxHashMap;
 use servo_arc::Arc;
 use smallvec::SmallVec;
 use std::borrow::Cow;
+use std::cell::Cell;
+use std::mem;
+use std::time::Instant;
 
 /// Whether we're resolving a style with the purposes of reparenting for ::first-line.
 #[derive(Copy, Clone)]
@@ -178,6 +182,180 @@ impl<'a> Iterator for DeclarationIterator<'a> {
     }
 }
 
+/// A declaration of a `CascadePlan`: the declaration at `index` in the block of the source at
+/// `source` in `CascadePlan::sources`.
+#[derive(Clone, Copy)]
+struct PlanDeclaration {
+    source: u32,
+    index: u32,
+    priority: CascadePriority,
+}
+
+/// A precomputed list of the declarations that may apply for a given rule node.
+///
+/// Walking the rule tree, filtering by importance and gathering the declarations is repeated for
+/// every element that matches a given set of rules, so the rule cache keeps plans around for rule
+/// nodes that get cascaded more than once. Declarations that can't possibly win the cascade are
+/// dropped, so replaying the plan is just a matter of reading the remaining declarations out of
+/// their blocks and applying them against a new parent style.
+///
+/// The plan keeps the declaration blocks alive, and refers to declarations by index, reading the
+/// blocks with the guards of each cascade. Like the rest of the rule cache, a plan must not be
+/// replayed after one of its blocks was mutated, but doing so can't read freed memory: it either
+/// cascades different declarations, or panics if the block shrunk.
+pub struct CascadePlan {
+    /// The declaration blocks of the rule nodes, and the level they were matched at, which
+    /// determines the guard to read them with.
+    sources: Vec<(StyleSource, CascadeLevel)>,
+    /// The longhand declarations, in cascade order.
+    declarations: Vec<(PlanDeclaration, LonghandId)>,
+    /// The custom property declarations, in cascade order.
+    custom_declarations: Vec<PlanDeclaration>,
+    /// All the longhand declarations that custom properties might depend on, including the ones
+    /// that were dropped from `declarations`.
+    non_custom_dependencies: Vec<(LonghandId, PlanDeclaration)>,
+}
+
+impl CascadePlan {
+    /// Gathers the declarations that may apply for `rules`.
+    ///
+    /// This doesn't support property restrictions (so it mustn't be used for pseudo-elements
+    /// that have them), nor ignoring document colors, which can turn a winning declaration into
+    /// a reverted one.
+    pub fn new(rules: &StrongRuleNode, guards: &StylesheetGuards) -> Self {
+        let mut plan = Self {
+            sources: Vec::new(),
+            declarations: Vec::new(),
+            custom_declarations: Vec::new(),
+            non_custom_dependencies: Vec::new(),
+        };
+        // Longhands for which we've already gathered a declaration that is guaranteed to win,
+        // and longhands for which a higher priority declaration might revert, in which case
+        // lower priority declarations might still apply.
+        let mut winners = LonghandIdSet::default();
+        let mut may_revert = LonghandIdSet::default();
+        // Same order as `DeclarationIterator`: from the most specific rule node to the root,
+        // and from the last declaration of each block to the first.
+        let mut node = Some(rules);
+        while let Some(current) = node {
+            node = current.parent();
+            let Some(source) = current.style_source() else {
+                continue;
+            };
+            let priority = current.cascade_priority();
+            let level = priority.cascade_level();
+            let important = level.importance().important();
+            let block = source.read(level.guard(guards));
+            let importance = block.declarations_importance();
+            let source_index = plan.sources.len() as u32;
+            let mut used = false;
+            for (index, declaration) in block.declarations().iter().enumerate().rev() {
+                if importance.get(index) != Some(important) {
+                    continue;
+                }
+                used = true;
+                let entry = PlanDeclaration {
+                    source: source_index,
+                    index: index as u32,
+                    priority,
+                };
+                if let PropertyDeclaration::Custom(..) = *declaration {
+                    plan.custom_declarations.push(entry);
+                    continue;
+                }
+                let id = declaration.id().as_longhand().unwrap();
+                if CustomPropertiesBuilder::might_have_non_custom_dependency(id, declaration) {
+                    plan.non_custom_dependencies.push((id, entry));
+                }
+                if winners.contains(id) {
+                    continue;
+                }
+                // Variable references might resolve to revert / revert-layer too.
+                let reverts = matches!(*declaration, PropertyDeclaration::WithVariables(..))
+                    || matches!(
+                        declaration.get_css_wide_keyword(),
+                        Some(CSSWideKeyword::Revert | CSSWideKeyword::RevertLayer)
+                    );
+                if reverts {
+                    may_revert.insert(id);
+                } else if !may_revert.contains(id) {
+                    winners.insert(id);
+                }
+                plan.declarations.push((entry, id));
+            }
+            if used {
+                plan.sources.push((source.clone(), level));
+            }
+        }
+        plan
+    }
+
+    /// Gathers the longhand declarations of the plan into `declarations`, and cascades the
+    /// custom properties into `custom_builder`, if present.
+    fn replay<'a, 'builder>(
+        &'a self,
+        guards: &'a StylesheetGuards<'a>,
+        declarations: &mut Declarations<'a>,
+        custom_builder: Option<&mut CustomPropertiesBuilder<'builder, 'a>>,
+    ) where
+        'a: 'builder,
+    {
+        let blocks = self
+            .sources
+            .iter()
+            .map(|(source, level)| source.read(level.guard(guards)).declarations())
+            .collect::<SmallVec<[_; 16]>>();
+        let get = |entry: &PlanDeclaration| -> &'a PropertyDeclaration {
+            let block: &'a [PropertyDeclaration] = blocks[entry.source as usize];
+            &block[entry.index as usize]
+        };
+        for (entry, id) in &self.declarations {
+            declarations.note_declaration(get(entry), entry.priority, *id);
+        }
+        if let Some(builder) = custom_builder {
+            for entry in &self.custom_declarations {
+                if let PropertyDeclaration::Custom(ref declaration) = *get(entry) {
+                    builder.cascade(declaration, entry.priority);
+                }
+            }
+            for (id, entry) in &self.non_custom_dependencies {
+                builder.maybe_note_non_custom_dependency(*id, get(entry));
+            }
+        }
+    }
+}
+
+/// Where the declarations to cascade come from.
+enum DeclarationSource<'a, I> {
+    /// An iterator over the declarations, in cascade order.
+    Iter(I),
+    /// A precomputed plan for the rules being cascaded, and the guards to read its declaration
+    /// blocks with.
+    Plan(&'a CascadePlan, &'a StylesheetGuards<'a>),
+}
+
+impl<'a, I> DeclarationSource<'a, I>
+where
+    I: Iterator<Item = (&'a PropertyDeclaration, CascadePriority)>,
+{
+    /// Gathers the longhand declarations into `storage`, and cascades the custom properties into
+    /// `custom_builder`, if present.
+    fn gather<'s, 'builder>(
+        self,
+        storage: &'s mut Declarations<'a>,
+        custom_builder: Option<&mut CustomPropertiesBuilder<'builder, 'a>>,
+    ) -> &'s Declarations<'a>
+    where
+        'a: 's + 'builder,
+    {
+        match self {
+            Self::Iter(iter) => iter_declarations(iter, storage, custom_builder),
+            Self::Plan(plan, guards) => plan.replay(guards, storage, custom_builder),
+        }
+        storage
+    }
+}
+
 fn cascade_rules<E>(
     stylist: &Stylist,
     pseudo: Option<&PseudoElement>,
@@ -195,12 +373,22 @@ fn cascade_rules<E>(
 where
     E: TElement,
 {
-    apply_declarations(
+    let can_use_plan = pseudo.map_or(true, |p| p.property_restriction().is_none())
+        && !stylist.device().forced_colors().is_active();
+    let plan = match rule_cache {
+        Some(rule_cache) if can_use_plan => rule_cache.cascade_plan(rule_node, guards),
+        _ => None,
+    };
+    let source = match plan {
+        Some(ref plan) => DeclarationSource::Plan(plan, guards),
+        None => DeclarationSource::Iter(DeclarationIterator::new(rule_node, guards, pseudo)),
+    };
+    apply_declarations_internal(
         stylist,
         pseudo,
         rule_node,
         guards,
-        DeclarationIterator::new(rule_node, guards, pseudo),
+        source,
         parent_style,
         layout_parent_style,
         first_line_reparenting,
@@ -266,6 +454,42 @@ pub fn apply_declarations<'a, E, I>(
     rule_cache_conditions: &'a mut RuleCacheConditions,
     element: Option<E>,
 ) -> Arc<ComputedValues>
+where
+    E: TElement + 'a,
+    I: Iterator<Item = (&'a PropertyDeclaration, CascadePriority)>,
+{
+    apply_declarations_internal(
+        stylist,
+        pseudo,
+        rules,
+        guards,
+        DeclarationSource::Iter(iter),
+        parent_style,
+        layout_parent_style,
+        first_line_reparenting,
+        cascade_mode,
+        cascade_input_flags,
+        rule_cache,
+        rule_cache_conditions,
+        element,
+    )
+}
+
+fn apply_declarations_internal<'a, E, I>(
+    stylist: &'a Stylist,
+    pseudo: Option<&'a PseudoElement>,
+    rules: &StrongRuleNode,
+    guards: &StylesheetGuards,
+    source: DeclarationSource<'a, I>,
+    parent_style: Option<&'a ComputedValues>,
+    layout_parent_style: Option<&ComputedValues>,
+    first_line_reparenting: FirstLineReparenting<'a>,
+    cascade_mode: CascadeMode,
+    cascade_input_flags: ComputedValueFlags,
+    rule_cache: Option<&'a RuleCache>,
+    rule_cache_conditions: &'a mut RuleCacheConditions,
+    element: Option<E>,
+) -> Arc<ComputedValues>
 where
     E: TElement + 'a,
     I: Iterator<Item = (&'a PropertyDeclaration, CascadePriority)>,
@@ -300,9 +524,13 @@ where
     let using_cached_reset_properties;
     let ignore_colors = context.builder.device.forced_colors().is_active();
     let mut cascade = Cascade::new(first_line_reparenting, ignore_colors);
-    let mut declarations = Default::default();
-    let mut shorthand_cache = ShorthandsWithPropertyReferencesCache::default();
-    let properties_to_apply = match cascade_mode {
+    let reuse_scratch = stylist.cascade_scratch_reuse_enabled();
+    let (mut gathered_declarations, mut shorthand_cache) = if reuse_scratch {
+        CascadeScratch::take()
+    } else {
+        Default::default()
+    };
+    let (declarations, properties_to_apply) = match cascade_mode {
         CascadeMode::Visited { unvisited_context } => {
             context.builder.custom_properties = unvisited_context.builder.custom_properties.clone();
             context.builder.writing_mode = unvisited_context.builder.writing_mode;
@@ -314,24 +542,39 @@ where
             // TODO(bug 1859385): If we match the same rules when visited and unvisited, we could
             // try to avoid gathering the declarations. That'd be:
             //      unvisited_context.builder.rules.as_ref() == Some(rules)
-            iter_declarations(iter, &mut declarations, None);
+            let declarations = source.gather(&mut gathered_declarations, None);
 
-            LonghandIdSet::visited_dependent()
+            (declarations, LonghandIdSet::visited_dependent())
         },
         CascadeMode::Unvisited { visited_rules } => {
-            let deferred_custom_properties = {
-                let mut builder = CustomPropertiesBuilder::new(stylist, &mut context);
-                iter_declarations(iter, &mut declarations, Some(&mut builder));
-                // Detect cycles, remove properties participating in them, and resolve properties, except:
-                // * Registered custom properties that depend on font-relative properties (Resolved)
-                //   when prioritary properties are resolved), and
-                // * Any property that, in turn, depend on properties like above.
-                builder.build(DeferFontRelativeCustomPropertyResolution::Yes)
+            let cached_custom_properties =
+                rule_cache.and_then(|c| c.find_custom_properties(&context.builder));
+            let (declarations, deferred_custom_properties) = match cached_custom_properties {
+                Some(custom_properties) => {
+                    // Another element with the same rules and inherited custom properties already
+                    // resolved them, so we can skip building the dependency graph altogether.
+                    context
+                        .style()
+                        .add_flags(stylist.get_custom_property_initial_values_flags());
+                    context.builder.custom_properties = custom_properties.clone();
+                    (source.gather(&mut gathered_declarations, None), None)
+                },
+                None => {
+                    let mut builder = CustomPropertiesBuilder::new(stylist, &mut context);
+                    let declarations =
+                        source.gather(&mut gathered_declarations, Some(&mut builder));
+                    // Detect cycles, remove properties participating in them, and resolve properties, except:
+                    // * Registered custom properties that depend on font-relative properties (Resolved)
+                    //   when prioritary properties are resolved), and
+                    // * Any property that, in turn, depend on properties like above.
+                    let deferred = builder.build(DeferFontRelativeCustomPropertyResolution::Yes);
+                    (declarations, deferred)
+                },
             };
 
             // Resolve prioritary properties - Guaranteed to not fall into a cycle with existing custom
             // properties.
-            cascade.apply_prioritary_properties(&mut context, &declarations, &mut shorthand_cache);
+            cascade.apply_prioritary_properties(&mut context, declarations, &mut shorthand_cache);
 
             // Resolve the deferred custom properties.
             if let Some(deferred) = deferred_custom_properties {
@@ -355,11 +598,12 @@ where
                 guards,
             );
 
-            if using_cached_reset_properties {
+            let properties_to_apply = if using_cached_reset_properties {
                 LonghandIdSet::late_group_only_inherited()
             } else {
                 LonghandIdSet::late_group()
-            }
+            };
+            (declarations, properties_to_apply)
         },
     };
 
@@ -373,6 +617,9 @@ where
     cascade.finished_applying_properties(&mut context.builder);
 
     std::mem::drop(cascade);
+    if reuse_scratch {
+        CascadeScratch::give_back(gathered_declarations, shorthand_cache);
+    }
 
     context.builder.clear_modified_reset();
 
@@ -585,6 +832,12 @@ struct Declarations<'a> {
 }
 
 impl<'a> Declarations<'a> {
+    fn clear(&mut self) {
+        self.has_prioritary_properties = false;
+        self.longhand_declarations.clear();
+        self.prioritary_positions = Default::default();
+    }
+
     fn note_prioritary_property(&mut self, id: PrioritaryPropertyId) {
         let new_index = self.longhand_declarations.len();
         if new_index >= DeclarationIndex::MAX as usize {
@@ -624,6 +877,50 @@ impl<'a> Declarations<'a> {
     }
 }
 
+/// Storage for the transient data of a cascade, reused by all the cascades of a thread.
+///
+/// With large stylesheets most elements spill the declaration list, so allocating it for every
+/// cascade causes a lot of malloc contention between style threads. Instead, a cascade takes the
+/// storage of its thread, and gives it back cleared, but keeping its capacity. Nested cascades
+/// (like the ones for visited styles) just get empty storage.
+///
+/// This can be turned off with `Stylist::set_cascade_scratch_reuse_enabled`, to compare.
+#[derive(Default)]
+struct CascadeScratch {
+    /// Always empty while stored, so the lifetime doesn't matter.
+    declarations: Declarations<'static>,
+    shorthand_cache: ShorthandsWithPropertyReferencesCache,
+}
+
+thread_local! {
+    static CASCADE_SCRATCH: Cell<CascadeScratch> = Cell::new(Default::default());
+}
+
+impl CascadeScratch {
+    fn take<'a>() -> (Declarations<'a>, ShorthandsWithPropertyReferencesCache) {
+        let scratch = CASCADE_SCRATCH.with(Cell::take);
+        debug_assert!(scratch.declarations.longhand_declarations.is_empty());
+        (scratch.declarations, scratch.shorthand_cache)
+    }
+
+    fn give_back(
+        mut declarations: Declarations,
+        mut shorthand_cache: ShorthandsWithPropertyReferencesCache,
+    ) {
+        declarations.clear();
+        shorthand_cache.clear();
+        // SAFETY: The list is empty, so there are no references left to outlive the cascade.
+        let declarations =
+            unsafe { mem::transmute::<Declarations<'_>, Declarations<'static>>(declarations) };
+        CASCADE_SCRATCH.with(|scratch| {
+            scratch.set(CascadeScratch {
+                declarations,
+                shorthand_cache,
+            })
+        });
+    }
+}
+
 struct Cascade<'b> {
     first_line_reparenting: FirstLineReparenting<'b>,
     ignore_colors: bool,
@@ -846,6 +1143,7 @@ impl<'b> Cascade<'b> {
     ) {
         debug_assert!(!properties_to_apply.contains_any(LonghandIdSet::prioritary_properties()));
         debug_assert!(self.declarations_to_apply_unless_overridden.is_empty());
+        let profile = cascade_profiler::is_enabled();
         for declaration in &*longhand_declarations {
             let mut longhand_id = declaration.decl.id().as_longhand().unwrap();
             if !properties_to_apply.contains(longhand_id) {
@@ -861,6 +1159,7 @@ impl<'b> Cascade<'b> {
                     .set_writing_mode_dependency(wm);
                 longhand_id = longhand_id.to_physical(wm);
             }
+            let start = if profile { Some(Instant::now()) } else { None };
             self.apply_one_longhand(
                 context,
                 longhand_id,
@@ -868,6 +1167,9 @@ impl<'b> Cascade<'b> {
                 declaration.priority,
                 shorthand_cache,
             );
+            if let Some(start) = start {
+                cascade_profiler::record_longhand(longhand_id, start.elapsed());
+            }
         }
         if !self.declarations_to_apply_unless_overridden.is_empty() {
             debug_assert!(self.ignore_colors);
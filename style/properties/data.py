@@ -97,6 +97,32 @@ VISITED_DEPENDENT_PROPERTIES = set(
     ]
 )
 
+# Reset longhands that are very rarely set in practice. When sparse style
+# structs are enabled (servo only), these are stored out of line in their style
+# struct, and only allocated once any of them is set to a non-initial value.
+SPARSE_LONGHANDS = set(
+    [
+        "backdrop-filter",
+        "backface-visibility",
+        "border-image-outset",
+        "border-image-repeat",
+        "border-image-slice",
+        "border-image-source",
+        "border-image-width",
+        "column-span",
+        "container-name",
+        "container-type",
+        "grid-template-areas",
+        "mask-image",
+        "object-fit",
+        "object-position",
+        "offset-path",
+        "overflow-clip-margin",
+        "perspective-origin",
+        "will-change",
+    ]
+)
+
 # Bitfield values for all rule types which can have property declarations.
 STYLE_RULE = 1 << 0
 PAGE_RULE = 1 << 1
@@ -417,6 +443,8 @@ class Longhand(Property):
         self.logical_group = logical_group
         if self.logical:
             assert logical_group, "Property " + name + " must have a logical group"
+        # Whether this longhand is stored out of line, see SPARSE_LONGHANDS.
+        self.sparse = False
 
         self.boxed = arg_to_bool(boxed)
         self.allow_quirks = allow_quirks
@@ -804,10 +832,17 @@ class StyleStruct(object):
         self.gecko_ffi_name = "nsStyle" + self.gecko_name
         self.document_dependent = self.gecko_name in ["Font", "Visibility", "Text"]
 
+    def sparse_longhands(self):
+        return [l for l in self.longhands if l.sparse]
+
 
 class PropertiesData(object):
-    def __init__(self, engine):
+    def __init__(self, engine, sparse_style_structs=False):
+        assert (
+            engine == "servo" or not sparse_style_structs
+        ), "Sparse style structs are servo-only"
         self.engine = engine
+        self.sparse_style_structs = sparse_style_structs
         self.longhands = []
         self.longhands_by_name = {}
         self.longhands_by_logical_group = {}
@@ -862,6 +897,12 @@ class PropertiesData(object):
             return
 
         longhand = Longhand(self.current_style_struct, name, **kwargs)
+        if self.sparse_style_structs and name in SPARSE_LONGHANDS:
+            assert not longhand.style_struct.inherited, name + " must be a reset property"
+            assert not longhand.logical and not longhand.need_index, (
+                name + " can't be sparse"
+            )
+            longhand.sparse = True
         self.add_prefixed_aliases(longhand)
         longhand.aliases = [Alias(xp[0], longhand, xp[1]) for xp in longhand.aliases]
         self.longhand_aliases += longhand.aliases
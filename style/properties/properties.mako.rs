@@ -1294,7 +1294,7 @@ impl PropertyId {
         }
 
         let name = crate::custom_properties::parse_name(property_name)?;
-        Ok(PropertyId::Custom(crate::custom_properties::Name::from(name)))
+        Ok(PropertyId::Custom(crate::atom_cache::atomize(name)))
     }
 }
 
@@ -1413,7 +1413,87 @@ pub mod style_structs {
     use std::hash::{Hash, Hasher};
     use crate::values::specified::color::ColorSchemeFlags;
 
+    /// Out-of-line storage for the rarely-set longhands of a style struct.
+    ///
+    /// `None` means that all of them have their initial values, so most
+    /// structs never allocate it.
+    #[derive(Clone, Debug, MallocSizeOf)]
+    pub struct SparseLonghands<T>(Option<Box<T>>);
+
+    impl<T> Default for SparseLonghands<T> {
+        #[inline]
+        fn default() -> Self {
+            Self(None)
+        }
+    }
+
+    impl<T: Default> SparseLonghands<T> {
+        /// Returns the longhand values, if any of them has been set.
+        #[inline]
+        pub fn get(&self) -> Option<&T> {
+            self.0.as_deref()
+        }
+
+        /// Returns the longhand values, allocating them if needed.
+        #[inline]
+        pub fn get_or_insert(&mut self) -> &mut T {
+            self.0.get_or_insert_with(Default::default)
+        }
+
+        /// Returns the longhand values, only if they've been allocated.
+        #[inline]
+        pub fn get_mut(&mut self) -> Option<&mut T> {
+            self.0.as_deref_mut()
+        }
+
+        /// Returns whether the longhand accessed by `get` has a different
+        /// value in `self` and `other`.
+        pub fn differs<V: PartialEq>(
+            &self,
+            other: &Self,
+            get: impl Fn(&T) -> &V,
+            initial_value: impl FnOnce() -> V,
+        ) -> bool {
+            match (self.get(), other.get()) {
+                (None, None) => false,
+                (Some(a), Some(b)) => get(a) != get(b),
+                (Some(v), None) | (None, Some(v)) => *get(v) != initial_value(),
+            }
+        }
+    }
+
+    impl<T: Default + PartialEq> PartialEq for SparseLonghands<T> {
+        fn eq(&self, other: &Self) -> bool {
+            match (&self.0, &other.0) {
+                (Some(a), Some(b)) => a == b,
+                (None, None) => true,
+                (Some(v), None) | (None, Some(v)) => **v == T::default(),
+            }
+        }
+    }
+
     % for style_struct in data.active_style_structs():
+        % if style_struct.sparse_longhands():
+        /// The rarely-set longhands of the ${style_struct.name} style struct.
+        #[derive(Clone, Debug, MallocSizeOf, PartialEq)]
+        pub struct ${style_struct.name}Sparse {
+            % for longhand in style_struct.sparse_longhands():
+                /// The ${longhand.name} computed value.
+                pub ${longhand.ident}: longhands::${longhand.ident}::computed_value::T,
+            % endfor
+        }
+
+        impl Default for ${style_struct.name}Sparse {
+            fn default() -> Self {
+                Self {
+                    % for longhand in style_struct.sparse_longhands():
+                        ${longhand.ident}: longhands::${longhand.ident}::get_initial_value(),
+                    % endfor
+                }
+            }
+        }
+
+        % endif
         % if style_struct.name == "Font":
         #[derive(Clone, Debug, MallocSizeOf)]
         #[cfg_attr(feature = "servo", derive(Serialize, Deserialize))]
@@ -1423,11 +1503,15 @@ pub mod style_structs {
         /// The ${style_struct.name} style struct.
         pub struct ${style_struct.name} {
             % for longhand in style_struct.longhands:
-                % if not longhand.logical:
+                % if not longhand.logical and not longhand.sparse:
                     /// The ${longhand.name} computed value.
                     pub ${longhand.ident}: longhands::${longhand.ident}::computed_value::T,
                 % endif
             % endfor
+            % if style_struct.sparse_longhands():
+                /// The rarely-set longhands of this struct.
+                pub sparse: SparseLonghands<${style_struct.name}Sparse>,
+            % endif
             % if style_struct.name == "Font":
                 /// The font hash, used for font caching.
                 pub hash: u64,
@@ -1463,6 +1547,13 @@ pub mod style_structs {
                             self.display = v;
                             self.original_display = v;
                         }
+                    % elif longhand.sparse:
+                        /// Set ${longhand.name}.
+                        #[allow(non_snake_case)]
+                        #[inline]
+                        pub fn set_${longhand.ident}(&mut self, v: longhands::${longhand.ident}::computed_value::T) {
+                            self.sparse.get_or_insert().${longhand.ident} = v;
+                        }
                     % else:
                         /// Set ${longhand.name}.
                         #[allow(non_snake_case)]
@@ -1482,6 +1573,24 @@ pub mod style_structs {
                             self.display = other.display.clone();
                             self.original_display = other.display.clone();
                         }
+                    % elif longhand.sparse:
+                        /// Set ${longhand.name} from other struct.
+                        #[allow(non_snake_case)]
+                        #[inline]
+                        pub fn copy_${longhand.ident}_from(&mut self, other: &Self) {
+                            match other.sparse.get() {
+                                Some(other) => {
+                                    self.sparse.get_or_insert().${longhand.ident} = other.${longhand.ident}.clone();
+                                },
+                                None => {
+                                    // The value is implied to be the initial one
+                                    // if we haven't allocated anything.
+                                    if let Some(sparse) = self.sparse.get_mut() {
+                                        sparse.${longhand.ident} = longhands::${longhand.ident}::get_initial_value();
+                                    }
+                                },
+                            }
+                        }
                     % else:
                         /// Set ${longhand.name} from other struct.
                         #[allow(non_snake_case)]
@@ -1501,7 +1610,14 @@ pub mod style_structs {
                     #[allow(non_snake_case)]
                     #[inline]
                     pub fn clone_${longhand.ident}(&self) -> longhands::${longhand.ident}::computed_value::T {
+                        % if longhand.sparse:
+                        match self.sparse.get() {
+                            Some(sparse) => sparse.${longhand.ident}.clone(),
+                            None => longhands::${longhand.ident}::get_initial_value(),
+                        }
+                        % else:
                         self.${longhand.ident}.clone()
+                        % endif
                     }
                 % endif
                 % if longhand.need_index:
@@ -1578,9 +1694,368 @@ pub mod style_structs {
                     }
                 }
             % endif
+
+            /// Returns a hash of the computed values of this struct, such that
+            /// equal structs have equal hashes. See `StyleStructInterner`.
+            pub fn struct_hash(&self) -> u64 {
+                let mut hasher = FxHasher::default();
+                % for longhand in style_struct.longhands:
+                    % if longhand.sparse:
+                        // Unallocated sparse longhands compare equal to their
+                        // initial values, so they need to hash the same too.
+                        (&FieldHasher(&self.clone_${longhand.ident}())).hash_field(&mut hasher);
+                    % elif not longhand.logical:
+                        (&FieldHasher(&self.${longhand.ident})).hash_field(&mut hasher);
+                    % endif
+                % endfor
+                % if style_struct.name == "Box":
+                    (&FieldHasher(&self.original_display)).hash_field(&mut hasher);
+                % endif
+                hasher.finish()
+            }
         }
 
     % endfor
+
+    /// Feeds a computed value into the hash of its style struct, see
+    /// `struct_hash`.
+    ///
+    /// Most computed values (like keywords) implement `Hash`, and are hashed
+    /// directly through `HashField`. Since the calls are made on concrete
+    /// types, method resolution only falls back to `HashFieldAsCss`, which
+    /// hashes the serialization of the value, for the ones that don't (mostly
+    /// the ones that contain floats).
+    struct FieldHasher<'a, T>(&'a T);
+
+    trait HashField {
+        fn hash_field(&self, hasher: &mut FxHasher);
+    }
+
+    impl<'a, T: Hash> HashField for FieldHasher<'a, T> {
+        #[inline]
+        fn hash_field(&self, hasher: &mut FxHasher) {
+            self.0.hash(hasher);
+        }
+    }
+
+    trait HashFieldAsCss {
+        fn hash_field(&self, hasher: &mut FxHasher);
+    }
+
+    impl<'a, T: style_traits::ToCss> HashFieldAsCss for &FieldHasher<'a, T> {
+        fn hash_field(&self, hasher: &mut FxHasher) {
+            let _ = self.0.to_css(&mut style_traits::CssWriter::new(&mut HashWriter(hasher)));
+            hasher.write_u8(0);
+        }
+    }
+
+    /// Feeds the serialization of a computed value into a hasher.
+    struct HashWriter<'a>(&'a mut FxHasher);
+
+    impl<'a> std::fmt::Write for HashWriter<'a> {
+        #[inline]
+        fn write_str(&mut self, s: &str) -> std::fmt::Result {
+            self.0.write(s.as_bytes());
+            Ok(())
+        }
+    }
+}
+
+/// The amount of entries a shard of a `StyleStructTable` can grow to before
+/// we try to remove structs that nobody else references anymore.
+#[cfg(feature = "servo")]
+const MIN_STYLE_STRUCT_PURGE_THRESHOLD: usize = 64;
+
+/// The log2 of the number of shards of a `StyleStructTable`.
+#[cfg(feature = "servo")]
+const STYLE_STRUCT_TABLE_SHARD_BITS: u32 = 4;
+
+/// A shard of a `StyleStructTable`, keyed by struct hash.
+#[cfg(feature = "servo")]
+struct StyleStructShard<T> {
+    map: rustc_hash::FxHashMap<u64, smallvec::SmallVec<[Arc<T>; 1]>>,
+    len: usize,
+    purge_threshold: usize,
+    stats: StyleStructInternerStats,
+}
+
+#[cfg(feature = "servo")]
+impl<T: PartialEq> StyleStructShard<T> {
+    fn new() -> Self {
+        Self {
+            map: Default::default(),
+            len: 0,
+            purge_threshold: MIN_STYLE_STRUCT_PURGE_THRESHOLD,
+            stats: StyleStructInternerStats::default(),
+        }
+    }
+
+    /// Returns an existing struct equal to `value`, if any, or inserts it
+    /// otherwise. The boolean is whether an existing struct was found.
+    fn intern(&mut self, hash: u64, value: UniqueArc<T>) -> (Arc<T>, bool) {
+        self.stats.lookups += 1;
+        let entries = self.map.entry(hash).or_default();
+        if let Some(existing) = entries.iter().find(|e| ***e == *value) {
+            self.stats.hits += 1;
+            self.stats.bytes_saved += mem::size_of::<T>();
+            return (existing.clone(), true);
+        }
+        let value = value.shareable();
+        entries.push(value.clone());
+        self.len += 1;
+        if self.len > self.purge_threshold {
+            self.purge();
+        }
+        (value, false)
+    }
+
+    /// Removes the structs that only we reference.
+    ///
+    /// The threshold doubles with the live entries, so this is amortized
+    /// constant time per insertion.
+    fn purge(&mut self) {
+        self.map.retain(|_, entries| {
+            entries.retain(|e| !e.is_unique());
+            !entries.is_empty()
+        });
+        self.len = self.map.values().map(|e| e.len()).sum();
+        self.purge_threshold = std::cmp::max(MIN_STYLE_STRUCT_PURGE_THRESHOLD, self.len * 2);
+    }
+
+    fn shallow_size_of(&self, ops: &mut MallocSizeOfOps) -> usize {
+        use malloc_size_of::MallocShallowSizeOf;
+        let mut n = self.map.shallow_size_of(ops);
+        for entries in self.map.values() {
+            n += entries.shallow_size_of(ops);
+        }
+        n
+    }
+}
+
+/// A table of style structs of a given type.
+///
+/// It's split into shards, picked by the high bits of the struct hash, so
+/// that style threads interning different structs rarely contend for the
+/// same lock, and purging only blocks a fraction of the table.
+#[cfg(feature = "servo")]
+struct StyleStructTable<T> {
+    shards: [parking_lot::Mutex<StyleStructShard<T>>; 1 << STYLE_STRUCT_TABLE_SHARD_BITS],
+}
+
+#[cfg(feature = "servo")]
+impl<T: PartialEq> StyleStructTable<T> {
+    fn new() -> Self {
+        Self {
+            shards: std::array::from_fn(|_| parking_lot::Mutex::new(StyleStructShard::new())),
+        }
+    }
+
+    fn intern(&self, hash: u64, value: UniqueArc<T>) -> (Arc<T>, bool) {
+        let shard = (hash >> (64 - STYLE_STRUCT_TABLE_SHARD_BITS)) as usize;
+        self.shards[shard].lock().intern(hash, value)
+    }
+
+    fn stats(&self) -> StyleStructInternerStats {
+        let mut stats = StyleStructInternerStats::default();
+        for shard in self.shards.iter() {
+            stats += shard.lock().stats;
+        }
+        stats
+    }
+
+    fn shallow_size_of(&self, ops: &mut MallocSizeOfOps) -> usize {
+        self.shards
+            .iter()
+            .map(|shard| shard.lock().shallow_size_of(ops))
+            .sum()
+    }
+}
+
+/// Statistics about style struct deduplication, see `StyleStructInterner`.
+#[cfg(feature = "servo")]
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub struct StyleStructInternerStats {
+    /// The number of newly computed structs that went through the interner.
+    pub lookups: usize,
+    /// The number of those that were replaced by an existing, equal struct.
+    pub hits: usize,
+    /// The size of the struct allocations that were deduplicated away.
+    pub bytes_saved: usize,
+}
+
+#[cfg(feature = "servo")]
+impl std::ops::AddAssign for StyleStructInternerStats {
+    fn add_assign(&mut self, other: Self) {
+        self.lookups += other.lookups;
+        self.hits += other.hits;
+        self.bytes_saved += other.bytes_saved;
+    }
+}
+
+#[cfg(feature = "servo")]
+impl StyleStructInternerStats {
+    /// The fraction of newly computed structs that were deduplicated.
+    pub fn dedup_ratio(&self) -> f32 {
+        if self.lookups == 0 {
+            return 0.;
+        }
+        self.hits as f32 / self.lookups as f32
+    }
+}
+
+/// A per-document table used to deduplicate newly computed style structs, so
+/// that equal structs computed for unrelated elements (e.g., through
+/// different rule nodes) share a single allocation.
+///
+/// Structs are only interned at `StyleBuilder::build` time, and only if they
+/// were computed (rather than inherited or reset from another style). This is
+/// opt-in, see `Stylist::set_style_struct_interning_enabled`.
+///
+/// The statistics are kept by each shard of the tables, under the lock that
+/// interning takes anyway, and summed up by `stats`.
+#[cfg(feature = "servo")]
+pub struct StyleStructInterner {
+    % for style_struct in data.active_style_structs():
+    ${style_struct.ident}: StyleStructTable<style_structs::${style_struct.name}>,
+    % endfor
+}
+
+#[cfg(feature = "servo")]
+impl StyleStructInterner {
+    /// Creates an empty interner.
+    pub fn new() -> Self {
+        Self {
+            % for style_struct in data.active_style_structs():
+            ${style_struct.ident}: StyleStructTable::new(),
+            % endfor
+        }
+    }
+
+    fn intern<T: Clone + PartialEq>(
+        &self,
+        table: &StyleStructTable<T>,
+        value: StyleStructRef<T>,
+        hash: fn(&T) -> u64,
+    ) -> Arc<T> {
+        let value = match value {
+            StyleStructRef::Owned(v) => v,
+            other => return other.build(),
+        };
+        let hash = hash(&value);
+        table.intern(hash, value).0
+    }
+
+    /// The statistics of all the structs interned since this interner was
+    /// created.
+    pub fn stats(&self) -> StyleStructInternerStats {
+        let mut stats = StyleStructInternerStats::default();
+        % for style_struct in data.active_style_structs():
+        stats += self.${style_struct.ident}.stats();
+        % endfor
+        stats
+    }
+}
+
+#[cfg(feature = "servo")]
+impl MallocSizeOf for StyleStructInterner {
+    fn size_of(&self, ops: &mut MallocSizeOfOps) -> usize {
+        // The structs themselves are shared with the styles that use them, so
+        // we only measure the tables.
+        let mut n = 0;
+        % for style_struct in data.active_style_structs():
+        n += self.${style_struct.ident}.shallow_size_of(ops);
+        % endfor
+        n
+    }
+}
+
+#[cfg(all(test, feature = "servo"))]
+mod style_struct_interner_tests {
+    use super::*;
+
+    fn unique(value: u32) -> UniqueArc<u32> {
+        UniqueArc::new(value)
+    }
+
+    #[test]
+    fn hits_and_misses() {
+        let mut shard = StyleStructShard::new();
+        let (first, hit) = shard.intern(1, unique(10));
+        assert!(!hit);
+        let (second, hit) = shard.intern(1, unique(10));
+        assert!(hit);
+        assert!(Arc::ptr_eq(&first, &second));
+
+        // Different structs with the same hash are told apart.
+        let (other, hit) = shard.intern(1, unique(20));
+        assert!(!hit);
+        assert!(!Arc::ptr_eq(&first, &other));
+        assert_eq!(shard.len, 2);
+
+        // Equal structs are only found through their hash.
+        let (_, hit) = shard.intern(2, unique(10));
+        assert!(!hit);
+
+        assert_eq!(shard.stats.lookups, 4);
+        assert_eq!(shard.stats.hits, 1);
+        assert_eq!(shard.stats.bytes_saved, mem::size_of::<u32>());
+    }
+
+    #[test]
+    fn purge_drops_unreferenced_structs() {
+        let mut shard = StyleStructShard::new();
+        let kept = (0..8)
+            .map(|i| shard.intern(i, unique(i as u32)).0)
+            .collect::<Vec<_>>();
+        for i in 8..MIN_STYLE_STRUCT_PURGE_THRESHOLD as u64 {
+            shard.intern(i, unique(i as u32));
+        }
+        assert_eq!(shard.len, MIN_STYLE_STRUCT_PURGE_THRESHOLD);
+
+        // Going over the threshold drops everything but the structs still in
+        // use, and the one just inserted.
+        let (last, _) = shard.intern(u64::MAX, unique(u32::MAX));
+        assert_eq!(shard.len, kept.len() + 1);
+        assert_eq!(shard.purge_threshold, MIN_STYLE_STRUCT_PURGE_THRESHOLD);
+        for (i, struct_) in kept.iter().enumerate() {
+            let (found, hit) = shard.intern(i as u64, unique(i as u32));
+            assert!(hit);
+            assert!(Arc::ptr_eq(&found, struct_));
+        }
+        let (found, hit) = shard.intern(u64::MAX, unique(u32::MAX));
+        assert!(hit && Arc::ptr_eq(&found, &last));
+        let (_, hit) = shard.intern(8, unique(8));
+        assert!(!hit);
+    }
+
+    #[test]
+    fn stats_are_per_interner() {
+        let interner = StyleStructInterner::new();
+        let initial = ComputedValues::initial_values_with_font_override(
+            style_structs::Font::initial_values(),
+        );
+        let position = || StyleStructRef::Owned(UniqueArc::new(initial.get_position().clone()));
+        let hash = style_structs::Position::struct_hash;
+        let first = interner.intern(&interner.position, position(), hash);
+        // Structs interned by other threads count too.
+        let second = std::thread::scope(|scope| {
+            scope
+                .spawn(|| interner.intern(&interner.position, position(), hash))
+                .join()
+                .unwrap()
+        });
+        assert!(Arc::ptr_eq(&first, &second));
+
+        let stats = interner.stats();
+        assert_eq!(stats.lookups, 2);
+        assert_eq!(stats.hits, 1);
+        assert_eq!(stats.bytes_saved, mem::size_of::<style_structs::Position>());
+        assert_eq!(stats.dedup_ratio(), 0.5);
+        assert_eq!(
+            StyleStructInterner::new().stats(),
+            StyleStructInternerStats::default()
+        );
+    }
 }
 
 % for style_struct in data.active_style_structs():
@@ -2006,10 +2481,13 @@ impl ComputedValues {
 
                     ${style_struct.ident}: Arc::new(style_structs::${style_struct.name} {
                         % for longhand in style_struct.longhands:
-                            % if not longhand.logical:
+                            % if not longhand.logical and not longhand.sparse:
                                 ${longhand.ident}: longhands::${longhand.ident}::get_initial_value(),
                             % endif
                         % endfor
+                        % if style_struct.sparse_longhands():
+                            sparse: Default::default(),
+                        % endif
                         % if style_struct.name == "Box":
                             original_display: longhands::display::get_initial_value(),
                         % endif
@@ -2748,6 +3226,19 @@ impl<'a> StyleBuilder<'a> {
 
     /// Turns this `StyleBuilder` into a proper `ComputedValues` instance.
     pub fn build(self) -> Arc<ComputedValues> {
+        % if engine == "servo":
+        let interner = self.stylist.and_then(|s| s.style_struct_interner());
+        % for style_struct in data.active_style_structs():
+        let ${style_struct.ident} = match interner {
+            Some(interner) => interner.intern(
+                &interner.${style_struct.ident},
+                self.${style_struct.ident},
+                style_structs::${style_struct.name}::struct_hash,
+            ),
+            None => self.${style_struct.ident}.build(),
+        };
+        % endfor
+        % endif
         ComputedValues::new(
             self.pseudo,
             self.custom_properties,
@@ -2757,7 +3248,11 @@ impl<'a> StyleBuilder<'a> {
             self.rules,
             self.visited_style,
             % for style_struct in data.active_style_structs():
+            % if engine == "servo":
+            ${style_struct.ident},
+            % else:
             self.${style_struct.ident}.build(),
+            % endif
             % endfor
         )
     }
@@ -3011,7 +3506,13 @@ pub(crate) fn restyle_damage_${effect_name} (old: &ComputedValues, new: &Compute
         if !std::ptr::eq(old_${style_struct.name_lower}, new_${style_struct.name_lower}) {
             if 
             % for longhand in style_struct.longhands:
-            % if effect_name in longhand.servo_restyle_damage.split() and not longhand.logical:
+            % if effect_name in longhand.servo_restyle_damage.split() and longhand.sparse:
+                old_${style_struct.name_lower}.sparse.differs(
+                    &new_${style_struct.name_lower}.sparse,
+                    |s| &s.${longhand.ident},
+                    longhands::${longhand.ident}::get_initial_value,
+                ) ||
+            % elif effect_name in longhand.servo_restyle_damage.split() and not longhand.logical:
                 old_${style_struct.name_lower}.${longhand.ident} != new_${style_struct.name_lower}.${longhand.ident} ||
             % endif
             % endfor
@@ -3025,3 +3526,43 @@ pub(crate) fn restyle_damage_${effect_name} (old: &ComputedValues, new: &Compute
 }
 % endfor
 % endif
+
+<% sparse_style_structs = [s for s in data.active_style_structs() if s.sparse_longhands()] %>
+% if engine == "servo" and sparse_style_structs:
+#[cfg(test)]
+mod style_struct_size_tests {
+    use super::{longhands, style_structs};
+    use std::mem::size_of;
+
+    % for style_struct in sparse_style_structs:
+    /// The ${style_struct.name} style struct with all its longhands inline, as
+    /// it's laid out without the `sparse_style_structs` feature.
+    #[allow(dead_code)]
+    struct Dense${style_struct.name} {
+        % for longhand in style_struct.longhands:
+            % if not longhand.logical:
+        ${longhand.ident}: longhands::${longhand.ident}::computed_value::T,
+            % endif
+        % endfor
+        % if style_struct.name == "Font":
+        hash: u64,
+        % endif
+        % if style_struct.name == "Box":
+        original_display: longhands::display::computed_value::T,
+        % endif
+    }
+
+    % endfor
+    #[test]
+    fn sparse_style_structs_are_smaller() {
+        % for style_struct in sparse_style_structs:
+        assert!(
+            size_of::<style_structs::${style_struct.name}>() < size_of::<Dense${style_struct.name}>(),
+            "${style_struct.name}: {} bytes with sparse longhands, {} without",
+            size_of::<style_structs::${style_struct.name}>(),
+            size_of::<Dense${style_struct.name}>(),
+        );
+        % endfor
+    }
+}
+% endif
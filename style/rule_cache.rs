@@ -3,10 +3,11 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
 //! A cache from rule node to computed values, in order to cache reset
-//! properties.
+//! properties and resolved custom properties.
 
+use crate::custom_properties::ComputedCustomProperties;
 use crate::logical_geometry::WritingMode;
-use crate::properties::{ComputedValues, StyleBuilder};
+use crate::properties::{CascadePlan, ComputedValues, StyleBuilder};
 use crate::rule_tree::StrongRuleNode;
 use crate::selector_parser::PseudoElement;
 use crate::shared_lock::StylesheetGuards;
@@ -15,6 +16,7 @@ use crate::values::specified::color::ColorSchemeFlags;
 use rustc_hash::FxHashMap;
 use servo_arc::Arc;
 use smallvec::SmallVec;
+use std::cell::RefCell;
 
 /// The conditions for caching and matching a style in the rule cache.
 #[derive(Clone, Debug, Default)]
@@ -24,6 +26,24 @@ pub struct RuleCacheConditions {
     line_height: Option<NonNegativeLength>,
     writing_mode: Option<WritingMode>,
     color_scheme: Option<ColorSchemeFlags>,
+    custom_properties: Option<CustomPropertiesInputs>,
+}
+
+/// The inputs that the custom properties of a style were computed from, when
+/// they only depend on the matched rules and the inherited custom properties.
+#[derive(Clone, Debug)]
+struct CustomPropertiesInputs {
+    /// The inherited custom properties. We hold a strong reference to the maps
+    /// so that comparing them by identity is sound.
+    inherited: ComputedCustomProperties,
+    is_root_element: bool,
+}
+
+impl CustomPropertiesInputs {
+    fn matches(&self, style: &StyleBuilder) -> bool {
+        self.is_root_element == style.is_root_element
+            && self.inherited.ptr_eq(style.inherited_custom_properties())
+    }
 }
 
 impl RuleCacheConditions {
@@ -56,6 +76,19 @@ impl RuleCacheConditions {
         self.writing_mode = Some(writing_mode);
     }
 
+    /// Sets the custom properties of the style as cacheable, given they only
+    /// depend on the matched rules and the given inherited custom properties.
+    pub fn set_custom_properties_cacheable(
+        &mut self,
+        inherited: ComputedCustomProperties,
+        is_root_element: bool,
+    ) {
+        self.custom_properties = Some(CustomPropertiesInputs {
+            inherited,
+            is_root_element,
+        });
+    }
+
     /// Returns whether the current style's reset properties are cacheable.
     fn cacheable(&self) -> bool {
         !self.uncacheable
@@ -110,10 +143,34 @@ impl CachedConditions {
     }
 }
 
+/// The maximum number of resolved custom properties we keep per rule node.
+///
+/// Each entry keeps the inherited custom properties it was computed from
+/// alive, and elements with the same rules usually have few distinct parent
+/// custom properties, so we keep the most recent ones.
+const MAX_CUSTOM_PROPERTIES_PER_RULE_NODE: usize = 4;
+
 /// A TLS cache from rules matched to computed values.
 pub struct RuleCache {
     // FIXME(emilio): Consider using LRUCache or something like that?
     map: FxHashMap<StrongRuleNode, SmallVec<[(CachedConditions, Arc<ComputedValues>); 1]>>,
+    /// Resolved custom properties, keyed by the full rule node and the
+    /// identity of the inherited custom properties. This allows skipping the
+    /// custom properties dependency graph for elements that share rules and
+    /// parent custom properties, which is very common.
+    custom_properties: FxHashMap<
+        StrongRuleNode,
+        SmallVec<[(CustomPropertiesInputs, ComputedCustomProperties); 1]>,
+    >,
+    /// Cascade plans for the rule nodes we've cascaded. A rule node maps to
+    /// `None` the first time it's cascaded, since most rule nodes are only
+    /// used once and building a plan isn't free.
+    ///
+    /// Like the rest of the cache, plans assume that the declaration blocks
+    /// they were built from aren't mutated while the cache is alive, which
+    /// holds since the cache lives for a single traversal. A cache that is
+    /// reused across traversals must be cleared in between.
+    cascade_plans: RefCell<FxHashMap<StrongRuleNode, Option<Arc<CascadePlan>>>>,
 }
 
 impl RuleCache {
@@ -121,9 +178,18 @@ impl RuleCache {
     pub fn new() -> Self {
         Self {
             map: FxHashMap::default(),
+            custom_properties: FxHashMap::default(),
+            cascade_plans: RefCell::new(FxHashMap::default()),
         }
     }
 
+    /// Drops all the cached styles, custom properties and cascade plans.
+    pub fn clear(&mut self) {
+        self.map.clear();
+        self.custom_properties.clear();
+        self.cascade_plans.get_mut().clear();
+    }
+
     /// Walk the rule tree and return a rule node for using as the key
     /// for rule cache.
     ///
@@ -234,4 +300,78 @@ impl RuleCache {
             .push((cached_conditions, style.clone()));
         true
     }
+
+    /// Returns the cascade plan for `rules`, building it if the rule node has
+    /// been cascaded before.
+    pub fn cascade_plan(
+        &self,
+        rules: &StrongRuleNode,
+        guards: &StylesheetGuards,
+    ) -> Option<Arc<CascadePlan>> {
+        let mut plans = self.cascade_plans.borrow_mut();
+        match plans.get_mut(rules) {
+            Some(Some(plan)) => Some(plan.clone()),
+            Some(entry) => {
+                let plan = Arc::new(CascadePlan::new(rules, guards));
+                *entry = Some(plan.clone());
+                Some(plan)
+            },
+            None => {
+                plans.insert(rules.clone(), None);
+                None
+            },
+        }
+    }
+
+    /// Finds the resolved custom properties for the style being built, if
+    /// another style with the same rules and inherited custom properties has
+    /// computed them already.
+    pub fn find_custom_properties(
+        &self,
+        builder: &StyleBuilder,
+    ) -> Option<&ComputedCustomProperties> {
+        if builder
+            .pseudo
+            .and_then(|p| p.property_restriction())
+            .is_some()
+        {
+            return None;
+        }
+        let rules = builder.rules.as_ref()?;
+        let cached = self.custom_properties.get(rules)?;
+        for &(ref inputs, ref custom_properties) in cached.iter() {
+            if inputs.matches(builder) {
+                return Some(custom_properties);
+            }
+        }
+        None
+    }
+
+    /// Inserts the custom properties of a style into the cache if possible.
+    ///
+    /// Returns whether the custom properties were inserted into the cache.
+    pub fn insert_custom_properties_if_possible(
+        &mut self,
+        style: &ComputedValues,
+        pseudo: Option<&PseudoElement>,
+        conditions: &RuleCacheConditions,
+    ) -> bool {
+        let inputs = match conditions.custom_properties {
+            Some(ref inputs) => inputs,
+            None => return false,
+        };
+        if pseudo.and_then(|p| p.property_restriction()).is_some() {
+            return false;
+        }
+        let rules = match style.rules.as_ref() {
+            Some(r) => r.clone(),
+            None => return false,
+        };
+        let cached = self.custom_properties.entry(rules).or_default();
+        if cached.len() == MAX_CUSTOM_PROPERTIES_PER_RULE_NODE {
+            cached.remove(0);
+        }
+        cached.push((inputs.clone(), style.custom_properties().clone()));
+        true
+    }
 }
@@ -86,6 +86,7 @@ impl RuleTree {
 
     /// This can only be called when no other threads is accessing this tree.
     pub fn gc(&self) {
+        let _span = style_span!("RuleTree::gc");
         unsafe { self.swap_free_list_and_gc(RuleNode::DANGLING_PTR) }
     }
 
@@ -6,16 +6,18 @@
 //! name, ids and hash.
 
 use crate::applicable_declarations::{ApplicableDeclarationList, ScopeProximity};
+use crate::cascade_profiler;
 use crate::context::QuirksMode;
 use crate::dom::TElement;
 use crate::rule_tree::CascadeLevel;
+use crate::selector_match_stats::MatchSample;
 use crate::selector_parser::SelectorImpl;
 use crate::stylist::{CascadeData, ContainerConditionId, Rule, ScopeConditionId, Stylist};
 use crate::AllocErr;
 use crate::{Atom, LocalName, Namespace, ShrinkIfNeeded, WeakAtom};
 use dom::ElementState;
 use precomputed_hash::PrecomputedHash;
-use selectors::matching::{matches_selector, MatchingContext};
+use selectors::matching::{matches_selector, selector_may_match, MatchingContext};
 use selectors::parser::{Combinator, Component, SelectorIter};
 use smallvec::SmallVec;
 use std::collections::hash_map;
@@ -338,21 +340,66 @@ impl SelectorMap<Rule> {
             matching_context.include_starting_style,
             IncludeStartingStyle::Yes
         );
+        let observed = cascade_profiler::is_enabled() || stylist.selector_match_stats().is_some();
         for rule in rules {
             let scope_proximity = if rule.scope_condition_id == ScopeConditionId::none() {
-                if !matches_selector(
-                    &rule.selector,
-                    0,
-                    Some(&rule.hashes),
-                    &element,
-                    matching_context,
-                ) {
+                let matched = if observed {
+                    Self::matches_rule_observed(
+                        element,
+                        rule,
+                        matching_context,
+                        cascade_level,
+                        cascade_data,
+                        stylist,
+                        |matching_context| {
+                            matches_selector(
+                                &rule.selector,
+                                0,
+                                Some(&rule.hashes),
+                                &element,
+                                matching_context,
+                            )
+                        },
+                    )
+                } else {
+                    matches_selector(
+                        &rule.selector,
+                        0,
+                        Some(&rule.hashes),
+                        &element,
+                        matching_context,
+                    )
+                };
+                if !matched {
                     continue;
                 }
                 ScopeProximity::infinity()
             } else {
-                let result =
-                    cascade_data.find_scope_proximity_if_matching(rule, element, matching_context);
+                let mut result = ScopeProximity::infinity();
+                if observed {
+                    Self::matches_rule_observed(
+                        element,
+                        rule,
+                        matching_context,
+                        cascade_level,
+                        cascade_data,
+                        stylist,
+                        |matching_context| {
+                            result = cascade_data.find_scope_proximity_if_matching(
+                                rule,
+                                element,
+                                matching_context,
+                            );
+                            result != ScopeProximity::infinity()
+                        },
+                    );
+                } else {
+                    result = cascade_data.find_scope_proximity_if_matching(
+                        rule,
+                        element,
+                        matching_context,
+                    );
+                }
                 if result == ScopeProximity::infinity() {
                     continue;
                 }
@@ -388,6 +435,53 @@ impl SelectorMap<Rule> {
             ));
         }
     }
+
+    /// Matches `rule` against `element` with `matches`, and reports the
+    /// attempt to the cascade profiler and the selector match statistics,
+    /// whichever are enabled. This is the only place where matching is
+    /// instrumented, so that the uninstrumented path stays as it was.
+    ///
+    /// `matches` is either plain selector matching, or, for rules in `@scope`,
+    /// finding the proximity of the scope root.
+    #[inline(never)]
+    fn matches_rule_observed<E>(
+        element: E,
+        rule: &Rule,
+        matching_context: &mut MatchingContext<E::Impl>,
+        cascade_level: CascadeLevel,
+        cascade_data: &CascadeData,
+        stylist: &Stylist,
+        matches: impl FnOnce(&mut MatchingContext<E::Impl>) -> bool,
+    ) -> bool
+    where
+        E: TElement,
+    {
+        let sample = stylist
+            .selector_match_stats()
+            .filter(|stats| stats.should_sample());
+        if sample.is_some() {
+            matching_context.compound_selector_steps = Some(0);
+        }
+        let matched = matches(matching_context);
+        let steps = matching_context.compound_selector_steps.take();
+        if let Some(stats) = sample {
+            let bloom_rejected = matching_context
+                .bloom_filter
+                .map_or(false, |filter| !selector_may_match(&rule.hashes, filter));
+            stats.record(
+                rule,
+                MatchSample {
+                    bloom_rejected,
+                    matched,
+                    steps: steps.unwrap_or(0),
+                },
+            );
+        }
+        if cascade_profiler::is_enabled() {
+            cascade_profiler::record_match_attempt(rule, cascade_level, cascade_data, matched);
+        }
+        matched
+    }
 }
 
 impl<T: SelectorMapEntry> SelectorMap<T> {
@@ -0,0 +1,212 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Sampled, per-rule statistics about the cost of selector matching.
+//!
+//! Unlike the `cascade_profiler`, this is meant to be cheap enough to leave
+//! enabled in production: only one in `sample_rate` match attempts on each
+//! thread is recorded, and recorded samples go to one of a number of sharded
+//! tables, so that threads rarely contend on the same lock.
+
+use crate::rule_tree::StyleSource;
+use crate::selector_parser::SelectorImpl;
+use crate::stylist::Rule;
+use cssparser::SourceLocation;
+use parking_lot::Mutex;
+use rustc_hash::FxHashMap;
+use selectors::parser::Selector;
+use std::cell::Cell;
+
+/// The default number of match attempts per recorded sample.
+pub const DEFAULT_SAMPLE_RATE: u32 = 64;
+
+/// The number of independently-locked tables samples are spread across.
+const SHARD_COUNT: usize = 16;
+
+thread_local! {
+    static SAMPLE_COUNTER: Cell<u32> = Cell::new(0);
+}
+
+/// The outcome of a single sampled match attempt.
+#[derive(Clone, Copy, Debug)]
+pub struct MatchSample {
+    /// Whether the selector was rejected by the ancestor bloom filter.
+    pub bloom_rejected: bool,
+    /// Whether the selector matched.
+    pub matched: bool,
+    /// The number of compound selectors walked while matching.
+    pub steps: u32,
+}
+
+/// The sampled match statistics of a given rule.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct RuleMatchStats {
+    /// The number of sampled attempts rejected by the bloom filter.
+    pub bloom_rejects: u32,
+    /// The number of sampled attempts that went through full selector
+    /// matching.
+    pub attempts: u32,
+    /// The number of sampled attempts that matched.
+    pub matches: u32,
+    /// The total number of compound selectors walked in the sampled
+    /// attempts.
+    pub steps: u64,
+}
+
+impl RuleMatchStats {
+    fn add(&mut self, sample: MatchSample) {
+        if sample.bloom_rejected {
+            self.bloom_rejects += 1;
+            return;
+        }
+        self.attempts += 1;
+        self.matches += sample.matched as u32;
+        self.steps += sample.steps as u64;
+    }
+
+    /// The average number of compound selectors walked per full match
+    /// attempt.
+    pub fn average_steps(&self) -> f64 {
+        if self.attempts == 0 {
+            return 0.;
+        }
+        self.steps as f64 / self.attempts as f64
+    }
+}
+
+struct Entry {
+    selector: Selector<SelectorImpl>,
+    style_source: StyleSource,
+    stats: RuleMatchStats,
+}
+
+/// A selector that was found to be expensive to match.
+#[derive(Clone, Debug)]
+pub struct SlowSelector {
+    /// The selector.
+    pub selector: Selector<SelectorImpl>,
+    /// The declarations of the rule the selector belongs to.
+    pub style_source: StyleSource,
+    /// The location of the rule in its stylesheet, if it could be found.
+    pub source_location: Option<SourceLocation>,
+    /// The sampled match statistics of the selector.
+    pub stats: RuleMatchStats,
+}
+
+/// Sampled match statistics for all the rules in a stylist.
+pub struct SelectorMatchStats {
+    sample_rate: u32,
+    shards: [Mutex<FxHashMap<usize, Entry>>; SHARD_COUNT],
+}
+
+impl SelectorMatchStats {
+    /// Creates an empty set of statistics, recording one in every
+    /// `sample_rate` match attempts.
+    pub fn new(sample_rate: u32) -> Self {
+        Self {
+            sample_rate: sample_rate.max(1),
+            shards: Default::default(),
+        }
+    }
+
+    /// Returns the number of match attempts per recorded sample.
+    #[inline]
+    pub fn sample_rate(&self) -> u32 {
+        self.sample_rate
+    }
+
+    /// Returns whether the next match attempt on this thread should be
+    /// recorded.
+    #[inline]
+    pub fn should_sample(&self) -> bool {
+        SAMPLE_COUNTER.with(|counter| {
+            let next = counter.get().wrapping_add(1);
+            counter.set(next);
+            next % self.sample_rate == 0
+        })
+    }
+
+    /// Records a sampled match attempt of `rule`.
+    pub fn record(&self, rule: &Rule, sample: MatchSample) {
+        let key = rule.selector.thin_arc_heap_ptr() as usize;
+        // The low bits of the pointer are always zero due to alignment.
+        let shard = (key >> 4) % SHARD_COUNT;
+        self.shards[shard]
+            .lock()
+            .entry(key)
+            .or_insert_with(|| Entry {
+                selector: rule.selector.clone(),
+                style_source: rule.style_source.clone(),
+                stats: RuleMatchStats::default(),
+            })
+            .stats
+            .add(sample);
+    }
+
+    /// Forgets all the recorded samples.
+    pub fn clear(&self) {
+        for shard in &self.shards {
+            shard.lock().clear();
+        }
+    }
+
+    /// Returns the `count` selectors that walked the most compound selectors
+    /// in total, most expensive first. Source locations are left for the
+    /// caller to fill in.
+    pub fn most_expensive(&self, count: usize) -> Vec<SlowSelector> {
+        let mut result = Vec::new();
+        for shard in &self.shards {
+            result.extend(shard.lock().values().map(|entry| SlowSelector {
+                selector: entry.selector.clone(),
+                style_source: entry.style_source.clone(),
+                source_location: None,
+                stats: entry.stats,
+            }));
+        }
+        result.sort_by(|a, b| {
+            b.stats
+                .steps
+                .cmp(&a.stats.steps)
+                .then(b.stats.attempts.cmp(&a.stats.attempts))
+        });
+        result.truncate(count);
+        result
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn bloom_rejects_are_not_attempts() {
+        let mut stats = RuleMatchStats::default();
+        stats.add(MatchSample {
+            bloom_rejected: true,
+            matched: false,
+            steps: 0,
+        });
+        stats.add(MatchSample {
+            bloom_rejected: false,
+            matched: false,
+            steps: 5,
+        });
+        stats.add(MatchSample {
+            bloom_rejected: false,
+            matched: true,
+            steps: 3,
+        });
+        assert_eq!(stats.bloom_rejects, 1);
+        assert_eq!(stats.attempts, 2);
+        assert_eq!(stats.matches, 1);
+        assert_eq!(stats.average_steps(), 4.);
+    }
+
+    #[test]
+    fn samples_at_rate() {
+        let stats = SelectorMatchStats::new(4);
+        let sampled = (0..64).filter(|_| stats.should_sample()).count();
+        assert_eq!(sampled, 16);
+    }
+}
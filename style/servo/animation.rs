@@ -8,7 +8,9 @@
 // compile it out so that people remember it exists.
 
 use crate::context::{CascadeInputs, SharedStyleContext};
+use crate::data::ElementData;
 use crate::dom::{OpaqueNode, TDocument, TElement, TNode};
+use crate::invalidation::element::restyle_hints::RestyleHint;
 use crate::properties::animated_properties::{AnimationValue, AnimationValueMap};
 use crate::properties::longhands::animation_direction::computed_value::single_value::T as AnimationDirection;
 use crate::properties::longhands::animation_fill_mode::computed_value::single_value::T as AnimationFillMode;
@@ -19,20 +21,23 @@ use crate::properties::{
     PropertyDeclarationIdSet,
 };
 use crate::rule_tree::CascadeLevel;
-use crate::selector_parser::PseudoElement;
+use crate::selector_parser::{PseudoElement, RestyleDamage};
 use crate::shared_lock::{Locked, SharedRwLock};
 use crate::style_resolver::StyleResolverForElement;
 use crate::stylesheets::keyframes_rule::{KeyframesAnimation, KeyframesStep, KeyframesStepValue};
 use crate::stylesheets::layer_rule::LayerOrder;
 use crate::values::animated::{Animate, Procedure};
+use crate::values::computed::easing::PrecomputedTimingFunction;
 use crate::values::computed::TimingFunction;
 use crate::values::generics::easing::BeforeFlag;
 use crate::values::specified::TransitionBehavior;
 use crate::Atom;
-use parking_lot::RwLock;
-use rustc_hash::FxHashMap;
+use parking_lot::{RwLock, RwLockReadGuard, RwLockWriteGuard};
+use rustc_hash::{FxHashMap, FxHasher};
 use servo_arc::Arc;
+use smallvec::SmallVec;
 use std::fmt;
+use std::hash::{Hash, Hasher};
 
 /// Represents an animation for a given property.
 #[derive(Clone, Debug, MallocSizeOf)]
@@ -44,7 +49,7 @@ pub struct PropertyAnimation {
     to: AnimationValue,
 
     /// The timing function of this `PropertyAnimation`.
-    timing_function: TimingFunction,
+    timing_function: PrecomputedTimingFunction,
 
     /// The duration of this `PropertyAnimation` in seconds.
     pub duration: f64,
@@ -58,20 +63,15 @@ impl PropertyAnimation {
     }
 
     /// The output of the timing function given the progress ration of this animation.
-    fn timing_function_output(&self, progress: f64) -> f64 {
+    fn timing_function_output(&self, progress: f64, before_flag: BeforeFlag) -> f64 {
         let epsilon = 1. / (200. * self.duration);
-        // FIXME: Need to set the before flag correctly.
-        // In order to get the before flag, we have to know the current animation phase
-        // and whether the iteration is reversed. For now, we skip this calculation
-        // by treating as if the flag is unset at all times.
-        // https://drafts.csswg.org/css-easing/#step-timing-function-algo
         self.timing_function
-            .calculate_output(progress, BeforeFlag::Unset, epsilon)
+            .calculate_output(progress, before_flag, epsilon)
     }
 
     /// Update the given animation at a given point of progress.
-    fn calculate_value(&self, progress: f64) -> AnimationValue {
-        let progress = self.timing_function_output(progress);
+    fn calculate_value(&self, progress: f64, before_flag: BeforeFlag) -> AnimationValue {
+        let progress = self.timing_function_output(progress, before_flag);
         let procedure = Procedure::Interpolate { progress };
         self.from.animate(&self.to, procedure).unwrap_or_else(|()| {
             // Fall back to discrete interpolation
@@ -254,11 +254,11 @@ impl IntermediateComputedKeyframe {
 }
 
 /// A single computed keyframe for a CSS Animation.
-#[derive(Clone, MallocSizeOf)]
+#[derive(Clone, MallocSizeOf, PartialEq)]
 struct ComputedKeyframe {
     /// The timing function to use for transitions between this step
     /// and the next one.
-    timing_function: TimingFunction,
+    timing_function: PrecomputedTimingFunction,
 
     /// The starting percentage (a number between 0 and 1) which represents
     /// at what point in an animation iteration this step is.
@@ -298,14 +298,20 @@ impl ComputedKeyframe {
         let intermediate_steps =
             IntermediateComputedKeyframe::generate_for_keyframes(animation, context, base_style);
 
+        // Keyframes without a timing function of their own share the precomputed default one.
+        let default_timing_function = PrecomputedTimingFunction::new(default_timing_function);
+
         let mut computed_steps: Vec<Self> = Vec::with_capacity(intermediate_steps.len());
         for (step_index, step) in intermediate_steps.into_iter().enumerate() {
             let start_percentage = step.start_percentage;
             let properties_changed_in_step = step.declarations.property_ids().clone();
-            let step_timing_function = step.timing_function.clone();
+            let timing_function = match step.timing_function {
+                Some(ref timing_function) => {
+                    PrecomputedTimingFunction::new(timing_function.clone())
+                },
+                None => default_timing_function.clone(),
+            };
             let step_style = step.resolve_style(element, context, base_style, resolver);
-            let timing_function =
-                step_timing_function.unwrap_or_else(|| default_timing_function.clone());
 
             let values = {
                 // If a value is not set in a property declaration we use the value from
@@ -578,9 +584,8 @@ impl Animation {
         }
     }
 
-    /// Fill in an `AnimationValueMap` with values calculated from this animation at
-    /// the given time value.
-    fn get_property_declaration_at_time(&self, now: f64, map: &mut AnimationValueMap) {
+    /// Where in its keyframes this animation is at the given time.
+    fn keyframe_position(&self, now: f64) -> KeyframePosition {
         debug_assert!(!self.computed_steps.is_empty());
 
         let total_progress = match self.state {
@@ -588,21 +593,30 @@ impl Animation {
                 (now - self.started_at) / self.duration
             },
             AnimationState::Paused(progress) => progress,
-            AnimationState::Canceled => return,
+            AnimationState::Canceled => return KeyframePosition::None,
         };
 
-        if total_progress < 0.
+        let in_before_phase = total_progress < 0.;
+        if in_before_phase
             && self.fill_mode != AnimationFillMode::Backwards
             && self.fill_mode != AnimationFillMode::Both
         {
-            return;
+            return KeyframePosition::None;
         }
-        if self.has_ended(now)
+        let in_after_phase = self.has_ended(now);
+        if in_after_phase
             && self.fill_mode != AnimationFillMode::Forwards
             && self.fill_mode != AnimationFillMode::Both
         {
-            return;
+            return KeyframePosition::None;
         }
+        // https://drafts.csswg.org/web-animations-1/#calculating-the-transformed-progress
+        let reversed = self.current_direction == AnimationDirection::Reverse;
+        let before_flag = if (in_before_phase && !reversed) || (in_after_phase && reversed) {
+            BeforeFlag::Set
+        } else {
+            BeforeFlag::Unset
+        };
         let total_progress = total_progress
             .min(self.current_iteration_end_progress())
             .max(0.0);
@@ -642,58 +656,108 @@ impl Animation {
         }
 
         debug!(
-            "Animation::get_property_declaration_at_time: keyframe from {:?} to {:?}",
+            "Animation::keyframe_position: keyframe from {:?} to {:?}",
             prev_keyframe_index, next_keyframe_index
         );
 
-        let prev_keyframe = &self.computed_steps[prev_keyframe_index];
-        let next_keyframe = match next_keyframe_index {
-            Some(index) => &self.computed_steps[index],
-            None => return,
+        let next_keyframe_index = match next_keyframe_index {
+            Some(index) => index,
+            None => return KeyframePosition::None,
         };
 
         // If we only need to take into account one keyframe, then exit early
         // in order to avoid doing more work.
-        let mut add_declarations_to_map = |keyframe: &ComputedKeyframe| {
-            for value in keyframe.values.iter() {
-                map.insert(value.id().to_owned(), value.clone());
-            }
-        };
         if total_progress <= 0.0 {
-            add_declarations_to_map(&prev_keyframe);
-            return;
+            return KeyframePosition::At(prev_keyframe_index);
         }
         if total_progress >= 1.0 {
-            add_declarations_to_map(&next_keyframe);
-            return;
+            return KeyframePosition::At(next_keyframe_index);
         }
 
+        let prev_keyframe = &self.computed_steps[prev_keyframe_index];
+        let next_keyframe = &self.computed_steps[next_keyframe_index];
         let percentage_between_keyframes =
             (next_keyframe.start_percentage - prev_keyframe.start_percentage).abs() as f64;
-        let duration_between_keyframes = percentage_between_keyframes * self.duration;
         let direction_aware_prev_keyframe_start_percentage = match self.current_direction {
             AnimationDirection::Normal => prev_keyframe.start_percentage as f64,
             AnimationDirection::Reverse => 1. - prev_keyframe.start_percentage as f64,
             _ => unreachable!(),
         };
-        let progress_between_keyframes = (total_progress
-            - direction_aware_prev_keyframe_start_percentage)
+        let progress = (total_progress - direction_aware_prev_keyframe_start_percentage)
             / percentage_between_keyframes;
+        KeyframePosition::Between {
+            prev: prev_keyframe_index,
+            next: next_keyframe_index,
+            progress,
+            before_flag,
+        }
+    }
+
+    /// The duration of the segment between two keyframes, which determines the
+    /// precision of the timing function output.
+    fn duration_between_keyframes(&self, prev: usize, next: usize) -> f64 {
+        let prev_keyframe = &self.computed_steps[prev];
+        let next_keyframe = &self.computed_steps[next];
+        (next_keyframe.start_percentage - prev_keyframe.start_percentage).abs() as f64
+            * self.duration
+    }
 
+    /// Fill in an `AnimationValueMap` with values calculated from this animation at
+    /// the given time value.
+    fn get_property_declaration_at_time(&self, now: f64, map: &mut AnimationValueMap) {
+        let mut add_declarations_to_map = |keyframe: &ComputedKeyframe| {
+            for value in keyframe.values.iter() {
+                map.insert(value.id().to_owned(), value.clone());
+            }
+        };
+        let (prev, next, progress, before_flag) = match self.keyframe_position(now) {
+            KeyframePosition::None => return,
+            KeyframePosition::At(index) => {
+                add_declarations_to_map(&self.computed_steps[index]);
+                return;
+            },
+            KeyframePosition::Between {
+                prev,
+                next,
+                progress,
+                before_flag,
+            } => (prev, next, progress, before_flag),
+        };
+
+        let prev_keyframe = &self.computed_steps[prev];
+        let next_keyframe = &self.computed_steps[next];
         for (from, to) in prev_keyframe.values.iter().zip(next_keyframe.values.iter()) {
             let animation = PropertyAnimation {
                 from: from.clone(),
                 to: to.clone(),
                 timing_function: prev_keyframe.timing_function.clone(),
-                duration: duration_between_keyframes as f64,
+                duration: self.duration_between_keyframes(prev, next),
             };
 
-            let value = animation.calculate_value(progress_between_keyframes);
+            let value = animation.calculate_value(progress, before_flag);
             map.insert(value.id().to_owned(), value);
         }
     }
 }
 
+/// Where an animation is in its keyframes at a given time.
+#[derive(Clone, Copy, Debug, PartialEq)]
+enum KeyframePosition {
+    /// The animation has no effect.
+    None,
+    /// The animation values are the ones of the keyframe at this index.
+    At(usize),
+    /// The animation values are interpolated between two keyframes, by the
+    /// given progress, before applying the timing function with the given
+    /// before flag.
+    Between {
+        prev: usize,
+        next: usize,
+        progress: f64,
+        before_flag: BeforeFlag,
+    },
+}
+
 impl fmt::Debug for Animation {
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
         f.debug_struct("Animation")
@@ -751,7 +815,7 @@ impl Transition {
         let property_animation = PropertyAnimation {
             from: from.clone(),
             to,
-            timing_function: timing_function.clone(),
+            timing_function: PrecomputedTimingFunction::new(timing_function.clone()),
             duration,
         };
         Self {
@@ -797,7 +861,8 @@ impl Transition {
             / (replaced_transition.property_animation.duration))
             .min(1.0)
             .max(0.0);
-        let timing_function_output = replaced_animation.timing_function_output(transition_progress);
+        let timing_function_output = replaced_animation
+            .timing_function_output(transition_progress, replaced_transition.before_flag(now));
         let old_reversing_shortening_factor = replaced_transition.reversing_shortening_factor;
         self.reversing_shortening_factor = ((timing_function_output
             * old_reversing_shortening_factor)
@@ -842,16 +907,27 @@ impl Transition {
         time >= self.start_time + (self.property_animation.duration)
     }
 
+    /// The before flag of the timing function of this transition at the given
+    /// time. Transitions always run forwards, so it's only set before they
+    /// start.
+    fn before_flag(&self, time: f64) -> BeforeFlag {
+        if time < self.start_time {
+            BeforeFlag::Set
+        } else {
+            BeforeFlag::Unset
+        }
+    }
+
     /// Update the given animation at a given point of progress.
     pub fn calculate_value(&self, time: f64) -> AnimationValue {
         let progress = (time - self.start_time) / (self.property_animation.duration);
         self.property_animation
-            .calculate_value(progress.clamp(0.0, 1.0))
+            .calculate_value(progress.clamp(0.0, 1.0), self.before_flag(time))
     }
 }
 
 /// Holds the animation state for a particular element.
-#[derive(Debug, Default, MallocSizeOf)]
+#[derive(Clone, Debug, Default, MallocSizeOf)]
 pub struct ElementAnimationSet {
     /// The animations for this element.
     pub animations: Vec<Animation>,
@@ -1284,6 +1360,158 @@ impl ElementAnimationSet {
 
         Some(map)
     }
+
+    /// Return a locked PropertyDeclarationBlock with the values of the active
+    /// animations at the given time.
+    fn animation_declarations(
+        &self,
+        time: f64,
+        shared_lock: &SharedRwLock,
+    ) -> Option<Arc<Locked<PropertyDeclarationBlock>>> {
+        self.get_value_map_for_active_animations(time).map(|map| {
+            let block = PropertyDeclarationBlock::from_animation_value_map(&map);
+            Arc::new(shared_lock.wrap(block))
+        })
+    }
+
+    /// Return a locked PropertyDeclarationBlock with the values of the running
+    /// transitions at the given time.
+    fn transition_declarations(
+        &self,
+        time: f64,
+        shared_lock: &SharedRwLock,
+    ) -> Option<Arc<Locked<PropertyDeclarationBlock>>> {
+        self.get_value_map_for_transitions(time, IgnoreTransitions::CanceledAndFinished)
+            .map(|map| {
+                let block = PropertyDeclarationBlock::from_animation_value_map(&map);
+                Arc::new(shared_lock.wrap(block))
+            })
+    }
+
+    fn all_declarations(&self, time: f64, shared_lock: &SharedRwLock) -> AnimationDeclarations {
+        AnimationDeclarations {
+            animations: self.animation_declarations(time, shared_lock),
+            transitions: self.transition_declarations(time, shared_lock),
+        }
+    }
+
+    /// Whether the animations and transitions of this set are all running at
+    /// `now`, and will stay in the same iteration, so that the set of animated
+    /// properties doesn't change.
+    fn is_steadily_running(&self, now: f64) -> bool {
+        let animations_running = self.animations.iter().all(|animation| {
+            matches!(
+                animation.state,
+                AnimationState::Running | AnimationState::Paused(..)
+            ) && !animation.has_ended(now)
+                && !animation.iteration_over(now)
+        });
+        let transitions_running = self.transitions.iter().all(|transition| {
+            transition.state == AnimationState::Running && !transition.has_ended(now)
+        });
+        animations_running && transitions_running
+    }
+
+    /// Computes the style of an element for an animation tick by applying the
+    /// animated values directly to its current style, skipping selector
+    /// matching, the rule tree and the cascade.
+    ///
+    /// This is only possible when all the animated properties are ones that
+    /// no other property depends on (see `animates_without_restyle`), and all
+    /// the animations are steadily running, since otherwise some property
+    /// would need to go back to its cascaded value. Returns `None` when a
+    /// regular restyle is needed.
+    ///
+    /// The rule node of the new style isn't updated, so its animation and
+    /// transition rules are stale. The result must be stored with
+    /// `AnimationOnlyTick::apply`, which makes sure that the element is
+    /// rematched before it's ever recascaded from that rule node.
+    pub fn tick_animation_only<E: TElement>(
+        &self,
+        style: &Arc<ComputedValues>,
+        now: f64,
+    ) -> Option<AnimationOnlyTick> {
+        if !self.is_steadily_running(now) {
+            return None;
+        }
+
+        let animations = self.get_value_map_for_active_animations(now);
+        let transitions =
+            self.get_value_map_for_transitions(now, IgnoreTransitions::CanceledAndFinished);
+        // Transitions are applied last, since they win over animations in the
+        // cascade.
+        let values = animations
+            .iter()
+            .chain(transitions.iter())
+            .flat_map(|map| map.values());
+        if !values.clone().all(|value| {
+            value
+                .id()
+                .as_longhand()
+                .map_or(false, animates_without_restyle)
+        }) {
+            return None;
+        }
+
+        // Only the style structs that hold animated properties get copied.
+        let mut new_style = (**style).clone();
+        for value in values {
+            value.set_in_style_for_servo(&mut new_style);
+        }
+        let damage = RestyleDamage::compute_style_difference::<E>(style, &new_style).damage;
+        Some(AnimationOnlyTick {
+            style: if damage.is_empty() {
+                style.clone()
+            } else {
+                Arc::new(new_style)
+            },
+            damage,
+        })
+    }
+}
+
+/// Whether animating the given property can be done by patching the computed
+/// style of an element, without cascading. These are the properties that are
+/// usually animated on the compositor, which no other property depends on.
+pub fn animates_without_restyle(id: LonghandId) -> bool {
+    matches!(
+        id,
+        LonghandId::Opacity
+            | LonghandId::Transform
+            | LonghandId::Translate
+            | LonghandId::Rotate
+            | LonghandId::Scale
+    )
+}
+
+/// The result of `ElementAnimationSet::tick_animation_only`.
+pub struct AnimationOnlyTick {
+    /// The new style of the element. It shares all the style structs without
+    /// animated properties with the previous style, or is the previous style if
+    /// nothing changed.
+    pub style: Arc<ComputedValues>,
+    /// The damage between the previous and the new style.
+    pub damage: RestyleDamage,
+}
+
+impl AnimationOnlyTick {
+    /// Stores the new style of the element, or of the given pseudo-element of
+    /// it, in its data, and accumulates the damage.
+    ///
+    /// Recascading the element from the rule node of the new style would bring
+    /// back the animated values of the last restyle, so this also asks the
+    /// next traversal that visits the element to rematch it, which replaces
+    /// its animation and transition rules. The ancestors aren't marked as
+    /// having dirty descendants, since the stored style is already up to date:
+    /// the element only needs to be rematched if something else restyles it.
+    pub fn apply(self, data: &mut ElementData, pseudo_element: Option<&PseudoElement>) {
+        match pseudo_element {
+            Some(pseudo_element) => data.styles.pseudos.set(pseudo_element, self.style),
+            None => data.styles.primary = Some(self.style),
+        }
+        data.damage |= self.damage;
+        data.hint.insert(RestyleHint::RESTYLE_SELF);
+    }
 }
 
 #[derive(Clone, Debug, Eq, Hash, MallocSizeOf, PartialEq)]
@@ -1322,18 +1550,44 @@ impl AnimationSetKey {
     }
 }
 
+/// The number of shards of a `DocumentAnimationSet`, as a power of two.
+const ANIMATION_SET_SHARD_BITS: u32 = 4;
+const ANIMATION_SET_SHARD_COUNT: usize = 1 << ANIMATION_SET_SHARD_BITS;
+
+type ElementAnimationSets = FxHashMap<AnimationSetKey, Arc<ElementAnimationSet>>;
+
+/// Returns the index of the shard of a `DocumentAnimationSet` that holds the given key.
+fn shard_index(key: &AnimationSetKey) -> usize {
+    let mut hasher = FxHasher::default();
+    key.hash(&mut hasher);
+    // Use the high bits, since keys are mostly aligned pointers.
+    (hasher.finish() >> (64 - ANIMATION_SET_SHARD_BITS)) as usize
+}
+
 #[derive(Clone, Debug, Default, MallocSizeOf)]
 /// A set of animations for a document.
+///
+/// Style threads look up the animations of every element they style, so rather than a single
+/// lock, the sets are split by key into independently locked shards, which keeps contention low
+/// when many elements are animating. The element sets themselves are reference counted, so that
+/// their declarations can be built outside of the locks.
+///
+/// The shards are copied on write, so that `snapshot` can hand out a view of the whole document
+/// that can be read without any locks.
 pub struct DocumentAnimationSet {
-    /// The `ElementAnimationSet`s that this set contains.
+    /// The shards of the map from keys to `ElementAnimationSet`s.
     #[ignore_malloc_size_of = "Arc is hard"]
-    pub sets: Arc<RwLock<FxHashMap<AnimationSetKey, ElementAnimationSet>>>,
+    shards: Arc<[RwLock<Arc<ElementAnimationSets>>; ANIMATION_SET_SHARD_COUNT]>,
 }
 
 impl DocumentAnimationSet {
+    fn shard(&self, key: &AnimationSetKey) -> &RwLock<Arc<ElementAnimationSets>> {
+        &self.shards[shard_index(key)]
+    }
+
     /// Return whether or not the provided node has active CSS animations.
     pub fn has_active_animations(&self, key: &AnimationSetKey) -> bool {
-        self.sets
+        self.shard(key)
             .read()
             .get(key)
             .map_or(false, |set| set.has_active_animation())
@@ -1341,7 +1595,7 @@ impl DocumentAnimationSet {
 
     /// Return whether or not the provided node has active CSS transitions.
     pub fn has_active_transitions(&self, key: &AnimationSetKey) -> bool {
-        self.sets
+        self.shard(key)
             .read()
             .get(key)
             .map_or(false, |set| set.has_active_transition())
@@ -1355,14 +1609,8 @@ impl DocumentAnimationSet {
         time: f64,
         shared_lock: &SharedRwLock,
     ) -> Option<Arc<Locked<PropertyDeclarationBlock>>> {
-        self.sets
-            .read()
-            .get(key)
-            .and_then(|set| set.get_value_map_for_active_animations(time))
-            .map(|map| {
-                let block = PropertyDeclarationBlock::from_animation_value_map(&map);
-                Arc::new(shared_lock.wrap(block))
-            })
+        let set = self.shard(key).read().get(key).cloned()?;
+        set.animation_declarations(time, shared_lock)
     }
 
     /// Return a locked PropertyDeclarationBlock with transition values for the given
@@ -1373,16 +1621,8 @@ impl DocumentAnimationSet {
         time: f64,
         shared_lock: &SharedRwLock,
     ) -> Option<Arc<Locked<PropertyDeclarationBlock>>> {
-        self.sets
-            .read()
-            .get(key)
-            .and_then(|set| {
-                set.get_value_map_for_transitions(time, IgnoreTransitions::CanceledAndFinished)
-            })
-            .map(|map| {
-                let block = PropertyDeclarationBlock::from_animation_value_map(&map);
-                Arc::new(shared_lock.wrap(block))
-            })
+        let set = self.shard(key).read().get(key).cloned()?;
+        set.transition_declarations(time, shared_lock)
     }
 
     /// Get all the animation declarations for the given key, returning an empty
@@ -1393,33 +1633,509 @@ impl DocumentAnimationSet {
         time: f64,
         shared_lock: &SharedRwLock,
     ) -> AnimationDeclarations {
-        let sets = self.sets.read();
-        let set = match sets.get(key) {
-            Some(set) => set,
-            None => return Default::default(),
-        };
-
-        let animations = set.get_value_map_for_active_animations(time).map(|map| {
-            let block = PropertyDeclarationBlock::from_animation_value_map(&map);
-            Arc::new(shared_lock.wrap(block))
-        });
-        let transitions = set
-            .get_value_map_for_transitions(time, IgnoreTransitions::CanceledAndFinished)
-            .map(|map| {
-                let block = PropertyDeclarationBlock::from_animation_value_map(&map);
-                Arc::new(shared_lock.wrap(block))
-            });
-        AnimationDeclarations {
-            animations,
-            transitions,
+        // Build the declarations outside of the lock.
+        let set = self.shard(key).read().get(key).cloned();
+        match set {
+            Some(set) => set.all_declarations(time, shared_lock),
+            None => Default::default(),
         }
     }
 
+    /// Computes the style of the element at the given key for an animation tick
+    /// without restyling it, see `ElementAnimationSet::tick_animation_only`.
+    pub fn tick_animation_only<E: TElement>(
+        &self,
+        key: &AnimationSetKey,
+        style: &Arc<ComputedValues>,
+        time: f64,
+    ) -> Option<AnimationOnlyTick> {
+        let set = self.shard(key).read().get(key).cloned()?;
+        set.tick_animation_only::<E>(style, time)
+    }
+
     /// Cancel all animations for set at the given key.
     pub fn cancel_all_animations_for_key(&self, key: &AnimationSetKey) {
-        if let Some(set) = self.sets.write().get_mut(key) {
-            set.cancel_all_animations();
+        self.with_set_mut(key, |set| set.cancel_all_animations());
+    }
+
+    /// Removes the `ElementAnimationSet` at the given key, and returns it.
+    pub fn take(&self, key: &AnimationSetKey) -> Option<ElementAnimationSet> {
+        let mut shard = self.shard(key).write();
+        // Don't copy the shard if there's nothing to remove.
+        if !shard.contains_key(key) {
+            return None;
+        }
+        let set = Arc::make_mut(&mut *shard).remove(key)?;
+        drop(shard);
+        Some(unwrap_element_animation_set(set))
+    }
+
+    /// Inserts or replaces the `ElementAnimationSet` at the given key.
+    pub fn insert(&self, key: AnimationSetKey, set: ElementAnimationSet) {
+        Arc::make_mut(&mut *self.shard(&key).write()).insert(key, Arc::new(set));
+    }
+
+    /// Runs `f` on the `ElementAnimationSet` at the given key, if there's one.
+    pub fn with_set_mut<R>(
+        &self,
+        key: &AnimationSetKey,
+        f: impl FnOnce(&mut ElementAnimationSet) -> R,
+    ) -> Option<R> {
+        let mut shard = self.shard(key).write();
+        if !shard.contains_key(key) {
+            return None;
+        }
+        Arc::make_mut(&mut *shard)
+            .get_mut(key)
+            .map(|set| f(Arc::make_mut(set)))
+    }
+
+    /// Runs `f` on all the `ElementAnimationSet`s, removing the ones for which it
+    /// returns false. Shards are locked one at a time.
+    pub fn retain(&self, mut f: impl FnMut(&AnimationSetKey, &mut ElementAnimationSet) -> bool) {
+        for shard in self.shards.iter() {
+            let mut shard = shard.write();
+            if shard.is_empty() {
+                continue;
+            }
+            Arc::make_mut(&mut *shard).retain(|key, set| f(key, Arc::make_mut(set)));
+        }
+    }
+
+    /// Runs `f` on all the `ElementAnimationSet`s. Shards are locked one at a time.
+    pub fn for_each(&self, mut f: impl FnMut(&AnimationSetKey, &ElementAnimationSet)) {
+        for shard in self.shards.iter() {
+            for (key, set) in shard.read().iter() {
+                f(key, set);
+            }
+        }
+    }
+
+    /// Returns the number of `ElementAnimationSet`s in this set.
+    pub fn len(&self) -> usize {
+        self.shards.iter().map(|shard| shard.read().len()).sum()
+    }
+
+    /// Groups the running animations of the document so that their values can be computed
+    /// together, see `AnimationBatch`.
+    pub fn animation_batch(&self) -> AnimationBatch {
+        let mut batch = AnimationBatch::default();
+        for shard in self.shards.iter() {
+            for (key, set) in shard.read().iter() {
+                batch.push(key, set);
+            }
+        }
+        batch
+    }
+
+    /// Locks all the shards for reading, and returns a view of all the `ElementAnimationSet`s of
+    /// the document.
+    ///
+    /// This is consistent across shards, but blocks writers to any of them while alive, so
+    /// prefer the methods that take a key when only one set is needed.
+    pub fn sets(&self) -> AnimationSetsReadGuard<'_> {
+        AnimationSetsReadGuard {
+            shards: std::array::from_fn(|i| self.shards[i].read()),
+        }
+    }
+
+    /// Locks all the shards for writing, and returns a view of all the `ElementAnimationSet`s of
+    /// the document. See `sets`.
+    pub fn sets_mut(&self) -> AnimationSetsWriteGuard<'_> {
+        AnimationSetsWriteGuard {
+            shards: std::array::from_fn(|i| self.shards[i].write()),
+        }
+    }
+
+    /// Returns an immutable view of all the `ElementAnimationSet`s of the document.
+    ///
+    /// The shards are locked together while taking it, so the snapshot is consistent across
+    /// shards, but it doesn't copy any of them: the next write to a shard copies it instead, if
+    /// the snapshot is still alive. Reading from a snapshot takes no locks, so style threads can
+    /// use one taken before a traversal to look up the animations of the elements they style.
+    /// Changes made after taking it, including the ones made by the traversal itself, aren't
+    /// visible through it.
+    pub fn snapshot(&self) -> AnimationSetSnapshot {
+        let sets = self.sets();
+        AnimationSetSnapshot {
+            shards: std::array::from_fn(|i| (*sets.shards[i]).clone()),
+        }
+    }
+}
+
+/// An immutable view of the animations of a document, see `DocumentAnimationSet::snapshot`.
+#[derive(Clone)]
+pub struct AnimationSetSnapshot {
+    shards: [Arc<ElementAnimationSets>; ANIMATION_SET_SHARD_COUNT],
+}
+
+impl AnimationSetSnapshot {
+    /// Returns the `ElementAnimationSet` at the given key, if any.
+    pub fn get(&self, key: &AnimationSetKey) -> Option<&ElementAnimationSet> {
+        self.shards[shard_index(key)].get(key).map(|set| &**set)
+    }
+
+    /// Return whether or not the provided node has active CSS animations.
+    pub fn has_active_animations(&self, key: &AnimationSetKey) -> bool {
+        self.get(key)
+            .map_or(false, |set| set.has_active_animation())
+    }
+
+    /// Return whether or not the provided node has active CSS transitions.
+    pub fn has_active_transitions(&self, key: &AnimationSetKey) -> bool {
+        self.get(key)
+            .map_or(false, |set| set.has_active_transition())
+    }
+
+    /// Get all the animation declarations for the given key, returning an empty
+    /// `AnimationDeclarations` if there are no animations.
+    pub fn get_all_declarations(
+        &self,
+        key: &AnimationSetKey,
+        time: f64,
+        shared_lock: &SharedRwLock,
+    ) -> AnimationDeclarations {
+        match self.get(key) {
+            Some(set) => set.all_declarations(time, shared_lock),
+            None => Default::default(),
+        }
+    }
+
+    /// Iterates over all the `ElementAnimationSet`s, in no particular order.
+    pub fn iter(&self) -> impl Iterator<Item = (&AnimationSetKey, &ElementAnimationSet)> {
+        self.shards
+            .iter()
+            .flat_map(|shard| shard.iter().map(|(key, set)| (key, &**set)))
+    }
+
+    /// Returns the number of `ElementAnimationSet`s in this snapshot.
+    pub fn len(&self) -> usize {
+        self.shards.iter().map(|shard| shard.len()).sum()
+    }
+
+    /// Returns whether this snapshot has no animations at all.
+    pub fn is_empty(&self) -> bool {
+        self.shards.iter().all(|shard| shard.is_empty())
+    }
+}
+
+/// Returns the contents of `set`, which is only copied if something else still refers to it.
+fn unwrap_element_animation_set(set: Arc<ElementAnimationSet>) -> ElementAnimationSet {
+    Arc::try_unwrap(set).unwrap_or_else(|set| (*set).clone())
+}
+
+/// A view of all the `ElementAnimationSet`s of a document, see `DocumentAnimationSet::sets`.
+///
+/// The shards are locked in order, so holding this can't deadlock with the methods of
+/// `DocumentAnimationSet`, which lock one shard at a time.
+pub struct AnimationSetsReadGuard<'a> {
+    shards: [RwLockReadGuard<'a, Arc<ElementAnimationSets>>; ANIMATION_SET_SHARD_COUNT],
+}
+
+impl<'a> AnimationSetsReadGuard<'a> {
+    fn shard(&self, key: &AnimationSetKey) -> &ElementAnimationSets {
+        &self.shards[shard_index(key)]
+    }
+
+    /// Returns the `ElementAnimationSet` at the given key, if any.
+    pub fn get(&self, key: &AnimationSetKey) -> Option<&ElementAnimationSet> {
+        self.shard(key).get(key).map(|set| &**set)
+    }
+
+    /// Returns whether there's an `ElementAnimationSet` at the given key.
+    pub fn contains_key(&self, key: &AnimationSetKey) -> bool {
+        self.shard(key).contains_key(key)
+    }
+
+    /// Iterates over all the `ElementAnimationSet`s, in no particular order.
+    pub fn iter(&self) -> impl Iterator<Item = (&AnimationSetKey, &ElementAnimationSet)> {
+        self.shards
+            .iter()
+            .flat_map(|shard| shard.iter().map(|(key, set)| (key, &**set)))
+    }
+
+    /// Returns the number of `ElementAnimationSet`s.
+    pub fn len(&self) -> usize {
+        self.shards.iter().map(|shard| shard.len()).sum()
+    }
+
+    /// Returns whether there are no `ElementAnimationSet`s at all.
+    pub fn is_empty(&self) -> bool {
+        self.shards.iter().all(|shard| shard.is_empty())
+    }
+}
+
+/// A mutable view of all the `ElementAnimationSet`s of a document, see
+/// `DocumentAnimationSet::sets_mut`.
+pub struct AnimationSetsWriteGuard<'a> {
+    shards: [RwLockWriteGuard<'a, Arc<ElementAnimationSets>>; ANIMATION_SET_SHARD_COUNT],
+}
+
+impl<'a> AnimationSetsWriteGuard<'a> {
+    fn shard(&mut self, key: &AnimationSetKey) -> &mut ElementAnimationSets {
+        Arc::make_mut(&mut *self.shards[shard_index(key)])
+    }
+
+    /// Returns the `ElementAnimationSet` at the given key, if any.
+    pub fn get(&self, key: &AnimationSetKey) -> Option<&ElementAnimationSet> {
+        self.shards[shard_index(key)].get(key).map(|set| &**set)
+    }
+
+    /// Returns the `ElementAnimationSet` at the given key mutably, if any.
+    pub fn get_mut(&mut self, key: &AnimationSetKey) -> Option<&mut ElementAnimationSet> {
+        self.shard(key).get_mut(key).map(Arc::make_mut)
+    }
+
+    /// Inserts or replaces the `ElementAnimationSet` at the given key.
+    pub fn insert(&mut self, key: AnimationSetKey, set: ElementAnimationSet) {
+        self.shard(&key).insert(key, Arc::new(set));
+    }
+
+    /// Removes the `ElementAnimationSet` at the given key, and returns it.
+    pub fn remove(&mut self, key: &AnimationSetKey) -> Option<ElementAnimationSet> {
+        self.shard(key)
+            .remove(key)
+            .map(unwrap_element_animation_set)
+    }
+
+    /// Removes the `ElementAnimationSet`s for which `f` returns false.
+    pub fn retain(
+        &mut self,
+        mut f: impl FnMut(&AnimationSetKey, &mut ElementAnimationSet) -> bool,
+    ) {
+        for shard in self.shards.iter_mut() {
+            Arc::make_mut(&mut **shard).retain(|key, set| f(key, Arc::make_mut(set)));
+        }
+    }
+
+    /// Iterates over all the `ElementAnimationSet`s, in no particular order.
+    pub fn iter(&self) -> impl Iterator<Item = (&AnimationSetKey, &ElementAnimationSet)> {
+        self.shards
+            .iter()
+            .flat_map(|shard| shard.iter().map(|(key, set)| (key, &**set)))
+    }
+
+    /// Iterates mutably over all the `ElementAnimationSet`s, in no particular order.
+    pub fn iter_mut(
+        &mut self,
+    ) -> impl Iterator<Item = (&AnimationSetKey, &mut ElementAnimationSet)> {
+        self.shards.iter_mut().flat_map(|shard| {
+            Arc::make_mut(&mut **shard)
+                .iter_mut()
+                .map(|(key, set)| (key, Arc::make_mut(set)))
+        })
+    }
+
+    /// Returns the number of `ElementAnimationSet`s.
+    pub fn len(&self) -> usize {
+        self.shards.iter().map(|shard| shard.len()).sum()
+    }
+}
+
+/// The running animations of a document, grouped by keyframes and duration.
+///
+/// Pages often run the same animation on many elements, usually with different start times. The
+/// animations of a group share their keyframes, so at any given time their values are computed
+/// segment by segment: the progress of all the members between the same two keyframes is eased
+/// in a single pass of the timing function, and then each property is interpolated for all of
+/// them at once, with a dedicated loop for `opacity`, the most commonly animated property.
+///
+/// Elements with more than one active animation are evaluated on their own, since the order of
+/// their animations matters.
+///
+/// The style traversal doesn't use this: it only restyles the elements that need it, and gets
+/// the animation declarations of each of them while cascading it. This is for embedders that
+/// update the animated values of all the elements of a document at once on each tick, for
+/// example to hand them over to a compositor.
+#[derive(Default)]
+pub struct AnimationBatch {
+    /// The groups of animations with the same keyframes.
+    groups: Vec<AnimationGroup>,
+    /// The indices in `groups` of the groups with each `AnimationGroup::key`.
+    group_indices: FxHashMap<u64, SmallVec<[usize; 1]>>,
+    /// The elements evaluated one by one.
+    singles: Vec<(AnimationSetKey, Arc<ElementAnimationSet>)>,
+}
+
+/// Animations of different elements with the same keyframes and duration.
+struct AnimationGroup {
+    /// The elements of this group, each with a single active animation.
+    members: Vec<(AnimationSetKey, Arc<ElementAnimationSet>)>,
+}
+
+impl AnimationGroup {
+    fn animation(&self, member: usize) -> &Animation {
+        &self.members[member].1.animations[0]
+    }
+
+    /// A hash of what animations need to have in common to be in the same group. It leaves out
+    /// the keyframe values, so groups with the same key still need to be checked with `accepts`.
+    fn key(animation: &Animation) -> u64 {
+        let mut hasher = FxHasher::default();
+        animation.name.hash(&mut hasher);
+        animation.duration.to_bits().hash(&mut hasher);
+        for step in animation.computed_steps.iter() {
+            step.start_percentage.to_bits().hash(&mut hasher);
+            step.values.len().hash(&mut hasher);
+        }
+        hasher.finish()
+    }
+
+    fn accepts(&self, animation: &Animation) -> bool {
+        let lead = self.animation(0);
+        lead.name == animation.name
+            && lead.duration == animation.duration
+            && lead.computed_steps == animation.computed_steps
+    }
+}
+
+impl AnimationBatch {
+    fn push(&mut self, key: &AnimationSetKey, set: &Arc<ElementAnimationSet>) {
+        if !set.has_active_animation() {
+            return;
+        }
+        if set.animations.len() != 1 {
+            self.singles.push((key.clone(), set.clone()));
+            return;
+        }
+        let animation = &set.animations[0];
+        let member = (key.clone(), set.clone());
+        let indices = self
+            .group_indices
+            .entry(AnimationGroup::key(animation))
+            .or_default();
+        let group = indices
+            .iter()
+            .copied()
+            .find(|&index| self.groups[index].accepts(animation));
+        match group {
+            Some(index) => self.groups[index].members.push(member),
+            None => {
+                indices.push(self.groups.len());
+                self.groups.push(AnimationGroup {
+                    members: vec![member],
+                });
+            },
+        }
+    }
+
+    /// Returns the number of elements with active animations in this batch.
+    pub fn len(&self) -> usize {
+        self.singles.len()
+            + self
+                .groups
+                .iter()
+                .map(|group| group.members.len())
+                .sum::<usize>()
+    }
+
+    /// Returns whether there are no active animations in this batch.
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Computes the values of all the animations of this batch at the given time, as
+    /// `ElementAnimationSet::get_value_map_for_active_animations` would for each element.
+    /// Elements whose animations have no effect at that time are left out.
+    pub fn get_value_maps(&self, now: f64) -> FxHashMap<AnimationSetKey, AnimationValueMap> {
+        let mut maps = FxHashMap::default();
+        for (key, set) in &self.singles {
+            match set.get_value_map_for_active_animations(now) {
+                Some(map) if !map.is_empty() => {
+                    maps.insert(key.clone(), map);
+                },
+                _ => {},
+            }
         }
+
+        // The members between each pair of keyframes with the same before flag, with their
+        // progress in the segment.
+        let mut segments: FxHashMap<(usize, usize, BeforeFlag), (Vec<usize>, Vec<f64>)> =
+            Default::default();
+        for group in &self.groups {
+            for (segment_members, progress) in segments.values_mut() {
+                segment_members.clear();
+                progress.clear();
+            }
+            let steps = &group.animation(0).computed_steps;
+            for (member, (key, set)) in group.members.iter().enumerate() {
+                match set.animations[0].keyframe_position(now) {
+                    KeyframePosition::None => {},
+                    KeyframePosition::At(index) => {
+                        if steps[index].values.is_empty() {
+                            continue;
+                        }
+                        let map: &mut AnimationValueMap = maps.entry(key.clone()).or_default();
+                        for value in steps[index].values.iter() {
+                            map.insert(value.id().to_owned(), value.clone());
+                        }
+                    },
+                    KeyframePosition::Between {
+                        prev,
+                        next,
+                        progress,
+                        before_flag,
+                    } => {
+                        let segment = segments.entry((prev, next, before_flag)).or_default();
+                        segment.0.push(member);
+                        segment.1.push(progress);
+                    },
+                }
+            }
+
+            for (&(prev, next, before_flag), (segment_members, progress)) in segments.iter_mut() {
+                if segment_members.is_empty() {
+                    continue;
+                }
+                let epsilon =
+                    1. / (200. * group.animation(0).duration_between_keyframes(prev, next));
+                steps[prev]
+                    .timing_function
+                    .calculate_outputs(progress, before_flag, epsilon);
+                for (from, to) in steps[prev].values.iter().zip(steps[next].values.iter()) {
+                    interpolate_for_each(from, to, progress, |index, value| {
+                        let key = &group.members[segment_members[index]].0;
+                        maps.entry(key.clone())
+                            .or_default()
+                            .insert(value.id().to_owned(), value);
+                    });
+                }
+            }
+        }
+        maps
+    }
+}
+
+/// Interpolates between two values for each of the given eased progress values, calling `f`
+/// with the index of the progress value and the result.
+fn interpolate_for_each(
+    from: &AnimationValue,
+    to: &AnimationValue,
+    progress: &[f64],
+    mut f: impl FnMut(usize, AnimationValue),
+) {
+    if let (AnimationValue::Opacity(from), AnimationValue::Opacity(to)) = (from, to) {
+        // Same as `Animate` for `f32`, without the dispatch on the property.
+        let (from, to) = (*from as f64, *to as f64);
+        for (index, progress) in progress.iter().enumerate() {
+            let value = (from * (1. - progress) + to * progress)
+                .min(f32::MAX as f64)
+                .max(f32::MIN as f64);
+            f(index, AnimationValue::Opacity(value as f32));
+        }
+        return;
+    }
+    for (index, &progress) in progress.iter().enumerate() {
+        let procedure = Procedure::Interpolate { progress };
+        let value = from.animate(to, procedure).unwrap_or_else(|()| {
+            // Fall back to discrete interpolation
+            if progress < 0.5 {
+                from.clone()
+            } else {
+                to.clone()
+            }
+        });
+        f(index, value);
     }
 }
 
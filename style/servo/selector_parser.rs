@@ -6,6 +6,7 @@
 
 //! Servo's selector parser.
 
+use crate::atom_cache;
 use crate::attr::{AttrIdentifier, AttrValue};
 use crate::computed_value_flags::ComputedValueFlags;
 use crate::dom::{OpaqueNode, TElement, TNode};
@@ -545,6 +546,11 @@ impl<'a, 'i> ::selectors::Parser<'i> for SelectorParser<'a> {
         !self.for_supports_rule
     }
 
+    #[inline]
+    fn identifier(&self, name: &str) -> AtomIdent {
+        AtomIdent(atom_cache::atomize(name))
+    }
+
     fn parse_non_ts_pseudo_class(
         &self,
         location: SourceLocation,
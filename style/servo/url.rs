@@ -49,7 +49,11 @@ pub struct CssUrlData {
 
 impl ToShmem for CssUrl {
     fn to_shmem(&self, _builder: &mut SharedMemoryBuilder) -> to_shmem::Result<Self> {
-        unimplemented!("If servo wants to share stylesheets across processes, ToShmem for Url must be implemented");
+        // Servo URLs point to the heap, and bundles have no URL table, so
+        // stylesheets with URLs can't be shared.
+        Err(String::from(
+            "ToShmem failed for CssUrl: URLs aren't supported in Servo",
+        ))
     }
 }
 
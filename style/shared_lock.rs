@@ -16,6 +16,10 @@ use std::fmt;
 use std::mem;
 #[cfg(feature = "gecko")]
 use std::ptr;
+#[cfg(all(feature = "servo", debug_assertions))]
+use std::sync::atomic::AtomicUsize;
+#[cfg(feature = "servo")]
+use std::sync::atomic::{AtomicBool, Ordering};
 use style_traits::{CssString, CssStringWriter};
 use to_shmem::{SharedMemoryBuilder, ToShmem};
 
@@ -33,12 +37,17 @@ use to_shmem::{SharedMemoryBuilder, ToShmem};
 /// Gecko also needs the ability to have "read only" SharedRwLocks, which are
 /// used for objects stored in (read only) shared memory. Attempting to acquire
 /// write access to objects protected by a read only SharedRwLock will panic.
+///
+/// In Servo, a lock whose data is not going to change for a while, like the
+/// lock of the stylesheets of a loaded document, can be frozen. Reading a
+/// frozen lock doesn't touch the underlying `RwLock`, so style threads don't
+/// contend on it. Writing requires unfreezing the lock first.
 #[derive(Clone)]
 #[cfg_attr(feature = "servo", derive(MallocSizeOf))]
 pub struct SharedRwLock {
     #[cfg(feature = "servo")]
     #[cfg_attr(feature = "servo", ignore_malloc_size_of = "Arc")]
-    arc: Arc<RwLock<()>>,
+    arc: Arc<ServoLock>,
 
     #[cfg(feature = "gecko")]
     cell: Option<Arc<AtomicRefCell<SomethingZeroSizedButTyped>>>,
@@ -47,6 +56,30 @@ pub struct SharedRwLock {
 #[cfg(feature = "gecko")]
 struct SomethingZeroSizedButTyped;
 
+/// The state of a shared lock (servo).
+#[cfg(feature = "servo")]
+struct ServoLock {
+    lock: RwLock<()>,
+    /// Whether the lock is frozen, in which case `lock` is held for reading
+    /// until it's unfrozen.
+    frozen: AtomicBool,
+    /// The number of live read guards obtained while the lock was frozen.
+    #[cfg(debug_assertions)]
+    frozen_readers: AtomicUsize,
+}
+
+#[cfg(feature = "servo")]
+impl ServoLock {
+    fn new() -> Self {
+        ServoLock {
+            lock: RwLock::new(()),
+            frozen: AtomicBool::new(false),
+            #[cfg(debug_assertions)]
+            frozen_readers: AtomicUsize::new(0),
+        }
+    }
+}
+
 impl fmt::Debug for SharedRwLock {
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
         f.write_str("SharedRwLock")
@@ -58,7 +91,7 @@ impl SharedRwLock {
     #[cfg(feature = "servo")]
     pub fn new() -> Self {
         SharedRwLock {
-            arc: Arc::new(RwLock::new(())),
+            arc: Arc::new(ServoLock::new()),
         }
     }
 
@@ -74,7 +107,7 @@ impl SharedRwLock {
     #[cfg(feature = "servo")]
     pub fn new_leaked() -> Self {
         SharedRwLock {
-            arc: Arc::new_leaked(RwLock::new(())),
+            arc: Arc::new_leaked(ServoLock::new()),
         }
     }
 
@@ -112,10 +145,18 @@ impl SharedRwLock {
     }
 
     /// Obtain the lock for reading (servo).
+    ///
+    /// If the lock is frozen, this doesn't touch the underlying lock.
     #[cfg(feature = "servo")]
+    #[inline]
     pub fn read(&self) -> SharedRwLockReadGuard<'_> {
-        mem::forget(self.arc.read());
-        SharedRwLockReadGuard(self)
+        if self.arc.frozen.load(Ordering::Acquire) {
+            #[cfg(debug_assertions)]
+            self.arc.frozen_readers.fetch_add(1, Ordering::Relaxed);
+            return SharedRwLockReadGuard(self, /* frozen = */ true);
+        }
+        mem::forget(self.arc.lock.read());
+        SharedRwLockReadGuard(self, /* frozen = */ false)
     }
 
     /// Obtain the lock for reading (gecko).
@@ -125,12 +166,67 @@ impl SharedRwLock {
     }
 
     /// Obtain the lock for writing (servo).
+    ///
+    /// The lock must not be frozen, otherwise this blocks forever.
     #[cfg(feature = "servo")]
     pub fn write(&self) -> SharedRwLockWriteGuard<'_> {
-        mem::forget(self.arc.write());
+        debug_assert!(
+            !self.is_frozen(),
+            "SharedRwLock::write called on a frozen lock, unfreeze it first"
+        );
+        mem::forget(self.arc.lock.write());
         SharedRwLockWriteGuard(self)
     }
 
+    /// Freeze this lock, so that reading it doesn't touch the underlying lock
+    /// until `unfreeze` is called. This waits for the current writer, if any.
+    ///
+    /// Freezing a frozen lock does nothing.
+    #[cfg(feature = "servo")]
+    pub fn freeze(&self) {
+        // Hold the lock for reading while frozen, so that writers that don't
+        // check for the frozen state block rather than race with readers.
+        mem::forget(self.arc.lock.read());
+        if self.arc.frozen.swap(true, Ordering::Release) {
+            // Unsafe: we took the read lock above.
+            unsafe { self.arc.lock.force_unlock_read() }
+        }
+    }
+
+    /// Unfreeze this lock, so that it can be written to again.
+    ///
+    /// Unfreezing a lock that isn't frozen does nothing.
+    ///
+    /// # Safety
+    ///
+    /// Read guards obtained while the lock was frozen don't hold the
+    /// underlying lock, so none of them may be alive, on any thread, when this
+    /// is called. This is checked in debug builds.
+    ///
+    /// No other thread may call `read` concurrently with this either: it could
+    /// still see the lock as frozen and hand out a guard that doesn't hold the
+    /// underlying lock, after the check above, which a writer wouldn't wait
+    /// for. This isn't checked.
+    #[cfg(feature = "servo")]
+    pub unsafe fn unfreeze(&self) {
+        #[cfg(debug_assertions)]
+        debug_assert_eq!(
+            self.arc.frozen_readers.load(Ordering::Acquire),
+            0,
+            "SharedRwLock::unfreeze called while frozen read guards are alive"
+        );
+        if self.arc.frozen.swap(false, Ordering::AcqRel) {
+            self.arc.lock.force_unlock_read()
+        }
+    }
+
+    /// Whether this lock is frozen (servo).
+    #[cfg(feature = "servo")]
+    #[inline]
+    pub fn is_frozen(&self) -> bool {
+        self.arc.frozen.load(Ordering::Relaxed)
+    }
+
     /// Obtain the lock for writing (gecko).
     #[cfg(feature = "gecko")]
     pub fn write(&self) -> SharedRwLockWriteGuard<'_> {
@@ -138,18 +234,24 @@ impl SharedRwLock {
     }
 }
 
-/// Proof that a shared lock was obtained for reading (servo).
+/// Proof that a shared lock was obtained for reading (servo), and whether it
+/// was frozen at the time.
 #[cfg(feature = "servo")]
-pub struct SharedRwLockReadGuard<'a>(&'a SharedRwLock);
+pub struct SharedRwLockReadGuard<'a>(&'a SharedRwLock, bool);
 /// Proof that a shared lock was obtained for reading (gecko).
 #[cfg(feature = "gecko")]
 pub struct SharedRwLockReadGuard<'a>(Option<AtomicRef<'a, SomethingZeroSizedButTyped>>);
 #[cfg(feature = "servo")]
 impl<'a> Drop for SharedRwLockReadGuard<'a> {
     fn drop(&mut self) {
+        if self.1 {
+            #[cfg(debug_assertions)]
+            self.0.arc.frozen_readers.fetch_sub(1, Ordering::Release);
+            return;
+        }
         // Unsafe: self.lock is private to this module, only ever set after `read()`,
         // and never copied or cloned (see `compile_time_assert` below).
-        unsafe { self.0.arc.force_unlock_read() }
+        unsafe { self.0.arc.lock.force_unlock_read() }
     }
 }
 
@@ -175,7 +277,7 @@ impl<'a> Drop for SharedRwLockWriteGuard<'a> {
     fn drop(&mut self) {
         // Unsafe: self.lock is private to this module, only ever set after `write()`,
         // and never copied or cloned (see `compile_time_assert` below).
-        unsafe { self.0.arc.force_unlock_write() }
+        unsafe { self.0.arc.lock.force_unlock_write() }
     }
 }
 
@@ -204,6 +306,16 @@ impl<T> Locked<T> {
         self.shared_lock.cell.is_none()
     }
 
+    /// Whether this is data written to shared memory (servo), whose lock is
+    /// static and only referenced from here, so that no write guard can ever
+    /// be obtained for it. As in Gecko, such data can be read with any guard,
+    /// like the one of the user agent stylesheets it's usually part of.
+    #[cfg(feature = "servo")]
+    #[inline]
+    fn is_read_only_lock(&self) -> bool {
+        self.shared_lock.arc.is_static()
+    }
+
     #[cfg(feature = "servo")]
     fn same_lock_as(&self, lock: &SharedRwLock) -> bool {
         Arc::ptr_eq(&self.shared_lock.arc, &lock.arc)
@@ -224,7 +336,10 @@ impl<T> Locked<T> {
             guard.ptr(),
         );
         #[cfg(not(feature = "gecko"))]
-        assert!(self.same_lock_as(&guard.0));
+        assert!(
+            self.is_read_only_lock() || self.same_lock_as(&guard.0),
+            "Locked::read_with called with a guard from an unrelated SharedRwLock"
+        );
 
         let ptr = self.data.get();
 
@@ -252,7 +367,10 @@ impl<T> Locked<T> {
             "Locked::write_with called with a guard from a read only or unrelated SharedRwLock"
         );
         #[cfg(not(feature = "gecko"))]
-        assert!(self.same_lock_as(&guard.0));
+        assert!(
+            !self.is_read_only_lock() && self.same_lock_as(&guard.0),
+            "Locked::write_with called with a guard from a read only or unrelated SharedRwLock"
+        );
 
         let ptr = self.data.get();
 
@@ -285,8 +403,20 @@ impl<T: ToShmem> ToShmem for Locked<T> {
 
 #[cfg(feature = "servo")]
 impl<T: ToShmem> ToShmem for Locked<T> {
-    fn to_shmem(&self, _builder: &mut SharedMemoryBuilder) -> to_shmem::Result<Self> {
-        panic!("ToShmem not supported in Servo currently")
+    fn to_shmem(&self, builder: &mut SharedMemoryBuilder) -> to_shmem::Result<Self> {
+        use std::mem::ManuallyDrop;
+
+        let guard = self.shared_lock.read();
+        let data = self.read_with(&guard).to_shmem(builder)?;
+        // The shared data gets a lock of its own in the buffer, whose static
+        // Arc marks it as read only.
+        let shared_lock = SharedRwLock {
+            arc: unsafe { Arc::new_static(|layout| builder.alloc(layout), ServoLock::new()) },
+        };
+        Ok(ManuallyDrop::new(Locked {
+            shared_lock,
+            data: UnsafeCell::new(ManuallyDrop::into_inner(data)),
+        }))
     }
 }
 
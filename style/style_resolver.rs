@@ -4,7 +4,6 @@
 
 //! Style resolution for a given element or pseudo-element.
 
-use crate::applicable_declarations::ApplicableDeclarationList;
 use crate::computed_value_flags::ComputedValueFlags;
 use crate::context::{CascadeInputs, ElementCascadeInputs, StyleContext};
 use crate::data::{EagerPseudoStyles, ElementStyles};
@@ -22,6 +21,7 @@ use selectors::matching::{
 };
 use selectors::parser::PseudoElement as PseudoElementTrait;
 use servo_arc::Arc;
+use std::mem;
 
 /// Whether pseudo-elements should be resolved or not.
 #[derive(Clone, Copy, Debug, Eq, PartialEq)]
@@ -336,6 +336,26 @@ where
         })
     }
 
+    /// Matches the rules of the element, and of its eager pseudo-elements
+    /// given the current style of the element, like `resolve_style` does, but
+    /// without cascading them. Returns the rule node of the element.
+    ///
+    /// This is useful to measure selector matching in isolation.
+    pub fn match_rules(&mut self, originating_element_style: &ComputedValues) -> StrongRuleNode {
+        let primary_results = self.match_primary(
+            VisitedHandlingMode::AllLinksUnvisited,
+            IncludeStartingStyle::No,
+        );
+        SelectorImpl::each_eagerly_cascaded_pseudo_element(|pseudo| {
+            let _ = self.match_pseudo(
+                originating_element_style,
+                &pseudo,
+                VisitedHandlingMode::AllLinksUnvisited,
+            );
+        });
+        primary_results.rule_node
+    }
+
     /// Cascade a set of rules, using the default parent for inheritance.
     pub fn cascade_style_and_visited_with_default_parents(
         &mut self,
@@ -399,6 +419,10 @@ where
             pseudo,
             &conditions,
         );
+        self.context
+            .thread_local
+            .rule_cache
+            .insert_custom_properties_if_possible(&values, pseudo, &conditions);
 
         ResolvedStyle(values)
     }
@@ -507,7 +531,8 @@ where
             "Match primary for {:?}, visited: {:?}",
             self.element, visited_handling
         );
-        let mut applicable_declarations = ApplicableDeclarationList::new();
+        let mut applicable_declarations =
+            mem::take(&mut self.context.thread_local.applicable_declarations);
 
         let bloom_filter = self.context.thread_local.bloom_filter.filter();
         let selector_caches = &mut self.context.thread_local.selector_caches;
@@ -541,6 +566,7 @@ where
         let rule_node = stylist
             .rule_tree()
             .compute_rule_node(&mut applicable_declarations, &self.context.shared.guards);
+        self.context.thread_local.applicable_declarations = applicable_declarations;
 
         if log_enabled!(Trace) {
             trace!("Matched rules for {:?}:", self.element);
@@ -571,8 +597,6 @@ where
         );
         debug_assert!(pseudo_element.is_eager());
 
-        let mut applicable_declarations = ApplicableDeclarationList::new();
-
         let stylist = &self.context.shared.stylist;
 
         if !self
@@ -582,6 +606,9 @@ where
             return None;
         }
 
+        let mut applicable_declarations =
+            mem::take(&mut self.context.thread_local.applicable_declarations);
+
         let bloom_filter = self.context.thread_local.bloom_filter.filter();
         let selector_caches = &mut self.context.thread_local.selector_caches;
 
@@ -611,12 +638,14 @@ where
         );
 
         if applicable_declarations.is_empty() {
+            self.context.thread_local.applicable_declarations = applicable_declarations;
             return None;
         }
 
         let rule_node = stylist
             .rule_tree()
             .compute_rule_node(&mut applicable_declarations, &self.context.shared.guards);
+        self.context.thread_local.applicable_declarations = applicable_declarations;
 
         Some(MatchingResults {
             rule_node,
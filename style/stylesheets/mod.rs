@@ -140,7 +140,11 @@ impl From<::url::Url> for UrlExtraData {
 #[cfg(not(feature = "gecko"))]
 impl ToShmem for UrlExtraData {
     fn to_shmem(&self, _builder: &mut SharedMemoryBuilder) -> to_shmem::Result<Self> {
-        unimplemented!("If servo wants to share stylesheets across processes, ToShmem for Url must be implemented");
+        // Servo URLs point to the heap, and bundles have no URL table, so
+        // stylesheets with URLs can't be shared.
+        Err(String::from(
+            "ToShmem failed for UrlExtraData: URLs aren't supported in Servo",
+        ))
     }
 }
 
@@ -2,6 +2,7 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
+use crate::atom_cache;
 use crate::context::QuirksMode;
 use crate::error_reporting::{ContextualParseError, ParseErrorReporter};
 use crate::media_queries::{Device, MediaList};
@@ -21,8 +22,11 @@ use malloc_size_of::{MallocSizeOfOps, MallocUnconditionalShallowSizeOf};
 use parking_lot::RwLock;
 use rustc_hash::FxHashMap;
 use servo_arc::Arc;
+use std::path::Path;
 use std::sync::atomic::{AtomicBool, Ordering};
 use style_traits::ParsingMode;
+use to_shmem::bundle::{self, Bundle};
+use to_shmem::Dedup;
 
 use super::scope_rule::ImplicitScopeRoot;
 
@@ -145,6 +149,130 @@ impl StylesheetContents {
         })
     }
 
+    /// Writes the rules of these contents into a bundle, which the same build
+    /// can load with `from_bundle` instead of parsing the stylesheet.
+    ///
+    /// Bundled rules are read only, like the user agent stylesheets that Gecko
+    /// shares between processes. User agent contents use them in place, and
+    /// other origins, whose rules the CSSOM can modify, get a copy of them.
+    /// The namespace map isn't kept, but is rebuilt from the `@namespace`
+    /// rules when loading.
+    ///
+    /// This fails if the rules contain values that can't be shared, like
+    /// imports or, in Servo, URLs and atoms that are neither static nor
+    /// inline. Bundles have no atom or URL table, so identifiers longer than
+    /// seven bytes need to be static atoms, which most author stylesheets
+    /// don't satisfy: those keep being parsed by `from_bundle_or_str`.
+    pub fn write_bundle(
+        &self,
+        build_key: u64,
+        capacity: usize,
+        dedup: Dedup,
+    ) -> Result<Vec<u8>, String> {
+        bundle::write_bundle(&self.rules, build_key, capacity, dedup)
+    }
+
+    /// Creates contents that use the rules of a bundle written by
+    /// `write_bundle`, without any parsing.
+    ///
+    /// User agent contents use the rules in place, and are read only. Other
+    /// origins get a copy of the rules that uses `shared_lock`, so that the
+    /// CSSOM can modify them, which is still much cheaper than parsing: the
+    /// values behind Arcs aren't copied, and keep pointing into the bundle.
+    ///
+    /// # Safety
+    ///
+    /// The bundle must outlive the returned contents, and any rule or value
+    /// obtained from them.
+    pub unsafe fn from_bundle(
+        bundle: &Bundle,
+        origin: Origin,
+        url_data: UrlExtraData,
+        shared_lock: &SharedRwLock,
+        quirks_mode: QuirksMode,
+    ) -> Result<Arc<Self>, String> {
+        let rules = bundle.root::<Arc<Locked<CssRules>>>()?;
+        if origin == Origin::UserAgent {
+            return Ok(Self::from_shared_data(
+                rules.clone(),
+                origin,
+                url_data,
+                quirks_mode,
+            ));
+        }
+
+        // The bundled rules are read only, so they can be read with any guard.
+        let guard = shared_lock.read();
+        let rules = rules
+            .read_with(&guard)
+            .deep_clone_with_lock(shared_lock, &guard);
+        let mut namespaces = Namespaces::default();
+        for rule in rules.0.iter() {
+            let CssRule::Namespace(ref rule) = *rule else {
+                continue;
+            };
+            match rule.prefix {
+                Some(ref prefix) => {
+                    namespaces.prefixes.insert(prefix.clone(), rule.url.clone());
+                },
+                None => namespaces.default = Some(rule.url.clone()),
+            }
+        }
+        Ok(Arc::new(Self {
+            rules: Arc::new(shared_lock.wrap(rules)),
+            origin,
+            url_data: RwLock::new(url_data),
+            namespaces: RwLock::new(namespaces),
+            quirks_mode,
+            source_map_url: RwLock::new(None),
+            source_url: RwLock::new(None),
+            use_counters: UseCounters::default(),
+            _forbid_construction: (),
+        }))
+    }
+
+    /// Creates contents of the given origin from the bundle at `path`, see
+    /// `from_bundle`, or by parsing `css` if the bundle is missing, was
+    /// written by another build, or is otherwise invalid.
+    ///
+    /// Returns the bundle the contents use, if any.
+    ///
+    /// # Safety
+    ///
+    /// As for `from_bundle`, the returned bundle must outlive the contents.
+    pub unsafe fn from_bundle_or_str(
+        path: &Path,
+        build_key: u64,
+        css: &str,
+        origin: Origin,
+        url_data: UrlExtraData,
+        shared_lock: &SharedRwLock,
+        quirks_mode: QuirksMode,
+    ) -> (Arc<Self>, Option<Bundle>) {
+        let loaded = Bundle::open(path, build_key).and_then(|bundle| {
+            let contents =
+                Self::from_bundle(&bundle, origin, url_data.clone(), shared_lock, quirks_mode)?;
+            Ok((contents, bundle))
+        });
+        match loaded {
+            Ok((contents, bundle)) => (contents, Some(bundle)),
+            Err(..) => {
+                let contents = Self::from_str(
+                    css,
+                    url_data,
+                    origin,
+                    shared_lock,
+                    None,
+                    None,
+                    quirks_mode,
+                    AllowImportRules::Yes,
+                    None,
+                );
+                (contents, None)
+            },
+        }
+    }
+
     /// Returns a reference to the list of rules.
     #[inline]
     pub fn rules<'a, 'b: 'a>(&'a self, guard: &'b SharedRwLockReadGuard) -> &'a [CssRule] {
@@ -443,6 +571,9 @@ impl Stylesheet {
         allow_import_rules: AllowImportRules,
         mut sanitization_data: Option<&mut SanitizationData>,
     ) -> (Namespaces, Vec<CssRule>, Option<String>, Option<String>) {
+        // Identifiers repeat a lot within a stylesheet, so intern them in a
+        // thread-local cache while parsing it.
+        let _atom_cache = atom_cache::ParseScope::new();
         let mut input = ParserInput::new(css);
         let mut input = Parser::new(&mut input);
 
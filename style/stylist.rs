@@ -22,6 +22,8 @@ use crate::invalidation::media_queries::{
 };
 use crate::invalidation::stylesheets::RuleChangeKind;
 use crate::media_queries::Device;
+#[cfg(feature = "servo")]
+use crate::properties::StyleStructInterner;
 use crate::properties::{self, CascadeMode, ComputedValues, FirstLineReparenting};
 use crate::properties::{AnimationDeclarations, PropertyDeclarationBlock};
 use crate::properties_and_values::registry::{
@@ -31,6 +33,7 @@ use crate::rule_cache::{RuleCache, RuleCacheConditions};
 use crate::rule_collector::RuleCollector;
 use crate::rule_tree::{CascadeLevel, RuleTree, StrongRuleNode, StyleSource};
 use crate::selector_map::{PrecomputedHashMap, PrecomputedHashSet, SelectorMap, SelectorMapEntry};
+use crate::selector_match_stats::{SelectorMatchStats, SlowSelector};
 use crate::selector_parser::{
     NonTSPseudoClass, PerPseudoElementMap, PseudoElement, SelectorImpl, SnapshotMap,
 };
@@ -46,15 +49,15 @@ use crate::stylesheets::scope_rule::{
     collect_scope_roots, element_is_outside_of_scope, scope_selector_list_is_trivial,
     ImplicitScopeRoot, ScopeRootCandidate, ScopeSubjectMap, ScopeTarget,
 };
+use crate::stylesheets::{
+    AllRules, CssRule, EffectiveRulesIterator, Origin, OriginSet, PageRule, PerOrigin,
+    PerOriginIter, StylesheetContents, StylesheetInDocument,
+};
 #[cfg(feature = "gecko")]
 use crate::stylesheets::{
     CounterStyleRule, FontFaceRule, FontFeatureValuesRule, FontPaletteValuesRule,
     PagePseudoClassFlags, PositionTryRule,
 };
-use crate::stylesheets::{
-    CssRule, EffectiveRulesIterator, Origin, OriginSet, PageRule, PerOrigin, PerOriginIter,
-    StylesheetContents, StylesheetInDocument,
-};
 use crate::values::{computed, AtomIdent};
 use crate::AllocErr;
 use crate::{Atom, LocalName, Namespace, ShrinkIfNeeded, WeakAtom};
@@ -565,6 +568,18 @@ pub struct Stylist {
 
     /// The total number of times the stylist has been rebuilt.
     num_rebuilds: usize,
+
+    /// The table used to deduplicate computed style structs, if enabled.
+    #[cfg(feature = "servo")]
+    style_struct_interner: Option<Box<StyleStructInterner>>,
+
+    /// Sampled selector matching statistics, if enabled.
+    #[cfg_attr(feature = "servo", ignore_malloc_size_of = "Debugging aid")]
+    selector_match_stats: Option<Box<SelectorMatchStats>>,
+
+    /// Whether cascades reuse the per-thread storage for their transient
+    /// data, see `CascadeScratch`.
+    cascade_scratch_reuse_enabled: bool,
 }
 
 /// What cascade levels to include when styling elements.
@@ -725,9 +740,101 @@ impl Stylist {
             initial_values_for_custom_properties: Default::default(),
             initial_values_for_custom_properties_flags: Default::default(),
             num_rebuilds: 0,
+            #[cfg(feature = "servo")]
+            style_struct_interner: None,
+            selector_match_stats: None,
+            cascade_scratch_reuse_enabled: true,
+        }
+    }
+
+    /// Enables or disables sharing equal style structs computed for unrelated
+    /// elements, see `StyleStructInterner`.
+    #[cfg(feature = "servo")]
+    pub fn set_style_struct_interning_enabled(&mut self, enabled: bool) {
+        if enabled != self.style_struct_interner.is_some() {
+            self.style_struct_interner = enabled.then(|| Box::new(StyleStructInterner::new()));
+        }
+    }
+
+    /// Returns the style struct interner, if style struct interning is enabled.
+    #[cfg(feature = "servo")]
+    #[inline]
+    pub fn style_struct_interner(&self) -> Option<&StyleStructInterner> {
+        self.style_struct_interner.as_deref()
+    }
+
+    /// Enables or disables reusing per-thread storage for the transient data
+    /// of the cascade, which is enabled by default. Disabling it allocates
+    /// that storage for every cascade, which is only useful to measure what
+    /// reusing it saves.
+    pub fn set_cascade_scratch_reuse_enabled(&mut self, enabled: bool) {
+        self.cascade_scratch_reuse_enabled = enabled;
+    }
+
+    /// Returns whether cascades reuse per-thread storage for their transient
+    /// data.
+    #[inline]
+    pub fn cascade_scratch_reuse_enabled(&self) -> bool {
+        self.cascade_scratch_reuse_enabled
+    }
+
+    /// Enables sampled selector match statistics, recording one in every
+    /// `sample_rate` match attempts, or disables them if `sample_rate` is
+    /// `None`. Changing the sample rate discards the recorded samples.
+    pub fn set_selector_match_stats(&mut self, sample_rate: Option<u32>) {
+        let current = self.selector_match_stats.as_ref().map(|s| s.sample_rate());
+        if current != sample_rate {
+            self.selector_match_stats =
+                sample_rate.map(|rate| Box::new(SelectorMatchStats::new(rate)));
         }
     }
 
+    /// Returns the selector match statistics, if enabled.
+    #[inline]
+    pub fn selector_match_stats(&self) -> Option<&SelectorMatchStats> {
+        self.selector_match_stats.as_deref()
+    }
+
+    /// Returns the `count` selectors that were the most expensive to match
+    /// according to the sampled selector match statistics, along with the
+    /// location of their style rule in the document stylesheets.
+    ///
+    /// Selectors from shadow tree stylesheets have no source location.
+    pub fn slowest_selectors(&self, count: usize, guards: &StylesheetGuards) -> Vec<SlowSelector> {
+        let stats = match self.selector_match_stats {
+            Some(ref stats) => stats,
+            None => return vec![],
+        };
+        let mut slowest = stats.most_expensive(count);
+        let mut locations = FxHashMap::default();
+        for selector in &slowest {
+            locations.insert(&**selector.style_source.get() as *const _, None);
+        }
+        for (stylesheet, origin) in self.stylesheets.iter() {
+            let guard = guards.for_origin(origin);
+            for rule in stylesheet.iter_rules::<AllRules>(&self.device, guard) {
+                let (block, location) = match *rule {
+                    CssRule::Style(ref rule) => {
+                        let rule = rule.read_with(guard);
+                        (&*rule.block as *const _, rule.source_location)
+                    },
+                    CssRule::NestedDeclarations(ref rule) => {
+                        let rule = rule.read_with(guard);
+                        (&*rule.block as *const _, rule.source_location)
+                    },
+                    _ => continue,
+                };
+                if let Some(slot) = locations.get_mut(&block) {
+                    *slot = Some(location);
+                }
+            }
+        }
+        for selector in &mut slowest {
+            selector.source_location = locations[&(&**selector.style_source.get() as *const _)];
+        }
+        slowest
+    }
+
     /// Returns the document cascade data.
     #[inline]
     pub fn cascade_data(&self) -> &DocumentCascadeData {
@@ -912,6 +1019,7 @@ impl Stylist {
         }
 
         self.num_rebuilds += 1;
+        let _span = style_span!("Stylist::flush", rebuild = self.num_rebuilds);
 
         let flusher = self.stylesheets.flush(document_element, snapshots);
 
@@ -2993,6 +3101,11 @@ pub struct CascadeData {
     /// style rule appears in a stylesheet, needed to sort them by source order.
     rules_source_order: u32,
 
+    /// The first source order of the rules of each stylesheet added to this
+    /// cascade data, alongside the stylesheet, in increasing order. Used to
+    /// attribute rules back to their stylesheet when profiling.
+    sheet_source_order_starts: Vec<(u32, RuleSheet)>,
+
     /// The total number of selectors.
     num_selectors: usize,
 
@@ -3059,6 +3172,7 @@ impl CascadeData {
             extra_data: ExtraStyleData::default(),
             effective_media_query_results: EffectiveMediaQueryResults::new(),
             rules_source_order: 0,
+            sheet_source_order_starts: Vec::new(),
             num_selectors: 0,
             num_declarations: 0,
         }
@@ -3081,6 +3195,11 @@ impl CascadeData {
         }
 
         let validity = collection.data_validity();
+        let span = style_span!(
+            "CascadeData::rebuild",
+            validity = tracing::field::debug(validity),
+            selectors = tracing::field::Empty,
+        );
 
         match validity {
             DataValidity::Valid => {},
@@ -3104,6 +3223,7 @@ impl CascadeData {
         });
 
         self.did_finish_rebuild();
+        style_span_record!(span, "selectors", self.num_selectors);
 
         result
     }
@@ -4079,6 +4199,13 @@ impl CascadeData {
             self.effective_media_query_results.saw_effective(contents);
         }
 
+        let sheet = RuleSheet {
+            index: sheet_index,
+            contents: contents as *const StylesheetContents as usize,
+        };
+        self.sheet_source_order_starts
+            .push((self.rules_source_order, sheet));
+
         let mut state = ContainingRuleState::default();
         self.add_rule_list(
             contents.rules(guard).iter(),
@@ -4095,6 +4222,15 @@ impl CascadeData {
         Ok(())
     }
 
+    /// Returns the stylesheet the rule with the given source order came from,
+    /// if any.
+    pub fn sheet_for_source_order(&self, source_order: u32) -> Option<RuleSheet> {
+        let after = self
+            .sheet_source_order_starts
+            .partition_point(|&(start, _)| start <= source_order);
+        Some(self.sheet_source_order_starts.get(after.checked_sub(1)?)?.1)
+    }
+
     /// Returns whether all the media-feature affected values matched before and
     /// match now in the given stylesheet.
     pub fn media_feature_affected_matches<S>(
@@ -4267,6 +4403,7 @@ impl CascadeData {
         #[cfg(feature = "gecko")]
         self.extra_data.clear();
         self.rules_source_order = 0;
+        self.sheet_source_order_starts.clear();
         self.num_selectors = 0;
         self.num_declarations = 0;
     }
@@ -4338,6 +4475,17 @@ impl Default for CascadeData {
     }
 }
 
+/// The stylesheet a rule came from, see `CascadeData::sheet_for_source_order`.
+#[derive(Clone, Copy, Debug, Eq, Hash, MallocSizeOf, PartialEq)]
+pub struct RuleSheet {
+    /// The index of the stylesheet within its origin (or shadow tree).
+    pub index: usize,
+    /// The address of the contents of the stylesheet. Unlike the index, this
+    /// tells apart the stylesheets of different shadow trees, and is the same
+    /// for a stylesheet shared by many of them.
+    pub contents: usize,
+}
+
 /// A rule, that wraps a style rule, but represents a single selector of the
 /// rule.
 #[derive(Clone, Debug, MallocSizeOf)]
@@ -0,0 +1,16 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Support for the `style_span!` macro, which emits `tracing` spans for the
+//! main phases of the style system when the `tracing` feature is enabled.
+
+/// A guard for an entered span.
+#[cfg(feature = "tracing")]
+pub use tracing::span::EnteredSpan;
+
+/// A stand-in for an entered span when the `tracing` feature is disabled.
+/// Fields are recorded with `style_span_record!`, which does nothing then.
+#[cfg(not(feature = "tracing"))]
+#[derive(Debug)]
+pub struct EnteredSpan;
@@ -0,0 +1,306 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Kernels for the 4x4 matrix operations of transform interpolation.
+//!
+//! Matrices are handled as four rows of four lanes. Products are computed as linear combinations
+//! of rows, which use SSE on x86-64, where it's part of the baseline, and a plain loop elsewhere.
+//! Both compute the same sums in the same order as the scalar code they replace, so the results
+//! don't depend on the platform.
+
+use crate::values::computed::transform::Matrix3D;
+
+/// The rows of a matrix.
+pub type Rows = [[f32; 4]; 4];
+
+/// The rows of the given matrix.
+#[inline]
+pub fn rows(matrix: &Matrix3D) -> &Rows {
+    // Safe because `Matrix3D` is `#[repr(C)]`, with its sixteen `f32` fields in row order.
+    unsafe { &*(matrix as *const Matrix3D as *const Rows) }
+}
+
+/// The matrix with the given rows.
+#[inline]
+#[cfg_attr(rustfmt, rustfmt_skip)]
+pub fn from_rows(rows: Rows) -> Matrix3D {
+    let [[m11, m12, m13, m14], [m21, m22, m23, m24], [m31, m32, m33, m34], [m41, m42, m43, m44]] =
+        rows;
+    Matrix3D {
+        m11, m12, m13, m14,
+        m21, m22, m23, m24,
+        m31, m32, m33, m34,
+        m41, m42, m43, m44,
+    }
+}
+
+/// `coefficients[0] * rows[0] + ... + coefficients[3] * rows[3]`, summed left to right.
+#[cfg(target_arch = "x86_64")]
+#[inline]
+pub fn linear_combination(coefficients: &[f32; 4], rows: &Rows) -> [f32; 4] {
+    use std::arch::x86_64::*;
+
+    let mut result = [0.0; 4];
+    // SSE is always available on x86-64, and the loads and stores are unaligned.
+    unsafe {
+        let mut sum = _mm_mul_ps(_mm_set1_ps(coefficients[0]), _mm_loadu_ps(rows[0].as_ptr()));
+        for i in 1..4 {
+            let term = _mm_mul_ps(_mm_set1_ps(coefficients[i]), _mm_loadu_ps(rows[i].as_ptr()));
+            sum = _mm_add_ps(sum, term);
+        }
+        _mm_storeu_ps(result.as_mut_ptr(), sum);
+    }
+    result
+}
+
+/// `coefficients[0] * rows[0] + ... + coefficients[3] * rows[3]`, summed left to right.
+#[cfg(not(target_arch = "x86_64"))]
+#[inline]
+pub fn linear_combination(coefficients: &[f32; 4], rows: &Rows) -> [f32; 4] {
+    linear_combination_scalar(coefficients, rows)
+}
+
+/// The portable version of `linear_combination`, one lane at a time.
+#[cfg(any(test, not(target_arch = "x86_64")))]
+#[inline]
+fn linear_combination_scalar(coefficients: &[f32; 4], rows: &Rows) -> [f32; 4] {
+    let mut result = [0.0; 4];
+    for (lane, result) in result.iter_mut().enumerate() {
+        *result = coefficients[0] * rows[0][lane]
+            + coefficients[1] * rows[1][lane]
+            + coefficients[2] * rows[2][lane]
+            + coefficients[3] * rows[3][lane];
+    }
+    result
+}
+
+/// The product `a * b`.
+#[inline]
+pub fn multiply(a: &Rows, b: &Rows) -> Rows {
+    [
+        linear_combination(&a[0], b),
+        linear_combination(&a[1], b),
+        linear_combination(&a[2], b),
+        linear_combination(&a[3], b),
+    ]
+}
+
+/// The 2x2 minors of the top two and bottom two rows of a matrix, from which its determinant and
+/// inverse are computed with about a third of the operations of the cofactor expansion.
+struct Minors {
+    top: [f32; 6],
+    bottom: [f32; 6],
+}
+
+impl Minors {
+    #[inline]
+    fn new(m: &Rows) -> Self {
+        let minor = |r0: usize, r1: usize, c0: usize, c1: usize| {
+            m[r0][c0] * m[r1][c1] - m[r1][c0] * m[r0][c1]
+        };
+        Minors {
+            top: [
+                minor(0, 1, 0, 1),
+                minor(0, 1, 0, 2),
+                minor(0, 1, 0, 3),
+                minor(0, 1, 1, 2),
+                minor(0, 1, 1, 3),
+                minor(0, 1, 2, 3),
+            ],
+            bottom: [
+                minor(2, 3, 0, 1),
+                minor(2, 3, 0, 2),
+                minor(2, 3, 0, 3),
+                minor(2, 3, 1, 2),
+                minor(2, 3, 1, 3),
+                minor(2, 3, 2, 3),
+            ],
+        }
+    }
+
+    #[inline]
+    fn determinant(&self) -> f32 {
+        let (s, c) = (&self.top, &self.bottom);
+        s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0]
+    }
+}
+
+/// The determinant of a matrix.
+#[inline]
+pub fn determinant(m: &Rows) -> f32 {
+    Minors::new(m).determinant()
+}
+
+/// The inverse of a matrix, or an error if it's singular.
+#[cfg_attr(rustfmt, rustfmt_skip)]
+pub fn inverse(m: &Rows) -> Result<Rows, ()> {
+    let minors = Minors::new(m);
+    let det = minors.determinant();
+    if det == 0.0 {
+        return Err(());
+    }
+
+    let d = 1.0 / det;
+    let (s, c) = (&minors.top, &minors.bottom);
+    Ok([
+        [
+            ( m[1][1] * c[5] - m[1][2] * c[4] + m[1][3] * c[3]) * d,
+            (-m[0][1] * c[5] + m[0][2] * c[4] - m[0][3] * c[3]) * d,
+            ( m[3][1] * s[5] - m[3][2] * s[4] + m[3][3] * s[3]) * d,
+            (-m[2][1] * s[5] + m[2][2] * s[4] - m[2][3] * s[3]) * d,
+        ],
+        [
+            (-m[1][0] * c[5] + m[1][2] * c[2] - m[1][3] * c[1]) * d,
+            ( m[0][0] * c[5] - m[0][2] * c[2] + m[0][3] * c[1]) * d,
+            (-m[3][0] * s[5] + m[3][2] * s[2] - m[3][3] * s[1]) * d,
+            ( m[2][0] * s[5] - m[2][2] * s[2] + m[2][3] * s[1]) * d,
+        ],
+        [
+            ( m[1][0] * c[4] - m[1][1] * c[2] + m[1][3] * c[0]) * d,
+            (-m[0][0] * c[4] + m[0][1] * c[2] - m[0][3] * c[0]) * d,
+            ( m[3][0] * s[4] - m[3][1] * s[2] + m[3][3] * s[0]) * d,
+            (-m[2][0] * s[4] + m[2][1] * s[2] - m[2][3] * s[0]) * d,
+        ],
+        [
+            (-m[1][0] * c[3] + m[1][1] * c[1] - m[1][2] * c[0]) * d,
+            ( m[0][0] * c[3] - m[0][1] * c[1] + m[0][2] * c[0]) * d,
+            (-m[3][0] * s[3] + m[3][1] * s[1] - m[3][2] * s[0]) * d,
+            ( m[2][0] * s[3] - m[2][1] * s[1] + m[2][2] * s[0]) * d,
+        ],
+    ])
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const IDENTITY: Rows = [
+        [1., 0., 0., 0.],
+        [0., 1., 0., 0.],
+        [0., 0., 1., 0.],
+        [0., 0., 0., 1.],
+    ];
+
+    /// Invertible matrices, from transforms and with arbitrary values.
+    fn matrices() -> Vec<Rows> {
+        let (sin, cos) = 0.6f32.sin_cos();
+        let mut matrices = vec![
+            IDENTITY,
+            // rotate3d(1, 0, 0, 0.6rad) translate3d(10px, -20px, 5px)
+            [
+                [1., 0., 0., 0.],
+                [0., cos, sin, 0.],
+                [0., -sin, cos, 0.],
+                [10., -20., 5., 1.],
+            ],
+            // perspective(500px) scale3d(2, 0.5, 3)
+            [
+                [2., 0., 0., 0.],
+                [0., 0.5, 0., 0.],
+                [0., 0., 3., -1. / 500.],
+                [0., 0., 0., 1.],
+            ],
+            [
+                [4., -1., 0.5, 2.],
+                [1., 3., -2., 0.25],
+                [0., 1.5, 5., -1.],
+                [2., 0., 1., 6.],
+            ],
+        ];
+        // Pseudo-random diagonally dominant matrices.
+        let mut seed = 0x2545_f491u32;
+        for _ in 0..16 {
+            let mut rows = [[0.; 4]; 4];
+            for (i, row) in rows.iter_mut().enumerate() {
+                for (j, value) in row.iter_mut().enumerate() {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 17;
+                    seed ^= seed << 5;
+                    *value = (seed % 2000) as f32 / 1000. - 1.;
+                    if i == j {
+                        *value += 8.;
+                    }
+                }
+            }
+            matrices.push(rows);
+        }
+        matrices
+    }
+
+    /// The cofactor expansion that `determinant` replaces.
+    #[cfg_attr(rustfmt, rustfmt_skip)]
+    fn cofactor_determinant(m: &Rows) -> f32 {
+        let [[m11, m12, m13, m14], [m21, m22, m23, m24], [m31, m32, m33, m34], [m41, m42, m43, m44]] =
+            *m;
+        m14 * m23 * m32 * m41 - m13 * m24 * m32 * m41 - m14 * m22 * m33 * m41 +
+        m12 * m24 * m33 * m41 + m13 * m22 * m34 * m41 - m12 * m23 * m34 * m41 -
+        m14 * m23 * m31 * m42 + m13 * m24 * m31 * m42 + m14 * m21 * m33 * m42 -
+        m11 * m24 * m33 * m42 - m13 * m21 * m34 * m42 + m11 * m23 * m34 * m42 +
+        m14 * m22 * m31 * m43 - m12 * m24 * m31 * m43 - m14 * m21 * m32 * m43 +
+        m11 * m24 * m32 * m43 + m12 * m21 * m34 * m43 - m11 * m22 * m34 * m43 -
+        m13 * m22 * m31 * m44 + m12 * m23 * m31 * m44 + m13 * m21 * m32 * m44 -
+        m11 * m23 * m32 * m44 - m12 * m21 * m33 * m44 + m11 * m22 * m33 * m44
+    }
+
+    #[test]
+    fn determinant_matches_cofactor_expansion() {
+        for m in matrices() {
+            let expected = cofactor_determinant(&m);
+            let tolerance = 1e-5 * expected.abs().max(1.);
+            assert!(
+                (determinant(&m) - expected).abs() <= tolerance,
+                "{:?}: {} != {}",
+                m,
+                determinant(&m),
+                expected
+            );
+        }
+        let singular = [
+            [1., 2., 3., 4.],
+            [2., 4., 6., 8.],
+            [0., 1., 0., 1.],
+            [5., 0., 1., 0.],
+        ];
+        assert_eq!(determinant(&singular), 0.);
+        assert_eq!(cofactor_determinant(&singular), 0.);
+    }
+
+    #[test]
+    fn inverse_times_matrix_is_identity() {
+        for m in matrices() {
+            let inverse = inverse(&m).unwrap();
+            for product in [multiply(&inverse, &m), multiply(&m, &inverse)] {
+                for (row, identity_row) in product.iter().zip(IDENTITY.iter()) {
+                    for (value, expected) in row.iter().zip(identity_row.iter()) {
+                        assert!((value - expected).abs() < 1e-4, "{:?}: {:?}", m, product);
+                    }
+                }
+            }
+        }
+        assert_eq!(inverse(&[[0.; 4]; 4]), Err(()));
+    }
+
+    #[test]
+    fn linear_combination_matches_scalar_bits() {
+        let coefficients = [
+            [1., 0., 0., 0.],
+            [0.1, -0.2, 0.3, 1e-20],
+            [3.5e30, -2., 0.75, f32::MIN_POSITIVE],
+            [-1. / 3., 1. / 7., 1e7, -1e-7],
+        ];
+        for rows in matrices() {
+            for coefficients in coefficients.iter() {
+                let simd = linear_combination(coefficients, &rows);
+                let scalar = linear_combination_scalar(coefficients, &rows);
+                assert_eq!(
+                    simd.map(f32::to_bits),
+                    scalar.map(f32::to_bits),
+                    "{:?} * {:?}",
+                    coefficients,
+                    rows
+                );
+            }
+        }
+    }
+}
@@ -23,6 +23,7 @@ pub mod effects;
 mod font;
 mod grid;
 pub mod lists;
+pub mod matrix;
 mod svg;
 pub mod transform;
 
@@ -7,6 +7,7 @@
 // because they still need mako to generate the code.
 
 use super::animate_multiplicative_factor;
+use super::matrix;
 use super::{Animate, Procedure, ToAnimatedZero};
 use crate::values::computed::transform::Rotate as ComputedRotate;
 use crate::values::computed::transform::Scale as ComputedScale;
@@ -22,7 +23,10 @@ use crate::values::generics::transform::{self, Transform, TransformOperation};
 use crate::values::generics::transform::{Rotate, Scale, Translate};
 use crate::values::CSSFloat;
 use crate::Zero;
+use rustc_hash::FxHasher;
+use std::cell::RefCell;
 use std::cmp;
+use std::hash::{Hash, Hasher};
 use std::ops::Add;
 
 // ------------------------------------
@@ -725,6 +729,48 @@ fn decompose_3d_matrix(mut matrix: Matrix3D) -> Result<MatrixDecomposed3D, ()> {
     })
 }
 
+/// The number of entries of the per-thread cache of 3D matrix decompositions, as a power of two.
+const DECOMPOSITION_CACHE_BITS: u32 = 4;
+const DECOMPOSITION_CACHE_SIZE: usize = 1 << DECOMPOSITION_CACHE_BITS;
+
+/// The bits of a matrix, and its decomposition.
+type DecompositionCacheEntry = ([[u32; 4]; 4], Result<MatrixDecomposed3D, ()>);
+
+thread_local! {
+    /// Recent decompositions of 3D matrices, indexed by a hash of the matrix.
+    ///
+    /// Interpolating 3D matrices decomposes both ends on every animation tick, but the ends are
+    /// usually keyframe values that don't change between ticks, so only the interpolation and
+    /// the recomposition need to be redone.
+    static DECOMPOSITION_CACHE: RefCell<[Option<DecompositionCacheEntry>; DECOMPOSITION_CACHE_SIZE]> =
+        const { RefCell::new([None; DECOMPOSITION_CACHE_SIZE]) };
+}
+
+/// The index in `DECOMPOSITION_CACHE` of the matrix with the given bits.
+fn decomposition_cache_slot(bits: &[[u32; 4]; 4]) -> usize {
+    let mut hasher = FxHasher::default();
+    bits.hash(&mut hasher);
+    (hasher.finish() >> (64 - DECOMPOSITION_CACHE_BITS)) as usize
+}
+
+/// Decompose a 3D matrix, reusing the last decomposition of a matrix with the same bits if it's
+/// still cached.
+fn decompose_3d_matrix_cached(matrix: Matrix3D) -> Result<MatrixDecomposed3D, ()> {
+    let bits = matrix::rows(&matrix).map(|row| row.map(f32::to_bits));
+    let slot = decomposition_cache_slot(&bits);
+    DECOMPOSITION_CACHE.with(|cache| {
+        let mut cache = cache.borrow_mut();
+        if let Some((cached_bits, decomposed)) = cache[slot] {
+            if cached_bits == bits {
+                return decomposed;
+            }
+        }
+        let decomposed = decompose_3d_matrix(matrix);
+        cache[slot] = Some((bits, decomposed));
+        decomposed
+    })
+}
+
 /**
  * The relevant section of the transitions specification:
  * https://drafts.csswg.org/web-animations-1/#animation-types
@@ -902,8 +948,8 @@ impl Animate for Matrix3D {
     #[cfg(feature = "servo")]
     fn animate(&self, other: &Self, procedure: Procedure) -> Result<Self, ()> {
         if self.is_3d() || other.is_3d() {
-            let decomposed_from = decompose_3d_matrix(*self);
-            let decomposed_to = decompose_3d_matrix(*other);
+            let decomposed_from = decompose_3d_matrix_cached(*self);
+            let decomposed_to = decompose_3d_matrix_cached(*other);
             match (decomposed_from, decomposed_to) {
                 (Ok(this), Ok(other)) => Ok(Matrix3D::from(this.animate(&other, procedure)?)),
                 // Matrices can be undecomposable due to couple reasons, e.g.,
@@ -923,7 +969,10 @@ impl Animate for Matrix3D {
     // to match it
     fn animate(&self, other: &Self, procedure: Procedure) -> Result<Self, ()> {
         let (from, to) = if self.is_3d() || other.is_3d() {
-            (decompose_3d_matrix(*self)?, decompose_3d_matrix(*other)?)
+            (
+                decompose_3d_matrix_cached(*self)?,
+                decompose_3d_matrix_cached(*other)?,
+            )
         } else {
             (decompose_2d_matrix(self)?, decompose_2d_matrix(other)?)
         };
@@ -1665,3 +1714,59 @@ impl ComputeSquaredDistance for ComputedScale {
             + from.2.compute_squared_distance(&to.2)?)
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn translation(x: f32) -> Matrix3D {
+        let mut matrix = Matrix3D::identity();
+        matrix.m41 = x;
+        matrix.m42 = -2. * x;
+        matrix.m33 = 0.5;
+        matrix.m34 = -0.002;
+        matrix
+    }
+
+    fn slot(matrix: &Matrix3D) -> usize {
+        decomposition_cache_slot(&matrix::rows(matrix).map(|row| row.map(f32::to_bits)))
+    }
+
+    fn check(matrix: Matrix3D) {
+        // The decompositions hold floats, which are compared through their
+        // exact representations.
+        assert_eq!(
+            format!("{:?}", decompose_3d_matrix_cached(matrix)),
+            format!("{:?}", decompose_3d_matrix(matrix)),
+        );
+    }
+
+    #[test]
+    fn cached_decompositions_match() {
+        let matrix = translation(10.);
+        check(matrix);
+        // Now from the cache.
+        check(matrix);
+        let slot = slot(&matrix);
+        DECOMPOSITION_CACHE.with(|cache| assert!(cache.borrow()[slot].is_some()));
+
+        // Singular matrices are cached too.
+        let mut singular = matrix;
+        singular.m44 = 0.;
+        check(singular);
+        check(singular);
+    }
+
+    #[test]
+    fn colliding_matrices_replace_each_other() {
+        let first = translation(1.);
+        let second = (2..)
+            .map(|x| translation(x as f32))
+            .find(|matrix| slot(matrix) == slot(&first))
+            .unwrap();
+        check(first);
+        check(second);
+        check(first);
+        check(second);
+    }
+}
@@ -6,7 +6,7 @@
 
 use euclid::approxeq::ApproxEq;
 
-use crate::bezier::Bezier;
+use crate::bezier::{Bezier, PrecomputedBezier};
 use crate::piecewise_linear::PiecewiseLinearFunction;
 use crate::values::computed::{Integer, Number};
 use crate::values::generics::easing::{self, BeforeFlag, StepPosition, TimingKeyword};
@@ -106,4 +106,102 @@ impl ComputedTimingFunction {
         // https://github.com/w3c/csswg-drafts/issues/8344
         progress.min(f64::MAX).max(f64::MIN)
     }
+
+    /// The output of the timing function for each of the given progress ratios,
+    /// in place.
+    ///
+    /// This is equivalent to calling `calculate_output` for each value, but
+    /// only dispatches on the kind of function once, so that the loops over the
+    /// values are tight.
+    pub fn calculate_outputs(&self, progress: &mut [f64], before_flag: BeforeFlag, epsilon: f64) {
+        if let TimingFunction::Keyword(TimingKeyword::Linear) = self {
+            return;
+        }
+        let (x1, y1, x2, y2) = match self.bezier_control_points() {
+            Some(points) => points,
+            None => {
+                for progress in progress.iter_mut() {
+                    *progress = self.calculate_output(*progress, before_flag, epsilon);
+                }
+                return;
+            },
+        };
+        Bezier::calculate_bezier_outputs(progress, epsilon, x1, y1, x2, y2);
+        for progress in progress.iter_mut() {
+            *progress = progress.min(f64::MAX).max(f64::MIN);
+        }
+    }
+
+    /// The middle control points of the cubic Bézier curve of this timing
+    /// function, if it's not linear and is one.
+    fn bezier_control_points(&self) -> Option<(f32, f32, f32, f32)> {
+        Some(match self {
+            TimingFunction::CubicBezier { x1, y1, x2, y2 } => (*x1, *y1, *x2, *y2),
+            TimingFunction::Keyword(TimingKeyword::Ease) => (0.25, 0.1, 0.25, 1.),
+            TimingFunction::Keyword(TimingKeyword::EaseIn) => (0.42, 0., 1., 1.),
+            TimingFunction::Keyword(TimingKeyword::EaseOut) => (0., 0., 0.58, 1.),
+            TimingFunction::Keyword(TimingKeyword::EaseInOut) => (0.42, 0., 0.58, 1.),
+            TimingFunction::Keyword(TimingKeyword::Linear)
+            | TimingFunction::Steps(..)
+            | TimingFunction::LinearFunction(..) => return None,
+        })
+    }
+}
+
+/// A computed timing function, along with the data needed to evaluate it
+/// quickly, for timing functions that are evaluated on every animation tick.
+///
+/// Cubic Bézier curves are sampled once, see `PrecomputedBezier`. Other
+/// timing functions are cheap to evaluate as they are.
+#[derive(Clone, Debug, MallocSizeOf, PartialEq)]
+pub struct PrecomputedTimingFunction {
+    function: ComputedTimingFunction,
+    #[ignore_malloc_size_of = "Pure stack type"]
+    bezier: Option<PrecomputedBezier>,
+}
+
+impl PrecomputedTimingFunction {
+    /// Precompute the given timing function.
+    pub fn new(function: ComputedTimingFunction) -> Self {
+        let bezier = function
+            .bezier_control_points()
+            .map(|(x1, y1, x2, y2)| PrecomputedBezier::new(x1, y1, x2, y2));
+        Self { function, bezier }
+    }
+
+    /// The timing function.
+    pub fn function(&self) -> &ComputedTimingFunction {
+        &self.function
+    }
+
+    /// The output of the timing function, as `ComputedTimingFunction::calculate_output`
+    /// would compute it.
+    #[inline]
+    pub fn calculate_output(&self, progress: f64, before_flag: BeforeFlag, epsilon: f64) -> f64 {
+        match self.bezier {
+            Some(ref bezier) => bezier
+                .calculate_output(progress, epsilon)
+                .min(f64::MAX)
+                .max(f64::MIN),
+            None => self
+                .function
+                .calculate_output(progress, before_flag, epsilon),
+        }
+    }
+
+    /// The output of the timing function for each of the given progress ratios,
+    /// in place.
+    pub fn calculate_outputs(&self, progress: &mut [f64], before_flag: BeforeFlag, epsilon: f64) {
+        match self.bezier {
+            Some(ref bezier) => {
+                bezier.calculate_outputs(progress, epsilon);
+                for progress in progress.iter_mut() {
+                    *progress = progress.min(f64::MAX).max(f64::MIN);
+                }
+            },
+            None => self
+                .function
+                .calculate_outputs(progress, before_flag, epsilon),
+        }
+    }
 }
@@ -5,6 +5,7 @@
 //! Computed types for CSS values that are related to transformations.
 
 use super::CSSFloat;
+use crate::values::animated::matrix;
 use crate::values::animated::transform::{Perspective, Scale3D, Translate3D};
 use crate::values::animated::ToAnimatedZero;
 use crate::values::computed::{Angle, Integer, Length, LengthPercentage, Number, Percentage};
@@ -94,30 +95,7 @@ impl Matrix3D {
     /// Return determinant value.
     #[inline]
     pub fn determinant(&self) -> CSSFloat {
-        self.m14 * self.m23 * self.m32 * self.m41 -
-        self.m13 * self.m24 * self.m32 * self.m41 -
-        self.m14 * self.m22 * self.m33 * self.m41 +
-        self.m12 * self.m24 * self.m33 * self.m41 +
-        self.m13 * self.m22 * self.m34 * self.m41 -
-        self.m12 * self.m23 * self.m34 * self.m41 -
-        self.m14 * self.m23 * self.m31 * self.m42 +
-        self.m13 * self.m24 * self.m31 * self.m42 +
-        self.m14 * self.m21 * self.m33 * self.m42 -
-        self.m11 * self.m24 * self.m33 * self.m42 -
-        self.m13 * self.m21 * self.m34 * self.m42 +
-        self.m11 * self.m23 * self.m34 * self.m42 +
-        self.m14 * self.m22 * self.m31 * self.m43 -
-        self.m12 * self.m24 * self.m31 * self.m43 -
-        self.m14 * self.m21 * self.m32 * self.m43 +
-        self.m11 * self.m24 * self.m32 * self.m43 +
-        self.m12 * self.m21 * self.m34 * self.m43 -
-        self.m11 * self.m22 * self.m34 * self.m43 -
-        self.m13 * self.m22 * self.m31 * self.m44 +
-        self.m12 * self.m23 * self.m31 * self.m44 +
-        self.m13 * self.m21 * self.m32 * self.m44 -
-        self.m11 * self.m23 * self.m32 * self.m44 -
-        self.m12 * self.m21 * self.m33 * self.m44 +
-        self.m11 * self.m22 * self.m33 * self.m44
+        matrix::determinant(matrix::rows(self))
     }
 
     /// Transpose a matrix.
@@ -133,131 +111,19 @@ impl Matrix3D {
 
     /// Return inverse matrix.
     pub fn inverse(&self) -> Result<Matrix3D, ()> {
-        let mut det = self.determinant();
-
-        if det == 0.0 {
-            return Err(());
-        }
-
-        det = 1.0 / det;
-        let x = Matrix3D {
-            m11: det *
-            (self.m23 * self.m34 * self.m42 - self.m24 * self.m33 * self.m42 +
-             self.m24 * self.m32 * self.m43 - self.m22 * self.m34 * self.m43 -
-             self.m23 * self.m32 * self.m44 + self.m22 * self.m33 * self.m44),
-            m12: det *
-            (self.m14 * self.m33 * self.m42 - self.m13 * self.m34 * self.m42 -
-             self.m14 * self.m32 * self.m43 + self.m12 * self.m34 * self.m43 +
-             self.m13 * self.m32 * self.m44 - self.m12 * self.m33 * self.m44),
-            m13: det *
-            (self.m13 * self.m24 * self.m42 - self.m14 * self.m23 * self.m42 +
-             self.m14 * self.m22 * self.m43 - self.m12 * self.m24 * self.m43 -
-             self.m13 * self.m22 * self.m44 + self.m12 * self.m23 * self.m44),
-            m14: det *
-            (self.m14 * self.m23 * self.m32 - self.m13 * self.m24 * self.m32 -
-             self.m14 * self.m22 * self.m33 + self.m12 * self.m24 * self.m33 +
-             self.m13 * self.m22 * self.m34 - self.m12 * self.m23 * self.m34),
-            m21: det *
-            (self.m24 * self.m33 * self.m41 - self.m23 * self.m34 * self.m41 -
-             self.m24 * self.m31 * self.m43 + self.m21 * self.m34 * self.m43 +
-             self.m23 * self.m31 * self.m44 - self.m21 * self.m33 * self.m44),
-            m22: det *
-            (self.m13 * self.m34 * self.m41 - self.m14 * self.m33 * self.m41 +
-             self.m14 * self.m31 * self.m43 - self.m11 * self.m34 * self.m43 -
-             self.m13 * self.m31 * self.m44 + self.m11 * self.m33 * self.m44),
-            m23: det *
-            (self.m14 * self.m23 * self.m41 - self.m13 * self.m24 * self.m41 -
-             self.m14 * self.m21 * self.m43 + self.m11 * self.m24 * self.m43 +
-             self.m13 * self.m21 * self.m44 - self.m11 * self.m23 * self.m44),
-            m24: det *
-            (self.m13 * self.m24 * self.m31 - self.m14 * self.m23 * self.m31 +
-             self.m14 * self.m21 * self.m33 - self.m11 * self.m24 * self.m33 -
-             self.m13 * self.m21 * self.m34 + self.m11 * self.m23 * self.m34),
-            m31: det *
-            (self.m22 * self.m34 * self.m41 - self.m24 * self.m32 * self.m41 +
-             self.m24 * self.m31 * self.m42 - self.m21 * self.m34 * self.m42 -
-             self.m22 * self.m31 * self.m44 + self.m21 * self.m32 * self.m44),
-            m32: det *
-            (self.m14 * self.m32 * self.m41 - self.m12 * self.m34 * self.m41 -
-             self.m14 * self.m31 * self.m42 + self.m11 * self.m34 * self.m42 +
-             self.m12 * self.m31 * self.m44 - self.m11 * self.m32 * self.m44),
-            m33: det *
-            (self.m12 * self.m24 * self.m41 - self.m14 * self.m22 * self.m41 +
-             self.m14 * self.m21 * self.m42 - self.m11 * self.m24 * self.m42 -
-             self.m12 * self.m21 * self.m44 + self.m11 * self.m22 * self.m44),
-            m34: det *
-            (self.m14 * self.m22 * self.m31 - self.m12 * self.m24 * self.m31 -
-             self.m14 * self.m21 * self.m32 + self.m11 * self.m24 * self.m32 +
-             self.m12 * self.m21 * self.m34 - self.m11 * self.m22 * self.m34),
-            m41: det *
-            (self.m23 * self.m32 * self.m41 - self.m22 * self.m33 * self.m41 -
-             self.m23 * self.m31 * self.m42 + self.m21 * self.m33 * self.m42 +
-             self.m22 * self.m31 * self.m43 - self.m21 * self.m32 * self.m43),
-            m42: det *
-            (self.m12 * self.m33 * self.m41 - self.m13 * self.m32 * self.m41 +
-             self.m13 * self.m31 * self.m42 - self.m11 * self.m33 * self.m42 -
-             self.m12 * self.m31 * self.m43 + self.m11 * self.m32 * self.m43),
-            m43: det *
-            (self.m13 * self.m22 * self.m41 - self.m12 * self.m23 * self.m41 -
-             self.m13 * self.m21 * self.m42 + self.m11 * self.m23 * self.m42 +
-             self.m12 * self.m21 * self.m43 - self.m11 * self.m22 * self.m43),
-            m44: det *
-            (self.m12 * self.m23 * self.m31 - self.m13 * self.m22 * self.m31 +
-             self.m13 * self.m21 * self.m32 - self.m11 * self.m23 * self.m32 -
-             self.m12 * self.m21 * self.m33 + self.m11 * self.m22 * self.m33),
-        };
-
-        Ok(x)
+        matrix::inverse(matrix::rows(self)).map(matrix::from_rows)
     }
 
     /// Multiply `pin * self`.
     #[inline]
     pub fn pre_mul_point4(&self, pin: &[f32; 4]) -> [f32; 4] {
-        [
-            pin[0] * self.m11 + pin[1] * self.m21 + pin[2] * self.m31 + pin[3] * self.m41,
-            pin[0] * self.m12 + pin[1] * self.m22 + pin[2] * self.m32 + pin[3] * self.m42,
-            pin[0] * self.m13 + pin[1] * self.m23 + pin[2] * self.m33 + pin[3] * self.m43,
-            pin[0] * self.m14 + pin[1] * self.m24 + pin[2] * self.m34 + pin[3] * self.m44,
-        ]
+        matrix::linear_combination(pin, matrix::rows(self))
     }
 
     /// Return the multiplication of two 4x4 matrices.
     #[inline]
     pub fn multiply(&self, other: &Self) -> Self {
-        Matrix3D {
-            m11: self.m11 * other.m11 + self.m12 * other.m21 +
-                 self.m13 * other.m31 + self.m14 * other.m41,
-            m12: self.m11 * other.m12 + self.m12 * other.m22 +
-                 self.m13 * other.m32 + self.m14 * other.m42,
-            m13: self.m11 * other.m13 + self.m12 * other.m23 +
-                 self.m13 * other.m33 + self.m14 * other.m43,
-            m14: self.m11 * other.m14 + self.m12 * other.m24 +
-                 self.m13 * other.m34 + self.m14 * other.m44,
-            m21: self.m21 * other.m11 + self.m22 * other.m21 +
-                 self.m23 * other.m31 + self.m24 * other.m41,
-            m22: self.m21 * other.m12 + self.m22 * other.m22 +
-                 self.m23 * other.m32 + self.m24 * other.m42,
-            m23: self.m21 * other.m13 + self.m22 * other.m23 +
-                 self.m23 * other.m33 + self.m24 * other.m43,
-            m24: self.m21 * other.m14 + self.m22 * other.m24 +
-                 self.m23 * other.m34 + self.m24 * other.m44,
-            m31: self.m31 * other.m11 + self.m32 * other.m21 +
-                 self.m33 * other.m31 + self.m34 * other.m41,
-            m32: self.m31 * other.m12 + self.m32 * other.m22 +
-                 self.m33 * other.m32 + self.m34 * other.m42,
-            m33: self.m31 * other.m13 + self.m32 * other.m23 +
-                 self.m33 * other.m33 + self.m34 * other.m43,
-            m34: self.m31 * other.m14 + self.m32 * other.m24 +
-                 self.m33 * other.m34 + self.m34 * other.m44,
-            m41: self.m41 * other.m11 + self.m42 * other.m21 +
-                 self.m43 * other.m31 + self.m44 * other.m41,
-            m42: self.m41 * other.m12 + self.m42 * other.m22 +
-                 self.m43 * other.m32 + self.m44 * other.m42,
-            m43: self.m41 * other.m13 + self.m42 * other.m23 +
-                 self.m43 * other.m33 + self.m44 * other.m43,
-            m44: self.m41 * other.m14 + self.m42 * other.m24 +
-                 self.m43 * other.m34 + self.m44 * other.m44,
-        }
+        matrix::from_rows(matrix::multiply(matrix::rows(self), matrix::rows(other)))
     }
 
     /// Scale the matrix by a factor.
@@ -8,6 +8,7 @@
 
 #![deny(missing_docs)]
 
+use crate::atom_cache;
 use crate::parser::{Parse, ParserContext};
 use crate::values::distance::{ComputeSquaredDistance, SquaredDistance};
 use crate::Atom;
@@ -562,7 +563,7 @@ impl CustomIdent {
         if excluding.iter().any(|s| ident.eq_ignore_ascii_case(s)) {
             Err(location.new_custom_error(StyleParseErrorKind::UnspecifiedError))
         } else {
-            Ok(CustomIdent(Atom::from(ident.as_ref())))
+            Ok(CustomIdent(atom_cache::atomize(ident)))
         }
     }
 
@@ -623,7 +624,7 @@ impl DashedIdent {
                 location.new_custom_error(SelectorParseErrorKind::UnexpectedIdent(ident.clone()))
             );
         }
-        Ok(Self(Atom::from(ident.as_ref())))
+        Ok(Self(atom_cache::atomize(ident)))
     }
 
     /// Special value for internal use. Useful where we can't use Option<>.
@@ -680,7 +681,7 @@ pub struct KeyframesName(Atom);
 impl KeyframesName {
     /// <https://drafts.csswg.org/css-animations/#dom-csskeyframesrule-name>
     pub fn from_ident(value: &str) -> Self {
-        Self(Atom::from(value))
+        Self(atom_cache::atomize(value))
     }
 
     /// Returns the `none` value.
@@ -713,7 +714,7 @@ impl Parse for KeyframesName {
         let location = input.current_source_location();
         Ok(match *input.next()? {
             Token::Ident(ref s) => Self(CustomIdent::from_ident(location, s, &["none"])?.0),
-            Token::QuotedString(ref s) => Self(Atom::from(s.as_ref())),
+            Token::QuotedString(ref s) => Self(atom_cache::atomize(s)),
             ref t => return Err(location.new_unexpected_token_error(t.clone())),
         })
     }
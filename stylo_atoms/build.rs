@@ -2,11 +2,107 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
+use std::collections::BTreeSet;
 use std::env;
-use std::fs::File;
-use std::io::{BufRead, BufReader};
+use std::fs::{self, File};
+use std::io::{self, BufRead, BufReader};
 use std::path::Path;
 
+/// The longest atoms that string_cache stores inline, which never go through
+/// the dynamic atom set, and so don't need to be static.
+const MAX_INLINE_LEN: usize = 7;
+
+/// Panics with the corpus path that couldn't be read.
+fn cannot_read(path: &Path, error: io::Error) -> ! {
+    panic!(
+        "STYLO_ATOMS_CORPUS: cannot read {}: {}",
+        path.display(),
+        error
+    )
+}
+
+/// Adds the identifiers of the CSS and HTML files at `path`, or in the
+/// directory at `path`, to `atoms`.
+fn add_corpus_atoms(path: &Path, atoms: &mut BTreeSet<String>) {
+    println!("cargo:rerun-if-changed={}", path.display());
+    let metadata = fs::metadata(path).unwrap_or_else(|e| cannot_read(path, e));
+    if metadata.is_dir() {
+        let mut entries = fs::read_dir(path)
+            .unwrap_or_else(|e| cannot_read(path, e))
+            .map(|entry| entry.unwrap_or_else(|e| cannot_read(path, e)).path())
+            .collect::<Vec<_>>();
+        entries.sort();
+        for entry in entries {
+            add_corpus_atoms(&entry, atoms);
+        }
+        return;
+    }
+    let extension = path.extension().and_then(|e| e.to_str()).unwrap_or("");
+    if !matches!(extension, "css" | "html" | "htm") {
+        return;
+    }
+    let text = fs::read_to_string(path).unwrap_or_else(|e| cannot_read(path, e));
+    let mut add = |atom: &str| {
+        if atom.len() > MAX_INLINE_LEN {
+            atoms.insert(atom.to_owned());
+        }
+    };
+    if extension == "css" {
+        css_identifiers(&text, &mut add);
+    } else {
+        html_classes_and_ids(&text, &mut add);
+    }
+}
+
+/// Calls `add` with the identifiers of a stylesheet, with the leading `--` of
+/// custom property names stripped, as they're atomized without it. Comments
+/// and strings are skipped, and escapes aren't handled.
+fn css_identifiers(css: &str, add: &mut impl FnMut(&str)) {
+    let is_name = |c: char| c.is_ascii_alphanumeric() || c == '-' || c == '_' || !c.is_ascii();
+    let bytes = css.as_bytes();
+    let mut i = 0;
+    while i < bytes.len() {
+        let rest = &css[i..];
+        if rest.starts_with("/*") {
+            i += rest.find("*/").map_or(rest.len(), |end| end + 2);
+            continue;
+        }
+        let c = rest.chars().next().unwrap();
+        if c == '"' || c == '\'' {
+            i += 1 + rest[1..].find(c).map_or(rest.len() - 1, |end| end + 1);
+            continue;
+        }
+        if !is_name(c) || c.is_ascii_digit() {
+            i += c.len_utf8();
+            continue;
+        }
+        let len = rest.find(|c| !is_name(c)).unwrap_or(rest.len());
+        let ident = &rest[..len];
+        add(ident.strip_prefix("--").unwrap_or(ident));
+        i += len;
+    }
+}
+
+/// Calls `add` with the classes and ids of the elements of a document.
+fn html_classes_and_ids(html: &str, add: &mut impl FnMut(&str)) {
+    for attribute in ["class=", "id="] {
+        for (start, _) in html.match_indices(attribute) {
+            let preceded_by_space = html[..start]
+                .chars()
+                .next_back()
+                .map_or(false, |c| c.is_ascii_whitespace());
+            let value = &html[start + attribute.len()..];
+            let quote = match value.chars().next() {
+                Some(quote @ '"') | Some(quote @ '\'') if preceded_by_space => quote,
+                _ => continue,
+            };
+            let value = &value[1..];
+            let value = &value[..value.find(quote).unwrap_or(value.len())];
+            value.split_ascii_whitespace().for_each(&mut *add);
+        }
+    }
+}
+
 fn main() {
     let static_atoms =
         Path::new(&env::var_os("CARGO_MANIFEST_DIR").unwrap()).join("static_atoms.txt");
@@ -24,8 +120,29 @@ fn main() {
     }
     include!("./predefined_counter_styles.rs");
 
+    // The classes, ids, custom property names and other identifiers of the
+    // CSS and HTML files listed in STYLO_ATOMS_CORPUS are made static too, so
+    // that atomizing them is a lock-free lookup, and their atoms aren't
+    // reference counted. The paths must be absolute: build scripts run in the
+    // directory of their crate, which may be in the registry or a git
+    // checkout rather than in the workspace of whoever set the variable.
+    println!("cargo:rerun-if-env-changed=STYLO_ATOMS_CORPUS");
+    let mut corpus_atoms = BTreeSet::new();
+    if let Some(corpus) = env::var_os("STYLO_ATOMS_CORPUS") {
+        for path in env::split_paths(&corpus) {
+            if !path.is_absolute() {
+                panic!(
+                    "STYLO_ATOMS_CORPUS: {} is relative, but paths must be absolute",
+                    path.display()
+                );
+            }
+            add_corpus_atoms(&path, &mut corpus_atoms);
+        }
+    }
+
     atom_type
         .atoms(static_atoms.lines().map(Result::unwrap))
+        .atoms(corpus_atoms)
         .write_to_file(&Path::new(&env::var_os("OUT_DIR").unwrap()).join("atom.rs"))
         .unwrap();
 }
@@ -0,0 +1,129 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Benchmarks of the evaluation of timing functions, comparing the solver
+//! used for one-off evaluations with the precomputed timing functions of
+//! running animations.
+//!
+//! Throughput is reported as described in `harness::report`, and accuracy as
+//! `[BENCH_ACCURACY],<name>,<samples>,<max error>`, where the error is the
+//! largest difference with a solution of the curve to within `1e-12`.
+//!
+//! Arguments not starting with `-` are used as filters on the benchmark
+//! names. The `STYLO_BENCH_ITERATIONS` environment variable overrides the
+//! number of timed runs of each benchmark.
+
+use std::hint::black_box;
+use style::bezier::Bezier;
+use style::piecewise_linear::PiecewiseLinearFunctionBuilder;
+use style::values::computed::easing::{ComputedTimingFunction, PrecomputedTimingFunction};
+use style::values::generics::easing::BeforeFlag;
+use stylo_bench::harness::{report, Timings};
+
+/// The number of progress values evaluated in each run.
+const SAMPLES: usize = 10000;
+
+/// The epsilons of animations of one and of a hundred seconds.
+const EPSILONS: [f64; 2] = [1. / 200., 1. / 20000.];
+
+const CURVES: [(&str, f32, f32, f32, f32); 5] = [
+    ("ease", 0.25, 0.1, 0.25, 1.),
+    ("ease-in-out", 0.42, 0., 0.58, 1.),
+    ("overshoot", 0.68, -0.55, 0.27, 1.55),
+    ("steep-start", 0., 1., 0., 1.),
+    ("steep-middle", 1., 0., 0., 1.),
+];
+
+fn progress_values() -> Vec<f64> {
+    (0..SAMPLES)
+        .map(|i| (i as f64 + 0.5) / SAMPLES as f64)
+        .collect()
+}
+
+fn enabled(filters: &[String], name: &str) -> bool {
+    filters.is_empty() || filters.iter().any(|f| name.contains(&**f))
+}
+
+/// Bézier curves, with the solver and precomputed.
+fn cubic_bezier(filters: &[String], iterations: usize) {
+    let progress = progress_values();
+    for (curve, x1, y1, x2, y2) in CURVES {
+        let function = ComputedTimingFunction::CubicBezier { x1, y1, x2, y2 };
+        let precomputed = PrecomputedTimingFunction::new(function.clone());
+        for epsilon in EPSILONS {
+            let reference = progress
+                .iter()
+                .map(|&p| Bezier::calculate_bezier_output(p, 1e-12, x1, y1, x2, y2))
+                .collect::<Vec<_>>();
+            let evaluators: [(&str, &dyn Fn(f64) -> f64); 2] = [
+                ("solver", &|p| {
+                    function.calculate_output(p, BeforeFlag::Unset, epsilon)
+                }),
+                ("precomputed", &|p| {
+                    precomputed.calculate_output(p, BeforeFlag::Unset, epsilon)
+                }),
+            ];
+            for (mode, evaluate) in evaluators {
+                let name = format!("easing/{}/{}/{}", curve, epsilon, mode);
+                if !enabled(filters, &name) {
+                    continue;
+                }
+                let max_error = progress
+                    .iter()
+                    .zip(&reference)
+                    .map(|(&p, &expected)| (evaluate(p) - expected).abs())
+                    .fold(0., f64::max);
+                println!("[BENCH_ACCURACY],{},{},{}", name, SAMPLES, max_error);
+                let timings = Timings::measure(iterations, |time| {
+                    time(&mut || {
+                        for &p in &progress {
+                            black_box(evaluate(black_box(p)));
+                        }
+                    });
+                });
+                report(&name, SAMPLES, &timings);
+            }
+        }
+    }
+}
+
+/// `linear()` functions with many stops, which are looked up the same way
+/// whether precomputed or not.
+fn linear_function(filters: &[String], iterations: usize) {
+    let progress = progress_values();
+    for stops in [5, 50] {
+        let name = format!("easing/linear/{}", stops);
+        if !enabled(filters, &name) {
+            continue;
+        }
+        let mut builder = PiecewiseLinearFunctionBuilder::with_capacity(stops);
+        for i in 0..stops {
+            let x = i as f32 / (stops - 1) as f32;
+            builder.push(x * x, Some(x));
+        }
+        let function =
+            PrecomputedTimingFunction::new(ComputedTimingFunction::LinearFunction(builder.build()));
+        let timings = Timings::measure(iterations, |time| {
+            time(&mut || {
+                for &p in &progress {
+                    black_box(function.calculate_output(black_box(p), BeforeFlag::Unset, 0.));
+                }
+            });
+        });
+        report(&name, SAMPLES, &timings);
+    }
+}
+
+fn main() {
+    let filters = std::env::args()
+        .skip(1)
+        .filter(|arg| !arg.starts_with('-'))
+        .collect::<Vec<_>>();
+    let iterations = std::env::var("STYLO_BENCH_ITERATIONS")
+        .ok()
+        .and_then(|n| n.parse().ok())
+        .unwrap_or(10);
+    cubic_bezier(&filters, iterations);
+    linear_function(&filters, iterations);
+}
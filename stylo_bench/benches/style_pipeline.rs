@@ -0,0 +1,791 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Benchmarks of the style pipeline over synthetic documents.
+//!
+//! Each benchmark prints one line, as described in `harness::report`, or, for
+//! memory benchmarks, `[BENCH_MEMORY],<name>,<elements>,<bytes>` and
+//! `[BENCH_ALLOCATIONS],<name>,<elements>,<allocations>`, and other lines
+//! described with the benchmark that prints them. Names are stable, so
+//! the output can be diffed across builds.
+//!
+//! Arguments not starting with `-` are used as filters on the benchmark
+//! names. The `STYLO_BENCH_ITERATIONS` environment variable overrides the
+//! number of timed runs of each benchmark.
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::hint::black_box;
+use std::sync::atomic::{AtomicIsize, AtomicUsize, Ordering};
+use string_cache::StaticAtomSet;
+use style::context::QuirksMode;
+use style::dom::TDocument;
+use style::dom_apis::{self, MayUseInvalidation, QueryAll};
+use style::selector_parser::SelectorParser;
+use style::shared_lock::SharedRwLock;
+use style::stylesheets::{AllowImportRules, Origin, StylesheetContents};
+use style::thread_state::{self, ThreadState};
+use style::values::AtomIdent;
+use stylo_atoms::AtomStaticSet;
+use stylo_bench::corpus::{self, Corpus};
+use stylo_bench::dom::Element;
+use stylo_bench::generators::{pick_elements, DomShape};
+use stylo_bench::harness::{report, Fixture, Timings, DEFAULT_RULE_COUNT};
+use stylo_bench::sheets;
+use stylo_bench::traversal::thread_pool;
+use to_shmem::Dedup;
+
+/// Counts the bytes currently allocated and the calls to the allocator, for
+/// the memory benchmarks.
+struct CountingAllocator;
+
+static ALLOCATED: AtomicIsize = AtomicIsize::new(0);
+static ALLOCATIONS: AtomicUsize = AtomicUsize::new(0);
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCATED.fetch_add(layout.size() as isize, Ordering::Relaxed);
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        System.alloc(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        ALLOCATED.fetch_sub(layout.size() as isize, Ordering::Relaxed);
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        ALLOCATED.fetch_add(
+            new_size as isize - layout.size() as isize,
+            Ordering::Relaxed,
+        );
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+#[global_allocator]
+static GLOBAL: CountingAllocator = CountingAllocator;
+
+const PARALLEL_THREADS: usize = 4;
+
+const SHAPES: [DomShape; 4] = [
+    DomShape::Wide {
+        sections: 50,
+        items: 40,
+    },
+    DomShape::Deep {
+        depth: 500,
+        siblings: 2,
+    },
+    DomShape::ListHeavy {
+        lists: 40,
+        items: 50,
+    },
+    DomShape::ShadowHeavy {
+        hosts: 200,
+        items: 8,
+    },
+];
+
+struct Bench {
+    filters: Vec<String>,
+    iterations: usize,
+    pool: rayon::ThreadPool,
+}
+
+impl Bench {
+    fn enabled(&self, name: &str) -> bool {
+        self.filters.is_empty() || self.filters.iter().any(|f| name.contains(&**f))
+    }
+}
+
+/// Styling a whole document from scratch, sequentially and in parallel.
+fn initial_style(bench: &Bench) {
+    for shape in SHAPES {
+        for corpus in Corpus::ALL {
+            for parallel in [false, true] {
+                let mode = if parallel { "parallel" } else { "sequential" };
+                let name = format!("initial_style/{}/{}/{}", shape.name(), corpus.name(), mode);
+                if !bench.enabled(&name) {
+                    continue;
+                }
+                let pool = parallel.then_some(&bench.pool);
+                let mut fixture = Fixture::new(shape, corpus, DEFAULT_RULE_COUNT);
+                let mut styled = 0;
+                let timings = Timings::measure(bench.iterations, |time| {
+                    fixture.clear_styles();
+                    time(&mut || styled = fixture.style(pool));
+                });
+                report(&name, styled, &timings);
+            }
+        }
+    }
+}
+
+/// Restyling after toggling a class on a few elements.
+fn restyle_class_toggle(bench: &Bench) {
+    for shape in SHAPES {
+        for toggled in [1, 32] {
+            let name = format!("restyle_class_toggle/{}/{}", shape.name(), toggled);
+            if !bench.enabled(&name) {
+                continue;
+            }
+            let mut fixture = Fixture::new(shape, Corpus::Framework, DEFAULT_RULE_COUNT);
+            fixture.style(None);
+            let targets = pick_elements(&fixture.dom, toggled, 42);
+            let mut restyled = 0;
+            let timings = Timings::measure(bench.iterations, |time| {
+                fixture.toggle_class(&targets, "c7");
+                time(&mut || restyled = fixture.style(None));
+                // Toggle back, so every run does the same work.
+                fixture.toggle_class(&targets, "c7");
+                fixture.style(None);
+            });
+            report(&name, restyled, &timings);
+        }
+    }
+}
+
+/// Inserting a stylesheet into a styled document: rebuilding the cascade
+/// data, invalidating and restyling.
+fn stylesheet_insertion(bench: &Bench) {
+    let css = corpus::insertion_css(50);
+    for shape in SHAPES {
+        let name = format!("stylesheet_insertion/{}", shape.name());
+        if !bench.enabled(&name) {
+            continue;
+        }
+        let mut fixture = Fixture::new(shape, Corpus::Framework, DEFAULT_RULE_COUNT);
+        fixture.style(None);
+        let mut restyled = 0;
+        let timings = Timings::measure(bench.iterations, |time| {
+            let sheet = fixture.append_stylesheet(&css);
+            time(&mut || {
+                fixture.flush_stylesheets();
+                restyled = fixture.style(None);
+            });
+            fixture.remove_stylesheet(sheet);
+            fixture.flush_stylesheets();
+            fixture.style(None);
+        });
+        report(&name, restyled, &timings);
+    }
+}
+
+/// Rebuilding the cascade data of all the document stylesheets, with no
+/// elements to restyle.
+fn cascade_data_rebuild(bench: &Bench) {
+    for corpus in Corpus::ALL {
+        for rules in [1000, 10000] {
+            let name = format!("cascade_data_rebuild/{}/{}", corpus.name(), rules);
+            if !bench.enabled(&name) {
+                continue;
+            }
+            let shape = DomShape::Wide {
+                sections: 1,
+                items: 1,
+            };
+            let mut fixture = Fixture::new(shape, corpus, rules);
+            let timings = Timings::measure(bench.iterations, |time| {
+                fixture.force_rebuild();
+                time(&mut || {
+                    fixture.flush_stylesheets();
+                });
+            });
+            report(&name, rules, &timings);
+        }
+    }
+}
+
+/// `querySelectorAll` for a class, with and without the document class
+/// index, as the document grows.
+fn query_selector(bench: &Bench) {
+    let url_data = sheets::url_data();
+    let selectors = SelectorParser::parse_author_origin_no_namespace(".c3 span", &url_data)
+        .expect("Invalid selector");
+    for sections in [10, 100, 1000] {
+        for indexed in [false, true] {
+            let shape = DomShape::Wide {
+                sections,
+                items: 10,
+            };
+            let name = format!(
+                "query_selector_all/{}/{}",
+                shape.name(),
+                if indexed { "indexed" } else { "unindexed" }
+            );
+            if !bench.enabled(&name) {
+                continue;
+            }
+            let mut fixture = Fixture::new(shape, Corpus::Simple, 0);
+            if indexed {
+                fixture.dom.build_indices();
+            }
+            let mut found = 0;
+            let timings = Timings::measure(bench.iterations, |time| {
+                let root = fixture.dom.document().as_node();
+                time(&mut || {
+                    let mut results = Default::default();
+                    dom_apis::query_selector::<Element, QueryAll>(
+                        root,
+                        &selectors,
+                        &mut results,
+                        MayUseInvalidation::No,
+                    );
+                    found = results.len();
+                });
+            });
+            report(&name, found, &timings);
+        }
+    }
+}
+
+/// `getElementsByClassName` for one and two classes, with and without the
+/// document class index, as the document grows. With the index, the time
+/// grows with the number of matching elements rather than with the size of
+/// the document.
+fn elements_by_class_name(bench: &Bench) {
+    for classes in [&["c3"][..], &["c3", "c5"]] {
+        let classes = classes
+            .iter()
+            .map(|c| AtomIdent::from(*c))
+            .collect::<Vec<_>>();
+        for sections in [10, 100, 1000] {
+            for indexed in [false, true] {
+                let shape = DomShape::Wide {
+                    sections,
+                    items: 10,
+                };
+                let name = format!(
+                    "elements_by_class_name/{}/{}/{}",
+                    classes.len(),
+                    shape.name(),
+                    if indexed { "indexed" } else { "unindexed" }
+                );
+                if !bench.enabled(&name) {
+                    continue;
+                }
+                let mut fixture = Fixture::new(shape, Corpus::Simple, 0);
+                if indexed {
+                    fixture.dom.build_indices();
+                }
+                let mut found = 0;
+                let timings = Timings::measure(bench.iterations, |time| {
+                    let root = fixture.dom.document().as_node();
+                    time(&mut || {
+                        let mut results = Default::default();
+                        dom_apis::elements_by_class_name::<Element, QueryAll>(
+                            root,
+                            &classes,
+                            &mut results,
+                        );
+                        found = results.len();
+                    });
+                });
+                report(&name, found, &timings);
+            }
+        }
+    }
+}
+
+/// The memory retained by the styles of a document after styling it from
+/// scratch, sequentially so that style sharing is deterministic, with and
+/// without style struct interning.
+///
+/// With interning, the memory includes the interner tables, and the interner
+/// statistics are also printed, as
+/// `[BENCH_INTERNING],<name>,<elements>,<lookups>,<hits>,<bytes saved>,<dedup ratio>`.
+fn style_memory(bench: &Bench) {
+    for shape in SHAPES {
+        for interning in [false, true] {
+            let mut name = format!("style_memory/{}", shape.name());
+            if interning {
+                name.push_str("/interned");
+            }
+            if !bench.enabled(&name) {
+                continue;
+            }
+            let mut fixture = Fixture::new(shape, Corpus::Framework, DEFAULT_RULE_COUNT);
+            // Style once, so that lazily-initialized global state doesn't count.
+            fixture.style(None);
+            fixture.clear_styles();
+            let before = ALLOCATED.load(Ordering::Relaxed);
+            fixture
+                .stylist
+                .set_style_struct_interning_enabled(interning);
+            let styled = fixture.style(None);
+            let after = ALLOCATED.load(Ordering::Relaxed);
+            println!("[BENCH_MEMORY],{},{},{}", name, styled, after - before);
+
+            if let Some(interner) = fixture.stylist.style_struct_interner() {
+                let stats = interner.stats();
+                println!(
+                    "[BENCH_INTERNING],{},{},{},{},{},{:.3}",
+                    name,
+                    styled,
+                    stats.lookups,
+                    stats.hits,
+                    stats.bytes_saved,
+                    stats.dedup_ratio()
+                );
+            }
+        }
+    }
+}
+
+/// The memory retained by the styles of a document after styling it from
+/// scratch, with the layout of the style structs of this build: with the
+/// `sparse_style_structs` feature, rarely-set longhands are stored out of
+/// line. Run once with and once without the feature to compare them.
+///
+/// The `unset` page leaves the sparse longhands at their initial values, and
+/// the `set` page also sets some of them on every span.
+fn sparse_style_structs(bench: &Bench) {
+    let layout = if cfg!(feature = "sparse_style_structs") {
+        "sparse"
+    } else {
+        "dense"
+    };
+    for shape in SHAPES {
+        for (page, css) in [
+            ("unset", None),
+            (
+                "set",
+                Some("span { will-change: transform; object-fit: cover }"),
+            ),
+        ] {
+            let name = format!("sparse_style_structs/{}/{}/{}", shape.name(), page, layout);
+            if !bench.enabled(&name) {
+                continue;
+            }
+            let mut fixture = Fixture::new(shape, Corpus::Framework, DEFAULT_RULE_COUNT);
+            if let Some(css) = css {
+                fixture.append_stylesheet(css);
+                fixture.flush_stylesheets();
+            }
+            fixture.style(None);
+            fixture.clear_styles();
+            let before = ALLOCATED.load(Ordering::Relaxed);
+            let styled = fixture.style(None);
+            let after = ALLOCATED.load(Ordering::Relaxed);
+            println!("[BENCH_MEMORY],{},{},{}", name, styled, after - before);
+        }
+    }
+}
+
+/// The number of calls to the allocator made while styling a document from
+/// scratch. Together with the parallel `initial_style` timings, this shows
+/// the allocator pressure of the style threads.
+fn style_allocations(bench: &Bench) {
+    for shape in SHAPES {
+        for parallel in [false, true] {
+            let mode = if parallel { "parallel" } else { "sequential" };
+            let name = format!("style_allocations/{}/{}", shape.name(), mode);
+            if !bench.enabled(&name) {
+                continue;
+            }
+            let pool = parallel.then_some(&bench.pool);
+            let mut fixture = Fixture::new(shape, Corpus::Framework, DEFAULT_RULE_COUNT);
+            fixture.style(pool);
+            fixture.clear_styles();
+            let before = ALLOCATIONS.load(Ordering::Relaxed);
+            let styled = fixture.style(pool);
+            let after = ALLOCATIONS.load(Ordering::Relaxed);
+            println!("[BENCH_ALLOCATIONS],{},{},{}", name, styled, after - before);
+        }
+    }
+}
+
+/// Styling a document from scratch with cascades reusing per-thread storage
+/// for their transient data, compared to allocating it for every cascade.
+///
+/// Also prints the number of calls to the allocator made by each, as
+/// `[BENCH_ALLOCATIONS]` lines.
+fn cascade_scratch(bench: &Bench) {
+    for shape in SHAPES {
+        for parallel in [false, true] {
+            for reuse in [true, false] {
+                let mode = if parallel { "parallel" } else { "sequential" };
+                let scratch = if reuse { "reuse" } else { "allocate" };
+                let name = format!("cascade_scratch/{}/{}/{}", shape.name(), scratch, mode);
+                if !bench.enabled(&name) {
+                    continue;
+                }
+                let pool = parallel.then_some(&bench.pool);
+                let mut fixture = Fixture::new(shape, Corpus::Framework, DEFAULT_RULE_COUNT);
+                fixture.stylist.set_cascade_scratch_reuse_enabled(reuse);
+                fixture.style(pool);
+                fixture.clear_styles();
+                let before = ALLOCATIONS.load(Ordering::Relaxed);
+                let styled = fixture.style(pool);
+                let after = ALLOCATIONS.load(Ordering::Relaxed);
+                println!("[BENCH_ALLOCATIONS],{},{},{}", name, styled, after - before);
+
+                let timings = Timings::measure(bench.iterations, |time| {
+                    fixture.clear_styles();
+                    time(&mut || {
+                        fixture.style(pool);
+                    });
+                });
+                report(&name, styled, &timings);
+            }
+        }
+    }
+}
+
+/// Styling a whole document in parallel with the stylesheet lock frozen, as
+/// an embedder would once the stylesheets are loaded, compared to taking the
+/// lock as usual.
+fn frozen_stylesheets(bench: &Bench) {
+    for shape in SHAPES {
+        for frozen in [false, true] {
+            let mode = if frozen { "frozen" } else { "locked" };
+            let name = format!("frozen_stylesheets/{}/{}", shape.name(), mode);
+            if !bench.enabled(&name) {
+                continue;
+            }
+            let mut fixture = Fixture::new(shape, Corpus::Framework, DEFAULT_RULE_COUNT);
+            let lock = fixture.dom.shared_lock().clone();
+            if frozen {
+                lock.freeze();
+            }
+            let mut styled = 0;
+            let timings = Timings::measure(bench.iterations, |time| {
+                fixture.clear_styles();
+                time(&mut || styled = fixture.style(Some(&bench.pool)));
+            });
+            // Unsafe: all the read guards of the traversals are gone.
+            unsafe { lock.unfreeze() };
+            report(&name, styled, &timings);
+        }
+    }
+}
+
+/// Taking read guards of a shared lock from all the style threads at once,
+/// which is where a frozen lock saves the contended atomic operations.
+fn lock_reads(bench: &Bench) {
+    const READS: usize = 1_000_000;
+    for frozen in [false, true] {
+        let name = format!(
+            "lock_reads/{}/{}",
+            PARALLEL_THREADS,
+            if frozen { "frozen" } else { "locked" }
+        );
+        if !bench.enabled(&name) {
+            continue;
+        }
+        let lock = SharedRwLock::new();
+        let locked = lock.wrap(0u32);
+        if frozen {
+            lock.freeze();
+        }
+        let timings = Timings::measure(bench.iterations, |time| {
+            time(&mut || {
+                std::thread::scope(|scope| {
+                    for _ in 0..PARALLEL_THREADS {
+                        scope.spawn(|| {
+                            for _ in 0..READS {
+                                let guard = lock.read();
+                                black_box(locked.read_with(&guard));
+                            }
+                        });
+                    }
+                });
+            });
+        });
+        // Unsafe: all the read guards are gone.
+        unsafe { lock.unfreeze() };
+        report(&name, READS * PARALLEL_THREADS, &timings);
+    }
+}
+
+/// Loading a stylesheet by parsing it, compared to loading a precompiled
+/// bundle of it, and to falling back to parsing when the bundle was written
+/// by another build.
+///
+/// Also prints the size of the bundles, written with each kind of
+/// deduplication, as `[BENCH_MEMORY]` lines. Stylesheets that can't be
+/// bundled are skipped, with the reason on stderr.
+///
+/// The user agent stylesheet uses the bundled rules in place, and the
+/// corpora, loaded as author stylesheets, copy them.
+fn stylesheet_loading(bench: &Bench) {
+    const BUILD_KEY: u64 = 0x5e1ec7;
+    const BUNDLE_CAPACITY: usize = 64 << 20;
+    let stylesheets = std::iter::once((
+        "user_agent",
+        String::from(corpus::USER_AGENT_CSS),
+        Origin::UserAgent,
+    ))
+    .chain(Corpus::ALL.iter().map(|corpus| {
+        (
+            corpus.name(),
+            corpus.css(DEFAULT_RULE_COUNT),
+            Origin::Author,
+        )
+    }));
+    for (sheet, css, origin) in stylesheets {
+        let prefix = format!("stylesheet_loading/{}", sheet);
+        if !bench.enabled(&prefix) {
+            continue;
+        }
+        let lock = SharedRwLock::new();
+        let parse = || {
+            StylesheetContents::from_str(
+                &css,
+                sheets::url_data(),
+                origin,
+                &lock,
+                None,
+                None,
+                QuirksMode::NoQuirks,
+                AllowImportRules::Yes,
+                None,
+            )
+        };
+        let contents = parse();
+        let rules = contents.rules(&lock.read()).len();
+        let mut bundle = None;
+        for (mode, dedup) in [
+            ("none", Dedup::None),
+            ("identity", Dedup::Identity),
+            ("content", Dedup::Content),
+        ] {
+            match contents.write_bundle(BUILD_KEY, BUNDLE_CAPACITY, dedup) {
+                Ok(bytes) => {
+                    println!(
+                        "[BENCH_MEMORY],{}/bundle/{},{},{}",
+                        prefix,
+                        mode,
+                        rules,
+                        bytes.len()
+                    );
+                    if dedup == Dedup::Identity {
+                        bundle = Some(bytes);
+                    }
+                },
+                Err(error) => eprintln!("{}/bundle/{}: skipped: {}", prefix, mode, error),
+            }
+        }
+        let Some(bundle) = bundle else {
+            continue;
+        };
+        let path = std::env::temp_dir().join(format!(
+            "stylo-bench-{}-{}.bundle",
+            sheet,
+            std::process::id()
+        ));
+        std::fs::write(&path, &bundle).expect("Couldn't write the bundle");
+
+        for mode in ["parse", "bundle", "stale"] {
+            let name = format!("{}/{}", prefix, mode);
+            if !bench.enabled(&name) {
+                continue;
+            }
+            let timings = Timings::measure(bench.iterations, |time| {
+                time(&mut || {
+                    if mode == "parse" {
+                        black_box(parse());
+                        return;
+                    }
+                    let key = if mode == "bundle" {
+                        BUILD_KEY
+                    } else {
+                        !BUILD_KEY
+                    };
+                    // Unsafe: the contents are dropped before the bundle.
+                    let (contents, bundle) = unsafe {
+                        StylesheetContents::from_bundle_or_str(
+                            &path,
+                            key,
+                            &css,
+                            origin,
+                            sheets::url_data(),
+                            &lock,
+                            QuirksMode::NoQuirks,
+                        )
+                    };
+                    assert_eq!(bundle.is_some(), mode == "bundle");
+                    // Use the rules, so that the bundle pages are touched.
+                    assert_eq!(contents.rules(&lock.read()).len(), rules);
+                    drop(contents);
+                    drop(bundle);
+                });
+            });
+            report(&name, rules, &timings);
+        }
+        let _ = std::fs::remove_file(&path);
+    }
+}
+
+/// Parsing a stylesheet with long class and custom property names, setting
+/// those classes on the elements of a document, and matching them, all of
+/// which atomize the names.
+///
+/// Compare with a build where `STYLO_ATOMS_CORPUS` is the absolute path of
+/// `stylo_bench/app_corpus.css`, which makes the names static atoms. The
+/// number of static atoms is printed as `[BENCH_STATIC_ATOMS],<count>`.
+fn static_atoms(bench: &Bench) {
+    println!("[BENCH_STATIC_ATOMS],{}", AtomStaticSet::get().atoms.len());
+    let name = "static_atoms/parse";
+    if bench.enabled(name) {
+        let lock = SharedRwLock::new();
+        let mut rules = 0;
+        let timings = Timings::measure(bench.iterations, |time| {
+            time(&mut || {
+                let contents = StylesheetContents::from_str(
+                    corpus::APP_CSS,
+                    sheets::url_data(),
+                    Origin::Author,
+                    &lock,
+                    None,
+                    None,
+                    QuirksMode::NoQuirks,
+                    AllowImportRules::Yes,
+                    None,
+                );
+                rules = contents.rules(&lock.read()).len();
+            });
+        });
+        report(name, rules, &timings);
+    }
+
+    let (attributes, matching) = ("static_atoms/class_attributes", "static_atoms/match");
+    if !bench.enabled(attributes) && !bench.enabled(matching) {
+        return;
+    }
+    let shape = DomShape::Wide {
+        sections: 50,
+        items: 40,
+    };
+    let mut fixture = Fixture::new(shape, Corpus::Simple, 0);
+    fixture.append_stylesheet(corpus::APP_CSS);
+    fixture.flush_stylesheets();
+    let classes = corpus::app_classes();
+    let elements = fixture
+        .dom
+        .element_ids()
+        .enumerate()
+        .map(|(i, id)| {
+            let first = classes[i % classes.len()];
+            let second = classes[(i * 7 + 3) % classes.len()];
+            (id, format!("{} {}", first, second))
+        })
+        .collect::<Vec<_>>();
+    let set_classes = |fixture: &mut Fixture| {
+        for (id, value) in &elements {
+            fixture.dom.set_attribute(*id, "class", value);
+        }
+    };
+    if bench.enabled(attributes) {
+        let timings = Timings::measure(bench.iterations, |time| {
+            time(&mut || set_classes(&mut fixture));
+        });
+        report(attributes, elements.len(), &timings);
+    }
+    set_classes(&mut fixture);
+    if bench.enabled(matching) {
+        let mut styled = 0;
+        let timings = Timings::measure(bench.iterations, |time| {
+            fixture.clear_styles();
+            time(&mut || styled = fixture.style(None));
+        });
+        report(matching, styled, &timings);
+    }
+}
+
+/// Parsing stylesheets with and without the atom cache, on one thread and on
+/// all the style threads at once, which contend on the global atom set.
+///
+/// The hit rate of the cache on each stylesheet is printed as
+/// `[BENCH_ATOM_CACHE],<name>,<lookups>,<hits>`.
+fn atom_cache(bench: &Bench) {
+    let stylesheets = std::iter::once(("app", String::from(corpus::APP_CSS))).chain(
+        Corpus::ALL
+            .iter()
+            .map(|corpus| (corpus.name(), corpus.css(DEFAULT_RULE_COUNT))),
+    );
+    for (sheet, css) in stylesheets {
+        let prefix = format!("atom_cache/{}", sheet);
+        if !bench.enabled(&prefix) {
+            continue;
+        }
+        let lock = SharedRwLock::new();
+        let parse = || {
+            StylesheetContents::from_str(
+                &css,
+                sheets::url_data(),
+                Origin::Author,
+                &lock,
+                None,
+                None,
+                QuirksMode::NoQuirks,
+                AllowImportRules::Yes,
+                None,
+            )
+        };
+        style::atom_cache::take_stats();
+        let rules = parse().rules(&lock.read()).len();
+        let stats = style::atom_cache::take_stats();
+        println!(
+            "[BENCH_ATOM_CACHE],{},{},{}",
+            prefix, stats.lookups, stats.hits
+        );
+
+        for cached in [false, true] {
+            style::atom_cache::set_enabled(cached);
+            let mode = if cached { "cached" } else { "uncached" };
+            let name = format!("{}/parse/{}", prefix, mode);
+            if bench.enabled(&name) {
+                let timings = Timings::measure(bench.iterations, |time| {
+                    time(&mut || drop(black_box(parse())));
+                });
+                report(&name, rules, &timings);
+            }
+            let name = format!("{}/parse_parallel/{}/{}", prefix, PARALLEL_THREADS, mode);
+            if bench.enabled(&name) {
+                let timings = Timings::measure(bench.iterations, |time| {
+                    time(&mut || {
+                        std::thread::scope(|scope| {
+                            for _ in 0..PARALLEL_THREADS {
+                                scope.spawn(|| drop(black_box(parse())));
+                            }
+                        });
+                    });
+                });
+                report(&name, rules * PARALLEL_THREADS, &timings);
+            }
+        }
+        style::atom_cache::set_enabled(true);
+    }
+}
+
+fn main() {
+    thread_state::initialize(ThreadState::LAYOUT);
+    let bench = Bench {
+        filters: std::env::args()
+            .skip(1)
+            .filter(|arg| !arg.starts_with('-'))
+            .collect(),
+        iterations: std::env::var("STYLO_BENCH_ITERATIONS")
+            .ok()
+            .and_then(|n| n.parse().ok())
+            .unwrap_or(10),
+        pool: thread_pool(PARALLEL_THREADS),
+    };
+    initial_style(&bench);
+    restyle_class_toggle(&bench);
+    stylesheet_insertion(&bench);
+    cascade_data_rebuild(&bench);
+    query_selector(&bench);
+    elements_by_class_name(&bench);
+    style_memory(&bench);
+    sparse_style_structs(&bench);
+    style_allocations(&bench);
+    cascade_scratch(&bench);
+    frozen_stylesheets(&bench);
+    lock_reads(&bench);
+    stylesheet_loading(&bench);
+    static_atoms(&bench);
+    atom_cache(&bench);
+}
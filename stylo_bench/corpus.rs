@@ -0,0 +1,212 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Deterministic stylesheet corpora, using the class names, ids and
+//! attributes the generators put in documents.
+
+use crate::generators::{Rng, CLASS_COUNT, DATA_KINDS};
+use std::fmt::Write;
+
+/// A minimal user agent stylesheet.
+pub const USER_AGENT_CSS: &str = "
+html, body, div, section, header, ul, li, x-card { display: block }
+head { display: none }
+li { display: list-item }
+body { margin: 8px }
+ul { margin: 1em 0; padding-left: 40px }
+a { color: blue; text-decoration: underline }
+";
+
+/// A stylesheet with the long class and custom property names of a large web
+/// app, which aren't stored inline in atoms.
+pub const APP_CSS: &str = include_str!("app_corpus.css");
+
+/// The class names of `APP_CSS`.
+pub fn app_classes() -> Vec<&'static str> {
+    let mut classes = APP_CSS
+        .split_ascii_whitespace()
+        .filter_map(|token| token.strip_prefix('.'))
+        .collect::<Vec<_>>();
+    classes.sort_unstable();
+    classes.dedup();
+    classes
+}
+
+/// The stylesheet of the shadow roots of `DomShape::ShadowHeavy` documents.
+pub const SHADOW_CSS: &str = "
+:host { display: block; padding: 4px }
+header { font-weight: bold }
+div { margin: 2px 0 }
+div:first-child, div:last-child { border: 1px solid }
+div:nth-child(odd) > span { color: gray }
+.c1 span, .c2 > span { font-style: italic }
+";
+
+/// A kind of stylesheet.
+#[derive(Clone, Copy, Debug)]
+pub enum Corpus {
+    /// Class, id and type selectors.
+    Simple,
+    /// Descendant and child combinators, which exercise the bloom filter.
+    Descendant,
+    /// Structural pseudo-classes, sibling combinators, `:is()`, `:not()` and
+    /// attribute selectors.
+    Structural,
+    /// A mix of all of the above, plus custom properties and media queries,
+    /// like the stylesheets of common CSS frameworks.
+    Framework,
+}
+
+impl Corpus {
+    /// All the corpora.
+    pub const ALL: [Corpus; 4] = [
+        Corpus::Simple,
+        Corpus::Descendant,
+        Corpus::Structural,
+        Corpus::Framework,
+    ];
+
+    /// A stable name for the corpus, used in benchmark output.
+    pub fn name(&self) -> &'static str {
+        match *self {
+            Corpus::Simple => "simple",
+            Corpus::Descendant => "descendant",
+            Corpus::Structural => "structural",
+            Corpus::Framework => "framework",
+        }
+    }
+
+    /// Generates the stylesheet of this corpus, with `rules` style rules.
+    pub fn css(&self, rules: usize) -> String {
+        let mut css = String::new();
+        let mut rng = Rng::new(0xc55 + *self as u64);
+        if let Corpus::Framework = *self {
+            css.push_str(":root {");
+            for i in 0..8 {
+                write!(css, " --space-{}: {}px;", i, i * 4).unwrap();
+            }
+            css.push_str(" }\n");
+        }
+        for i in 0..rules {
+            let kind = match *self {
+                Corpus::Framework => i % 3,
+                Corpus::Simple => 0,
+                Corpus::Descendant => 1,
+                Corpus::Structural => 2,
+            };
+            let selector = match kind {
+                0 => simple_selector(&mut rng),
+                1 => descendant_selector(&mut rng),
+                _ => structural_selector(&mut rng),
+            };
+            let declarations = declarations(&mut rng, matches!(*self, Corpus::Framework));
+            if matches!(*self, Corpus::Framework) && i % 16 == 15 {
+                writeln!(
+                    css,
+                    "@media (min-width: {}px) {{ {} {{ {} }} }}",
+                    320 + rng.below(8) * 160,
+                    selector,
+                    declarations
+                )
+                .unwrap();
+            } else {
+                writeln!(css, "{} {{ {} }}", selector, declarations).unwrap();
+            }
+        }
+        css
+    }
+}
+
+/// A stylesheet inserted into a styled document, with rules that match a
+/// subset of the elements of any generated document.
+pub fn insertion_css(rules: usize) -> String {
+    let mut css = String::new();
+    let mut rng = Rng::new(0x1a5e);
+    for _ in 0..rules {
+        let selector = match rng.below(3) {
+            0 => simple_selector(&mut rng),
+            1 => descendant_selector(&mut rng),
+            _ => structural_selector(&mut rng),
+        };
+        writeln!(css, "{} {{ outline: 1px dotted }}", selector).unwrap();
+    }
+    css
+}
+
+fn class(rng: &mut Rng) -> String {
+    format!(".c{}", rng.below(CLASS_COUNT))
+}
+
+fn tag(rng: &mut Rng) -> &'static str {
+    const TAGS: [&str; 6] = ["div", "span", "section", "li", "a", "ul"];
+    TAGS[rng.below(TAGS.len())]
+}
+
+fn simple_selector(rng: &mut Rng) -> String {
+    match rng.below(8) {
+        0 => format!("#e{}", rng.below(256)),
+        1 => tag(rng).to_owned(),
+        2 => format!("{}{}", tag(rng), class(rng)),
+        3 => format!("{}{}", class(rng), class(rng)),
+        _ => class(rng),
+    }
+}
+
+fn descendant_selector(rng: &mut Rng) -> String {
+    match rng.below(5) {
+        0 => format!("{} {}", class(rng), class(rng)),
+        1 => format!("{} > {}", tag(rng), class(rng)),
+        2 => format!("{} {} {}", class(rng), tag(rng), tag(rng)),
+        3 => format!("body {} > {}", class(rng), tag(rng)),
+        _ => format!("#e{} {}", rng.below(256), class(rng)),
+    }
+}
+
+fn structural_selector(rng: &mut Rng) -> String {
+    match rng.below(10) {
+        0 => format!(
+            "{}:nth-child({}n+{})",
+            tag(rng),
+            2 + rng.below(3),
+            rng.below(3)
+        ),
+        1 => format!("{}:first-child", class(rng)),
+        2 => format!("{}:last-of-type", tag(rng)),
+        3 => format!("{}:not({})", class(rng), class(rng)),
+        4 => format!(":is({}, {}) > {}", class(rng), class(rng), tag(rng)),
+        5 => format!(
+            "[data-kind=\"{}\"] {}",
+            DATA_KINDS[rng.below(DATA_KINDS.len())],
+            class(rng)
+        ),
+        6 => format!("{} ~ {}", class(rng), class(rng)),
+        7 => format!("{} + {}", class(rng), tag(rng)),
+        8 => format!("{}:hover", class(rng)),
+        _ => format!("{}:empty", tag(rng)),
+    }
+}
+
+fn declarations(rng: &mut Rng, custom_properties: bool) -> String {
+    let mut declarations = String::new();
+    for _ in 0..1 + rng.below(4) {
+        let declaration = match rng.below(8) {
+            0 => format!(
+                "color: rgb({}, {}, {})",
+                rng.below(256),
+                rng.below(256),
+                rng.below(256)
+            ),
+            1 => format!("margin-left: {}px", rng.below(32)),
+            2 if custom_properties => format!("padding: var(--space-{})", rng.below(8)),
+            2 => format!("padding: {}px", rng.below(32)),
+            3 => format!("font-size: {}px", 10 + rng.below(16)),
+            4 => format!("width: {}%", rng.below(100)),
+            5 => "display: flex".to_owned(),
+            6 => format!("border-top: {}px solid", rng.below(4)),
+            _ => format!("line-height: 1.{}", rng.below(10)),
+        };
+        write!(declarations, "{}; ", declaration).unwrap();
+    }
+    declarations
+}
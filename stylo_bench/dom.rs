@@ -0,0 +1,1346 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! A lightweight in-memory DOM implementing the style system traits.
+//!
+//! All the nodes of a `Dom` live in a single vector, and are addressed by
+//! `NodeId` while building or mutating the tree, which requires exclusive
+//! access. The style system sees them through the `Node`, `Element`,
+//! `ShadowRoot` and `Document` handles, which are thin references into that
+//! vector, so the tree can't change while any of them is alive.
+//!
+//! Element shadow trees are supported, but slots aren't: the light tree
+//! children of a shadow host are never traversed.
+
+#![allow(unsafe_code)]
+
+use crate::sheets::ShadowSheet;
+use atomic_refcell::{AtomicRef, AtomicRefCell, AtomicRefMut};
+use dom::ElementState;
+use euclid::default::Size2D;
+use selectors::attr::{AttrSelectorOperation, CaseSensitivity, NamespaceConstraint};
+use selectors::bloom::{BloomFilter, SubtreeSummary, BLOOM_HASH_MASK};
+use selectors::matching::{ElementSelectorFlags, MatchingContext, VisitedHandlingMode};
+use selectors::sink::Push;
+use selectors::{Element as SelectorsElement, OpaqueElement};
+use servo_arc::{Arc, ArcBorrow};
+use std::fmt;
+use std::hash::{Hash, Hasher};
+use std::ptr;
+use std::sync::atomic::{AtomicIsize, AtomicU32, AtomicUsize, Ordering};
+use style::applicable_declarations::ApplicableDeclarationBlock;
+use style::attr::{AttrIdentifier, AttrValue as ServoAttrValue};
+use style::author_styles::AuthorStyles;
+use style::bloom::{each_relevant_element_hash, subtree_summary_contribution};
+use style::context::{QuirksMode, SharedStyleContext};
+use style::data::ElementData;
+use style::dom::{LayoutIterator, NodeInfo, OpaqueNode, TDocument, TElement, TNode, TShadowRoot};
+use style::properties::{parse_style_attribute, ComputedValues, PropertyDeclarationBlock};
+use style::selector_parser::{
+    extended_filtering, AttrValue, Lang, NonTSPseudoClass, PseudoElement, SelectorImpl,
+    ServoElementSnapshot,
+};
+use style::shared_lock::{Locked, SharedRwLock, SharedRwLockReadGuard};
+use style::stylesheets::{CssRuleType, UrlExtraData};
+use style::stylist::{CascadeData, Stylist};
+use style::values::computed::Display;
+use style::values::{AtomIdent, AtomString, GenericAtomIdent};
+use style::{CaseSensitivityExt, LocalName, Namespace};
+use stylo_atoms::Atom;
+
+/// The index of a node in its `Dom`.
+#[derive(Clone, Copy, Debug, Eq, Hash, Ord, PartialEq, PartialOrd)]
+pub struct NodeId(u32);
+
+impl NodeId {
+    /// The document node, which every `Dom` has.
+    pub const DOCUMENT: NodeId = NodeId(0);
+
+    #[inline]
+    fn index(self) -> usize {
+        self.0 as usize
+    }
+}
+
+bitflags::bitflags! {
+    #[derive(Clone, Copy)]
+    struct NodeFlags: u32 {
+        const DIRTY_DESCENDANTS = 1 << 0;
+        const HAS_SNAPSHOT = 1 << 1;
+        const HANDLED_SNAPSHOT = 1 << 2;
+    }
+}
+
+struct ElementInfo {
+    local_name: web_atoms::LocalName,
+    namespace: web_atoms::Namespace,
+    id: Option<Atom>,
+    classes: Vec<Atom>,
+    /// All the attributes, including `id` and `class`, in no namespace.
+    attrs: Vec<(LocalName, String)>,
+    /// The attributes in a namespace, which aren't in the document indices.
+    namespaced_attrs: Vec<(web_atoms::Namespace, LocalName, String)>,
+    state: ElementState,
+    style_attribute: Option<Arc<Locked<PropertyDeclarationBlock>>>,
+    shadow_root: Option<NodeId>,
+    flags: AtomicU32,
+    selector_flags: AtomicUsize,
+    children_to_process: AtomicIsize,
+    data: AtomicRefCell<Option<ElementData>>,
+    /// The summary of the hashes of the descendants, once the document
+    /// keeps subtree summaries.
+    subtree_summary: AtomicRefCell<Option<SubtreeSummary>>,
+}
+
+struct ShadowRootInfo {
+    host: NodeId,
+    styles: AuthorStyles<ShadowSheet>,
+}
+
+enum NodeKind {
+    Document,
+    Text(Box<str>),
+    Element(Box<ElementInfo>),
+    ShadowRoot(Box<ShadowRootInfo>),
+}
+
+/// The storage of a node.
+pub struct NodeData {
+    dom: *const DomInner,
+    id: NodeId,
+    parent: Option<NodeId>,
+    first_child: Option<NodeId>,
+    last_child: Option<NodeId>,
+    prev_sibling: Option<NodeId>,
+    next_sibling: Option<NodeId>,
+    /// The shadow root this node is in, if any.
+    containing_shadow: Option<NodeId>,
+    kind: NodeKind,
+}
+
+/// Per-document lists of elements, in tree order, as used by the `dom_apis`
+/// queries.
+#[derive(Default)]
+struct Indices {
+    ids: rustc_hash::FxHashMap<Atom, Vec<*const NodeData>>,
+    classes: rustc_hash::FxHashMap<Atom, Vec<*const NodeData>>,
+    attrs: rustc_hash::FxHashMap<LocalName, Vec<*const NodeData>>,
+}
+
+struct DomInner {
+    nodes: Vec<NodeData>,
+    shared_lock: SharedRwLock,
+    quirks_mode: QuirksMode,
+    url_data: UrlExtraData,
+    indices: Option<Indices>,
+    /// Whether the elements have subtree summaries, which are then kept up to
+    /// date as the tree mutates.
+    keeps_subtree_summaries: bool,
+}
+
+/// An in-memory document.
+pub struct Dom {
+    // Boxed so that nodes can point back to it.
+    inner: Box<DomInner>,
+}
+
+impl Dom {
+    /// Creates a document with no children, using the given lock for its
+    /// style attributes.
+    pub fn new(shared_lock: SharedRwLock, url_data: UrlExtraData) -> Self {
+        let mut dom = Dom {
+            inner: Box::new(DomInner {
+                nodes: vec![],
+                shared_lock,
+                quirks_mode: QuirksMode::NoQuirks,
+                url_data,
+                indices: None,
+                keeps_subtree_summaries: false,
+            }),
+        };
+        dom.push_node(NodeKind::Document);
+        dom
+    }
+
+    fn push_node(&mut self, kind: NodeKind) -> NodeId {
+        let dom = &*self.inner as *const DomInner;
+        let id = NodeId(self.inner.nodes.len() as u32);
+        // Growing the vector may move the nodes.
+        self.inner.indices = None;
+        self.inner.nodes.push(NodeData {
+            dom,
+            id,
+            parent: None,
+            first_child: None,
+            last_child: None,
+            prev_sibling: None,
+            next_sibling: None,
+            containing_shadow: None,
+            kind,
+        });
+        id
+    }
+
+    /// The number of nodes in the document, including the document node
+    /// itself and detached nodes.
+    pub fn len(&self) -> usize {
+        self.inner.nodes.len()
+    }
+
+    /// The lock protecting the style attributes and shadow root stylesheets
+    /// of this document.
+    pub fn shared_lock(&self) -> &SharedRwLock {
+        &self.inner.shared_lock
+    }
+
+    /// Sets the quirks mode of the document.
+    pub fn set_quirks_mode(&mut self, quirks_mode: QuirksMode) {
+        self.inner.quirks_mode = quirks_mode;
+    }
+
+    /// The URL data used to parse style attributes.
+    pub fn url_data(&self) -> &UrlExtraData {
+        &self.inner.url_data
+    }
+
+    /// Creates a detached HTML element.
+    pub fn create_element(&mut self, local_name: &str) -> NodeId {
+        let subtree_summary = self.inner.keeps_subtree_summaries.then(SubtreeSummary::new);
+        self.push_node(NodeKind::Element(Box::new(ElementInfo {
+            local_name: web_atoms::LocalName::from(local_name),
+            namespace: web_atoms::ns!(html),
+            id: None,
+            classes: vec![],
+            attrs: vec![],
+            namespaced_attrs: vec![],
+            state: ElementState::empty(),
+            style_attribute: None,
+            shadow_root: None,
+            flags: AtomicU32::new(0),
+            selector_flags: AtomicUsize::new(0),
+            children_to_process: AtomicIsize::new(0),
+            data: AtomicRefCell::new(None),
+            subtree_summary: AtomicRefCell::new(subtree_summary),
+        })))
+    }
+
+    /// Creates a detached text node.
+    pub fn create_text(&mut self, text: &str) -> NodeId {
+        self.push_node(NodeKind::Text(text.into()))
+    }
+
+    /// Attaches a shadow root to `host`, and returns it.
+    pub fn attach_shadow(&mut self, host: NodeId) -> NodeId {
+        assert!(self.element_info(host).shadow_root.is_none());
+        let shadow = self.push_node(NodeKind::ShadowRoot(Box::new(ShadowRootInfo {
+            host,
+            styles: AuthorStyles::new(),
+        })));
+        self.inner.nodes[shadow.index()].containing_shadow =
+            self.inner.nodes[host.index()].containing_shadow;
+        self.element_info_mut(host).shadow_root = Some(shadow);
+        shadow
+    }
+
+    /// Appends `child` to the children of `parent`.
+    ///
+    /// Trees need to be built top-down, that is, `child` can't have children
+    /// of its own yet.
+    pub fn append_child(&mut self, parent: NodeId, child: NodeId) {
+        debug_assert!(self.inner.nodes[child.index()].parent.is_none());
+        debug_assert!(self.inner.nodes[child.index()].first_child.is_none());
+        let containing_shadow = match self.inner.nodes[parent.index()].kind {
+            NodeKind::ShadowRoot(..) => Some(parent),
+            _ => self.inner.nodes[parent.index()].containing_shadow,
+        };
+        let prev = self.inner.nodes[parent.index()].last_child;
+        {
+            let child = &mut self.inner.nodes[child.index()];
+            child.parent = Some(parent);
+            child.prev_sibling = prev;
+            child.containing_shadow = containing_shadow;
+        }
+        match prev {
+            Some(prev) => self.inner.nodes[prev.index()].next_sibling = Some(child),
+            None => self.inner.nodes[parent.index()].first_child = Some(child),
+        }
+        self.inner.nodes[parent.index()].last_child = Some(child);
+        self.inner.indices = None;
+        if !self.inner.keeps_subtree_summaries {
+            return;
+        }
+        if let Some(child) = self.node(child).as_element() {
+            child.update_subtree_summaries_after_insertion();
+        }
+    }
+
+    /// Removes `child`, and its subtree, from the children of its parent.
+    ///
+    /// The removed subtree stays detached: it can't be inserted again.
+    pub fn remove_child(&mut self, child: NodeId) {
+        let node = &self.inner.nodes[child.index()];
+        let parent = node.parent.expect("Not in the tree");
+        let (prev, next) = (node.prev_sibling, node.next_sibling);
+        match prev {
+            Some(prev) => self.inner.nodes[prev.index()].next_sibling = next,
+            None => self.inner.nodes[parent.index()].first_child = next,
+        }
+        match next {
+            Some(next) => self.inner.nodes[next.index()].prev_sibling = prev,
+            None => self.inner.nodes[parent.index()].last_child = prev,
+        }
+        let node = &mut self.inner.nodes[child.index()];
+        node.parent = None;
+        node.prev_sibling = None;
+        node.next_sibling = None;
+        self.inner.indices = None;
+        if !self.inner.keeps_subtree_summaries {
+            return;
+        }
+        if let Some(parent) = self.node(parent).as_element() {
+            parent.update_subtree_summaries_after_removal();
+        }
+    }
+
+    fn element_info(&self, id: NodeId) -> &ElementInfo {
+        match self.inner.nodes[id.index()].kind {
+            NodeKind::Element(ref info) => info,
+            _ => panic!("Not an element"),
+        }
+    }
+
+    fn element_info_mut(&mut self, id: NodeId) -> &mut ElementInfo {
+        match self.inner.nodes[id.index()].kind {
+            NodeKind::Element(ref mut info) => info,
+            _ => panic!("Not an element"),
+        }
+    }
+
+    /// Sets an attribute in no namespace on an element. The `id` and `class`
+    /// attributes are parsed as such.
+    pub fn set_attribute(&mut self, element: NodeId, name: &str, value: &str) {
+        let name = LocalName::from(name);
+        let info = self.element_info_mut(element);
+        if name.0 == web_atoms::local_name!("id") {
+            info.id = Some(Atom::from(value));
+        } else if name.0 == web_atoms::local_name!("class") {
+            info.classes = value.split_ascii_whitespace().map(Atom::from).collect();
+        }
+        match info.attrs.iter_mut().find(|(n, _)| *n == name) {
+            Some(attr) => attr.1 = value.to_owned(),
+            None => info.attrs.push((name, value.to_owned())),
+        }
+        self.inner.indices = None;
+        self.attributes_changed(element);
+    }
+
+    /// Sets an attribute in the given namespace on an element.
+    pub fn set_attribute_ns(&mut self, element: NodeId, namespace: &str, name: &str, value: &str) {
+        let namespace = web_atoms::Namespace::from(namespace);
+        let name = LocalName::from(name);
+        let info = self.element_info_mut(element);
+        match info
+            .namespaced_attrs
+            .iter_mut()
+            .find(|(ns, n, _)| *ns == namespace && *n == name)
+        {
+            Some(attr) => attr.2 = value.to_owned(),
+            None => info
+                .namespaced_attrs
+                .push((namespace, name, value.to_owned())),
+        }
+        self.inner.indices = None;
+        self.attributes_changed(element);
+    }
+
+    /// Updates the subtree summaries of the ancestors of an element whose
+    /// classes, id or attributes changed. Rebuilding the summary of the
+    /// parent handles both the hashes it gained and those it lost.
+    fn attributes_changed(&self, element: NodeId) {
+        if !self.inner.keeps_subtree_summaries {
+            return;
+        }
+        if let Some(parent) = self.element(element).parent_element() {
+            parent.update_subtree_summaries_after_removal();
+        }
+    }
+
+    /// Returns the value of an attribute in no namespace of an element.
+    pub fn attribute(&self, element: NodeId, name: &str) -> Option<&str> {
+        let name = LocalName::from(name);
+        self.element_info(element)
+            .attrs
+            .iter()
+            .find(|(n, _)| *n == name)
+            .map(|(_, v)| &**v)
+    }
+
+    /// Parses `css` as the style attribute of an element.
+    pub fn set_style_attribute(&mut self, element: NodeId, css: &str) {
+        let block = parse_style_attribute(
+            css,
+            &self.inner.url_data,
+            None,
+            self.inner.quirks_mode,
+            CssRuleType::Style,
+        );
+        let block = Arc::new(self.inner.shared_lock.wrap(block));
+        self.element_info_mut(element).style_attribute = Some(block);
+    }
+
+    /// Adds a stylesheet to a shadow root. The changes are applied by
+    /// `flush_shadow_stylesheets`.
+    pub fn append_shadow_stylesheet(
+        &mut self,
+        shadow: NodeId,
+        sheet: ShadowSheet,
+        guard: &SharedRwLockReadGuard,
+    ) {
+        match self.inner.nodes[shadow.index()].kind {
+            NodeKind::ShadowRoot(ref mut info) => info
+                .styles
+                .stylesheets
+                .append_stylesheet(None, sheet, guard),
+            _ => panic!("Not a shadow root"),
+        }
+    }
+
+    /// Rebuilds the cascade data of all the shadow roots whose stylesheets
+    /// changed.
+    pub fn flush_shadow_stylesheets(
+        &mut self,
+        stylist: &mut Stylist,
+        guard: &SharedRwLockReadGuard,
+    ) {
+        for node in &mut self.inner.nodes {
+            if let NodeKind::ShadowRoot(ref mut info) = node.kind {
+                info.styles.flush::<Element>(stylist, guard);
+            }
+        }
+    }
+
+    /// Builds the id, class and attribute indices of the document, which
+    /// are dropped on the next mutation of the tree or of an attribute.
+    pub fn build_indices(&mut self) {
+        let mut indices = Indices::default();
+        let mut current = self.document().as_node().first_child();
+        let document = self.document().as_node();
+        while let Some(node) = current {
+            if let Some(element) = node.as_element() {
+                let info = element.info();
+                let ptr = element.0 .0 as *const NodeData;
+                if let Some(ref id) = info.id {
+                    indices.ids.entry(id.clone()).or_default().push(ptr);
+                }
+                for class in &info.classes {
+                    let list = indices.classes.entry(class.clone()).or_default();
+                    // Don't add duplicate classes twice.
+                    if list.last() != Some(&ptr) {
+                        list.push(ptr);
+                    }
+                }
+                for (name, _) in &info.attrs {
+                    indices.attrs.entry(name.clone()).or_default().push(ptr);
+                }
+            }
+            current = node.next_in_preorder(document);
+        }
+        self.inner.indices = Some(indices);
+    }
+
+    /// Computes the subtree summaries of all the elements, which are then kept
+    /// up to date as the tree mutates.
+    pub fn build_subtree_summaries(&mut self) {
+        self.inner.keeps_subtree_summaries = true;
+        let roots = self.inner.nodes.iter().filter(|n| n.parent.is_none());
+        let mut nodes = vec![];
+        for root in roots {
+            let root = Node(root);
+            let mut current = Some(root);
+            while let Some(node) = current {
+                nodes.push(node);
+                current = node.next_in_preorder(root);
+            }
+        }
+        // Children come after their parent in preorder, so summaries are
+        // built bottom-up.
+        for element in nodes.iter().rev().filter_map(|n| n.as_element()) {
+            let mut summary = SubtreeSummary::new();
+            for child in element.0.dom_children().filter_map(|n| n.as_element()) {
+                summary.union_with(&subtree_summary_contribution(child).unwrap());
+            }
+            *element.info().subtree_summary.borrow_mut() = Some(summary);
+        }
+    }
+
+    /// Returns a snapshot of the current attributes and state of an element,
+    /// to be used before changing them.
+    pub fn snapshot(&self, element: NodeId) -> ServoElementSnapshot {
+        let info = self.element_info(element);
+        let namespaced_attrs = info.namespaced_attrs.iter().map(|(ns, name, value)| {
+            let identifier = AttrIdentifier {
+                local_name: name.clone(),
+                name: name.clone(),
+                namespace: GenericAtomIdent(ns.clone()),
+                prefix: None,
+            };
+            (identifier, ServoAttrValue::String(value.clone()))
+        });
+        let attrs = info
+            .attrs
+            .iter()
+            .map(|(name, value)| {
+                let value = if name.0 == web_atoms::local_name!("class") {
+                    ServoAttrValue::from_serialized_tokenlist(value.clone())
+                } else if name.0 == web_atoms::local_name!("id") {
+                    ServoAttrValue::from_atomic(value.clone())
+                } else {
+                    ServoAttrValue::String(value.clone())
+                };
+                let identifier = AttrIdentifier {
+                    local_name: name.clone(),
+                    name: name.clone(),
+                    namespace: GenericAtomIdent(web_atoms::ns!()),
+                    prefix: None,
+                };
+                (identifier, value)
+            })
+            .chain(namespaced_attrs)
+            .collect();
+        ServoElementSnapshot {
+            state: Some(info.state),
+            attrs: Some(attrs),
+            ..Default::default()
+        }
+    }
+
+    /// Returns the document.
+    pub fn document(&self) -> Document<'_> {
+        Document(self.node(NodeId::DOCUMENT))
+    }
+
+    /// Returns a handle to a node.
+    pub fn node(&self, id: NodeId) -> Node<'_> {
+        Node(&self.inner.nodes[id.index()])
+    }
+
+    /// Returns a handle to an element.
+    pub fn element(&self, id: NodeId) -> Element<'_> {
+        self.node(id).as_element().expect("Not an element")
+    }
+
+    /// Returns the root element.
+    pub fn root_element(&self) -> Element<'_> {
+        self.document()
+            .as_node()
+            .dom_children()
+            .find_map(|n| n.as_element())
+            .expect("No root element")
+    }
+
+    /// Returns the ids of all the elements, in creation order, including
+    /// those in shadow trees.
+    pub fn element_ids(&self) -> impl Iterator<Item = NodeId> + '_ {
+        self.inner
+            .nodes
+            .iter()
+            .filter(|n| matches!(n.kind, NodeKind::Element(..)))
+            .map(|n| n.id)
+    }
+
+    /// Returns the number of elements, including those in shadow trees.
+    pub fn element_count(&self) -> usize {
+        self.element_ids().count()
+    }
+}
+
+/// A handle to a node.
+#[derive(Clone, Copy)]
+#[repr(transparent)]
+pub struct Node<'a>(&'a NodeData);
+
+impl<'a> Node<'a> {
+    #[inline]
+    fn dom(&self) -> &'a DomInner {
+        unsafe { &*self.0.dom }
+    }
+
+    #[inline]
+    fn relative(&self, id: Option<NodeId>) -> Option<Self> {
+        let dom = self.dom();
+        id.map(|id| Node(&dom.nodes[id.index()]))
+    }
+
+    /// The id of this node in its `Dom`.
+    pub fn node_id(&self) -> NodeId {
+        self.0.id
+    }
+
+    fn is_shadow_root(&self) -> bool {
+        matches!(self.0.kind, NodeKind::ShadowRoot(..))
+    }
+
+    fn is_empty_text(&self) -> bool {
+        matches!(self.0.kind, NodeKind::Text(ref t) if t.is_empty())
+    }
+}
+
+impl<'a> PartialEq for Node<'a> {
+    fn eq(&self, other: &Self) -> bool {
+        ptr::eq(self.0, other.0)
+    }
+}
+
+impl<'a> fmt::Debug for Node<'a> {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        match self.0.kind {
+            NodeKind::Document => write!(f, "#document"),
+            NodeKind::Text(..) => write!(f, "#text({})", self.0.id.0),
+            NodeKind::ShadowRoot(..) => write!(f, "#shadow-root({})", self.0.id.0),
+            NodeKind::Element(..) => self.as_element().unwrap().fmt(f),
+        }
+    }
+}
+
+impl<'a> NodeInfo for Node<'a> {
+    fn is_element(&self) -> bool {
+        matches!(self.0.kind, NodeKind::Element(..))
+    }
+
+    fn is_text_node(&self) -> bool {
+        matches!(self.0.kind, NodeKind::Text(..))
+    }
+}
+
+impl<'a> TNode for Node<'a> {
+    type ConcreteElement = Element<'a>;
+    type ConcreteDocument = Document<'a>;
+    type ConcreteShadowRoot = ShadowRoot<'a>;
+
+    fn parent_node(&self) -> Option<Self> {
+        self.relative(self.0.parent)
+    }
+
+    fn first_child(&self) -> Option<Self> {
+        self.relative(self.0.first_child)
+    }
+
+    fn last_child(&self) -> Option<Self> {
+        self.relative(self.0.last_child)
+    }
+
+    fn prev_sibling(&self) -> Option<Self> {
+        self.relative(self.0.prev_sibling)
+    }
+
+    fn next_sibling(&self) -> Option<Self> {
+        self.relative(self.0.next_sibling)
+    }
+
+    fn owner_doc(&self) -> Document<'a> {
+        Document(self.relative(Some(NodeId::DOCUMENT)).unwrap())
+    }
+
+    fn is_in_document(&self) -> bool {
+        self.0.containing_shadow.is_none()
+    }
+
+    fn traversal_parent(&self) -> Option<Element<'a>> {
+        let parent = self.parent_node()?;
+        if let Some(shadow) = parent.as_shadow_root() {
+            return Some(shadow.host());
+        }
+        parent.as_element()
+    }
+
+    fn opaque(&self) -> OpaqueNode {
+        OpaqueNode(self.0 as *const NodeData as usize)
+    }
+
+    fn debug_id(self) -> usize {
+        self.0.id.index()
+    }
+
+    fn as_element(&self) -> Option<Element<'a>> {
+        match self.0.kind {
+            NodeKind::Element(..) => Some(Element(*self)),
+            _ => None,
+        }
+    }
+
+    fn as_document(&self) -> Option<Document<'a>> {
+        match self.0.kind {
+            NodeKind::Document => Some(Document(*self)),
+            _ => None,
+        }
+    }
+
+    fn as_shadow_root(&self) -> Option<ShadowRoot<'a>> {
+        match self.0.kind {
+            NodeKind::ShadowRoot(..) => Some(ShadowRoot(*self)),
+            _ => None,
+        }
+    }
+}
+
+/// A handle to the document node.
+#[derive(Clone, Copy)]
+#[repr(transparent)]
+pub struct Document<'a>(Node<'a>);
+
+impl<'a> Document<'a> {
+    /// Returns the index for `key` in `map`, as a slice of elements.
+    fn index<K, Q>(
+        &self,
+        map: impl FnOnce(&'a Indices) -> &'a rustc_hash::FxHashMap<K, Vec<*const NodeData>>,
+        key: &Q,
+    ) -> Result<&'a [Element<'a>], ()>
+    where
+        K: std::borrow::Borrow<Q> + Eq + Hash + 'a,
+        Q: Eq + Hash + ?Sized,
+    {
+        let indices = self.0.dom().indices.as_ref().ok_or(())?;
+        let list = match map(indices).get(key) {
+            Some(list) => list,
+            None => return Ok(&[]),
+        };
+        // Safety: `Element` is a transparent wrapper around a `&NodeData`,
+        // and the indices are dropped whenever the nodes may move.
+        Ok(unsafe { std::slice::from_raw_parts(list.as_ptr() as *const Element<'a>, list.len()) })
+    }
+}
+
+impl<'a> TDocument for Document<'a> {
+    type ConcreteNode = Node<'a>;
+
+    fn as_node(&self) -> Node<'a> {
+        self.0
+    }
+
+    fn is_html_document(&self) -> bool {
+        true
+    }
+
+    fn quirks_mode(&self) -> QuirksMode {
+        self.0.dom().quirks_mode
+    }
+
+    fn elements_with_id<'b>(&self, id: &AtomIdent) -> Result<&'b [Element<'a>], ()>
+    where
+        Self: 'b,
+    {
+        self.index(|i| &i.ids, &id.0)
+    }
+
+    fn elements_with_class<'b>(&self, class: &AtomIdent) -> Result<&'b [Element<'a>], ()>
+    where
+        Self: 'b,
+    {
+        self.index(|i| &i.classes, &class.0)
+    }
+
+    fn elements_with_attr<'b>(&self, name: &LocalName) -> Result<&'b [Element<'a>], ()>
+    where
+        Self: 'b,
+    {
+        self.index(|i| &i.attrs, name)
+    }
+
+    fn shared_lock(&self) -> &SharedRwLock {
+        &self.0.dom().shared_lock
+    }
+}
+
+/// A handle to a shadow root.
+#[derive(Clone, Copy, PartialEq)]
+#[repr(transparent)]
+pub struct ShadowRoot<'a>(Node<'a>);
+
+impl<'a> ShadowRoot<'a> {
+    fn info(&self) -> &'a ShadowRootInfo {
+        match self.0 .0.kind {
+            NodeKind::ShadowRoot(ref info) => info,
+            _ => unreachable!(),
+        }
+    }
+}
+
+impl<'a> fmt::Debug for ShadowRoot<'a> {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        self.0.fmt(f)
+    }
+}
+
+impl<'a> TShadowRoot for ShadowRoot<'a> {
+    type ConcreteNode = Node<'a>;
+
+    fn as_node(&self) -> Node<'a> {
+        self.0
+    }
+
+    fn host(&self) -> Element<'a> {
+        self.0
+            .relative(Some(self.info().host))
+            .unwrap()
+            .as_element()
+            .unwrap()
+    }
+
+    fn style_data<'b>(&self) -> Option<&'b CascadeData>
+    where
+        Self: 'b,
+    {
+        Some(&self.info().styles.data)
+    }
+}
+
+/// A handle to an element.
+#[derive(Clone, Copy, PartialEq)]
+#[repr(transparent)]
+pub struct Element<'a>(Node<'a>);
+
+impl<'a> Element<'a> {
+    #[inline]
+    fn info(&self) -> &'a ElementInfo {
+        match self.0 .0.kind {
+            NodeKind::Element(ref info) => info,
+            _ => unreachable!(),
+        }
+    }
+
+    #[inline]
+    fn flags(&self) -> NodeFlags {
+        NodeFlags::from_bits_retain(self.info().flags.load(Ordering::Relaxed))
+    }
+
+    #[inline]
+    fn insert_flags(&self, flags: NodeFlags) {
+        self.info().flags.fetch_or(flags.bits(), Ordering::Relaxed);
+    }
+
+    #[inline]
+    fn remove_flags(&self, flags: NodeFlags) {
+        self.info()
+            .flags
+            .fetch_and(!flags.bits(), Ordering::Relaxed);
+    }
+
+    #[inline]
+    fn selector_flags(&self) -> ElementSelectorFlags {
+        ElementSelectorFlags::from_bits_retain(self.info().selector_flags.load(Ordering::Relaxed))
+    }
+
+    /// The id of this element in its `Dom`.
+    pub fn node_id(&self) -> NodeId {
+        self.0.node_id()
+    }
+
+    /// Notes that this element has a snapshot to process, and that all its
+    /// ancestors have a dirty descendant.
+    pub fn note_snapshot(&self) {
+        self.insert_flags(NodeFlags::HAS_SNAPSHOT);
+        self.note_dirty_descendant();
+    }
+
+    /// Forgets about the snapshot of this element, once it has been
+    /// processed.
+    pub fn clear_snapshot(&self) {
+        self.remove_flags(NodeFlags::HAS_SNAPSHOT | NodeFlags::HANDLED_SNAPSHOT);
+    }
+
+    /// Marks the ancestors of this element in the flat tree as having dirty
+    /// descendants.
+    pub fn note_dirty_descendant(&self) {
+        let mut current = self.traversal_parent();
+        while let Some(parent) = current {
+            if parent.has_dirty_descendants() {
+                break;
+            }
+            parent.insert_flags(NodeFlags::DIRTY_DESCENDANTS);
+            current = parent.traversal_parent();
+        }
+    }
+}
+
+impl<'a> fmt::Debug for Element<'a> {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "<{}", self.info().local_name)?;
+        if let Some(ref id) = self.info().id {
+            write!(f, " id={}", id)?;
+        }
+        write!(f, "> ({})", self.0 .0.id.0)
+    }
+}
+
+impl<'a> Eq for Element<'a> {}
+
+impl<'a> Hash for Element<'a> {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        (self.0 .0 as *const NodeData).hash(state)
+    }
+}
+
+/// Iterates over the children of an element in the flat tree.
+pub struct TraversalChildren<'a>(Option<Node<'a>>);
+
+impl<'a> Iterator for TraversalChildren<'a> {
+    type Item = Node<'a>;
+
+    fn next(&mut self) -> Option<Node<'a>> {
+        let node = self.0.take()?;
+        self.0 = node.next_sibling();
+        Some(node)
+    }
+}
+
+impl<'a> TElement for Element<'a> {
+    type ConcreteNode = Node<'a>;
+    type TraversalChildrenIterator = TraversalChildren<'a>;
+
+    fn as_node(&self) -> Node<'a> {
+        self.0
+    }
+
+    fn traversal_children(&self) -> LayoutIterator<TraversalChildren<'a>> {
+        let parent = match self.shadow_root() {
+            Some(shadow) => shadow.as_node(),
+            None => self.0,
+        };
+        LayoutIterator(TraversalChildren(parent.first_child()))
+    }
+
+    fn is_html_element(&self) -> bool {
+        self.info().namespace == web_atoms::ns!(html)
+    }
+
+    fn is_mathml_element(&self) -> bool {
+        self.info().namespace == web_atoms::ns!(mathml)
+    }
+
+    fn is_svg_element(&self) -> bool {
+        self.info().namespace == web_atoms::ns!(svg)
+    }
+
+    fn style_attribute(&self) -> Option<ArcBorrow<'_, Locked<PropertyDeclarationBlock>>> {
+        self.info().style_attribute.as_ref().map(|b| b.borrow_arc())
+    }
+
+    fn animation_rule(
+        &self,
+        _: &SharedStyleContext,
+    ) -> Option<Arc<Locked<PropertyDeclarationBlock>>> {
+        None
+    }
+
+    fn transition_rule(
+        &self,
+        _: &SharedStyleContext,
+    ) -> Option<Arc<Locked<PropertyDeclarationBlock>>> {
+        None
+    }
+
+    fn state(&self) -> ElementState {
+        self.info().state
+    }
+
+    fn has_part_attr(&self) -> bool {
+        false
+    }
+
+    fn exports_any_part(&self) -> bool {
+        false
+    }
+
+    fn id(&self) -> Option<&Atom> {
+        self.info().id.as_ref()
+    }
+
+    fn each_class<F>(&self, mut callback: F)
+    where
+        F: FnMut(&AtomIdent),
+    {
+        for class in &self.info().classes {
+            callback(AtomIdent::cast(class));
+        }
+    }
+
+    fn each_custom_state<F>(&self, _callback: F)
+    where
+        F: FnMut(&AtomIdent),
+    {
+    }
+
+    fn each_attr_name<F>(&self, mut callback: F)
+    where
+        F: FnMut(&LocalName),
+    {
+        for (name, _) in &self.info().attrs {
+            callback(name);
+        }
+        for (_, name, _) in &self.info().namespaced_attrs {
+            callback(name);
+        }
+    }
+
+    fn has_dirty_descendants(&self) -> bool {
+        self.flags().contains(NodeFlags::DIRTY_DESCENDANTS)
+    }
+
+    fn has_snapshot(&self) -> bool {
+        self.flags().contains(NodeFlags::HAS_SNAPSHOT)
+    }
+
+    fn handled_snapshot(&self) -> bool {
+        self.flags().contains(NodeFlags::HANDLED_SNAPSHOT)
+    }
+
+    unsafe fn set_handled_snapshot(&self) {
+        self.insert_flags(NodeFlags::HANDLED_SNAPSHOT)
+    }
+
+    unsafe fn set_dirty_descendants(&self) {
+        self.insert_flags(NodeFlags::DIRTY_DESCENDANTS)
+    }
+
+    unsafe fn unset_dirty_descendants(&self) {
+        self.remove_flags(NodeFlags::DIRTY_DESCENDANTS)
+    }
+
+    fn store_children_to_process(&self, n: isize) {
+        self.info().children_to_process.store(n, Ordering::Relaxed);
+    }
+
+    fn did_process_child(&self) -> isize {
+        self.info()
+            .children_to_process
+            .fetch_sub(1, Ordering::Relaxed)
+            - 1
+    }
+
+    unsafe fn ensure_data(&self) -> AtomicRefMut<'_, ElementData> {
+        AtomicRefMut::map(self.info().data.borrow_mut(), |data| {
+            data.get_or_insert_with(Default::default)
+        })
+    }
+
+    unsafe fn clear_data(&self) {
+        *self.info().data.borrow_mut() = None;
+    }
+
+    fn has_data(&self) -> bool {
+        self.info().data.borrow().is_some()
+    }
+
+    fn borrow_data(&self) -> Option<AtomicRef<'_, ElementData>> {
+        let data = self.info().data.borrow();
+        if data.is_none() {
+            return None;
+        }
+        Some(AtomicRef::map(data, |data| data.as_ref().unwrap()))
+    }
+
+    fn mutate_data(&self) -> Option<AtomicRefMut<'_, ElementData>> {
+        let data = self.info().data.borrow_mut();
+        if data.is_none() {
+            return None;
+        }
+        Some(AtomicRefMut::map(data, |data| data.as_mut().unwrap()))
+    }
+
+    fn skip_item_display_fixup(&self) -> bool {
+        false
+    }
+
+    fn may_have_animations(&self) -> bool {
+        false
+    }
+
+    fn has_animations(&self, _: &SharedStyleContext) -> bool {
+        false
+    }
+
+    fn has_css_animations(&self, _: &SharedStyleContext, _: Option<PseudoElement>) -> bool {
+        false
+    }
+
+    fn has_css_transitions(&self, _: &SharedStyleContext, _: Option<PseudoElement>) -> bool {
+        false
+    }
+
+    fn shadow_root(&self) -> Option<ShadowRoot<'a>> {
+        self.0
+            .relative(self.info().shadow_root)
+            .and_then(|n| n.as_shadow_root())
+    }
+
+    fn containing_shadow(&self) -> Option<ShadowRoot<'a>> {
+        self.0
+            .relative(self.0 .0.containing_shadow)
+            .and_then(|n| n.as_shadow_root())
+    }
+
+    fn lang_attr(&self) -> Option<AttrValue> {
+        self.info()
+            .attrs
+            .iter()
+            .find(|(name, _)| name.0 == web_atoms::local_name!("lang"))
+            .map(|(_, value)| AtomString::from(&**value))
+    }
+
+    fn match_element_lang(&self, override_lang: Option<Option<AttrValue>>, value: &Lang) -> bool {
+        let lang = match override_lang {
+            Some(lang) => lang,
+            None => {
+                let mut current = Some(*self);
+                loop {
+                    let Some(element) = current else { break None };
+                    if let Some(lang) = element.lang_attr() {
+                        break Some(lang);
+                    }
+                    current = element.parent_element();
+                }
+            },
+        };
+        lang.map_or(false, |lang| extended_filtering(lang.as_ref(), value))
+    }
+
+    fn is_html_document_body_element(&self) -> bool {
+        self.info().local_name == web_atoms::local_name!("body")
+            && self.parent_element().map_or(false, |p| p.is_root())
+    }
+
+    fn synthesize_presentational_hints_for_legacy_attributes<V>(
+        &self,
+        _visited_handling: VisitedHandlingMode,
+        _hints: &mut V,
+    ) where
+        V: Push<ApplicableDeclarationBlock>,
+    {
+    }
+
+    fn local_name(&self) -> &web_atoms::LocalName {
+        &self.info().local_name
+    }
+
+    fn namespace(&self) -> &web_atoms::Namespace {
+        &self.info().namespace
+    }
+
+    fn query_container_size(&self, _display: &Display) -> Size2D<Option<app_units::Au>> {
+        Size2D::new(None, None)
+    }
+
+    fn has_selector_flags(&self, flags: ElementSelectorFlags) -> bool {
+        self.selector_flags().contains(flags)
+    }
+
+    fn relative_selector_search_direction(&self) -> ElementSelectorFlags {
+        self.selector_flags()
+            .intersection(ElementSelectorFlags::RELATIVE_SELECTOR_SEARCH_DIRECTION_ANCESTOR_SIBLING)
+    }
+
+    unsafe fn set_subtree_summary(&self, summary: Option<SubtreeSummary>) {
+        *self.info().subtree_summary.borrow_mut() = summary;
+    }
+}
+
+impl<'a> SelectorsElement for Element<'a> {
+    type Impl = SelectorImpl;
+
+    fn opaque(&self) -> OpaqueElement {
+        OpaqueElement::new(self.0 .0)
+    }
+
+    fn parent_element(&self) -> Option<Self> {
+        self.0.parent_node()?.as_element()
+    }
+
+    fn parent_node_is_shadow_root(&self) -> bool {
+        self.0.parent_node().map_or(false, |p| p.is_shadow_root())
+    }
+
+    fn containing_shadow_host(&self) -> Option<Self> {
+        self.containing_shadow().map(|s| s.host())
+    }
+
+    fn is_pseudo_element(&self) -> bool {
+        false
+    }
+
+    fn prev_sibling_element(&self) -> Option<Self> {
+        let mut current = self.0.prev_sibling();
+        while let Some(node) = current {
+            if let Some(element) = node.as_element() {
+                return Some(element);
+            }
+            current = node.prev_sibling();
+        }
+        None
+    }
+
+    fn next_sibling_element(&self) -> Option<Self> {
+        let mut current = self.0.next_sibling();
+        while let Some(node) = current {
+            if let Some(element) = node.as_element() {
+                return Some(element);
+            }
+            current = node.next_sibling();
+        }
+        None
+    }
+
+    fn first_element_child(&self) -> Option<Self> {
+        self.0.dom_children().find_map(|n| n.as_element())
+    }
+
+    fn is_html_element_in_html_document(&self) -> bool {
+        self.is_html_element()
+    }
+
+    fn has_local_name(&self, local_name: &web_atoms::LocalName) -> bool {
+        self.info().local_name == *local_name
+    }
+
+    fn has_namespace(&self, ns: &web_atoms::Namespace) -> bool {
+        self.info().namespace == *ns
+    }
+
+    fn is_same_type(&self, other: &Self) -> bool {
+        self.info().local_name == other.info().local_name
+            && self.info().namespace == other.info().namespace
+    }
+
+    fn attr_matches(
+        &self,
+        ns: &NamespaceConstraint<&Namespace>,
+        local_name: &LocalName,
+        operation: &AttrSelectorOperation<&AtomString>,
+    ) -> bool {
+        let in_no_namespace = || {
+            self.info()
+                .attrs
+                .iter()
+                .find(|(name, _)| name == local_name)
+                .map_or(false, |(_, value)| operation.eval_str(value))
+        };
+        let in_namespace = |ns: Option<&web_atoms::Namespace>| {
+            self.info()
+                .namespaced_attrs
+                .iter()
+                .any(|(attr_ns, name, value)| {
+                    ns.map_or(true, |ns| ns == attr_ns)
+                        && name == local_name
+                        && operation.eval_str(value)
+                })
+        };
+        match *ns {
+            NamespaceConstraint::Any => in_no_namespace() || in_namespace(None),
+            NamespaceConstraint::Specific(ns) if ns.0 == web_atoms::ns!() => in_no_namespace(),
+            NamespaceConstraint::Specific(ns) => in_namespace(Some(&ns.0)),
+        }
+    }
+
+    fn match_non_ts_pseudo_class(
+        &self,
+        pc: &NonTSPseudoClass,
+        _context: &mut MatchingContext<SelectorImpl>,
+    ) -> bool {
+        match *pc {
+            NonTSPseudoClass::Lang(ref lang) => self.match_element_lang(None, lang),
+            NonTSPseudoClass::CustomState(ref state) => self.has_custom_state(&state.0),
+            NonTSPseudoClass::ServoNonZeroBorder => false,
+            _ => self.state().intersects(pc.state_flag()),
+        }
+    }
+
+    fn match_pseudo_element(
+        &self,
+        _pe: &PseudoElement,
+        _context: &mut MatchingContext<SelectorImpl>,
+    ) -> bool {
+        false
+    }
+
+    fn apply_selector_flags(&self, flags: ElementSelectorFlags) {
+        let self_flags = flags.for_self();
+        if !self_flags.is_empty() {
+            self.info()
+                .selector_flags
+                .fetch_or(self_flags.bits(), Ordering::Relaxed);
+        }
+        let parent_flags = flags.for_parent();
+        if !parent_flags.is_empty() {
+            if let Some(parent) = self.parent_element() {
+                parent
+                    .info()
+                    .selector_flags
+                    .fetch_or(parent_flags.bits(), Ordering::Relaxed);
+            }
+        }
+    }
+
+    fn is_link(&self) -> bool {
+        false
+    }
+
+    fn is_html_slot_element(&self) -> bool {
+        false
+    }
+
+    fn has_id(&self, id: &AtomIdent, case_sensitivity: CaseSensitivity) -> bool {
+        self.info()
+            .id
+            .as_ref()
+            .map_or(false, |own| case_sensitivity.eq_atom(own, &id.0))
+    }
+
+    fn has_class(&self, name: &AtomIdent, case_sensitivity: CaseSensitivity) -> bool {
+        self.info()
+            .classes
+            .iter()
+            .any(|class| case_sensitivity.eq_atom(class, &name.0))
+    }
+
+    fn has_custom_state(&self, _name: &AtomIdent) -> bool {
+        false
+    }
+
+    fn imported_part(&self, _name: &AtomIdent) -> Option<AtomIdent> {
+        None
+    }
+
+    fn is_part(&self, _name: &AtomIdent) -> bool {
+        false
+    }
+
+    fn is_empty(&self) -> bool {
+        self.0
+            .dom_children()
+            .all(|n| !n.is_element() && (!n.is_text_node() || n.is_empty_text()))
+    }
+
+    fn is_root(&self) -> bool {
+        self.0
+            .parent_node()
+            .map_or(false, |p| p.as_document().is_some())
+    }
+
+    fn add_element_unique_hashes(&self, filter: &mut BloomFilter) -> bool {
+        each_relevant_element_hash(*self, |hash| filter.insert_hash(hash & BLOOM_HASH_MASK));
+        true
+    }
+
+    fn subtree_summary(&self) -> Option<SubtreeSummary> {
+        *self.info().subtree_summary.borrow()
+    }
+}
+
+/// Returns the computed values of an element, if it has been styled.
+pub fn primary_style(element: Element) -> Option<Arc<ComputedValues>> {
+    let data = element.borrow_data()?;
+    if !data.has_styles() {
+        return None;
+    }
+    Some(data.styles.primary().clone())
+}
@@ -0,0 +1,220 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Deterministic generators of synthetic documents.
+//!
+//! Every generator is seeded with a constant, so a given shape always
+//! produces the same tree, with the same ids, classes and attributes.
+
+use crate::dom::{Dom, NodeId};
+use crate::sheets;
+use style::shared_lock::SharedRwLock;
+
+/// The number of distinct class names used by the generators and corpora.
+pub const CLASS_COUNT: usize = 64;
+
+/// The values of the `data-kind` attribute used by the generators and
+/// corpora.
+pub const DATA_KINDS: [&str; 4] = ["card", "nav", "promo", "footer"];
+
+/// A small deterministic pseudo-random number generator (SplitMix64).
+pub struct Rng(u64);
+
+impl Rng {
+    /// Creates a generator from a seed.
+    pub fn new(seed: u64) -> Self {
+        Rng(seed)
+    }
+
+    /// Returns the next pseudo-random number.
+    pub fn next_u64(&mut self) -> u64 {
+        self.0 = self.0.wrapping_add(0x9e3779b97f4a7c15);
+        let mut z = self.0;
+        z = (z ^ (z >> 30)).wrapping_mul(0xbf58476d1ce4e5b9);
+        z = (z ^ (z >> 27)).wrapping_mul(0x94d049bb133111eb);
+        z ^ (z >> 31)
+    }
+
+    /// Returns a number in `0..n`.
+    pub fn below(&mut self, n: usize) -> usize {
+        (self.next_u64() % n as u64) as usize
+    }
+
+    /// Returns true once every `n` calls on average.
+    pub fn one_in(&mut self, n: usize) -> bool {
+        self.below(n) == 0
+    }
+}
+
+/// The shape of a synthetic document.
+#[derive(Clone, Copy, Debug)]
+pub enum DomShape {
+    /// `sections` sibling sections of `items` small blocks each.
+    Wide { sections: usize, items: usize },
+    /// A chain of `depth` nested blocks, each with `siblings` leaves.
+    Deep { depth: usize, siblings: usize },
+    /// `lists` lists of `items` items each, with a link and a label per item.
+    ListHeavy { lists: usize, items: usize },
+    /// `hosts` custom elements, each with a shadow tree of `items` blocks,
+    /// all sharing a shadow stylesheet.
+    ShadowHeavy { hosts: usize, items: usize },
+}
+
+impl DomShape {
+    /// A stable name for the shape, used in benchmark output.
+    pub fn name(&self) -> String {
+        match *self {
+            DomShape::Wide { sections, items } => format!("wide-{}x{}", sections, items),
+            DomShape::Deep { depth, siblings } => format!("deep-{}x{}", depth, siblings),
+            DomShape::ListHeavy { lists, items } => format!("lists-{}x{}", lists, items),
+            DomShape::ShadowHeavy { hosts, items } => format!("shadow-{}x{}", hosts, items),
+        }
+    }
+}
+
+/// A generated document.
+pub struct GeneratedDom {
+    /// The document.
+    pub dom: Dom,
+    /// The shadow roots in the document, which need a shadow stylesheet.
+    pub shadow_roots: Vec<NodeId>,
+}
+
+struct Builder {
+    dom: Dom,
+    rng: Rng,
+    next_id: usize,
+    shadow_roots: Vec<NodeId>,
+}
+
+impl Builder {
+    fn element(&mut self, parent: NodeId, local_name: &str) -> NodeId {
+        let element = self.dom.create_element(local_name);
+        self.dom.append_child(parent, element);
+        self.decorate(element);
+        element
+    }
+
+    fn text(&mut self, parent: NodeId, text: &str) {
+        let text = self.dom.create_text(text);
+        self.dom.append_child(parent, text);
+    }
+
+    /// Gives an element a few random classes, and sometimes an id, a
+    /// `data-kind` attribute or a style attribute.
+    fn decorate(&mut self, element: NodeId) {
+        let class_count = self.rng.below(4);
+        if class_count != 0 {
+            let classes = (0..class_count)
+                .map(|_| format!("c{}", self.rng.below(CLASS_COUNT)))
+                .collect::<Vec<_>>()
+                .join(" ");
+            self.dom.set_attribute(element, "class", &classes);
+        }
+        if self.rng.one_in(16) {
+            let id = format!("e{}", self.next_id);
+            self.next_id += 1;
+            self.dom.set_attribute(element, "id", &id);
+        }
+        if self.rng.one_in(8) {
+            let kind = DATA_KINDS[self.rng.below(DATA_KINDS.len())];
+            self.dom.set_attribute(element, "data-kind", kind);
+        }
+        if self.rng.one_in(32) {
+            let css = format!("margin-top: {}px", self.rng.below(16));
+            self.dom.set_style_attribute(element, &css);
+        }
+    }
+
+    /// Creates the `html`, `head` and `body` elements, and returns the body.
+    fn skeleton(&mut self) -> NodeId {
+        let html = self.dom.create_element("html");
+        self.dom.append_child(NodeId::DOCUMENT, html);
+        self.dom.set_attribute(html, "lang", "en");
+        let head = self.dom.create_element("head");
+        self.dom.append_child(html, head);
+        let body = self.dom.create_element("body");
+        self.dom.append_child(html, body);
+        body
+    }
+}
+
+/// Generates a document of the given shape.
+pub fn generate(shape: DomShape, lock: &SharedRwLock) -> GeneratedDom {
+    let mut builder = Builder {
+        dom: Dom::new(lock.clone(), sheets::url_data()),
+        rng: Rng::new(0x5eed),
+        next_id: 0,
+        shadow_roots: vec![],
+    };
+    let body = builder.skeleton();
+    match shape {
+        DomShape::Wide { sections, items } => {
+            for _ in 0..sections {
+                let section = builder.element(body, "section");
+                for _ in 0..items {
+                    let div = builder.element(section, "div");
+                    let span = builder.element(div, "span");
+                    builder.text(span, "Lorem ipsum");
+                }
+            }
+        },
+        DomShape::Deep { depth, siblings } => {
+            let mut parent = body;
+            for _ in 0..depth {
+                for _ in 0..siblings {
+                    let span = builder.element(parent, "span");
+                    builder.text(span, "dolor");
+                }
+                parent = builder.element(parent, "div");
+            }
+        },
+        DomShape::ListHeavy { lists, items } => {
+            for _ in 0..lists {
+                let ul = builder.element(body, "ul");
+                for _ in 0..items {
+                    let li = builder.element(ul, "li");
+                    let a = builder.element(li, "a");
+                    builder.dom.set_attribute(a, "href", "#");
+                    builder.text(a, "sit amet");
+                    let span = builder.element(li, "span");
+                    builder.text(span, "consectetur");
+                }
+            }
+        },
+        DomShape::ShadowHeavy { hosts, items } => {
+            for _ in 0..hosts {
+                let host = builder.element(body, "x-card");
+                let shadow = builder.dom.attach_shadow(host);
+                builder.shadow_roots.push(shadow);
+                let header = builder.element(shadow, "header");
+                builder.text(header, "adipiscing");
+                for _ in 0..items {
+                    let div = builder.element(shadow, "div");
+                    let span = builder.element(div, "span");
+                    builder.text(span, "elit");
+                }
+            }
+        },
+    }
+    GeneratedDom {
+        dom: builder.dom,
+        shadow_roots: builder.shadow_roots,
+    }
+}
+
+/// Picks `count` elements of the light tree of `dom`, deterministically, to
+/// be mutated by a benchmark.
+pub fn pick_elements(dom: &Dom, count: usize, seed: u64) -> Vec<NodeId> {
+    use style::dom::TNode;
+
+    let candidates = dom
+        .element_ids()
+        .filter(|id| dom.node(*id).is_in_document())
+        .collect::<Vec<_>>();
+    let mut rng = Rng::new(seed);
+    (0..count)
+        .map(|_| candidates[rng.below(candidates.len())])
+        .collect()
+}
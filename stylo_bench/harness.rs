@@ -0,0 +1,253 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! A styled synthetic document, with the operations the benchmarks measure,
+//! and helpers to time them and report results.
+
+use crate::corpus::{Corpus, SHADOW_CSS, USER_AGENT_CSS};
+use crate::dom::{Dom, Element, NodeId};
+use crate::generators::{self, DomShape};
+use crate::sheets::{self, ShadowSheet};
+use crate::traversal::{self, RecalcStyle};
+use std::time::{Duration, Instant};
+use style::context::{QuirksMode, StyleContext, ThreadLocalStyleContext};
+use style::dom::{TElement, TNode};
+use style::driver::traverse_dom;
+use style::selector_parser::SnapshotMap;
+use style::shared_lock::StylesheetGuards;
+use style::style_resolver::{
+    PseudoElementResolution, ResolvedElementStyles, StyleResolverForElement,
+};
+use style::stylesheets::{DocumentStyleSheet, Origin, OriginSet};
+use style::stylist::{RuleInclusion, Stylist};
+use style::traversal::DomTraversal;
+
+/// The number of style rules of the document stylesheet of a fixture.
+pub const DEFAULT_RULE_COUNT: usize = 1000;
+
+/// A synthetic document with its stylist.
+pub struct Fixture {
+    /// The document.
+    pub dom: Dom,
+    /// The stylist, with the user agent and corpus stylesheets.
+    pub stylist: Stylist,
+    snapshots: SnapshotMap,
+    pending_snapshots: Vec<NodeId>,
+}
+
+impl Fixture {
+    /// Generates a document of the given shape, with a stylesheet from the
+    /// given corpus, and flushes the stylist. Nothing is styled yet.
+    pub fn new(shape: DomShape, corpus: Corpus, rules: usize) -> Self {
+        let lock = style::shared_lock::SharedRwLock::new();
+        let generated = generators::generate(shape, &lock);
+        let mut fixture = Fixture {
+            dom: generated.dom,
+            stylist: Stylist::new(traversal::device(), QuirksMode::NoQuirks),
+            snapshots: SnapshotMap::new(),
+            pending_snapshots: vec![],
+        };
+        let guard = lock.read();
+        let ua_sheet = sheets::parse(USER_AGENT_CSS, Origin::UserAgent, &lock);
+        fixture.stylist.append_stylesheet(ua_sheet, &guard);
+        let author_sheet = sheets::parse(&corpus.css(rules), Origin::Author, &lock);
+        fixture.stylist.append_stylesheet(author_sheet, &guard);
+        if !generated.shadow_roots.is_empty() {
+            let shadow_sheet = ShadowSheet(sheets::parse(SHADOW_CSS, Origin::Author, &lock));
+            for shadow in generated.shadow_roots {
+                fixture
+                    .dom
+                    .append_shadow_stylesheet(shadow, shadow_sheet.clone(), &guard);
+            }
+        }
+        drop(guard);
+        fixture.flush_stylesheets();
+        fixture
+    }
+
+    /// Applies the pending stylesheet changes, rebuilding the cascade data
+    /// and invalidating the styles of the affected elements.
+    pub fn flush_stylesheets(&mut self) -> bool {
+        let lock = self.dom.shared_lock().clone();
+        let guard = lock.read();
+        let guards = StylesheetGuards::same(&guard);
+        let root = self.dom.root_element();
+        let changed = self
+            .stylist
+            .flush(&guards, Some(root), Some(&self.snapshots));
+        self.dom.flush_shadow_stylesheets(&mut self.stylist, &guard);
+        changed
+    }
+
+    /// Marks all the stylesheets of the document as changed, so that the next
+    /// flush rebuilds all the cascade data.
+    pub fn force_rebuild(&mut self) {
+        self.stylist
+            .force_stylesheet_origins_dirty(OriginSet::all());
+    }
+
+    /// Styles all the elements that need it, returning how many were
+    /// traversed.
+    pub fn style(&mut self, pool: Option<&rayon::ThreadPool>) -> usize {
+        let styled = {
+            let lock = self.dom.shared_lock().clone();
+            let guard = lock.read();
+            let guards = StylesheetGuards::same(&guard);
+            let context = traversal::shared_context(&self.stylist, guards, &self.snapshots);
+            let root = self.dom.root_element();
+            let token = RecalcStyle::pre_traverse(root, &context);
+            if token.should_traverse() {
+                let traversal = RecalcStyle::new(context);
+                traverse_dom(&traversal, token, pool);
+                traversal.styled_count()
+            } else {
+                0
+            }
+        };
+        for id in self.pending_snapshots.drain(..) {
+            self.dom.element(id).clear_snapshot();
+        }
+        self.snapshots.clear();
+        styled
+    }
+
+    /// Resolves the style of an element outside of a traversal, like the
+    /// traversal would, with the per-thread state of `thread_local`. The
+    /// ancestors of the element need to be styled already.
+    pub fn resolve_style<'dom>(
+        &'dom self,
+        element: NodeId,
+        thread_local: &mut ThreadLocalStyleContext<Element<'dom>>,
+    ) -> ResolvedElementStyles {
+        let lock = self.dom.shared_lock();
+        let guard = lock.read();
+        let guards = StylesheetGuards::same(&guard);
+        let shared = traversal::shared_context(&self.stylist, guards, &self.snapshots);
+        let element = self.dom.element(element);
+        thread_local.bloom_filter.rebuild(element);
+        let mut context = StyleContext {
+            shared: &shared,
+            thread_local,
+        };
+        StyleResolverForElement::new(
+            element,
+            &mut context,
+            RuleInclusion::All,
+            PseudoElementResolution::IfApplicable,
+        )
+        .resolve_style_with_default_parents()
+    }
+
+    /// Drops the styles of all the elements, so that the next `style` call
+    /// styles the whole document from scratch.
+    pub fn clear_styles(&mut self) {
+        for id in self.dom.element_ids() {
+            unsafe { self.dom.element(id).clear_data() };
+        }
+        self.stylist.rule_tree().gc();
+    }
+
+    /// Toggles a class on the given elements, taking snapshots of them so
+    /// that the next `style` call invalidates their styles.
+    pub fn toggle_class(&mut self, elements: &[NodeId], class: &str) {
+        for &id in elements {
+            let opaque = self.dom.node(id).opaque();
+            if !self.snapshots.contains_key(&opaque) {
+                let mut snapshot = self.dom.snapshot(id);
+                snapshot.class_changed = true;
+                snapshot.changed_attrs.push(style::LocalName::from("class"));
+                self.snapshots.insert(opaque, snapshot);
+                self.pending_snapshots.push(id);
+            }
+            let current = self.dom.attribute(id, "class").unwrap_or("");
+            let had_class = current.split_ascii_whitespace().any(|c| c == class);
+            let mut classes = current
+                .split_ascii_whitespace()
+                .filter(|c| *c != class)
+                .map(|c| c.to_owned())
+                .collect::<Vec<_>>();
+            if !had_class {
+                classes.push(class.to_owned());
+            }
+            self.dom.set_attribute(id, "class", &classes.join(" "));
+            self.dom.element(id).note_snapshot();
+        }
+    }
+
+    /// Parses and appends a document stylesheet, which is applied by the
+    /// next `flush_stylesheets` call.
+    pub fn append_stylesheet(&mut self, css: &str) -> DocumentStyleSheet {
+        let lock = self.dom.shared_lock().clone();
+        let sheet = sheets::parse(css, Origin::Author, &lock);
+        self.stylist.append_stylesheet(sheet.clone(), &lock.read());
+        sheet
+    }
+
+    /// Removes a document stylesheet, which is applied by the next
+    /// `flush_stylesheets` call.
+    pub fn remove_stylesheet(&mut self, sheet: DocumentStyleSheet) {
+        let lock = self.dom.shared_lock().clone();
+        self.stylist.remove_stylesheet(sheet, &lock.read());
+    }
+}
+
+/// Timings of a benchmark.
+pub struct Timings {
+    samples: Vec<Duration>,
+}
+
+impl Timings {
+    /// Runs `f` `iterations` times, timing each run.
+    ///
+    /// `f` gets a callback to time the part of the work it wants to measure,
+    /// so that it can prepare and clean up outside of the measured section.
+    pub fn measure<F>(iterations: usize, mut f: F) -> Self
+    where
+        F: FnMut(&mut dyn FnMut(&mut dyn FnMut())),
+    {
+        let mut samples = Vec::with_capacity(iterations);
+        for _ in 0..iterations {
+            f(&mut |work| {
+                let start = Instant::now();
+                work();
+                samples.push(start.elapsed());
+            });
+        }
+        Timings { samples }
+    }
+
+    /// The number of timed runs.
+    pub fn len(&self) -> usize {
+        self.samples.len()
+    }
+
+    /// The median duration of a run, in nanoseconds.
+    pub fn median_ns(&self) -> u128 {
+        let mut samples = self.samples.clone();
+        samples.sort();
+        samples.get(samples.len() / 2).map_or(0, |d| d.as_nanos())
+    }
+
+    /// The shortest duration of a run, in nanoseconds.
+    pub fn min_ns(&self) -> u128 {
+        self.samples.iter().min().map_or(0, |d| d.as_nanos())
+    }
+}
+
+/// Prints the result of a benchmark as a single line.
+///
+/// The format is `[BENCH],<name>,<work>,<runs>,<median ns>,<min ns>`, where
+/// `<work>` is a deterministic measure of the work done in each run (like the
+/// number of elements styled), which can be used to check that two builds
+/// are doing the same work before comparing their timings.
+pub fn report(name: &str, work: usize, timings: &Timings) {
+    println!(
+        "[BENCH],{},{},{},{},{}",
+        name,
+        work,
+        timings.len(),
+        timings.median_ns(),
+        timings.min_ns()
+    );
+}
@@ -0,0 +1,103 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Deterministic benchmarks of the style system over synthetic documents.
+//!
+//! This crate has a lightweight in-memory DOM implementing the style system
+//! traits (`dom`), generators of documents of various shapes
+//! (`generators`), generated stylesheet corpora (`corpus`), and a harness to
+//! style documents and time the different phases of the style pipeline
+//! (`harness`). The benchmarks themselves are in `benches/`, and can be run
+//! with `cargo bench -p stylo_bench`.
+
+#![deny(missing_docs)]
+
+pub mod corpus;
+pub mod dom;
+pub mod generators;
+pub mod harness;
+pub mod sheets;
+pub mod traversal;
+
+#[cfg(test)]
+mod tests {
+    use crate::corpus::Corpus;
+    use crate::generators::DomShape;
+    use crate::harness::Fixture;
+    use crate::traversal::thread_pool;
+    use style::dom::TElement;
+    use style::thread_state::{self, ThreadState};
+
+    fn styled_colors(fixture: &Fixture) -> Vec<String> {
+        fixture
+            .dom
+            .element_ids()
+            .map(|id| {
+                let element = fixture.dom.element(id);
+                let style = element.borrow_data().unwrap().styles.primary().clone();
+                format!("{:?}", style.get_inherited_text().color)
+            })
+            .collect()
+    }
+
+    #[test]
+    fn styles_every_element() {
+        thread_state::initialize(ThreadState::LAYOUT);
+        for shape in [
+            DomShape::Wide {
+                sections: 4,
+                items: 8,
+            },
+            DomShape::Deep {
+                depth: 32,
+                siblings: 2,
+            },
+            DomShape::ListHeavy { lists: 4, items: 8 },
+            DomShape::ShadowHeavy { hosts: 4, items: 4 },
+        ] {
+            let mut fixture = Fixture::new(shape, Corpus::Framework, 200);
+            let elements = fixture.dom.element_count();
+            assert_eq!(fixture.style(None), elements, "{}", shape.name());
+            // Nothing left to do.
+            assert_eq!(fixture.style(None), 0, "{}", shape.name());
+        }
+    }
+
+    #[test]
+    fn parallel_traversal_matches_sequential() {
+        thread_state::initialize(ThreadState::LAYOUT);
+        let shape = DomShape::Wide {
+            sections: 16,
+            items: 32,
+        };
+        let mut sequential = Fixture::new(shape, Corpus::Structural, 200);
+        sequential.style(None);
+        let mut parallel = Fixture::new(shape, Corpus::Structural, 200);
+        parallel.style(Some(&thread_pool(4)));
+        assert_eq!(styled_colors(&sequential), styled_colors(&parallel));
+    }
+
+    #[test]
+    fn class_toggles_restyle_incrementally() {
+        thread_state::initialize(ThreadState::LAYOUT);
+        let shape = DomShape::ListHeavy {
+            lists: 8,
+            items: 16,
+        };
+        let mut fixture = Fixture::new(shape, Corpus::Descendant, 200);
+        let elements = fixture.dom.element_count();
+        fixture.style(None);
+        let targets = crate::generators::pick_elements(&fixture.dom, 4, 1);
+        fixture.toggle_class(&targets, "c1");
+        let restyled = fixture.style(None);
+        assert!(restyled > 0 && restyled < elements);
+        // Toggling back gives the same styles as styling from scratch.
+        fixture.toggle_class(&targets, "c1");
+        fixture.style(None);
+        let incremental = styled_colors(&fixture);
+        fixture.clear_styles();
+        fixture.style(None);
+        assert_eq!(incremental, styled_colors(&fixture));
+    }
+}
@@ -0,0 +1,75 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Stylesheet parsing helpers, and the stylesheet type used by shadow roots.
+
+use servo_arc::Arc;
+use style::context::QuirksMode;
+use style::invalidation::media_queries::{MediaListKey, ToMediaListKey};
+use style::media_queries::MediaList;
+use style::shared_lock::{SharedRwLock, SharedRwLockReadGuard};
+use style::stylesheets::scope_rule::ImplicitScopeRoot;
+use style::stylesheets::{
+    AllowImportRules, DocumentStyleSheet, Origin, Stylesheet, StylesheetContents,
+    StylesheetInDocument, UrlExtraData,
+};
+
+/// The URL all the benchmark stylesheets and style attributes are parsed
+/// with.
+pub fn url_data() -> UrlExtraData {
+    UrlExtraData::from(url::Url::parse("https://bench.invalid/").unwrap())
+}
+
+/// Parses a stylesheet for the document.
+pub fn parse(css: &str, origin: Origin, lock: &SharedRwLock) -> DocumentStyleSheet {
+    let media = Arc::new(lock.wrap(MediaList::empty()));
+    DocumentStyleSheet(Arc::new(Stylesheet::from_str(
+        css,
+        url_data(),
+        origin,
+        media,
+        lock.clone(),
+        None,
+        None,
+        QuirksMode::NoQuirks,
+        AllowImportRules::Yes,
+    )))
+}
+
+/// A stylesheet in a shadow root.
+///
+/// Shadow roots can share the same stylesheet, which is the common case for
+/// components, and lets the stylist share their cascade data.
+#[derive(Clone, Debug)]
+pub struct ShadowSheet(pub DocumentStyleSheet);
+
+impl PartialEq for ShadowSheet {
+    fn eq(&self, other: &Self) -> bool {
+        self.0 == other.0
+    }
+}
+
+impl ToMediaListKey for ShadowSheet {
+    fn to_media_list_key(&self) -> MediaListKey {
+        MediaListKey::from_raw(&*self.0 .0 as *const Stylesheet as usize)
+    }
+}
+
+impl StylesheetInDocument for ShadowSheet {
+    fn enabled(&self) -> bool {
+        self.0.enabled()
+    }
+
+    fn media<'a>(&'a self, guard: &'a SharedRwLockReadGuard) -> Option<&'a MediaList> {
+        self.0.media(guard)
+    }
+
+    fn contents(&self) -> &StylesheetContents {
+        self.0.contents()
+    }
+
+    fn implicit_scope_root(&self) -> Option<ImplicitScopeRoot> {
+        None
+    }
+}
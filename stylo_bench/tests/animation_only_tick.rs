@@ -0,0 +1,424 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Checks when animation ticks can patch the style of an element instead of
+//! restyling it, and that the patched style matches the animated values. Also
+//! checks that batched animation values match the values of each element, that
+//! snapshots of the animations of a document don't see later changes, and that
+//! step timing functions see the before flag of animations and transitions.
+
+use servo_arc::Arc;
+use style::animation::{
+    AnimationSetKey, AnimationState, DocumentAnimationSet, ElementAnimationSet,
+    KeyframesIterationState,
+};
+use style::context::{StyleContext, ThreadLocalStyleContext};
+use style::data::ElementData;
+use style::dom::{TElement, TNode};
+use style::invalidation::element::restyle_hints::RestyleHint;
+use style::properties::ComputedValues;
+use style::selector_parser::SnapshotMap;
+use style::shared_lock::StylesheetGuards;
+use style::style_resolver::{PseudoElementResolution, StyleResolverForElement};
+use style::stylist::RuleInclusion;
+use style::thread_state::{self, ThreadState};
+use stylo_bench::corpus::Corpus;
+use stylo_bench::dom::{Element, NodeId};
+use stylo_bench::generators::DomShape;
+use stylo_bench::harness::Fixture;
+use stylo_bench::traversal;
+
+const CSS: &str = "
+    @keyframes fade { from { opacity: 0 } to { opacity: 1 } }
+    @keyframes slide { from { transform: translateX(0px) } to { transform: translateX(100px) } }
+    @keyframes grow { from { width: 0px } to { width: 100px } }
+    span { animation: fade 1s linear 2, slide 1s linear 2 }
+    div { animation: fade 1s linear 2, grow 1s linear 2 }
+";
+
+fn fixture(css: &str, shape: DomShape) -> Fixture {
+    thread_state::initialize(ThreadState::LAYOUT);
+    let mut fixture = Fixture::new(shape, Corpus::Simple, 0);
+    fixture.append_stylesheet(css);
+    fixture.flush_stylesheets();
+    fixture.style(None);
+    fixture
+}
+
+fn first(fixture: &Fixture, name: &str) -> NodeId {
+    fixture
+        .dom
+        .element_ids()
+        .find(|id| &**fixture.dom.element(*id).local_name() == name)
+        .unwrap()
+}
+
+/// Starts the animations of an element like a restyle at time 0 would, and
+/// marks them as running. Returns its style and animations, and the style
+/// that a full restyle would compute at time `now`.
+fn start_animations(
+    fixture: &Fixture,
+    id: NodeId,
+    now: f64,
+) -> (
+    Arc<ComputedValues>,
+    ElementAnimationSet,
+    Arc<ComputedValues>,
+) {
+    let lock = fixture.dom.shared_lock();
+    let guard = lock.read();
+    let snapshots = SnapshotMap::new();
+    let mut shared =
+        traversal::shared_context(&fixture.stylist, StylesheetGuards::same(&guard), &snapshots);
+    let element: Element = fixture.dom.element(id);
+    let style = element.borrow_data().unwrap().styles.primary().clone();
+
+    let mut set = ElementAnimationSet::default();
+    let mut thread_local = ThreadLocalStyleContext::new();
+    let mut context = StyleContext {
+        shared: &shared,
+        thread_local: &mut thread_local,
+    };
+    let mut resolver = StyleResolverForElement::new(
+        element,
+        &mut context,
+        RuleInclusion::All,
+        PseudoElementResolution::IfApplicable,
+    );
+    set.update_animations_for_new_style(element, &shared, &style, &mut resolver);
+    drop(resolver);
+    for animation in set.animations.iter_mut() {
+        animation.state = AnimationState::Running;
+    }
+
+    shared.current_time_for_animations = now;
+    let mut restyled = style.clone();
+    set.apply_active_animations(&shared, &mut restyled);
+    (style, set, restyled)
+}
+
+const SHAPE: DomShape = DomShape::Wide {
+    sections: 1,
+    items: 1,
+};
+
+#[test]
+fn compositor_animations_tick_without_restyle() {
+    let fixture = fixture(CSS, SHAPE);
+    let (style, set, restyled) = start_animations(&fixture, first(&fixture, "span"), 0.25);
+
+    let tick = set
+        .tick_animation_only::<Element>(&style, 0.25)
+        .expect("Running opacity and transform animations should tick");
+    assert!(!tick.damage.is_empty());
+    assert_eq!(
+        tick.style.get_effects().clone_opacity(),
+        restyled.get_effects().clone_opacity()
+    );
+    assert_eq!(
+        tick.style.get_box().clone_transform(),
+        restyled.get_box().clone_transform()
+    );
+    assert_ne!(
+        tick.style.get_effects().clone_opacity(),
+        style.get_effects().clone_opacity()
+    );
+    // The style structs without animated properties are shared.
+    assert!(std::ptr::eq(tick.style.get_font(), style.get_font()));
+
+    // Ticking again at the same time changes nothing, so the style is reused.
+    let again = set
+        .tick_animation_only::<Element>(&tick.style, 0.25)
+        .unwrap();
+    assert!(again.damage.is_empty());
+    assert!(Arc::ptr_eq(&again.style, &tick.style));
+
+    let mut data = ElementData::default();
+    let damage = tick.damage;
+    let new_style = tick.style.clone();
+    tick.apply(&mut data, None);
+    assert!(Arc::ptr_eq(data.styles.primary(), &new_style));
+    assert_eq!(data.damage, damage);
+    assert!(data.hint.contains(RestyleHint::RESTYLE_SELF));
+}
+
+#[test]
+fn other_properties_need_a_restyle() {
+    let fixture = fixture(CSS, SHAPE);
+    let (style, set, _) = start_animations(&fixture, first(&fixture, "div"), 0.25);
+    assert!(set.tick_animation_only::<Element>(&style, 0.25).is_none());
+}
+
+#[test]
+fn state_changes_need_a_restyle() {
+    let fixture = fixture(CSS, SHAPE);
+    let (style, set, _) = start_animations(&fixture, first(&fixture, "span"), 0.25);
+
+    let mut pending = set.clone();
+    pending.animations[0].state = AnimationState::Pending;
+    assert!(pending
+        .tick_animation_only::<Element>(&style, 0.25)
+        .is_none());
+
+    let mut finished = set.clone();
+    finished.animations[1].state = AnimationState::Finished;
+    assert!(finished
+        .tick_animation_only::<Element>(&style, 0.25)
+        .is_none());
+
+    // The first iteration is over, which changes the keyframes that apply.
+    let mut iterating = set.clone();
+    assert!(iterating
+        .tick_animation_only::<Element>(&style, 1.5)
+        .is_none());
+    for animation in iterating.animations.iter_mut() {
+        assert!(animation.iterate_if_necessary(1.5));
+        assert!(matches!(
+            animation.iteration_state,
+            KeyframesIterationState::Finite(current, _) if current == 1.
+        ));
+    }
+    assert!(iterating
+        .tick_animation_only::<Element>(&style, 1.5)
+        .is_some());
+
+    // The last iteration has ended.
+    assert!(iterating
+        .tick_animation_only::<Element>(&style, 2.5)
+        .is_none());
+}
+
+const BATCH_CSS: &str = "
+    @keyframes fade {
+        from { opacity: 0 }
+        40% { opacity: 0.8; animation-timing-function: steps(2, jump-start) }
+        to { opacity: 1 }
+    }
+    @keyframes slide { from { transform: translateX(0px) } to { transform: translateX(100px) } }
+    section { animation: fade 1s linear 2 alternate, slide 1s ease 2 }
+    div, span { animation: fade 1s ease-in-out 1.5 alternate both }
+";
+
+#[test]
+fn batched_values_match_each_element() {
+    let fixture = fixture(
+        BATCH_CSS,
+        DomShape::Wide {
+            sections: 2,
+            items: 8,
+        },
+    );
+    let mut sets = fixture
+        .dom
+        .element_ids()
+        .filter(|id| {
+            let element = fixture.dom.element(*id);
+            ["section", "div", "span"].contains(&&**element.local_name())
+        })
+        .enumerate()
+        .map(|(i, id)| {
+            let (_, mut set, _) = start_animations(&fixture, id, 0.);
+            assert!(!set.animations.is_empty());
+            for animation in set.animations.iter_mut() {
+                // Spread the animations over their keyframes.
+                animation.started_at -= (i % 7) as f64 * 0.15;
+                match i % 5 {
+                    0 => animation.state = AnimationState::Paused(0.3),
+                    1 => animation.started_at += 0.5,
+                    _ => {},
+                }
+            }
+            let key = AnimationSetKey::new_for_non_pseudo(fixture.dom.node(id).opaque());
+            (key, set)
+        })
+        .collect::<Vec<_>>();
+
+    let mut grouped = false;
+    for now in [0., 0.1, 0.35, 0.6, 0.95, 1.2, 1.45, 1.7, 2.2] {
+        let document = DocumentAnimationSet::default();
+        for (key, set) in sets.iter_mut() {
+            for animation in set.animations.iter_mut() {
+                animation.iterate_if_necessary(now);
+            }
+            document.insert(key.clone(), set.clone());
+        }
+
+        let batch = document.animation_batch();
+        assert_eq!(batch.len(), sets.len());
+        let maps = batch.get_value_maps(now);
+        let expected = sets
+            .iter()
+            .filter_map(|(key, set)| {
+                let map = set.get_value_map_for_active_animations(now)?;
+                grouped |= set.animations.len() == 1 && !map.is_empty();
+                (!map.is_empty()).then(|| (key.clone(), map))
+            })
+            .collect::<Vec<_>>();
+        assert_eq!(maps.len(), expected.len(), "at {}", now);
+        for (key, map) in expected {
+            assert_eq!(maps.get(&key), Some(&map), "{:?} at {}", key, now);
+        }
+    }
+    assert!(grouped);
+}
+
+#[test]
+fn snapshots_do_not_see_later_changes() {
+    let fixture = fixture(
+        CSS,
+        DomShape::Wide {
+            sections: 1,
+            items: 8,
+        },
+    );
+    let lock = fixture.dom.shared_lock();
+    let entries = fixture
+        .dom
+        .element_ids()
+        .filter(|id| &**fixture.dom.element(*id).local_name() == "span")
+        .map(|id| {
+            let (_, set, _) = start_animations(&fixture, id, 0.);
+            let key = AnimationSetKey::new_for_non_pseudo(fixture.dom.node(id).opaque());
+            (key, set)
+        })
+        .collect::<Vec<_>>();
+    assert!(entries.len() > 2);
+
+    let document = DocumentAnimationSet::default();
+    for (key, set) in &entries[1..] {
+        document.insert(key.clone(), set.clone());
+    }
+    let snapshot = document.snapshot();
+    assert_eq!(snapshot.len(), entries.len() - 1);
+
+    // Insert, remove and mutate sets after taking the snapshot.
+    let (first_key, first_set) = &entries[0];
+    document.insert(first_key.clone(), first_set.clone());
+    document.take(&entries[1].0).unwrap();
+    document.cancel_all_animations_for_key(&entries[2].0);
+    assert!(!document.has_active_animations(&entries[2].0));
+
+    assert_eq!(snapshot.len(), entries.len() - 1);
+    assert!(snapshot.get(first_key).is_none());
+    for (key, _) in &entries[1..] {
+        assert!(snapshot.has_active_animations(key));
+        let declarations = snapshot.get_all_declarations(key, 0.25, lock);
+        assert!(declarations.animations.is_some());
+    }
+
+    let snapshot = document.snapshot();
+    assert_eq!(snapshot.len(), document.len());
+    assert!(snapshot.has_active_animations(first_key));
+    assert!(snapshot.get(&entries[1].0).is_none());
+    assert!(!snapshot.has_active_animations(&entries[2].0));
+}
+
+fn assert_opacity(actual: f32, expected: f32, case: &str) {
+    assert!(
+        (actual - expected).abs() < 1e-6,
+        "{}: {} != {}",
+        case,
+        actual,
+        expected
+    );
+}
+
+/// The opacity of a span animated from 0 to 1 at time `now`.
+fn animated_opacity(timing_function: &str, delay: &str, now: f64) -> f32 {
+    let css = format!(
+        "@keyframes fade {{ from {{ opacity: 0 }} to {{ opacity: 1 }} }}
+         span {{ animation: fade 1s {} {} both }}",
+        timing_function, delay
+    );
+    let fixture = fixture(&css, SHAPE);
+    let (_, _, restyled) = start_animations(&fixture, first(&fixture, "span"), now);
+    restyled.get_effects().clone_opacity()
+}
+
+/// The opacity of a span transitioned from 0 to 1 at time 0, at time `now`.
+fn transitioned_opacity(timing_function: &str, delay: &str, now: f64) -> f32 {
+    let css = format!(
+        "span {{ opacity: 0; transition: opacity 1s {} {} }}
+         span.on {{ opacity: 1 }}",
+        timing_function, delay
+    );
+    let mut fixture = fixture(&css, SHAPE);
+    let id = first(&fixture, "span");
+    let old_style = fixture
+        .dom
+        .element(id)
+        .borrow_data()
+        .unwrap()
+        .styles
+        .primary()
+        .clone();
+    fixture.toggle_class(&[id], "on");
+    fixture.style(None);
+    let new_style = fixture
+        .dom
+        .element(id)
+        .borrow_data()
+        .unwrap()
+        .styles
+        .primary()
+        .clone();
+
+    let lock = fixture.dom.shared_lock();
+    let guard = lock.read();
+    let snapshots = SnapshotMap::new();
+    let mut shared =
+        traversal::shared_context(&fixture.stylist, StylesheetGuards::same(&guard), &snapshots);
+    let mut set = ElementAnimationSet::default();
+    set.update_transitions_for_new_style(true, &shared, Some(&old_style), &new_style);
+    assert_eq!(set.transitions.len(), 1);
+
+    shared.current_time_for_animations = now;
+    let mut style = new_style.clone();
+    set.apply_active_animations(&shared, &mut style);
+    style.get_effects().clone_opacity()
+}
+
+#[test]
+fn steps_use_the_before_flag_of_animations() {
+    let cases = [
+        // Before the animation starts, the step at its start isn't taken.
+        ("steps(2, jump-start)", "0.5s", 0., 0.),
+        ("steps(2, jump-both)", "0.5s", 0., 0.),
+        // A negative delay starts the animation at a step, which is taken.
+        ("steps(2, jump-start)", "-0.5s", 0., 1.),
+        ("steps(2, jump-both)", "-0.5s", 0., 2. / 3.),
+        ("steps(2, jump-start)", "-0.25s", 0., 0.5),
+    ];
+    for (timing_function, delay, now, expected) in cases {
+        assert_opacity(
+            animated_opacity(timing_function, delay, now),
+            expected,
+            &format!("animation {} {} at {}", timing_function, delay, now),
+        );
+    }
+}
+
+#[test]
+fn steps_use_the_before_flag_of_transitions() {
+    let cases = [
+        // During the delay, the step at the start of the transition isn't
+        // taken.
+        ("steps(2, jump-start)", "0.5s", 0., 0.),
+        ("steps(2, jump-both)", "0.5s", 0., 0.),
+        ("steps(2, jump-start)", "0.5s", 0.25, 0.),
+        // A negative delay starts the transition at a step, which is taken.
+        ("steps(2, jump-start)", "-0.5s", 0., 1.),
+        ("steps(2, jump-both)", "-0.5s", 0., 2. / 3.),
+        // Once the transition starts, the first step is taken.
+        ("steps(2, jump-start)", "0.5s", 0.5, 0.5),
+        ("steps(2, jump-both)", "0.5s", 0.5, 1. / 3.),
+    ];
+    for (timing_function, delay, now, expected) in cases {
+        assert_opacity(
+            transitioned_opacity(timing_function, delay, now),
+            expected,
+            &format!("transition {} {} at {}", timing_function, delay, now),
+        );
+    }
+}
@@ -0,0 +1,150 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Checks the selector and stylesheet costs that the cascade profiler records
+//! over a traversal, including for stylesheets of shadow trees that have the
+//! same index as a document stylesheet.
+
+use cssparser::ToCss;
+use std::sync::atomic::Ordering;
+use style::cascade_profiler::{self, CascadeProfile, ProfilingScope, SelectorCost};
+use style::context::DEFAULT_DISABLE_STYLE_SHARING_CACHE;
+use style::dom::{TElement, TShadowRoot};
+use style::stylesheets::{Origin, StylesheetContents, StylesheetInDocument};
+use style::thread_state::{self, ThreadState};
+use stylo_bench::corpus::Corpus;
+use stylo_bench::generators::DomShape;
+use stylo_bench::harness::Fixture;
+use stylo_bench::sheets::{self, ShadowSheet};
+
+/// The second stylesheet of the document, after the empty corpus one.
+const DOCUMENT_CSS: &str = "
+    x-card { color: red }
+    section x-card { color: blue }
+";
+
+/// The second stylesheet of the first shadow tree, after `SHADOW_CSS`.
+const SHADOW_TREE_CSS: &str = "span { color: green }";
+
+const HOSTS: usize = 2;
+const ITEMS: usize = 3;
+
+fn contents_address(contents: &StylesheetContents) -> usize {
+    contents as *const StylesheetContents as usize
+}
+
+fn selector<'a>(profile: &'a CascadeProfile, css: &str, contents: usize) -> &'a SelectorCost {
+    profile
+        .selectors()
+        .into_iter()
+        .find(|s| {
+            s.selector.to_css_string() == css
+                && s.sheet.map(|sheet| sheet.contents) == Some(contents)
+        })
+        .unwrap_or_else(|| panic!("No cost for {}", css))
+}
+
+#[test]
+fn traversal_profile() {
+    thread_state::initialize(ThreadState::LAYOUT);
+    // Every element matches its rules, rather than sharing the style of a
+    // sibling.
+    DEFAULT_DISABLE_STYLE_SHARING_CACHE.store(true, Ordering::Relaxed);
+    let shape = DomShape::ShadowHeavy {
+        hosts: HOSTS,
+        items: ITEMS,
+    };
+    let mut fixture = Fixture::new(shape, Corpus::Simple, 0);
+    let document_sheet = fixture.append_stylesheet(DOCUMENT_CSS);
+    let host = fixture
+        .dom
+        .element_ids()
+        .find(|id| &**fixture.dom.element(*id).local_name() == "x-card")
+        .unwrap();
+    let shadow = fixture
+        .dom
+        .element(host)
+        .shadow_root()
+        .unwrap()
+        .as_node()
+        .node_id();
+    let lock = fixture.dom.shared_lock().clone();
+    let shadow_sheet = ShadowSheet(sheets::parse(SHADOW_TREE_CSS, Origin::Author, &lock));
+    fixture
+        .dom
+        .append_shadow_stylesheet(shadow, shadow_sheet.clone(), &lock.read());
+    fixture.flush_stylesheets();
+
+    let scope = ProfilingScope::new();
+    fixture.style(None);
+    let profile = cascade_profiler::take();
+    drop(scope);
+
+    let document_contents = contents_address(document_sheet.contents());
+    let shadow_tree_contents = contents_address(shadow_sheet.contents());
+
+    // Type selectors are only tried against elements with that name.
+    let cost = selector(&profile, "x-card", document_contents).cost;
+    assert_eq!((cost.attempts, cost.matches), (HOSTS as u32, HOSTS as u32));
+    let cost = selector(&profile, "section x-card", document_contents).cost;
+    assert_eq!((cost.attempts, cost.matches), (HOSTS as u32, 0));
+    let cost = selector(&profile, "span", shadow_tree_contents).cost;
+    assert_eq!((cost.attempts, cost.matches), (ITEMS as u32, ITEMS as u32));
+
+    // The shadow stylesheet shared by all the shadow trees is counted once,
+    // for all of them.
+    let header = profile
+        .selectors()
+        .into_iter()
+        .find(|s| s.selector.to_css_string() == "header" && s.origin == Origin::Author)
+        .unwrap();
+    assert_eq!(
+        (header.cost.attempts, header.cost.matches),
+        (HOSTS as u32, HOSTS as u32)
+    );
+    let shared_contents = header.sheet.unwrap().contents;
+
+    // The second stylesheets of the document and of the first shadow tree
+    // have the same origin and index, but are counted apart.
+    let stylesheets = profile.stylesheets();
+    let sheet = |contents: usize| {
+        stylesheets
+            .iter()
+            .find(|s| s.sheet.contents == contents)
+            .unwrap()
+    };
+    let document = sheet(document_contents);
+    assert_eq!((document.origin, document.sheet.index), (Origin::Author, 1));
+    assert_eq!(
+        (document.cost.attempts, document.cost.matches),
+        (2 * HOSTS as u32, HOSTS as u32)
+    );
+    let shadow_tree = sheet(shadow_tree_contents);
+    assert_eq!(
+        (shadow_tree.origin, shadow_tree.sheet.index),
+        (Origin::Author, 1)
+    );
+    assert_eq!(
+        (shadow_tree.cost.attempts, shadow_tree.cost.matches),
+        (ITEMS as u32, ITEMS as u32)
+    );
+    assert_eq!(sheet(shared_contents).sheet.index, 0);
+
+    // The cost of each stylesheet is the sum of the costs of its selectors.
+    for stylesheet in stylesheets.iter() {
+        let selectors = profile
+            .selectors()
+            .into_iter()
+            .filter(|s| s.sheet.map(|sheet| sheet.contents) == Some(stylesheet.sheet.contents))
+            .collect::<Vec<_>>();
+        assert_eq!(
+            stylesheet.cost.attempts,
+            selectors.iter().map(|s| s.cost.attempts).sum::<u32>()
+        );
+        assert_eq!(
+            stylesheet.cost.matches,
+            selectors.iter().map(|s| s.cost.matches).sum::<u32>()
+        );
+    }
+}
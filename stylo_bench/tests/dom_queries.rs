@@ -0,0 +1,321 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Checks the querySelector and querySelectorAll paths of `dom_apis`
+//! against matching every element of the subtree one by one.
+
+use selectors::{Element as _, SelectorList};
+use std::cell::Cell;
+use style::context::QuirksMode;
+use style::dom::{TDocument, TNode};
+use style::dom_apis::{self, MayUseInvalidation, QueryAll, QueryFirst, QueryPlanCache};
+use style::selector_parser::{SelectorImpl, SelectorParser};
+use style::shared_lock::SharedRwLock;
+use style::thread_state::{self, ThreadState};
+use style::values::AtomIdent;
+use stylo_bench::dom::{Dom, Element, Node, NodeId};
+use stylo_bench::sheets;
+
+const SELECTORS: &[&str] = &[
+    "span",
+    ".c",
+    "[data-x]",
+    ".a .c",
+    ".a > .c",
+    "div span",
+    ".outer .c",
+    ".a *",
+    ".a > *",
+    "#main .c",
+    "section + p",
+    ".a .c, p",
+    ".missing .c",
+    "[*|data-x]",
+    ".a [*|data-x]",
+];
+
+struct Tree {
+    dom: Dom,
+    /// An element in the document, with ancestors that selectors can match.
+    main: NodeId,
+    /// An element whose only `data-x` attribute is in a namespace.
+    namespaced: NodeId,
+    /// The next sibling of `main`.
+    other: NodeId,
+    /// A shadow root, whose host is in the document.
+    shadow: NodeId,
+    /// An element in the shadow tree.
+    shadow_div: NodeId,
+}
+
+fn append(dom: &mut Dom, parent: NodeId, name: &str, attrs: &[(&str, &str)]) -> NodeId {
+    let element = dom.create_element(name);
+    for (name, value) in attrs {
+        dom.set_attribute(element, name, value);
+    }
+    dom.append_child(parent, element);
+    element
+}
+
+fn tree() -> Tree {
+    let mut dom = Dom::new(SharedRwLock::new(), sheets::url_data());
+    let html = append(&mut dom, NodeId::DOCUMENT, "html", &[("class", "outer")]);
+    let body = append(&mut dom, html, "body", &[]);
+    let main = append(&mut dom, body, "div", &[("id", "main"), ("class", "a")]);
+    let section = append(&mut dom, main, "section", &[("class", "b")]);
+    append(
+        &mut dom,
+        section,
+        "span",
+        &[("class", "c"), ("data-x", "1")],
+    );
+    let namespaced = append(&mut dom, section, "span", &[("class", "c d")]);
+    dom.set_attribute_ns(namespaced, "urn:x", "data-x", "4");
+    append(&mut dom, main, "p", &[("class", "c")]);
+    let other = append(&mut dom, body, "div", &[("class", "a e")]);
+    append(&mut dom, other, "span", &[("class", "c"), ("data-x", "2")]);
+    append(&mut dom, body, "span", &[("class", "c")]);
+
+    let host = append(&mut dom, body, "div", &[("class", "host")]);
+    let shadow = dom.attach_shadow(host);
+    let shadow_div = append(&mut dom, shadow, "div", &[("class", "a")]);
+    let inner = append(&mut dom, shadow_div, "section", &[]);
+    append(&mut dom, inner, "span", &[("class", "c")]);
+    append(&mut dom, shadow, "span", &[("class", "c"), ("data-x", "3")]);
+    Tree {
+        dom,
+        main,
+        namespaced,
+        other,
+        shadow,
+        shadow_div,
+    }
+}
+
+fn parse(text: &str) -> SelectorList<SelectorImpl> {
+    SelectorParser::parse_author_origin_no_namespace(text, &sheets::url_data())
+        .expect("Invalid selector")
+}
+
+/// The elements of the subtree of `root` that match `selectors`, in tree
+/// order.
+fn expected<'a>(root: Node<'a>, selectors: &SelectorList<SelectorImpl>) -> Vec<Element<'a>> {
+    root.dom_descendants()
+        .filter_map(|node| node.as_element())
+        .filter(|element| dom_apis::element_matches(element, selectors, QuirksMode::NoQuirks))
+        .collect()
+}
+
+fn check_roots(dom: &Dom, roots: &[NodeId], cache: &mut QueryPlanCache) {
+    for &root in roots {
+        let root = dom.node(root);
+        for text in SELECTORS {
+            let selectors = parse(text);
+            let expected = expected(root, &selectors);
+            for use_invalidation in [true, false] {
+                let may_use_invalidation = || match use_invalidation {
+                    true => MayUseInvalidation::Yes,
+                    false => MayUseInvalidation::No,
+                };
+                let mut all = Default::default();
+                dom_apis::query_selector::<Element, QueryAll>(
+                    root,
+                    &selectors,
+                    &mut all,
+                    may_use_invalidation(),
+                );
+                assert_eq!(&all[..], &expected[..], "{:?} {}", root, text);
+
+                let mut first = None;
+                dom_apis::query_selector::<Element, QueryFirst>(
+                    root,
+                    &selectors,
+                    &mut first,
+                    may_use_invalidation(),
+                );
+                assert_eq!(first, expected.first().copied(), "{:?} {}", root, text);
+            }
+
+            let plan = cache
+                .get_or_compile(text, QuirksMode::NoQuirks, |text| Ok::<_, ()>(parse(text)))
+                .unwrap();
+            let mut all = Default::default();
+            dom_apis::query_selector_with_plan::<Element, QueryAll>(
+                root,
+                &plan,
+                &mut all,
+                MayUseInvalidation::Yes,
+            );
+            assert_eq!(&all[..], &expected[..], "{:?} {} (cached plan)", root, text);
+        }
+    }
+}
+
+#[test]
+fn queries_match_every_element_matching() {
+    thread_state::initialize(ThreadState::LAYOUT);
+    let mut tree = tree();
+    let roots = [NodeId::DOCUMENT, tree.main, tree.shadow, tree.shadow_div];
+    let mut cache = QueryPlanCache::default();
+    check_roots(&tree.dom, &roots, &mut cache);
+    tree.dom.build_indices();
+    check_roots(&tree.dom, &roots, &mut cache);
+}
+
+#[test]
+fn query_plan_cache_reuses_plans() {
+    let mut cache = QueryPlanCache::default();
+    let parses = Cell::new(0);
+    let compile = |cache: &mut QueryPlanCache, text: &str, quirks_mode| {
+        cache
+            .get_or_compile(text, quirks_mode, |text| {
+                parses.set(parses.get() + 1);
+                Ok::<_, ()>(parse(text))
+            })
+            .unwrap()
+    };
+    let plan = compile(&mut cache, ".a .c", QuirksMode::NoQuirks);
+    assert!(servo_arc::Arc::ptr_eq(
+        &plan,
+        &compile(&mut cache, ".a .c", QuirksMode::NoQuirks)
+    ));
+    let quirks = compile(&mut cache, ".a .c", QuirksMode::Quirks);
+    assert!(!servo_arc::Arc::ptr_eq(&plan, &quirks));
+    compile(&mut cache, ".a > .c", QuirksMode::NoQuirks);
+    assert_eq!(parses.get(), 3);
+    cache.clear();
+    compile(&mut cache, ".a .c", QuirksMode::NoQuirks);
+    assert_eq!(parses.get(), 4);
+}
+
+#[test]
+fn ancestors_of_the_root_are_not_results() {
+    thread_state::initialize(ThreadState::LAYOUT);
+    let tree = tree();
+    // The ancestors of the root are taken into account by the bloom filter,
+    // but the elements they match aren't results.
+    let selectors = parse(".outer .a");
+    let mut results = Default::default();
+    dom_apis::query_selector::<Element, QueryAll>(
+        tree.dom.node(tree.main),
+        &selectors,
+        &mut results,
+        MayUseInvalidation::No,
+    );
+    assert!(results.is_empty());
+
+    // Elements in shadow trees aren't descendants of the document.
+    dom_apis::query_selector::<Element, QueryAll>(
+        tree.dom.document().as_node(),
+        &selectors,
+        &mut results,
+        MayUseInvalidation::No,
+    );
+    let results = results.iter().map(|e| e.node_id()).collect::<Vec<_>>();
+    assert_eq!(results, [tree.main, tree.other]);
+}
+
+#[test]
+fn namespaced_attributes_are_not_looked_up_in_the_index() {
+    thread_state::initialize(ThreadState::LAYOUT);
+    let mut tree = tree();
+    tree.dom.build_indices();
+    let namespaced = tree.dom.element(tree.namespaced);
+    let document = tree.dom.document().as_node();
+    for (text, matches) in [("[*|data-x]", true), ("[data-x]", false)] {
+        let plan = dom_apis::QueryPlan::new(parse(text), QuirksMode::NoQuirks);
+        let mut results = Default::default();
+        dom_apis::query_selector_with_plan::<Element, QueryAll>(
+            document,
+            &plan,
+            &mut results,
+            MayUseInvalidation::No,
+        );
+        assert_eq!(results.contains(&namespaced), matches, "{}", text);
+        assert_eq!(
+            dom_apis::element_closest_with_plan(namespaced, &plan) == Some(namespaced),
+            matches,
+            "{}",
+            text
+        );
+    }
+}
+
+#[test]
+fn elements_by_class_name_matches_walking() {
+    thread_state::initialize(ThreadState::LAYOUT);
+    const CLASSES: &[&[&str]] = &[
+        &["c"],
+        &["C"],
+        &["c", "d"],
+        &["d", "c"],
+        &["e", "c"],
+        &["missing"],
+        &["c", "missing"],
+    ];
+    for quirks_mode in [QuirksMode::NoQuirks, QuirksMode::Quirks] {
+        let mut tree = tree();
+        tree.dom.set_quirks_mode(quirks_mode);
+        // More elements with these classes under `other` than subtree queries
+        // go through in the index, so those walk the subtree instead.
+        for i in 0..100 {
+            let class = ["c d", "C", "c"][i % 3];
+            append(&mut tree.dom, tree.other, "i", &[("class", class)]);
+        }
+        let case_sensitivity = quirks_mode.classes_and_ids_case_sensitivity();
+        let roots = [
+            NodeId::DOCUMENT,
+            tree.main,
+            tree.other,
+            tree.shadow,
+            tree.shadow_div,
+        ];
+        for indexed in [false, true] {
+            if indexed {
+                tree.dom.build_indices();
+            }
+            for &root in &roots {
+                let root = tree.dom.node(root);
+                for classes in CLASSES {
+                    let classes = classes
+                        .iter()
+                        .map(|c| AtomIdent::from(*c))
+                        .collect::<Vec<_>>();
+                    let expected = root
+                        .dom_descendants()
+                        .filter_map(|node| node.as_element())
+                        .filter(|e| classes.iter().all(|c| e.has_class(c, case_sensitivity)))
+                        .collect::<Vec<_>>();
+                    let what = format!("{:?} {:?} {:?}", root, classes, quirks_mode);
+
+                    let mut all = Default::default();
+                    dom_apis::elements_by_class_name::<Element, QueryAll>(root, &classes, &mut all);
+                    assert_eq!(&all[..], &expected[..], "{}", what);
+
+                    let mut first = None;
+                    dom_apis::elements_by_class_name::<Element, QueryFirst>(
+                        root, &classes, &mut first,
+                    );
+                    assert_eq!(first, expected.first().copied(), "{}", what);
+                }
+            }
+        }
+
+        // Classes only differing in case are the same in quirks mode.
+        let document = tree.dom.document().as_node();
+        let mut lower = Default::default();
+        let mut upper = Default::default();
+        dom_apis::elements_by_class_name::<Element, QueryAll>(
+            document,
+            &[AtomIdent::from("c")],
+            &mut lower,
+        );
+        dom_apis::elements_by_class_name::<Element, QueryAll>(
+            document,
+            &[AtomIdent::from("C")],
+            &mut upper,
+        );
+        assert_eq!(lower == upper, quirks_mode == QuirksMode::Quirks);
+    }
+}
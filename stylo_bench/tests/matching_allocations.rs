@@ -0,0 +1,112 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Checks that matching an element against a large stylesheet through the
+//! style resolver doesn't allocate once the per-thread style context is
+//! warmed up.
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::cell::Cell;
+use style::context::{StyleContext, ThreadLocalStyleContext};
+use style::dom::TElement;
+use style::selector_parser::SnapshotMap;
+use style::shared_lock::StylesheetGuards;
+use style::style_resolver::{PseudoElementResolution, StyleResolverForElement};
+use style::stylist::RuleInclusion;
+use style::thread_state::{self, ThreadState};
+use stylo_bench::corpus::Corpus;
+use stylo_bench::dom::Element;
+use stylo_bench::generators::{pick_elements, DomShape};
+use stylo_bench::harness::{Fixture, DEFAULT_RULE_COUNT};
+use stylo_bench::traversal;
+
+/// Counts the allocations made by the current thread, so that the test
+/// harness threads don't interfere.
+struct CountingAllocator;
+
+thread_local! {
+    static ALLOCATIONS: Cell<usize> = const { Cell::new(0) };
+}
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        let _ = ALLOCATIONS.try_with(|count| count.set(count.get() + 1));
+        System.alloc(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        let _ = ALLOCATIONS.try_with(|count| count.set(count.get() + 1));
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+#[global_allocator]
+static GLOBAL: CountingAllocator = CountingAllocator;
+
+fn allocations() -> usize {
+    ALLOCATIONS.with(|count| count.get())
+}
+
+#[test]
+fn matching_does_not_allocate_in_steady_state() {
+    thread_state::initialize(ThreadState::LAYOUT);
+    let shape = DomShape::Wide {
+        sections: 8,
+        items: 16,
+    };
+    let mut fixture = Fixture::new(shape, Corpus::Framework, DEFAULT_RULE_COUNT);
+    // Make every element match more declarations than the inline capacity
+    // of the declaration list.
+    let catch_all = (0..24)
+        .map(|i| format!("body * {{ margin-right: {}px }}\n", i))
+        .collect::<String>();
+    fixture.append_stylesheet(&catch_all);
+    fixture.flush_stylesheets();
+    fixture.style(None);
+
+    let lock = fixture.dom.shared_lock().clone();
+    let guard = lock.read();
+    let guards = StylesheetGuards::same(&guard);
+    let snapshots = SnapshotMap::new();
+    let shared = traversal::shared_context(&fixture.stylist, guards, &snapshots);
+    let elements = pick_elements(&fixture.dom, 64, 7)
+        .into_iter()
+        .map(|id| {
+            let element = fixture.dom.element(id);
+            let style = element.borrow_data().unwrap().styles.primary().clone();
+            (element, style)
+        })
+        .collect::<Vec<_>>();
+    // The per-thread state a traversal keeps across elements.
+    let mut thread_local = ThreadLocalStyleContext::new();
+
+    let match_all = |thread_local: &mut ThreadLocalStyleContext<Element>| {
+        for (element, style) in &elements {
+            thread_local.bloom_filter.rebuild(*element);
+            let mut context = StyleContext {
+                shared: &shared,
+                thread_local: &mut *thread_local,
+            };
+            let rule_node = StyleResolverForElement::new(
+                *element,
+                &mut context,
+                RuleInclusion::All,
+                PseudoElementResolution::IfApplicable,
+            )
+            .match_rules(style);
+            assert_eq!(style.rules.as_ref(), Some(&rule_node));
+        }
+    };
+
+    // Warm up the caches, the bloom filter and the declaration list.
+    match_all(&mut thread_local);
+    assert!(thread_local.applicable_declarations.spilled());
+    let before = allocations();
+    match_all(&mut thread_local);
+    assert_eq!(allocations() - before, 0);
+}
@@ -0,0 +1,141 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Checks that the rule cache shares the resolved custom properties of
+//! elements with the same rules and inherited custom properties, and that
+//! replaying its cascade plans computes the same styles as cascading the
+//! rules.
+
+use style::context::ThreadLocalStyleContext;
+use style::dom::TElement;
+use style::properties::{ComputedValues, LonghandId, PropertyDeclarationId};
+use style::thread_state::{self, ThreadState};
+use style::Atom;
+use stylo_bench::corpus::Corpus;
+use stylo_bench::generators::DomShape;
+use stylo_bench::harness::Fixture;
+
+#[test]
+fn cache_hits_share_custom_properties() {
+    thread_state::initialize(ThreadState::LAYOUT);
+    let shape = DomShape::Wide {
+        sections: 2,
+        items: 8,
+    };
+    let mut fixture = Fixture::new(shape, Corpus::Simple, 0);
+    fixture.append_stylesheet("span { --x: 1px; --y: calc(var(--x) * 2) }");
+    fixture.flush_stylesheets();
+    fixture.style(None);
+
+    let spans = fixture
+        .dom
+        .element_ids()
+        .filter(|id| &**fixture.dom.element(*id).local_name() == "span")
+        .collect::<Vec<_>>();
+
+    // Resolve all the spans with the same per-thread caches, like a traversal
+    // would. Only the traversal fills the style sharing cache, so styles can
+    // only be shared through the rule cache.
+    let mut thread_local = ThreadLocalStyleContext::new();
+    let styles = spans
+        .iter()
+        .map(|id| fixture.resolve_style(*id, &mut thread_local))
+        .collect::<Vec<_>>();
+    drop(thread_local);
+
+    let mut hits = 0;
+    for (i, style) in styles.iter().enumerate() {
+        let style = style.primary_style();
+        assert_eq!(style.custom_properties().inherited.len(), 2);
+        let first = styles[..i]
+            .iter()
+            .map(|s| s.primary_style())
+            .find(|s| s.rules == style.rules);
+        if let Some(first) = first {
+            assert!(first.custom_properties().ptr_eq(style.custom_properties()));
+            hits += 1;
+        }
+    }
+    assert!(hits > 0, "No spans with the same rules");
+
+    // Without the cache, each span gets its own custom properties.
+    let first = fixture.resolve_style(spans[0], &mut ThreadLocalStyleContext::new());
+    assert!(!first
+        .primary_style()
+        .custom_properties()
+        .ptr_eq(styles[0].primary_style().custom_properties()));
+}
+
+/// Serializes the properties set by the stylesheet of
+/// `cascade_plans_match_the_cascade`.
+fn serialize(style: &ComputedValues) -> Vec<String> {
+    let longhands = [
+        LonghandId::MarginTop,
+        LonghandId::MarginLeft,
+        LonghandId::PaddingTop,
+        LonghandId::PaddingLeft,
+        LonghandId::PaddingBottom,
+        LonghandId::Color,
+        LonghandId::BorderTopWidth,
+        LonghandId::BorderTopColor,
+        LonghandId::Display,
+    ];
+    let mut values = longhands
+        .iter()
+        .map(|id| style.computed_value_to_string(PropertyDeclarationId::Longhand(*id)))
+        .collect::<Vec<_>>();
+    for name in ["m", "c"] {
+        let name = Atom::from(name);
+        values.push(style.computed_value_to_string(PropertyDeclarationId::Custom(&name)));
+    }
+    values
+}
+
+#[test]
+fn cascade_plans_match_the_cascade() {
+    thread_state::initialize(ThreadState::LAYOUT);
+    let shape = DomShape::Wide {
+        sections: 2,
+        items: 8,
+    };
+    let mut fixture = Fixture::new(shape, Corpus::Simple, 0);
+    fixture.append_stylesheet(
+        "
+        section { --m: 4px; --c: blue }
+        span { margin: var(--m) 1px; color: green !important; padding: 2px }
+        span { color: red; padding-left: 5px !important; padding-top: revert }
+        span:first-child { --m: 7px; border: var(--m) solid var(--c) }
+        span:nth-child(3n) { margin: 0 !important; --c: calc(var(--m) * 2) }
+    ",
+    );
+    fixture.flush_stylesheets();
+    fixture.style(None);
+
+    let spans = fixture
+        .dom
+        .element_ids()
+        .filter(|id| &**fixture.dom.element(*id).local_name() == "span")
+        .collect::<Vec<_>>();
+
+    // With the same per-thread caches, the second and later spans with the
+    // same rules replay a plan. With fresh caches, each span cascades its
+    // rules.
+    let mut thread_local = ThreadLocalStyleContext::new();
+    let mut seen = Vec::new();
+    let mut replayed = 0;
+    for id in &spans {
+        let cached = fixture.resolve_style(*id, &mut thread_local);
+        let cached = cached.primary_style();
+        let fresh = fixture.resolve_style(*id, &mut ThreadLocalStyleContext::new());
+        let fresh = fresh.primary_style();
+        assert_eq!(cached.rules, fresh.rules);
+        assert_eq!(serialize(cached), serialize(fresh), "{:?}", id);
+
+        if seen.contains(&cached.rules) {
+            replayed += 1;
+        }
+        seen.push(cached.rules.clone());
+    }
+    assert!(replayed > 0, "No plans were replayed");
+}
@@ -0,0 +1,129 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Checks the selector match statistics recorded over a traversal: the
+//! compound selectors walked by a deep descendant chain, the attempts that
+//! the bloom filter rejects, and the source location of the slowest selector.
+
+use cssparser::ToCss;
+use std::sync::atomic::Ordering;
+use style::context::DEFAULT_DISABLE_STYLE_SHARING_CACHE;
+use style::dom::{TElement, TNode};
+use style::selector_match_stats::SlowSelector;
+use style::shared_lock::StylesheetGuards;
+use style::thread_state::{self, ThreadState};
+use stylo_bench::corpus::Corpus;
+use stylo_bench::dom::Element;
+use stylo_bench::generators::DomShape;
+use stylo_bench::harness::Fixture;
+
+const CSS: &str = "span { color: red }
+section span { color: green }
+div div div div div span { color: blue }
+";
+
+/// The number of compound selectors of the descendant chain.
+const CHAIN_LENGTH: usize = 6;
+
+fn find<'a>(slowest: &'a [SlowSelector], css: &str) -> &'a SlowSelector {
+    slowest
+        .iter()
+        .find(|s| s.selector.to_css_string() == css)
+        .unwrap_or_else(|| panic!("No statistics for {}", css))
+}
+
+fn ancestors(element: Element) -> Vec<Element> {
+    let mut ancestors = vec![];
+    let mut current = element.as_node().parent_element();
+    while let Some(parent) = current {
+        ancestors.push(parent);
+        current = parent.as_node().parent_element();
+    }
+    ancestors
+}
+
+#[test]
+fn deep_descendant_chains() {
+    thread_state::initialize(ThreadState::LAYOUT);
+    // Every element matches its rules, rather than sharing the style of a
+    // sibling.
+    DEFAULT_DISABLE_STYLE_SHARING_CACHE.store(true, Ordering::Relaxed);
+    let shape = DomShape::Deep {
+        depth: 8,
+        siblings: 2,
+    };
+    let mut fixture = Fixture::new(shape, Corpus::Simple, 0);
+    fixture.append_stylesheet(CSS);
+    fixture.flush_stylesheets();
+    // Record every match attempt.
+    fixture.stylist.set_selector_match_stats(Some(1));
+    fixture.style(None);
+
+    let lock = fixture.dom.shared_lock();
+    let guard = lock.read();
+    let slowest = fixture
+        .stylist
+        .slowest_selectors(usize::MAX, &StylesheetGuards::same(&guard));
+    let spans = fixture
+        .dom
+        .element_ids()
+        .map(|id| fixture.dom.element(id))
+        .filter(|e| &**e.local_name() == "span")
+        .collect::<Vec<_>>();
+
+    // The chain walks every compound selector of the spans it matches, and
+    // every ancestor of the ones it doesn't. Spans without a `div` ancestor
+    // are rejected by the bloom filter, except for false positives.
+    let chain = find(&slowest, "div div div div div span");
+    let (mut matches, mut walked, mut may_be_rejected, mut rootless_steps) = (0, 0, 0, 0);
+    for span in spans.iter() {
+        let ancestors = ancestors(*span);
+        let divs = ancestors
+            .iter()
+            .filter(|a| &**a.local_name() == "div")
+            .count();
+        if divs >= CHAIN_LENGTH - 1 {
+            matches += 1;
+            walked += CHAIN_LENGTH;
+        } else if divs > 0 {
+            walked += 1 + ancestors.len();
+        } else {
+            may_be_rejected += 1;
+            rootless_steps = 1 + ancestors.len();
+        }
+    }
+    assert!(matches > 0 && may_be_rejected > 0);
+    let stats = chain.stats;
+    assert_eq!(stats.matches, matches);
+    assert_eq!((stats.attempts + stats.bloom_rejects) as usize, spans.len());
+    let false_positives = spans.len() - may_be_rejected - stats.attempts as usize;
+    assert_eq!(
+        stats.steps as usize,
+        walked + false_positives * rootless_steps
+    );
+
+    // A single compound selector is one step per attempt, and is never
+    // rejected by the bloom filter.
+    let span = find(&slowest, "span").stats;
+    assert_eq!(span.attempts as usize, spans.len());
+    assert_eq!(span.matches as usize, spans.len());
+    assert_eq!(span.steps, span.attempts as u64);
+    assert_eq!(span.bloom_rejects, 0);
+
+    // There is no `section`, so the bloom filter rejects most attempts.
+    let section = find(&slowest, "section span").stats;
+    assert_eq!(section.matches, 0);
+    assert_eq!(
+        (section.attempts + section.bloom_rejects) as usize,
+        spans.len()
+    );
+    assert!(section.bloom_rejects > 0);
+
+    // The chain is the slowest selector, and its location is that of its
+    // rule in the stylesheet.
+    assert!(std::ptr::eq(&slowest[0], chain));
+    assert!(chain.stats.average_steps() > span.average_steps());
+    assert_eq!(chain.source_location.unwrap().line, 2);
+    assert_eq!(find(&slowest, "span").source_location.unwrap().line, 0);
+}
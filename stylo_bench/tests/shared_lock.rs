@@ -0,0 +1,73 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Checks that frozen shared locks can be read from many threads, can't be
+//! written to, and can be written to again once unfrozen.
+
+use style::shared_lock::SharedRwLock;
+
+#[test]
+fn frozen_locks_can_be_read() {
+    let lock = SharedRwLock::new();
+    let locked = lock.wrap(vec![1, 2, 3]);
+    lock.freeze();
+    assert!(lock.is_frozen());
+    // Freezing a frozen lock does nothing.
+    lock.freeze();
+
+    let guard = lock.read();
+    std::thread::scope(|scope| {
+        for _ in 0..4 {
+            scope.spawn(|| {
+                let guard = lock.read();
+                assert_eq!(locked.read_with(&guard), &[1, 2, 3]);
+            });
+        }
+    });
+    assert_eq!(locked.read_with(&guard), &[1, 2, 3]);
+    drop(guard);
+
+    unsafe { lock.unfreeze() };
+    assert!(!lock.is_frozen());
+}
+
+#[test]
+fn unfrozen_locks_can_be_written() {
+    let lock = SharedRwLock::new();
+    let locked = lock.wrap(vec![1, 2, 3]);
+    lock.freeze();
+    assert_eq!(locked.read_with(&lock.read()), &[1, 2, 3]);
+    unsafe { lock.unfreeze() };
+    // Unfreezing a lock that isn't frozen does nothing.
+    unsafe { lock.unfreeze() };
+
+    locked.write_with(&mut lock.write()).push(4);
+    assert_eq!(locked.read_with(&lock.read()), &[1, 2, 3, 4]);
+
+    // The lock can be frozen again, and reading it then sees the write.
+    lock.freeze();
+    assert_eq!(locked.read_with(&lock.read()), &[1, 2, 3, 4]);
+    unsafe { lock.unfreeze() };
+    locked.write_with(&mut lock.write()).clear();
+    assert!(locked.read_with(&lock.read()).is_empty());
+}
+
+#[cfg(debug_assertions)]
+#[test]
+#[should_panic(expected = "SharedRwLock::write called on a frozen lock")]
+fn writing_frozen_locks_asserts() {
+    let lock = SharedRwLock::new();
+    lock.freeze();
+    let _guard = lock.write();
+}
+
+#[cfg(debug_assertions)]
+#[test]
+#[should_panic(expected = "SharedRwLock::unfreeze called while frozen read guards are alive")]
+fn unfreezing_with_frozen_readers_asserts() {
+    let lock = SharedRwLock::new();
+    lock.freeze();
+    let _guard = lock.read();
+    unsafe { lock.unfreeze() };
+}
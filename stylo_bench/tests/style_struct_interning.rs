@@ -0,0 +1,87 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Checks that styling a document with style struct interning enabled shares
+//! the equal structs computed for elements with different rules, and that the
+//! interner counts them.
+
+use servo_arc::Arc;
+use style::dom::TElement;
+use style::properties::{style_structs, ComputedValues};
+use style::thread_state::{self, ThreadState};
+use stylo_bench::corpus::Corpus;
+use stylo_bench::generators::DomShape;
+use stylo_bench::harness::Fixture;
+
+const CSS: &str = "
+    span.x { padding-left: 3px }
+    span.y { padding-left: 3px }
+";
+
+/// Styles a document where the first two spans have different rules that
+/// compute the same padding, and returns their styles.
+fn style_spans(interning: bool) -> (Fixture, Vec<Arc<ComputedValues>>) {
+    thread_state::initialize(ThreadState::LAYOUT);
+    let shape = DomShape::Wide {
+        sections: 2,
+        items: 4,
+    };
+    let mut fixture = Fixture::new(shape, Corpus::Simple, 0);
+    fixture
+        .stylist
+        .set_style_struct_interning_enabled(interning);
+    let spans = fixture
+        .dom
+        .element_ids()
+        .filter(|id| &**fixture.dom.element(*id).local_name() == "span")
+        .take(2)
+        .collect::<Vec<_>>();
+    for (id, class) in spans.iter().zip(["x", "y"]) {
+        fixture.dom.set_attribute(*id, "class", class);
+    }
+    fixture.append_stylesheet(CSS);
+    fixture.flush_stylesheets();
+    fixture.style(None);
+
+    let styles = spans
+        .iter()
+        .map(|id| {
+            fixture
+                .dom
+                .element(*id)
+                .borrow_data()
+                .unwrap()
+                .styles
+                .primary()
+                .clone()
+        })
+        .collect::<Vec<_>>();
+    assert_ne!(styles[0].rules, styles[1].rules);
+    (fixture, styles)
+}
+
+#[test]
+fn interning_shares_equal_structs() {
+    let (fixture, styles) = style_spans(true);
+    assert!(std::ptr::eq(
+        styles[0].get_padding(),
+        styles[1].get_padding()
+    ));
+
+    let stats = fixture.stylist.style_struct_interner().unwrap().stats();
+    assert!(stats.hits > 0);
+    assert!(stats.hits <= stats.lookups);
+    assert!(stats.bytes_saved >= std::mem::size_of::<style_structs::Padding>());
+    assert!(stats.dedup_ratio() > 0. && stats.dedup_ratio() <= 1.);
+}
+
+#[test]
+fn structs_are_not_shared_without_interning() {
+    let (fixture, styles) = style_spans(false);
+    assert!(!std::ptr::eq(
+        styles[0].get_padding(),
+        styles[1].get_padding()
+    ));
+    assert!(fixture.stylist.style_struct_interner().is_none());
+}
@@ -0,0 +1,212 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Checks that stylesheets loaded from bundles have the rules they were
+//! written with, that author stylesheets loaded from bundles can be modified,
+//! and that stylesheets that can't be bundled are parsed.
+
+use servo_arc::Arc;
+use std::path::PathBuf;
+use style::context::QuirksMode;
+use style::shared_lock::{SharedRwLock, ToCssWithGuard};
+use style::stylesheets::{AllowImportRules, Origin, StylesheetContents};
+use style::{Namespace, Prefix};
+use stylo_bench::sheets;
+use to_shmem::bundle::Bundle;
+use to_shmem::Dedup;
+
+const BUILD_KEY: u64 = 0xb0b;
+const CAPACITY: usize = 1 << 20;
+
+const CSS: &str = "
+    div, p { display: block; margin: 8px 0 }
+    ul > li:hover { color: red !important }
+    @media screen and (min-width: 100px) { span { padding: 1em } }
+";
+
+fn parse(css: &str, origin: Origin, lock: &SharedRwLock) -> Arc<StylesheetContents> {
+    StylesheetContents::from_str(
+        css,
+        sheets::url_data(),
+        origin,
+        lock,
+        None,
+        None,
+        QuirksMode::NoQuirks,
+        AllowImportRules::Yes,
+        None,
+    )
+}
+
+fn serialize(contents: &StylesheetContents, lock: &SharedRwLock) -> Vec<String> {
+    let guard = lock.read();
+    contents
+        .rules(&guard)
+        .iter()
+        .map(|rule| {
+            let mut css = String::new();
+            rule.to_css(&guard, &mut css).unwrap();
+            css
+        })
+        .collect()
+}
+
+fn temp_path(name: &str) -> PathBuf {
+    std::env::temp_dir().join(format!(
+        "stylo-bundle-test-{}-{}.bundle",
+        name,
+        std::process::id()
+    ))
+}
+
+#[test]
+fn bundled_rules_round_trip() {
+    let lock = SharedRwLock::new();
+    let contents = parse(CSS, Origin::UserAgent, &lock);
+    let expected = serialize(&contents, &lock);
+    assert_eq!(expected.len(), 3);
+
+    let path = temp_path("round-trip");
+    let bytes = contents
+        .write_bundle(BUILD_KEY, CAPACITY, Dedup::Identity)
+        .unwrap();
+    std::fs::write(&path, bytes).unwrap();
+
+    let bundle = Bundle::open(&path, BUILD_KEY).unwrap();
+    // Unsafe: the contents are dropped before the bundle.
+    let loaded = unsafe {
+        StylesheetContents::from_bundle(
+            &bundle,
+            Origin::UserAgent,
+            sheets::url_data(),
+            &lock,
+            QuirksMode::NoQuirks,
+        )
+    }
+    .unwrap();
+    assert_eq!(loaded.origin, Origin::UserAgent);
+    // The rules are read only, and can be read with any guard.
+    assert_eq!(serialize(&loaded, &lock), expected);
+    assert_eq!(serialize(&loaded, &SharedRwLock::new()), expected);
+    drop(loaded);
+    drop(bundle);
+
+    // Unsafe: the contents are dropped before the bundle.
+    let (loaded, bundle) = unsafe {
+        StylesheetContents::from_bundle_or_str(
+            &path,
+            BUILD_KEY,
+            CSS,
+            Origin::UserAgent,
+            sheets::url_data(),
+            &lock,
+            QuirksMode::NoQuirks,
+        )
+    };
+    assert!(bundle.is_some());
+    assert_eq!(serialize(&loaded, &lock), expected);
+    drop(loaded);
+    drop(bundle);
+
+    // Another build parses the stylesheet.
+    assert!(Bundle::open(&path, !BUILD_KEY).is_err());
+    let (parsed, bundle) = unsafe {
+        StylesheetContents::from_bundle_or_str(
+            &path,
+            !BUILD_KEY,
+            CSS,
+            Origin::UserAgent,
+            sheets::url_data(),
+            &lock,
+            QuirksMode::NoQuirks,
+        )
+    };
+    assert!(bundle.is_none());
+    assert_eq!(serialize(&parsed, &lock), expected);
+    let _ = std::fs::remove_file(&path);
+}
+
+#[test]
+fn bundled_author_rules_can_be_modified() {
+    let lock = SharedRwLock::new();
+    let css = format!("@namespace svg url(http://www.w3.org/2000/svg); {}", CSS);
+    let contents = parse(&css, Origin::Author, &lock);
+    let expected = serialize(&contents, &lock);
+    let bytes = contents
+        .write_bundle(BUILD_KEY, CAPACITY, Dedup::Identity)
+        .unwrap();
+    let bundle = Bundle::from_bytes(&bytes, BUILD_KEY).unwrap();
+
+    // Unsafe: the contents are dropped before the bundle.
+    let loaded = unsafe {
+        StylesheetContents::from_bundle(
+            &bundle,
+            Origin::Author,
+            sheets::url_data(),
+            &lock,
+            QuirksMode::NoQuirks,
+        )
+    }
+    .unwrap();
+    assert_eq!(loaded.origin, Origin::Author);
+    assert_eq!(serialize(&loaded, &lock), expected);
+    // The namespace map is rebuilt, so that new rules can use the prefix.
+    assert_eq!(
+        loaded.namespaces.read().prefixes.get(&Prefix::from("svg")),
+        Some(&Namespace::from("http://www.w3.org/2000/svg"))
+    );
+
+    // The rules are a copy that uses the document lock.
+    loaded.rules.write_with(&mut lock.write()).0.remove(1);
+    assert_eq!(
+        serialize(&loaded, &lock),
+        [&expected[..1], &expected[2..]].concat()
+    );
+    drop(loaded);
+    drop(bundle);
+}
+
+#[test]
+fn unsupported_stylesheets_are_parsed() {
+    let lock = SharedRwLock::new();
+    let unsupported = [
+        // The namespace is a dynamic atom.
+        (
+            "@namespace svg url(urn:x-stylo:bundle-test); svg|rect { display: none }",
+            Origin::UserAgent,
+        ),
+        (
+            "div { background-image: url(image.png) }",
+            Origin::UserAgent,
+        ),
+        // Class names longer than seven bytes are dynamic atoms.
+        (".long-class-name { display: block }", Origin::Author),
+    ];
+    for (i, (css, origin)) in unsupported.into_iter().enumerate() {
+        let contents = parse(css, origin, &lock);
+        assert!(
+            contents
+                .write_bundle(BUILD_KEY, CAPACITY, Dedup::Identity)
+                .is_err(),
+            "{}",
+            css
+        );
+
+        // Without a bundle, the stylesheet is parsed.
+        let path = temp_path(&format!("unsupported-{}", i));
+        let (parsed, bundle) = unsafe {
+            StylesheetContents::from_bundle_or_str(
+                &path,
+                BUILD_KEY,
+                css,
+                origin,
+                sheets::url_data(),
+                &lock,
+                QuirksMode::NoQuirks,
+            )
+        };
+        assert!(bundle.is_none());
+        assert_eq!(serialize(&parsed, &lock), serialize(&contents, &lock));
+    }
+}
@@ -0,0 +1,189 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! Checks that the subtree summaries of the DOM stay up to date as the tree
+//! mutates, and that `:has()` never rejects an element whose subtree has an
+//! element without a summary.
+
+use cssparser::{Parser as CssParser, ParserInput};
+use selectors::bloom::SubtreeSummary;
+use selectors::parser::{ParseRelative, SelectorParseErrorKind};
+use selectors::{Element as SelectorsElement, SelectorList};
+use style::context::QuirksMode;
+use style::dom::{TElement, TNode};
+use style::dom_apis;
+use style::selector_parser::SelectorImpl;
+use style::shared_lock::SharedRwLock;
+use style::thread_state::{self, ThreadState};
+use stylo_bench::dom::{Dom, NodeId};
+use stylo_bench::sheets;
+
+/// The Servo selector parser doesn't parse `:has()` yet.
+struct HasParser;
+
+impl<'i> selectors::Parser<'i> for HasParser {
+    type Impl = SelectorImpl;
+    type Error = SelectorParseErrorKind<'i>;
+
+    fn parse_has(&self) -> bool {
+        true
+    }
+}
+
+fn parse(text: &str) -> SelectorList<SelectorImpl> {
+    let mut input = ParserInput::new(text);
+    SelectorList::parse(
+        &HasParser,
+        &mut CssParser::new(&mut input),
+        ParseRelative::No,
+    )
+    .expect("Invalid selector")
+}
+
+const CLASSES: &[&str] = &["a", "b", "c"];
+
+fn append(dom: &mut Dom, parent: NodeId, name: &str, class: &str) -> NodeId {
+    let element = dom.create_element(name);
+    if !class.is_empty() {
+        dom.set_attribute(element, "class", class);
+    }
+    dom.append_child(parent, element);
+    element
+}
+
+struct Tree {
+    dom: Dom,
+    main: NodeId,
+    section: NodeId,
+    span: NodeId,
+}
+
+/// `html > body > div#main > section > span.a`, and `body > p.c`.
+fn tree() -> Tree {
+    thread_state::initialize(ThreadState::LAYOUT);
+    let mut dom = Dom::new(SharedRwLock::new(), sheets::url_data());
+    let html = append(&mut dom, NodeId::DOCUMENT, "html", "");
+    let body = append(&mut dom, html, "body", "");
+    let main = append(&mut dom, body, "div", "");
+    dom.set_attribute(main, "id", "main");
+    let section = append(&mut dom, main, "section", "");
+    let span = append(&mut dom, section, "span", "a");
+    append(&mut dom, body, "p", "c");
+    dom.build_subtree_summaries();
+    Tree {
+        dom,
+        main,
+        section,
+        span,
+    }
+}
+
+/// Checks that `:has(.class)` matches exactly the elements with a descendant
+/// with that class.
+fn check_has(dom: &Dom) {
+    for class in CLASSES {
+        let selectors = parse(&format!(":has(.{})", class));
+        for id in dom.element_ids() {
+            let element = dom.element(id);
+            if element.as_node().parent_node().is_none() {
+                continue;
+            }
+            let expected = element
+                .as_node()
+                .dom_descendants()
+                .filter_map(|n| n.as_element())
+                .any(|e| {
+                    dom.attribute(e.node_id(), "class")
+                        .map_or(false, |v| v.split_ascii_whitespace().any(|c| c == *class))
+                });
+            assert_eq!(
+                dom_apis::element_matches(&element, &selectors, QuirksMode::NoQuirks),
+                expected,
+                "{:?} :has(.{})",
+                element,
+                class
+            );
+        }
+    }
+}
+
+/// The summaries of the attached elements.
+fn summaries(dom: &Dom) -> Vec<(NodeId, Option<SubtreeSummary>)> {
+    dom.document()
+        .as_node()
+        .dom_descendants()
+        .filter_map(|n| n.as_element())
+        .map(|e| (e.node_id(), e.subtree_summary()))
+        .collect()
+}
+
+/// Checks that the summaries kept up to date by the DOM are those it would
+/// build from scratch.
+fn check_summaries(dom: &mut Dom) {
+    let updated = summaries(dom);
+    dom.build_subtree_summaries();
+    assert_eq!(updated, summaries(dom));
+}
+
+#[test]
+fn insertions_update_summaries() {
+    let mut tree = tree();
+    check_has(&tree.dom);
+
+    append(&mut tree.dom, tree.section, "em", "b");
+    check_has(&tree.dom);
+    check_summaries(&mut tree.dom);
+
+    // A class gained by an existing element.
+    tree.dom.set_attribute(tree.span, "class", "a c");
+    check_has(&tree.dom);
+    check_summaries(&mut tree.dom);
+}
+
+#[test]
+fn removals_update_summaries() {
+    let mut tree = tree();
+    tree.dom.remove_child(tree.section);
+    let main = tree.dom.element(tree.main);
+    assert_eq!(main.subtree_summary(), Some(Default::default()));
+    check_has(&tree.dom);
+    check_summaries(&mut tree.dom);
+
+    // A class lost by an existing element.
+    let mut tree = self::tree();
+    tree.dom.set_attribute(tree.span, "class", "");
+    check_has(&tree.dom);
+    check_summaries(&mut tree.dom);
+}
+
+#[test]
+fn elements_without_summaries_are_unknown() {
+    // Inserting under an element without a summary, whose ancestors have
+    // one.
+    let mut tree = tree();
+    unsafe { tree.dom.element(tree.section).set_subtree_summary(None) };
+    append(&mut tree.dom, tree.section, "em", "b");
+    let main = tree.dom.element(tree.main);
+    assert_eq!(main.subtree_summary(), None);
+    assert_eq!(main.parent_element().unwrap().subtree_summary(), None);
+    check_has(&tree.dom);
+
+    // Inserting an element without a summary, and then under it.
+    let mut tree = self::tree();
+    let em = tree.dom.create_element("em");
+    unsafe { tree.dom.element(em).set_subtree_summary(None) };
+    tree.dom.append_child(tree.section, em);
+    assert_eq!(tree.dom.element(tree.main).subtree_summary(), None);
+    append(&mut tree.dom, em, "strong", "b");
+    check_has(&tree.dom);
+
+    // Removing a sibling of an element without a summary.
+    let mut tree = self::tree();
+    let em = append(&mut tree.dom, tree.section, "em", "b");
+    unsafe { tree.dom.element(em).set_subtree_summary(None) };
+    tree.dom.remove_child(tree.span);
+    assert_eq!(tree.dom.element(tree.section).subtree_summary(), None);
+    assert_eq!(tree.dom.element(tree.main).subtree_summary(), None);
+    check_has(&tree.dom);
+}
@@ -0,0 +1,164 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! The style traversal over the synthetic DOM, and the device and contexts
+//! it needs.
+
+use crate::dom::{Element, Node};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use style::context::{
+    QuirksMode, RegisteredSpeculativePainter, RegisteredSpeculativePainters, SharedStyleContext,
+    StyleContext, StyleSystemOptions,
+};
+use style::dom::{TElement, TNode};
+use style::font_metrics::FontMetrics;
+use style::media_queries::{Device, MediaType};
+use style::parallel::STYLE_THREAD_STACK_SIZE_KB;
+use style::properties::style_structs::Font;
+use style::properties::ComputedValues;
+use style::queries::values::PrefersColorScheme;
+use style::selector_parser::SnapshotMap;
+use style::servo::media_queries::FontMetricsProvider;
+use style::shared_lock::StylesheetGuards;
+use style::stylist::Stylist;
+use style::thread_state;
+use style::traversal::{recalc_style_at, DomTraversal, PerLevelTraversalData};
+use style::traversal_flags::TraversalFlags;
+use style::values::computed::font::GenericFontFamily;
+use style::values::computed::{CSSPixelLength, Length};
+use style::values::specified::font::QueryFontMetricsFlags;
+use stylo_atoms::Atom;
+
+/// Font metrics that don't depend on the font, as there's no font backend.
+#[derive(Debug)]
+struct FixedFontMetrics;
+
+impl FontMetricsProvider for FixedFontMetrics {
+    fn query_font_metrics(
+        &self,
+        _vertical: bool,
+        _font: &Font,
+        _base_size: CSSPixelLength,
+        _flags: QueryFontMetricsFlags,
+    ) -> FontMetrics {
+        Default::default()
+    }
+
+    fn base_size_for_generic(&self, generic: GenericFontFamily) -> Length {
+        Length::new(match generic {
+            GenericFontFamily::Monospace => 13.,
+            _ => 16.,
+        })
+    }
+}
+
+/// Creates an 800x600 screen device.
+pub fn device() -> Device {
+    Device::new(
+        MediaType::screen(),
+        QuirksMode::NoQuirks,
+        euclid::Size2D::new(800., 600.),
+        euclid::Scale::new(1.),
+        Box::new(FixedFontMetrics),
+        ComputedValues::initial_values_with_font_override(Font::initial_values()),
+        PrefersColorScheme::Light,
+    )
+}
+
+struct NoPainters;
+
+impl RegisteredSpeculativePainters for NoPainters {
+    fn get(&self, _name: &Atom) -> Option<&dyn RegisteredSpeculativePainter> {
+        None
+    }
+}
+
+static NO_PAINTERS: NoPainters = NoPainters;
+
+/// Creates the shared style context for a traversal.
+pub fn shared_context<'a>(
+    stylist: &'a Stylist,
+    guards: StylesheetGuards<'a>,
+    snapshot_map: &'a SnapshotMap,
+) -> SharedStyleContext<'a> {
+    SharedStyleContext {
+        stylist,
+        visited_styles_enabled: false,
+        options: StyleSystemOptions::default(),
+        guards,
+        current_time_for_animations: 0.,
+        traversal_flags: TraversalFlags::empty(),
+        snapshot_map,
+        animations: Default::default(),
+        registered_speculative_painters: &NO_PAINTERS,
+    }
+}
+
+/// Creates a thread pool suitable for the parallel traversal, like the
+/// global style thread pool but with a fixed number of threads.
+pub fn thread_pool(threads: usize) -> rayon::ThreadPool {
+    rayon::ThreadPoolBuilder::new()
+        .num_threads(threads)
+        .thread_name(|i| format!("BenchStyleThread#{}", i))
+        .stack_size(STYLE_THREAD_STACK_SIZE_KB * 1024)
+        .start_handler(|_| thread_state::initialize_layout_worker_thread())
+        .build()
+        .expect("Failed to create the style thread pool")
+}
+
+/// A traversal that restyles all the elements that need it, counting them.
+pub struct RecalcStyle<'a> {
+    context: SharedStyleContext<'a>,
+    styled: AtomicUsize,
+}
+
+impl<'a> RecalcStyle<'a> {
+    /// Creates a new traversal.
+    pub fn new(context: SharedStyleContext<'a>) -> Self {
+        Self {
+            context,
+            styled: AtomicUsize::new(0),
+        }
+    }
+
+    /// The number of elements styled so far.
+    pub fn styled_count(&self) -> usize {
+        self.styled.load(Ordering::Relaxed)
+    }
+}
+
+impl<'a, 'dom> DomTraversal<Element<'dom>> for RecalcStyle<'a> {
+    fn process_preorder<F>(
+        &self,
+        traversal_data: &PerLevelTraversalData,
+        context: &mut StyleContext<Element<'dom>>,
+        node: Node<'dom>,
+        note_child: F,
+    ) where
+        F: FnMut(Node<'dom>),
+    {
+        let Some(element) = node.as_element() else {
+            return;
+        };
+        self.styled.fetch_add(1, Ordering::Relaxed);
+        let mut data = unsafe { element.ensure_data() };
+        recalc_style_at(
+            self,
+            traversal_data,
+            context,
+            element,
+            &mut data,
+            note_child,
+        );
+        unsafe { element.unset_dirty_descendants() };
+    }
+
+    fn process_postorder(&self, _: &mut StyleContext<Element<'dom>>, _: Node<'dom>) {
+        unreachable!("We don't need a postorder traversal");
+    }
+
+    fn shared_context(&self) -> &SharedStyleContext<'_> {
+        &self.context
+    }
+}
@@ -0,0 +1,438 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+//! An on-disk format for values written with a SharedMemoryBuilder, which
+//! can be mapped into memory and used without any deserialization.
+//!
+//! A bundle is made of a header, identifying the format and the build that
+//! wrote it, the offsets of the pointers in the buffer, and the buffer
+//! itself, at a page-aligned offset so that it can be mapped in place. The
+//! pointers are stored as offsets from the start of the buffer, and are
+//! relocated when the bundle is loaded.
+//!
+//! The pointers are found by writing the value twice, into buffers at
+//! different addresses: the words that differ by the distance between the
+//! two buffers are the pointers into the buffer. This relies on the contract
+//! of ToShmem that all the heap allocations of a value are copied into the
+//! buffer, and on the value not pointing to static data, which isn't at the
+//! same address in other processes.
+//!
+//! Bundles are native-endian, and are only meant to be read by the build
+//! that wrote them, which is checked through the build key. Validation
+//! catches stale or truncated bundles, not malicious ones.
+
+use crate::{Dedup, SharedMemoryBuilder, ToShmem};
+use std::alloc::{self, Layout};
+use std::fs::File;
+use std::mem;
+use std::path::Path;
+use std::ptr;
+use std::slice;
+
+/// The version of the format, which must be bumped on any change to it.
+pub const FORMAT_VERSION: u32 = 1;
+
+/// The magic bytes at the start of a bundle.
+const MAGIC: [u8; 8] = *b"STYLOSHM";
+
+/// The alignment of the buffer, in memory and in the file. This is a
+/// multiple of the page size of the platforms we run on, so that the buffer
+/// can be mapped in place, and larger than the alignment of any value
+/// written into it, so that the padding computed by the builder doesn't
+/// depend on the address the buffer ends up at.
+const ALIGNMENT: usize = 16384;
+
+/// The header at the start of a bundle.
+#[derive(Clone, Copy)]
+#[repr(C)]
+struct Header {
+    magic: [u8; 8],
+    version: u32,
+    pointer_width: u32,
+    build_key: u64,
+    root_type: u64,
+    root_offset: u64,
+    relocation_count: u64,
+    buffer_offset: u64,
+    buffer_len: u64,
+}
+
+/// A hash identifying the type of the root value of a bundle, which is
+/// stable for a given build.
+fn type_hash<T>() -> u64 {
+    // FNV-1a.
+    std::any::type_name::<T>()
+        .bytes()
+        .fold(0xcbf29ce484222325, |hash, byte| {
+            (hash ^ byte as u64).wrapping_mul(0x100000001b3)
+        })
+}
+
+/// A zeroed, aligned heap buffer.
+struct AlignedBuffer {
+    ptr: *mut u8,
+    layout: Layout,
+}
+
+impl AlignedBuffer {
+    fn new(len: usize) -> Self {
+        let layout = Layout::from_size_align(len.max(1), ALIGNMENT).unwrap();
+        // Zeroed, so that the padding between values is the same in both of
+        // the buffers that are compared.
+        let ptr = unsafe { alloc::alloc_zeroed(layout) };
+        if ptr.is_null() {
+            alloc::handle_alloc_error(layout);
+        }
+        AlignedBuffer { ptr, layout }
+    }
+}
+
+impl Drop for AlignedBuffer {
+    fn drop(&mut self) {
+        unsafe { alloc::dealloc(self.ptr, self.layout) }
+    }
+}
+
+/// Writes `value` into a bundle, which can be loaded with `Bundle::open` by
+/// the same build, as identified by `build_key`.
+///
+/// `capacity` is the size of the buffers the value is written into, which
+/// must be enough for it, as for `SharedMemoryBuilder::new`, and `dedup` is
+/// how the values written into them are deduplicated.
+pub fn write_bundle<T: ToShmem>(
+    value: &T,
+    build_key: u64,
+    capacity: usize,
+    dedup: Dedup,
+) -> Result<Vec<u8>, String> {
+    let write = |buffer: &AlignedBuffer| -> Result<(usize, usize), String> {
+        let mut builder = unsafe { SharedMemoryBuilder::with_dedup(buffer.ptr, capacity, dedup) };
+        let root = builder.write(value)?;
+        Ok((root as usize - buffer.ptr as usize, builder.len()))
+    };
+
+    let (first, second) = (AlignedBuffer::new(capacity), AlignedBuffer::new(capacity));
+    let (root_offset, len) = write(&first)?;
+    if write(&second)? != (root_offset, len) {
+        return Err(String::from(
+            "Writing the bundle failed: the value wasn't written the same way twice",
+        ));
+    }
+    if len > u32::MAX as usize {
+        return Err(format!(
+            "Writing the bundle failed: {} bytes is too large",
+            len
+        ));
+    }
+
+    let mut buffer = unsafe { slice::from_raw_parts(first.ptr, len) }.to_vec();
+    let delta = (second.ptr as usize).wrapping_sub(first.ptr as usize);
+    let mut relocations = vec![];
+    const WORD: usize = mem::size_of::<usize>();
+    for offset in (0..len - len % WORD).step_by(WORD) {
+        let read = |base: *mut u8| unsafe { ptr::read(base.add(offset) as *const usize) };
+        let (a, b) = (read(first.ptr), read(second.ptr));
+        let target = a.wrapping_sub(first.ptr as usize);
+        if b.wrapping_sub(a) != delta || target > len {
+            continue;
+        }
+        // Store the pointer as an offset from the start of the buffer, so
+        // that the bundle doesn't depend on where it was written.
+        buffer[offset..offset + WORD].copy_from_slice(&target.to_ne_bytes());
+        relocations.push(offset as u32);
+    }
+
+    let relocations_end = mem::size_of::<Header>() + relocations.len() * mem::size_of::<u32>();
+    let buffer_offset = (relocations_end + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    let header = Header {
+        magic: MAGIC,
+        version: FORMAT_VERSION,
+        pointer_width: WORD as u32,
+        build_key,
+        root_type: type_hash::<T>(),
+        root_offset: root_offset as u64,
+        relocation_count: relocations.len() as u64,
+        buffer_offset: buffer_offset as u64,
+        buffer_len: len as u64,
+    };
+
+    let mut bundle = Vec::with_capacity(buffer_offset + len);
+    bundle.extend_from_slice(unsafe {
+        slice::from_raw_parts(
+            &header as *const Header as *const u8,
+            mem::size_of::<Header>(),
+        )
+    });
+    for offset in relocations {
+        bundle.extend_from_slice(&offset.to_ne_bytes());
+    }
+    bundle.resize(buffer_offset, 0);
+    bundle.extend_from_slice(&buffer);
+    Ok(bundle)
+}
+
+/// The memory a bundle is loaded into.
+enum Storage {
+    /// A private, writable mapping of the file.
+    #[cfg(unix)]
+    Mapped { ptr: *mut u8, len: usize },
+    /// A copy of the bundle on the heap.
+    Heap(AlignedBuffer),
+}
+
+/// A loaded bundle, whose root value can be used in place.
+pub struct Bundle {
+    storage: Storage,
+    header: Header,
+}
+
+// Unsafe: the bundle is never written to once loaded.
+unsafe impl Send for Bundle {}
+unsafe impl Sync for Bundle {}
+
+impl Bundle {
+    /// Maps the bundle at `path`, validates it, and relocates its pointers.
+    ///
+    /// Returns an error if the bundle can't be read, or was written by
+    /// another build or version of the format, in which case the caller
+    /// should fall back to whatever the bundle was made from.
+    pub fn open(path: &Path, build_key: u64) -> Result<Bundle, String> {
+        let mut file = File::open(path).map_err(|e| e.to_string())?;
+        let len = file.metadata().map_err(|e| e.to_string())?.len() as usize;
+        let storage = Self::map(&mut file, len)?;
+        unsafe { Self::load(storage, len, build_key) }
+    }
+
+    /// Copies a bundle written by `write_bundle` into memory, validates it,
+    /// and relocates its pointers.
+    pub fn from_bytes(bytes: &[u8], build_key: u64) -> Result<Bundle, String> {
+        let buffer = AlignedBuffer::new(bytes.len());
+        unsafe {
+            ptr::copy_nonoverlapping(bytes.as_ptr(), buffer.ptr, bytes.len());
+            Self::load(Storage::Heap(buffer), bytes.len(), build_key)
+        }
+    }
+
+    #[cfg(unix)]
+    fn map(file: &mut File, len: usize) -> Result<Storage, String> {
+        use std::os::unix::io::AsRawFd;
+
+        if len == 0 {
+            return Err(String::from("Invalid bundle: empty file"));
+        }
+        // The mapping is private, so relocating the pointers only copies the
+        // pages that contain pointers, and never writes to the file.
+        let ptr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_PRIVATE,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(std::io::Error::last_os_error().to_string());
+        }
+        Ok(Storage::Mapped {
+            ptr: ptr as *mut u8,
+            len,
+        })
+    }
+
+    #[cfg(not(unix))]
+    fn map(file: &mut File, len: usize) -> Result<Storage, String> {
+        use std::io::Read;
+
+        let buffer = AlignedBuffer::new(len);
+        let bytes = unsafe { slice::from_raw_parts_mut(buffer.ptr, len) };
+        file.read_exact(bytes).map_err(|e| e.to_string())?;
+        Ok(Storage::Heap(buffer))
+    }
+
+    fn base(storage: &Storage) -> *mut u8 {
+        match *storage {
+            #[cfg(unix)]
+            Storage::Mapped { ptr, .. } => ptr,
+            Storage::Heap(ref buffer) => buffer.ptr,
+        }
+    }
+
+    /// Validates the `len` bytes of `storage` and relocates the pointers of
+    /// the buffer.
+    unsafe fn load(storage: Storage, len: usize, build_key: u64) -> Result<Bundle, String> {
+        let base = Self::base(&storage);
+        if len < mem::size_of::<Header>() {
+            return Err(String::from("Invalid bundle: truncated header"));
+        }
+        let header = ptr::read(base as *const Header);
+        if header.magic != MAGIC {
+            return Err(String::from("Invalid bundle: bad magic"));
+        }
+        if header.version != FORMAT_VERSION {
+            return Err(format!(
+                "Stale bundle: format version {}, expected {}",
+                header.version, FORMAT_VERSION
+            ));
+        }
+        if header.pointer_width as usize != mem::size_of::<usize>() || header.build_key != build_key
+        {
+            return Err(String::from("Stale bundle: written by another build"));
+        }
+
+        let buffer_offset = header.buffer_offset as usize;
+        let buffer_len = header.buffer_len as usize;
+        let relocations_end = (header.relocation_count as usize)
+            .checked_mul(mem::size_of::<u32>())
+            .and_then(|size| size.checked_add(mem::size_of::<Header>()));
+        if buffer_offset % ALIGNMENT != 0
+            || relocations_end.map_or(true, |end| end > buffer_offset)
+            || buffer_offset.checked_add(buffer_len) != Some(len)
+            || header.root_offset > buffer_len as u64
+        {
+            return Err(String::from("Invalid bundle: inconsistent header"));
+        }
+
+        let buffer = base.add(buffer_offset);
+        let relocations = slice::from_raw_parts(
+            base.add(mem::size_of::<Header>()) as *const u32,
+            header.relocation_count as usize,
+        );
+        const WORD: usize = mem::size_of::<usize>();
+        for &offset in relocations {
+            let offset = offset as usize;
+            if offset % WORD != 0 || offset + WORD > buffer_len {
+                return Err(String::from("Invalid bundle: bad relocation"));
+            }
+            let word = buffer.add(offset) as *mut usize;
+            if *word > buffer_len {
+                return Err(String::from("Invalid bundle: bad relocation"));
+            }
+            *word += buffer as usize;
+        }
+
+        Ok(Bundle { storage, header })
+    }
+
+    /// Returns the size of the buffer of the bundle.
+    pub fn len(&self) -> usize {
+        self.header.buffer_len as usize
+    }
+
+    /// Returns the value the bundle was written from.
+    ///
+    /// # Safety
+    ///
+    /// The values in the bundle are static, as with shared memory, so the
+    /// bundle must outlive any reference or `Arc` obtained from them.
+    pub unsafe fn root<T: ToShmem>(&self) -> Result<&T, String> {
+        if self.header.root_type != type_hash::<T>()
+            || self.header.root_offset as usize + mem::size_of::<T>() > self.len()
+        {
+            return Err(format!(
+                "Invalid bundle: the root isn't a {}",
+                std::any::type_name::<T>()
+            ));
+        }
+        let buffer = Self::base(&self.storage).add(self.header.buffer_offset as usize);
+        Ok(&*(buffer.add(self.header.root_offset as usize) as *const T))
+    }
+}
+
+impl Drop for Storage {
+    fn drop(&mut self) {
+        #[cfg(unix)]
+        if let Storage::Mapped { ptr, len } = *self {
+            unsafe { libc::munmap(ptr as *mut libc::c_void, len) };
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn value() -> Vec<Box<[String]>> {
+        (0..100)
+            .map(|i| (0..i % 7).map(|j| format!("{}-{}", i, j)).collect())
+            .collect()
+    }
+
+    #[test]
+    fn round_trip() {
+        let value = value();
+        let bytes = write_bundle(&value, 42, 1 << 16, Dedup::None).unwrap();
+        let bundle = Bundle::from_bytes(&bytes, 42).unwrap();
+        assert_eq!(
+            unsafe { bundle.root::<Vec<Box<[String]>>>() }.unwrap(),
+            &value
+        );
+        // Writing is deterministic.
+        assert_eq!(
+            write_bundle(&value, 42, 1 << 16, Dedup::None).unwrap(),
+            bytes
+        );
+    }
+
+    #[cfg(feature = "servo_arc")]
+    #[test]
+    fn dedup() {
+        use servo_arc::Arc;
+
+        let value = (0..100)
+            .map(|_| Arc::new(String::from("repeated")))
+            .collect::<Vec<_>>();
+        let plain = write_bundle(&value, 42, 1 << 16, Dedup::None).unwrap();
+        let deduplicated = write_bundle(&value, 42, 1 << 16, Dedup::Content).unwrap();
+        assert!(deduplicated.len() < plain.len());
+        let bundle = Bundle::from_bytes(&deduplicated, 42).unwrap();
+        let loaded = unsafe { bundle.root::<Vec<Arc<String>>>() }.unwrap();
+        assert_eq!(loaded, &value);
+        assert_eq!(loaded[0].as_ptr(), loaded[1].as_ptr());
+    }
+
+    #[test]
+    fn owned_strings_are_not_deduplicated() {
+        // The strings could be mutated through the vector, so they can't
+        // share their bytes.
+        let value = vec![String::from("repeated"); 100];
+        let plain = write_bundle(&value, 42, 1 << 16, Dedup::None).unwrap();
+        let deduplicated = write_bundle(&value, 42, 1 << 16, Dedup::Content).unwrap();
+        assert_eq!(deduplicated.len(), plain.len());
+        let bundle = Bundle::from_bytes(&deduplicated, 42).unwrap();
+        let loaded = unsafe { bundle.root::<Vec<String>>() }.unwrap();
+        assert_eq!(loaded, &value);
+        assert_ne!(loaded[0].as_ptr(), loaded[1].as_ptr());
+    }
+
+    #[test]
+    fn open() {
+        let value = value();
+        let path = std::env::temp_dir().join(format!("to_shmem-{}.bundle", std::process::id()));
+        std::fs::write(
+            &path,
+            write_bundle(&value, 42, 1 << 16, Dedup::None).unwrap(),
+        )
+        .unwrap();
+        let bundle = Bundle::open(&path, 42);
+        std::fs::remove_file(&path).unwrap();
+        assert_eq!(
+            unsafe { bundle.unwrap().root::<Vec<Box<[String]>>>() }.unwrap(),
+            &value
+        );
+    }
+
+    #[test]
+    fn validation() {
+        let bytes = write_bundle(&value(), 42, 1 << 16, Dedup::None).unwrap();
+        assert!(Bundle::from_bytes(&bytes, 43).is_err());
+        assert!(Bundle::from_bytes(&bytes[..bytes.len() - 1], 42).is_err());
+        let mut stale = bytes.clone();
+        stale[8] += 1;
+        assert!(Bundle::from_bytes(&stale, 42).is_err());
+        let bundle = Bundle::from_bytes(&bytes, 42).unwrap();
+        assert!(unsafe { bundle.root::<Vec<String>>() }.is_err());
+    }
+}
@@ -13,7 +13,7 @@
 #![crate_type = "rlib"]
 
 use std::alloc::Layout;
-use std::collections::HashSet;
+use std::collections::{HashMap, HashSet};
 use std::ffi::CString;
 use std::isize;
 use std::marker::PhantomData;
@@ -25,6 +25,8 @@ use std::ptr::{self, NonNull};
 use std::slice;
 use std::str;
 
+pub mod bundle;
+
 /// Result type for ToShmem::to_shmem.
 ///
 /// The String is an error message describing why the call failed.
@@ -35,6 +37,27 @@ pub type Result<T> = std::result::Result<ManuallyDrop<T>, String>;
 //
 // https://github.com/rust-lang/rust/issues/55724
 
+/// How a SharedMemoryBuilder deduplicates the values written into it.
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub enum Dedup {
+    /// Values are written as many times as they're referenced. Encountering a
+    /// value behind an Arc twice is asserted against in debug builds, so that
+    /// we don't inadvertently store duplicate copies of values.
+    None,
+    /// The value behind an Arc is written once, however many references to
+    /// it are written.
+    Identity,
+    /// As `Identity`, and the bytes of identical strings behind an Arc are
+    /// written once.
+    ///
+    /// Only the contents of Arcs are deduplicated, since they're immutable
+    /// once in the buffer: the copy of an Arc is static, so it can't be
+    /// uniquely owned, and its contents can't be reached mutably. Owned
+    /// values, like a `String` held directly by a `Vec`, could be mutated
+    /// through their owner, so they always get bytes of their own.
+    Content,
+}
+
 /// A builder object that transforms and copies values into a fixed size buffer.
 pub struct SharedMemoryBuilder {
     /// The buffer into which values will be copied.
@@ -44,14 +67,26 @@ pub struct SharedMemoryBuilder {
     /// The current position in the buffer, where the next value will be written
     /// at.
     index: usize,
-    /// Pointers to every shareable value that we store in the shared memory
-    /// buffer.  We use this to assert against encountering the same value
-    /// twice, e.g. through another Arc reference, so that we don't
-    /// inadvertently store duplicate copies of values.
-    #[cfg(all(debug_assertions, feature = "servo_arc"))]
-    shared_values: HashSet<*const std::os::raw::c_void>,
+    /// How values are deduplicated.
+    dedup: Dedup,
+    /// The copy of every shareable value that we store in the shared memory
+    /// buffer, keyed by the address of the original, with the number of bytes
+    /// written for it.
+    #[cfg(feature = "servo_arc")]
+    shared_values: HashMap<*const std::os::raw::c_void, (*const std::os::raw::c_void, usize)>,
+    /// The strings written with `Dedup::Content`, with their offset.
+    shared_bytes: HashMap<Box<[u8]>, usize>,
+    /// The number of Arcs whose contents are being written, see
+    /// `Dedup::Content`.
+    arc_depth: usize,
+    /// The number of bytes that deduplication saved.
+    deduplicated: usize,
 }
 
+// Unsafe: a builder only writes to its part of the buffer, and `split_off`
+// gives disjoint parts to the builders it creates.
+unsafe impl Send for SharedMemoryBuilder {}
+
 /// Amount of padding needed after `size` bytes to ensure that the following
 /// address will satisfy `align`.
 fn padding_needed_for(size: usize, align: usize) -> usize {
@@ -66,12 +101,26 @@ fn padded_size(size: usize, align: usize) -> usize {
 impl SharedMemoryBuilder {
     /// Creates a new SharedMemoryBuilder using the specified buffer.
     pub unsafe fn new(buffer: *mut u8, capacity: usize) -> SharedMemoryBuilder {
+        Self::with_dedup(buffer, capacity, Dedup::None)
+    }
+
+    /// Creates a new SharedMemoryBuilder using the specified buffer, which
+    /// deduplicates the values written into it as specified.
+    pub unsafe fn with_dedup(
+        buffer: *mut u8,
+        capacity: usize,
+        dedup: Dedup,
+    ) -> SharedMemoryBuilder {
         SharedMemoryBuilder {
             buffer,
             capacity,
             index: 0,
-            #[cfg(all(debug_assertions, feature = "servo_arc"))]
-            shared_values: HashSet::new(),
+            dedup,
+            #[cfg(feature = "servo_arc")]
+            shared_values: HashMap::new(),
+            shared_bytes: HashMap::new(),
+            arc_depth: 0,
+            deduplicated: 0,
         }
     }
 
@@ -81,6 +130,122 @@ impl SharedMemoryBuilder {
         self.index
     }
 
+    /// Returns the number of bytes that deduplication saved so far, including
+    /// in the builders split off from this one and joined back.
+    pub fn deduplicated_len(&self) -> usize {
+        self.deduplicated
+    }
+
+    /// Splits off a builder for the next `capacity` bytes of the buffer, so
+    /// that independent values can be written from another thread.
+    ///
+    /// Values are only deduplicated within each builder.
+    ///
+    /// Panics if there is insufficient space in the buffer.
+    pub fn split_off(&mut self, capacity: usize) -> SharedMemoryBuilder {
+        let start = self.index;
+        let end = start.checked_add(capacity).unwrap();
+        assert!(end <= self.capacity);
+        self.index = end;
+        let mut builder = unsafe { Self::with_dedup(self.buffer.add(start), capacity, self.dedup) };
+        builder.arc_depth = self.arc_depth;
+        builder
+    }
+
+    /// Joins back a builder split off from this one.
+    ///
+    /// If nothing was written after it, the space it didn't use is given back,
+    /// so that the next values written directly follow its values. Otherwise,
+    /// that space is left unused.
+    pub fn join(&mut self, other: SharedMemoryBuilder) {
+        let end = other.buffer as usize + other.capacity;
+        if end == self.buffer as usize + self.index {
+            self.index -= other.capacity - other.index;
+        }
+        self.deduplicated += other.deduplicated;
+    }
+
+    /// Copies `bytes` into the buffer, and returns a pointer to them, which
+    /// may be a previous copy with `Dedup::Content`.
+    ///
+    /// # Safety
+    ///
+    /// With `Dedup::Content`, when writing the contents of an Arc, the
+    /// returned pointer may be shared with other values written from the
+    /// contents of Arcs. It must only be used for values that are never
+    /// mutated, which ToShmem implementations get for free from being behind
+    /// a static Arc, and never be turned into a mutable reference.
+    ///
+    /// Panics if there is insufficient space in the buffer.
+    pub fn write_bytes(&mut self, bytes: &[u8]) -> *mut u8 {
+        let dedup = self.dedup == Dedup::Content && self.arc_depth > 0 && !bytes.is_empty();
+        if dedup {
+            if let Some(&offset) = self.shared_bytes.get(bytes) {
+                self.deduplicated += bytes.len();
+                return unsafe { self.buffer.add(offset) };
+            }
+        }
+
+        let dest: *mut u8 = self.alloc_array(bytes.len());
+        unsafe { ptr::copy(bytes.as_ptr(), dest, bytes.len()) };
+
+        if dedup {
+            let offset = dest as usize - self.buffer as usize;
+            self.shared_bytes.insert(bytes.into(), offset);
+        }
+        dest
+    }
+
+    /// Returns the copy of the value behind `arc` already written through
+    /// another reference to it, if any, when deduplicating.
+    #[cfg(feature = "servo_arc")]
+    fn shared_arc<T>(&mut self, arc: &servo_arc::Arc<T>) -> Option<servo_arc::Arc<T>> {
+        let key = arc.raw_ptr().as_ptr() as *const std::os::raw::c_void;
+        let &(copy, len) = self.shared_values.get(&key)?;
+        if self.dedup == Dedup::None {
+            // Assert that we don't encounter any shared references to values
+            // we don't expect.
+            debug_assert!(
+                false,
+                "ToShmem failed for Arc<{}>: encountered a value with multiple \
+                 references.",
+                std::any::type_name::<T>()
+            );
+            return None;
+        }
+
+        self.deduplicated += len;
+        // Unsafe: `copy` is the data of a static Arc, so there's no reference
+        // count to increment.
+        Some(unsafe { servo_arc::Arc::from_raw(copy as *const T) })
+    }
+
+    /// Runs `f`, which writes the contents of an Arc.
+    #[cfg(feature = "servo_arc")]
+    fn write_arc_contents<R>(&mut self, f: impl FnOnce(&mut Self) -> R) -> R {
+        self.arc_depth += 1;
+        let result = f(self);
+        self.arc_depth -= 1;
+        result
+    }
+
+    /// Records `copy` as the copy of the value behind `arc`, which was
+    /// written from `start`.
+    #[cfg(feature = "servo_arc")]
+    fn record_shared_arc<T>(
+        &mut self,
+        arc: &servo_arc::Arc<T>,
+        copy: &servo_arc::Arc<T>,
+        start: usize,
+    ) {
+        if self.dedup == Dedup::None && !cfg!(debug_assertions) {
+            return;
+        }
+        let key = arc.raw_ptr().as_ptr() as *const std::os::raw::c_void;
+        let value = &**copy as *const T as *const std::os::raw::c_void;
+        self.shared_values.insert(key, (value, self.index - start));
+    }
+
     /// Writes a value into the shared memory buffer and returns a pointer to
     /// it in the buffer.
     ///
@@ -301,13 +466,10 @@ impl<T: ToShmem> ToShmem for Box<[T]> {
 
 impl ToShmem for Box<str> {
     fn to_shmem(&self, builder: &mut SharedMemoryBuilder) -> Result<Self> {
-        // Reserve space for the string bytes.
-        let dest: *mut u8 = builder.alloc_array(self.len());
+        // Copy the string bytes into the buffer.
+        let dest = builder.write_bytes(self.as_bytes());
 
         unsafe {
-            // Copy the value into the buffer.
-            ptr::copy(self.as_ptr(), dest, self.len());
-
             Ok(ManuallyDrop::new(Box::from_raw(
                 str::from_utf8_unchecked_mut(slice::from_raw_parts_mut(dest, self.len())),
             )))
@@ -317,13 +479,10 @@ impl ToShmem for Box<str> {
 
 impl ToShmem for String {
     fn to_shmem(&self, builder: &mut SharedMemoryBuilder) -> Result<Self> {
-        // Reserve space for the string bytes.
-        let dest: *mut u8 = builder.alloc_array(self.len());
+        // Copy the string bytes into the buffer.
+        let dest = builder.write_bytes(self.as_bytes());
 
         unsafe {
-            // Copy the value into the buffer.
-            ptr::copy(self.as_ptr(), dest, self.len());
-
             Ok(ManuallyDrop::new(String::from_raw_parts(
                 dest,
                 self.len(),
@@ -335,17 +494,10 @@ impl ToShmem for String {
 
 impl ToShmem for CString {
     fn to_shmem(&self, builder: &mut SharedMemoryBuilder) -> Result<Self> {
-        let len = self.as_bytes_with_nul().len();
-
-        // Reserve space for the string bytes.
-        let dest: *mut c_char = builder.alloc_array(len);
-
-        unsafe {
-            // Copy the value into the buffer.
-            ptr::copy(self.as_ptr(), dest, len);
+        // Copy the string bytes into the buffer.
+        let dest = builder.write_bytes(self.as_bytes_with_nul()) as *mut c_char;
 
-            Ok(ManuallyDrop::new(CString::from_raw(dest)))
-        }
+        unsafe { Ok(ManuallyDrop::new(CString::from_raw(dest))) }
     }
 }
 
@@ -429,19 +581,14 @@ where
 #[cfg(feature = "servo_arc")]
 impl<T: ToShmem> ToShmem for servo_arc::Arc<T> {
     fn to_shmem(&self, builder: &mut SharedMemoryBuilder) -> Result<Self> {
-        // Assert that we don't encounter any shared references to values we
-        // don't expect.
-        #[cfg(debug_assertions)]
-        assert!(
-            !builder.shared_values.contains(&self.heap_ptr()),
-            "ToShmem failed for Arc<{}>: encountered a value with multiple \
-            references.",
-            std::any::type_name::<T>()
-        );
+        if let Some(copy) = builder.shared_arc(self) {
+            return Ok(ManuallyDrop::new(copy));
+        }
+        let start = builder.len();
 
         // Make a clone of the Arc-owned value with all of its heap allocations
         // placed in the shared memory buffer.
-        let value = (**self).to_shmem(builder)?;
+        let value = builder.write_arc_contents(|builder| (**self).to_shmem(builder))?;
 
         // Create a new Arc with the shared value and have it place its
         // ArcInner in the shared memory buffer.
@@ -451,8 +598,7 @@ impl<T: ToShmem> ToShmem for servo_arc::Arc<T> {
                 ManuallyDrop::into_inner(value),
             );
 
-            #[cfg(debug_assertions)]
-            builder.shared_values.insert(self.heap_ptr());
+            builder.record_shared_arc(self, &static_arc, start);
 
             Ok(ManuallyDrop::new(static_arc))
         }
@@ -461,22 +607,21 @@ impl<T: ToShmem> ToShmem for servo_arc::Arc<T> {
 #[cfg(feature = "servo_arc")]
 impl<H: ToShmem, T: ToShmem> ToShmem for servo_arc::Arc<servo_arc::HeaderSlice<H, T>> {
     fn to_shmem(&self, builder: &mut SharedMemoryBuilder) -> Result<Self> {
-        // We don't currently have any shared ThinArc values in stylesheets,
-        // so don't support them for now.
-        #[cfg(debug_assertions)]
-        assert!(
-            !builder.shared_values.contains(&self.heap_ptr()),
-            "ToShmem failed for ThinArc<T>: encountered a value with multiple references, which \
-             is not currently supported",
-        );
+        if let Some(copy) = builder.shared_arc(self) {
+            return Ok(ManuallyDrop::new(copy));
+        }
+        let start = builder.len();
 
         // Make a clone of the Arc-owned header and slice values with all of
         // their heap allocations placed in the shared memory buffer.
-        let header = self.header.to_shmem(builder)?;
-        let mut values = Vec::with_capacity(self.len());
-        for v in self.slice().iter() {
-            values.push(v.to_shmem(builder)?);
-        }
+        let (header, values) = builder.write_arc_contents(|builder| {
+            let header = self.header.to_shmem(builder)?;
+            let mut values = Vec::with_capacity(self.len());
+            for v in self.slice().iter() {
+                values.push(v.to_shmem(builder)?);
+            }
+            Ok::<_, String>((header, values))
+        })?;
 
         // Create a new ThinArc with the shared value and have it place
         // its ArcInner in the shared memory buffer.
@@ -489,8 +634,7 @@ impl<H: ToShmem, T: ToShmem> ToShmem for servo_arc::Arc<servo_arc::HeaderSlice<H
             /* is_static = */ true,
         );
 
-        #[cfg(debug_assertions)]
-        builder.shared_values.insert(self.heap_ptr());
+        builder.record_shared_arc(self, &static_arc, start);
 
         Ok(ManuallyDrop::new(static_arc))
     }
@@ -583,15 +727,34 @@ impl ToShmem for smallbitvec::SmallBitVec {
 #[cfg(feature = "string_cache")]
 impl<Static: string_cache::StaticAtomSet> ToShmem for string_cache::Atom<Static> {
     fn to_shmem(&self, _: &mut SharedMemoryBuilder) -> Result<Self> {
-        // NOTE(emilio): In practice, this can be implemented trivially if
-        // string_cache could expose the implementation detail of static atoms
-        // being an index into the static table (and panicking in the
-        // non-static, non-inline cases).
-        unimplemented!(
-            "If servo wants to share stylesheets across processes, \
-             then ToShmem for Atom needs to be implemented"
-        )
+        // Static atoms are an index into the static atom table, and atoms of
+        // up to seven bytes that aren't static are stored inline, so neither
+        // points to the heap, and they can be copied as is. Other atoms are
+        // pointers into the dynamic atom set of the process.
+        const MAX_INLINE_LEN: usize = 7;
+        if self.len() > MAX_INLINE_LEN && !is_static_atom(self) {
+            return Err(format!(
+                "ToShmem failed for Atom: must be a static or inline atom: {}",
+                &**self
+            ));
+        }
+
+        // Cloning a static or inline atom doesn't touch any reference count.
+        Ok(ManuallyDrop::new(self.clone()))
+    }
+}
+
+/// Whether an atom is in the static atom table. The table is looked up with
+/// its perfect hash function, like `Atom::from` does.
+#[cfg(feature = "string_cache")]
+fn is_static_atom<Static: string_cache::StaticAtomSet>(atom: &string_cache::Atom<Static>) -> bool {
+    let set = Static::get();
+    if set.atoms.is_empty() {
+        return false;
     }
+    let hashes = phf_shared::hash(&**atom, &set.key);
+    let index = phf_shared::get_index(&hashes, set.disps, set.atoms.len());
+    *atom == string_cache::Atom::pack_static(index)
 }
 
 #[cfg(feature = "cssparser")]
@@ -609,3 +772,83 @@ impl ToShmem for cssparser::UnicodeRange {
         }))
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[repr(align(4096))]
+    struct Buffer([u8; 4096]);
+
+    #[test]
+    fn dedup_strings() {
+        let strings = vec![
+            String::from("abc"),
+            String::from("abc"),
+            String::from("def"),
+        ];
+        for (dedup, len) in [(Dedup::None, 9), (Dedup::Identity, 9), (Dedup::Content, 6)] {
+            let mut buffer = Buffer([0; 4096]);
+            let mut builder =
+                unsafe { SharedMemoryBuilder::with_dedup(buffer.0.as_mut_ptr(), 4096, dedup) };
+            let copies = strings
+                .iter()
+                .map(|s| ManuallyDrop::into_inner(s.to_shmem(&mut builder).unwrap()))
+                .map(ManuallyDrop::new)
+                .collect::<Vec<_>>();
+            assert_eq!(builder.len(), len);
+            assert_eq!(builder.deduplicated_len(), 9 - len);
+            assert!(copies
+                .iter()
+                .map(|s| &***s)
+                .eq(strings.iter().map(|s| &**s)));
+        }
+    }
+
+    #[cfg(feature = "servo_arc")]
+    #[test]
+    fn dedup_arcs() {
+        let arc = servo_arc::Arc::new(String::from("shared"));
+        let arcs = vec![arc.clone(), arc.clone(), arc];
+        let mut buffer = Buffer([0; 4096]);
+        let mut builder = unsafe {
+            SharedMemoryBuilder::with_dedup(buffer.0.as_mut_ptr(), 4096, Dedup::Identity)
+        };
+        let copy = builder.write(&arcs).unwrap();
+        let copy = unsafe { &*copy };
+        assert!(servo_arc::Arc::ptr_eq(&copy[0], &copy[2]));
+        assert!(copy[0].is_static());
+        assert_eq!(*copy[1], "shared");
+        assert!(builder.deduplicated_len() > 2 * "shared".len());
+    }
+
+    #[test]
+    fn split_off_and_join() {
+        let values: Vec<Vec<u64>> = (0..4).map(|i| (0..i * 10).collect()).collect();
+        let mut buffer = Buffer([0; 4096]);
+        let mut builder = unsafe { SharedMemoryBuilder::new(buffer.0.as_mut_ptr(), 4096) };
+        let mut parts = (0..values.len())
+            .map(|_| builder.split_off(512))
+            .collect::<Vec<_>>();
+        let copies = std::thread::scope(|scope| {
+            let threads = parts
+                .iter_mut()
+                .zip(&values)
+                .map(|(part, value)| scope.spawn(move || part.write(value).unwrap() as usize))
+                .collect::<Vec<_>>();
+            threads
+                .into_iter()
+                .map(|thread| thread.join().unwrap() as *const Vec<u64>)
+                .collect::<Vec<_>>()
+        });
+        let last_len = parts.last().unwrap().len();
+        for part in parts {
+            builder.join(part);
+        }
+        // Only the space the last part didn't use is given back.
+        assert_eq!(builder.len(), 3 * 512 + last_len);
+        for (copy, value) in copies.iter().zip(&values) {
+            assert_eq!(unsafe { &**copy }, value);
+        }
+    }
+}